@@ -0,0 +1,300 @@
+#define _GNU_SOURCE // For clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h> // For __rdtsc
+#include <zlib.h>      // For Z_DEFAULT_COMPRESSION
+#include "../src/include/http_utils.h"
+#include "../src/include/http_parser.h"
+#include "../src/include/http_scan.h"
+#include "../src/include/http_timer.h"
+
+// --- Microbenchmarks for the request/response helpers ---
+// Usage: bench_micro [output.json]
+// Each case runs for roughly BENCH_MIN_NS and reports nanoseconds per operation; scanning
+// cases also report throughput in bytes per TSC cycle.
+
+#define BENCH_MIN_NS 200000000ULL // 0.2 s per case
+#define GZIP_INPUT_SIZE (16 * 1024)
+
+static const char SAMPLE_REQUEST[] =
+    "GET /assets/app.js?v=42 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: http://localhost:8080/index.html\r\n"
+    "Cookie: session=0123456789abcdef; theme=dark\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// Realistic browser header sets for the scanning cases: a Chrome page navigation with
+// client hints and cookies, and a Firefox fetch() from a single-page app.
+static const char CHROME_NAVIGATION[] =
+    "GET /dashboard/overview?tab=activity&range=7d HTTP/1.1\r\n"
+    "Host: app.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Referer: https://app.example.com/login?next=%2Fdashboard%2Foverview\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session_id=9f8e7d6c5b4a39281706f5e4d3c2b1a0; "
+    "csrftoken=QWxhZGRpbjpvcGVuIHNlc2FtZQ8bX2Q; theme=dark; _ga_ABCDEF1234=GS1.1.1700000000.3.1.1700000100.0.0.0\r\n"
+    "If-None-Match: \"5d8c72a5edda3-2ab980-18df14645339496d\"\r\n"
+    "\r\n";
+
+static const char FIREFOX_FETCH[] =
+    "POST /api/v2/events HTTP/1.1\r\n"
+    "Host: app.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: application/json\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 0\r\n"
+    "Origin: https://app.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: https://app.example.com/dashboard/overview\r\n"
+    "Cookie: session_id=9f8e7d6c5b4a39281706f5e4d3c2b1a0; theme=dark\r\n"
+    "Sec-Fetch-Dest: empty\r\n"
+    "Sec-Fetch-Mode: cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "\r\n";
+
+typedef struct {
+    char name[48];
+    double ns_per_op;
+    double bytes_per_cycle; // 0 for cases that are not byte scans
+    unsigned long iterations;
+} bench_result;
+
+static bench_result results[48];
+static int num_results;
+static volatile unsigned long sink; // Keeps results observable so calls are not optimized out
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+/**
+ * @brief Runs op in growing batches until BENCH_MIN_NS has elapsed and records ns/op, plus
+ *        bytes per TSC cycle when each op scans bytes_per_op bytes.
+ */
+static void run_scan_case(const char *name, void (*op)(void), size_t bytes_per_op) {
+    unsigned long iterations = 0, batch = 16;
+    unsigned long long start = now_ns(), elapsed = 0;
+    unsigned long long start_cycles = __rdtsc();
+
+    while (elapsed < BENCH_MIN_NS) {
+        for (unsigned long i = 0; i < batch; i++) op();
+        iterations += batch;
+        if (batch < (1UL << 20)) batch *= 2;
+        elapsed = now_ns() - start;
+    }
+    unsigned long long cycles = __rdtsc() - start_cycles;
+
+    bench_result *r = &results[num_results++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->iterations = iterations;
+    r->ns_per_op = (double)elapsed / (double)iterations;
+    r->bytes_per_cycle = bytes_per_op ? (double)bytes_per_op * (double)iterations / (double)cycles : 0;
+    if (bytes_per_op) {
+        printf("%-32s %12.1f ns/op  %6.2f bytes/cycle  (%lu iterations)\n", name, r->ns_per_op,
+               r->bytes_per_cycle, iterations);
+    } else {
+        printf("%-32s %12.1f ns/op  (%lu iterations)\n", name, r->ns_per_op, iterations);
+    }
+}
+
+static void run_case(const char *name, void (*op)(void)) {
+    run_scan_case(name, op, 0);
+}
+
+// --- Cases ---
+
+static http_header parsed_headers[MAX_HEADERS];
+static int parsed_count;
+static unsigned char gzip_input[GZIP_INPUT_SIZE];
+
+static void op_extract_path(void) {
+    char *path = extract_path(SAMPLE_REQUEST);
+    sink += path ? (unsigned char)path[1] : 0;
+    free(path);
+}
+
+static void op_parse_headers(void) {
+    // parse_headers is destructive, so each run includes copying the request.
+    char buffer[sizeof(SAMPLE_REQUEST)];
+    memcpy(buffer, SAMPLE_REQUEST, sizeof(SAMPLE_REQUEST));
+    sink += parse_headers(buffer, parsed_headers, MAX_HEADERS);
+}
+
+static void op_get_header_value(void) {
+    const char *value = get_header_value(parsed_headers, parsed_count, "Connection");
+    sink += value ? (unsigned char)value[0] : 0;
+}
+
+static void op_get_mime_type(void) {
+    sink += (unsigned char)get_mime_type("/assets/styles/site.css")[0];
+}
+
+static void op_http_parse_request(void) {
+    // Same copy as op_parse_headers, for a like-for-like comparison.
+    char buffer[sizeof(SAMPLE_REQUEST)];
+    memcpy(buffer, SAMPLE_REQUEST, sizeof(SAMPLE_REQUEST));
+    http_request req;
+    http_request_reset(&req);
+    sink += http_parse_request(&req, buffer, sizeof(SAMPLE_REQUEST) - 1) + req.num_headers;
+}
+
+static http_request parsed_request;
+static char parsed_buffer[sizeof(SAMPLE_REQUEST)];
+
+static void op_http_request_header_id(void) {
+    const char *value = http_request_header_id(&parsed_request, HDR_CONNECTION);
+    sink += value ? (unsigned char)value[0] : 0;
+}
+
+static void op_compress_data_gzip(void) {
+    size_t compressed_len = 0;
+    unsigned char *compressed = compress_data_gzip(gzip_input, GZIP_INPUT_SIZE, Z_DEFAULT_COMPRESSION, &compressed_len);
+    sink += compressed_len;
+    free(compressed);
+}
+
+// One timer per connection, with 100k connections' worth already armed: re-arming the
+// timeout after an event must stay O(1).
+#define TIMER_BENCH_CONNECTIONS 100000
+static timer_wheel bench_wheel;
+static timer_node *bench_timers;
+static unsigned long bench_timer_next;
+
+static void op_timer_rearm_100k(void) {
+    timer_node *node = &bench_timers[bench_timer_next++ % TIMER_BENCH_CONNECTIONS];
+    timer_arm(&bench_wheel, node, 1000 + 15000 + (bench_timer_next & 4095));
+}
+
+// --- Scanning cases: one header set, scanned the old way and by the parser at each level ---
+
+static const char *scan_input;
+static size_t scan_input_len;
+static const scan_kernels *scan_kernels_under_test;
+
+static void op_legacy_strstr_scan(void) {
+    // What the original parser did: find the end of the block, then every line and colon.
+    const char *end = strstr(scan_input, "\r\n\r\n");
+    const char *line = strstr(scan_input, "\r\n") + 2;
+    while (line < end) {
+        const char *line_end = strstr(line, "\r\n");
+        const char *colon = strchr(line, ':');
+        sink += (unsigned long)(colon - line) + strlen(line_end);
+        line = line_end + 2;
+    }
+}
+
+static void op_kernel_line_scan(void) {
+    // Every line end, then every name (token run up to ':'), as the parser visits them.
+    const char *p = scan_input;
+    size_t left = scan_input_len;
+    while (left > 2) {
+        size_t name = scan_kernels_under_test->token_end(p, left);
+        size_t line = scan_kernels_under_test->line_end(p, left);
+        sink += name;
+        p += line + 2;
+        left -= line + 2;
+    }
+}
+
+static void op_parse_scan_input(void) {
+    char buffer[2048];
+    memcpy(buffer, scan_input, scan_input_len);
+    http_request req;
+    http_request_reset(&req);
+    sink += http_parse_request(&req, buffer, scan_input_len) + req.num_headers;
+}
+
+static void run_scan_cases(const char *set_name, const char *input, size_t len) {
+    char name[48];
+    scan_input = input;
+    scan_input_len = len;
+
+    snprintf(name, sizeof(name), "legacy_strstr/%s", set_name);
+    run_scan_case(name, op_legacy_strstr_scan, len);
+
+    for (int level = SCAN_SCALAR; level < SCAN_LEVEL_COUNT; level++) {
+        scan_kernels_under_test = scan_kernels_for((scan_level)level);
+        if (!scan_kernels_under_test) continue;
+
+        snprintf(name, sizeof(name), "kernels_%s/%s", scan_kernels_under_test->name, set_name);
+        run_scan_case(name, op_kernel_line_scan, len);
+
+        scan_limit((scan_level)level);
+        snprintf(name, sizeof(name), "http_parse_%s/%s", scan_kernels_under_test->name, set_name);
+        run_scan_case(name, op_parse_scan_input, len);
+    }
+    scan_limit(SCAN_LEVEL_COUNT - 1);
+}
+
+static int write_json(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("Could not open benchmark output");
+        return -1;
+    }
+    fprintf(out, "{\n  \"benchmarks\": [\n");
+    for (int i = 0; i < num_results; i++) {
+        fprintf(out, "    {\"name\": \"%s\", \"ns_per_op\": %.2f, \"bytes_per_cycle\": %.3f, \"iterations\": %lu}%s\n",
+                results[i].name, results[i].ns_per_op, results[i].bytes_per_cycle, results[i].iterations,
+                i + 1 < num_results ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // Text-like input: repeated markup with some variation, so deflate has realistic work.
+    for (size_t i = 0; i < GZIP_INPUT_SIZE; i++) {
+        gzip_input[i] = (unsigned char)("<div class=\"item\">entry</div>\n"[i % 30] + (i % 997 == 0));
+    }
+    char buffer[sizeof(SAMPLE_REQUEST)];
+    memcpy(buffer, SAMPLE_REQUEST, sizeof(SAMPLE_REQUEST));
+    parsed_count = parse_headers(buffer, parsed_headers, MAX_HEADERS);
+    memcpy(parsed_buffer, SAMPLE_REQUEST, sizeof(SAMPLE_REQUEST));
+    http_request_reset(&parsed_request);
+    http_parse_request(&parsed_request, parsed_buffer, sizeof(SAMPLE_REQUEST) - 1);
+    bench_timers = (timer_node *)calloc(TIMER_BENCH_CONNECTIONS, sizeof(timer_node));
+    if (!bench_timers) return EXIT_FAILURE;
+    timer_wheel_init(&bench_wheel, 1000);
+    for (int i = 0; i < TIMER_BENCH_CONNECTIONS; i++) timer_arm(&bench_wheel, &bench_timers[i], 1000 + 10000 + i % 20000);
+
+    printf("--- Microbenchmarks ---\n");
+    run_case("extract_path", op_extract_path);
+    run_case("parse_headers", op_parse_headers);
+    run_case("get_header_value", op_get_header_value);
+    run_case("get_mime_type", op_get_mime_type);
+    run_case("http_parse_request", op_http_parse_request);
+    run_case("http_request_header_id", op_http_request_header_id);
+    run_case("compress_data_gzip_16k", op_compress_data_gzip);
+    run_case("timer_rearm_100k", op_timer_rearm_100k);
+
+    printf("--- Request scanning (active kernels: %s) ---\n", scan_active()->name);
+    run_scan_cases("chrome_navigation", CHROME_NAVIGATION, sizeof(CHROME_NAVIGATION) - 1);
+    run_scan_cases("firefox_fetch", FIREFOX_FETCH, sizeof(FIREFOX_FETCH) - 1);
+
+    if (argc > 1 && write_json(argv[1]) != 0) return EXIT_FAILURE;
+    return 0;
+}
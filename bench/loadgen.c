@@ -0,0 +1,584 @@
+#define _GNU_SOURCE // For memmem, strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "http_hpack.h"
+
+// --- Closed-loop HTTP/1.1 and HTTP/2 load generator ---
+// Usage: loadgen [-a addr] [-p port] [-u path] [-c connections] [-t threads] [-d seconds]
+//                [-P pipeline depth] [-C (close after each response)] [-2 (cleartext HTTP/2)]
+//                [-l label] [-o output.json]
+//
+// Each connection sends a batch of P pipelined requests, waits for all P responses, and
+// repeats until the duration ends. Latency is measured per request from the moment its
+// batch is written until its response has been fully read. With -2 the connection speaks
+// HTTP/2 with prior knowledge and the batch is P concurrent streams.
+
+#define LOADGEN_READ_BUFFER 65536
+#define LOADGEN_MAX_EVENTS 256
+#define LOADGEN_H2_WINDOW 0x7fffffff    // Granted per stream and per connection; the connection's is topped up
+#define LOADGEN_H2_CONTROL_BUFFER 256   // SETTINGS and PING acknowledgements, window updates
+#define LOADGEN_H2_MAX_FIELDS 64
+#define LOADGEN_H2_FIELD_BUFFER 8192
+
+typedef struct {
+    const char *addr;
+    int port;
+    const char *path;
+    int connections;
+    int threads;
+    int duration;
+    int pipeline;
+    int keep_alive;
+    int http2;
+    const char *label;
+    const char *output;
+} loadgen_config;
+
+typedef enum { LC_CONNECTING, LC_SENDING, LC_READING } lc_phase;
+
+typedef struct {
+    int fd;
+    lc_phase phase;
+    size_t sent;             // Bytes of the request batch already written
+    int outstanding;         // Responses still expected for the current batch
+    unsigned long long batch_start;
+
+    // Response parsing
+    char buf[LOADGEN_READ_BUFFER];
+    size_t len;
+    size_t body_left;        // Body bytes of the current response still to skip
+    int in_body;
+    int status;
+
+    // HTTP/2: the batch is rewritten with fresh stream ids, and the first one opens with the preface
+    unsigned char *h2_batch;
+    size_t batch_off, batch_len;
+    unsigned next_stream;
+    hpack_table h2_table;
+    unsigned long long h2_consumed; // DATA received since the connection window was last topped up
+    unsigned char control[LOADGEN_H2_CONTROL_BUFFER];
+    size_t control_len;
+} lc_conn;
+
+typedef struct {
+    const loadgen_config *cfg;
+    int num_conns;
+    pthread_t thread;
+
+    unsigned long long *latencies; // ns per completed request
+    size_t num_latencies, cap_latencies;
+    unsigned long errors;
+    unsigned long non_2xx;
+    unsigned long long bytes;
+} lc_thread;
+
+static char *request_batch;
+static size_t request_batch_len;
+static size_t request_frame_len; // HTTP/2: one HEADERS frame of the batch
+static unsigned char h2_handshake[64];
+static size_t h2_handshake_len;
+static struct sockaddr_in target;
+static unsigned long long deadline;
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static void record_latency(lc_thread *t, unsigned long long ns) {
+    if (t->num_latencies == t->cap_latencies) {
+        size_t cap = t->cap_latencies ? t->cap_latencies * 2 : 65536;
+        unsigned long long *grown = (unsigned long long *)realloc(t->latencies, cap * sizeof(*grown));
+        if (!grown) return;
+        t->latencies = grown;
+        t->cap_latencies = cap;
+    }
+    t->latencies[t->num_latencies++] = ns;
+}
+
+static int open_conn(int epoll_fd, lc_conn *c) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) return -1;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    c->phase = LC_CONNECTING;
+    c->sent = 0;
+    c->len = 0;
+    c->in_body = 0;
+    c->batch_start = now_ns(); // Close mode: latency includes the TCP handshake
+    if (request_frame_len) {
+        if (!c->h2_batch && !(c->h2_batch = (unsigned char *)malloc(h2_handshake_len + request_batch_len))) return -1;
+        memcpy(c->h2_batch, h2_handshake, h2_handshake_len);
+        memcpy(c->h2_batch + h2_handshake_len, request_batch, request_batch_len);
+        c->batch_off = 0;
+        c->next_stream = 1;
+        c->h2_consumed = 0;
+        c->control_len = 0;
+        hpack_table_init(&c->h2_table, HPACK_TABLE_SIZE_DEFAULT);
+    }
+
+    if (connect(c->fd, (struct sockaddr *)&target, sizeof(target)) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = c };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void close_conn(lc_conn *c) {
+    if (c->fd >= 0) close(c->fd);
+    if (c->fd >= 0 && request_frame_len) hpack_table_free(&c->h2_table);
+    c->fd = -1;
+}
+
+// --- HTTP/2 framing ---
+
+static void put_frame_header(unsigned char *p, size_t len, int type, int flags, unsigned stream) {
+    p[0] = (unsigned char)(len >> 16);
+    p[1] = (unsigned char)(len >> 8);
+    p[2] = (unsigned char)len;
+    p[3] = (unsigned char)type;
+    p[4] = (unsigned char)flags;
+    p[5] = (unsigned char)(stream >> 24);
+    p[6] = (unsigned char)(stream >> 16);
+    p[7] = (unsigned char)(stream >> 8);
+    p[8] = (unsigned char)stream;
+}
+
+static void put32(unsigned char *p, unsigned v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+/**
+ * @brief Appends a control frame; they are tiny and rare, so a full buffer means a broken peer.
+ */
+static int queue_control(lc_conn *c, int type, int flags, const unsigned char *payload, size_t len) {
+    if (c->control_len + 9 + len > sizeof(c->control)) return -1;
+    put_frame_header(c->control + c->control_len, len, type, flags, 0);
+    memcpy(c->control + c->control_len + 9, payload, len);
+    c->control_len += 9 + len;
+    return 0;
+}
+
+static int flush_control(lc_conn *c) {
+    while (c->control_len > 0) {
+        ssize_t n = send(c->fd, c->control, c->control_len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        memmove(c->control, c->control + n, c->control_len - (size_t)n);
+        c->control_len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds the next batch: the same HEADERS frames with the connection's next stream ids.
+ */
+static void next_h2_batch(const loadgen_config *cfg, lc_conn *c) {
+    unsigned char *frames = c->h2_batch + h2_handshake_len;
+    for (int i = 0; i < cfg->pipeline; i++) {
+        put32(frames + (size_t)i * request_frame_len + 5, c->next_stream);
+        c->next_stream += 2;
+    }
+    c->batch_len = h2_handshake_len + request_batch_len;
+    c->sent = c->batch_off;
+}
+
+/**
+ * @brief Consumes buffered frames. Returns the number of streams whose response has ended,
+ *        or -1 on a connection error, a reset stream or GOAWAY.
+ */
+static int parse_frames(lc_thread *t, lc_conn *c) {
+    int completed = 0;
+    size_t off = 0;
+
+    while (c->len - off >= 9) {
+        const unsigned char *frame = (const unsigned char *)c->buf + off;
+        size_t len = (size_t)frame[0] << 16 | (size_t)frame[1] << 8 | frame[2];
+        int type = frame[3], flags = frame[4];
+        if (len + 9 > sizeof(c->buf)) return -1; // Larger than the SETTINGS_MAX_FRAME_SIZE default
+        if (c->len - off < 9 + len) break;
+        const unsigned char *payload = frame + 9;
+        off += 9 + len;
+
+        // Padding (DATA, HEADERS) and priority (HEADERS) are stripped before the content
+        size_t pad = 0;
+        if ((type == 0 || type == 1) && (flags & 0x8)) {
+            if (len < 1 || (pad = payload[0]) >= len) return -1;
+            payload++;
+            len -= 1 + pad;
+        }
+        if (type == 1 && (flags & 0x20)) {
+            if (len < 5) return -1;
+            payload += 5;
+            len -= 5;
+        }
+
+        switch (type) {
+        case 0: // DATA
+            c->h2_consumed += len + pad + ((flags & 0x8) != 0);
+            if (c->h2_consumed >= LOADGEN_H2_WINDOW / 2) {
+                unsigned char increment[4];
+                put32(increment, (unsigned)c->h2_consumed);
+                if (queue_control(c, 8, 0, increment, 4) < 0) return -1;
+                c->h2_consumed = 0;
+            }
+            break;
+        case 1: { // HEADERS: always decoded, as the server may have added fields to the table
+            if (!(flags & 0x4)) return -1; // CONTINUATION is never needed for these responses
+            hpack_field fields[LOADGEN_H2_MAX_FIELDS];
+            char values[LOADGEN_H2_FIELD_BUFFER];
+            int count = hpack_decode(&c->h2_table, payload, len, fields, LOADGEN_H2_MAX_FIELDS, values, sizeof(values));
+            if (count < 0) return -1;
+            // Streams interleave, so a response is counted by its status as soon as that arrives
+            if (count > 0 && strcmp(fields[0].name, ":status") == 0) {
+                int status = atoi(fields[0].value);
+                if (status < 200 || status >= 300) t->non_2xx++;
+            }
+            break;
+        }
+        case 3: // RST_STREAM
+        case 7: // GOAWAY
+            return -1;
+        case 4: // SETTINGS
+            if (!(flags & 0x1) && queue_control(c, 4, 0x1, NULL, 0) < 0) return -1;
+            break;
+        case 6: // PING
+            if (!(flags & 0x1) && (len != 8 || queue_control(c, 6, 0x1, payload, 8) < 0)) return -1;
+            break;
+        default: // WINDOW_UPDATE and anything else needs no answer
+            break;
+        }
+
+        if ((type == 0 || type == 1) && (flags & 0x1)) { // END_STREAM
+            completed++;
+            record_latency(t, now_ns() - c->batch_start);
+        }
+    }
+
+    memmove(c->buf, c->buf + off, c->len - off);
+    c->len -= off;
+    return completed;
+}
+
+/**
+ * @brief Consumes buffered response bytes. Returns the number of complete responses,
+ *        or -1 on a malformed response.
+ */
+static int parse_responses(lc_thread *t, lc_conn *c) {
+    int completed = 0;
+    size_t off = 0;
+
+    while (off < c->len) {
+        if (c->in_body) {
+            size_t avail = c->len - off;
+            size_t take = avail < c->body_left ? avail : c->body_left;
+            off += take;
+            c->body_left -= take;
+        } else {
+            char *start = c->buf + off;
+            char *end = memmem(start, c->len - off, "\r\n\r\n", 4);
+            if (!end) break;
+            *end = '\0';
+            if (sscanf(start, "HTTP/1.%*d %d", &c->status) != 1) return -1;
+            const char *cl = strcasestr(start, "\r\nContent-Length:");
+            c->body_left = cl ? strtoull(cl + 17, NULL, 10) : 0;
+            c->in_body = 1;
+            off = (size_t)(end - c->buf) + 4;
+        }
+
+        if (c->in_body && c->body_left == 0) {
+            c->in_body = 0;
+            completed++;
+            record_latency(t, now_ns() - c->batch_start);
+            if (c->status < 200 || c->status >= 300) t->non_2xx++;
+        }
+    }
+
+    memmove(c->buf, c->buf + off, c->len - off);
+    c->len -= off;
+    if (c->len == sizeof(c->buf)) return -1; // Header larger than the buffer
+    return completed;
+}
+
+/**
+ * @brief Drives one connection as far as it can go without blocking.
+ * @return 0 to keep going, 1 to reconnect for the next request (close mode),
+ *         -1 on error (the connection is replaced).
+ */
+static int drive(lc_thread *t, lc_conn *c) {
+    const loadgen_config *cfg = t->cfg;
+
+    while (1) {
+        if (c->phase == LC_CONNECTING) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) return -1;
+            c->phase = LC_SENDING;
+        }
+
+        if (c->phase == LC_SENDING) {
+            if (now_ns() >= deadline) return 0;
+            if (c->sent == 0 && cfg->keep_alive) {
+                c->batch_start = now_ns();
+                if (cfg->http2) next_h2_batch(cfg, c);
+            }
+            const char *batch = cfg->http2 ? (const char *)c->h2_batch : request_batch;
+            size_t batch_len = cfg->http2 ? c->batch_len : request_batch_len;
+            while (c->sent < batch_len) {
+                ssize_t n = send(c->fd, batch + c->sent, batch_len - c->sent, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EAGAIN) return 0;
+                    if (errno == EINTR) continue;
+                    return -1;
+                }
+                c->sent += (size_t)n;
+            }
+            c->batch_off = h2_handshake_len; // Only the first batch carries the preface
+            c->outstanding = cfg->pipeline;
+            c->phase = LC_READING;
+        }
+
+        if (flush_control(c) < 0) return -1;
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (n < 0) {
+            if (errno == EAGAIN) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return c->outstanding == 0 ? 0 : -1;
+        t->bytes += (unsigned long long)n;
+        c->len += (size_t)n;
+
+        int done = cfg->http2 ? parse_frames(t, c) : parse_responses(t, c);
+        if (done < 0) return -1;
+        c->outstanding -= done;
+        if (c->outstanding > 0) continue;
+
+        if (!cfg->keep_alive) return 1; // Reconnect for the next request
+        c->sent = 0;
+        c->phase = LC_SENDING;
+    }
+}
+
+static void *thread_loop(void *arg) {
+    lc_thread *t = (lc_thread *)arg;
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    lc_conn *conns = (lc_conn *)calloc(t->num_conns, sizeof(lc_conn));
+    if (epoll_fd < 0 || !conns) {
+        perror("loadgen thread setup failed");
+        return NULL;
+    }
+
+    for (int i = 0; i < t->num_conns; i++) {
+        if (open_conn(epoll_fd, &conns[i]) < 0) t->errors++;
+    }
+
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+    while (now_ns() < deadline) {
+        int ready = epoll_wait(epoll_fd, events, LOADGEN_MAX_EVENTS, 100);
+        for (int i = 0; i < ready; i++) {
+            lc_conn *c = (lc_conn *)events[i].data.ptr;
+            if (c->fd < 0) continue;
+            int rc = drive(t, c);
+            if (rc != 0) {
+                if (rc < 0) t->errors++;
+                close_conn(c);
+                if (now_ns() < deadline && open_conn(epoll_fd, c) < 0) t->errors++;
+            }
+        }
+    }
+
+    for (int i = 0; i < t->num_conns; i++) {
+        close_conn(&conns[i]);
+        free(conns[i].h2_batch);
+    }
+    free(conns);
+    close(epoll_fd);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const unsigned long long *sorted, size_t n, double p) {
+    if (n == 0) return 0.0;
+    size_t index = (size_t)(p * (double)(n - 1) + 0.5);
+    return (double)sorted[index] / 1000.0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: loadgen [-a addr] [-p port] [-u path] [-c connections] [-t threads] "
+                    "[-d seconds] [-P pipeline] [-C] [-2] [-l label] [-o output.json]\n");
+}
+
+int main(int argc, char *argv[]) {
+    loadgen_config cfg = { "127.0.0.1", 8080, "/", 64, 4, 5, 1, 1, 0, "default", NULL };
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:u:c:t:d:P:C2l:o:")) != -1) {
+        switch (opt) {
+        case 'a': cfg.addr = optarg; break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'u': cfg.path = optarg; break;
+        case 'c': cfg.connections = atoi(optarg); break;
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'd': cfg.duration = atoi(optarg); break;
+        case 'P': cfg.pipeline = atoi(optarg); break;
+        case 'C': cfg.keep_alive = 0; break;
+        case '2': cfg.http2 = 1; break;
+        case 'l': cfg.label = optarg; break;
+        case 'o': cfg.output = optarg; break;
+        default: usage(); return EXIT_FAILURE;
+        }
+    }
+    if (cfg.connections < 1 || cfg.threads < 1 || cfg.duration < 1 || cfg.pipeline < 1) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (cfg.threads > cfg.connections) cfg.threads = cfg.connections;
+    if (!cfg.keep_alive) cfg.pipeline = 1; // One request per connection
+    if (cfg.http2) cfg.keep_alive = 1;     // Streams, not connections, carry the requests
+
+    target.sin_family = AF_INET;
+    target.sin_port = htons((unsigned short)cfg.port);
+    if (inet_pton(AF_INET, cfg.addr, &target.sin_addr) != 1) {
+        fprintf(stderr, "Invalid address: %s\n", cfg.addr);
+        return EXIT_FAILURE;
+    }
+
+    char request[512];
+    int request_len;
+    if (cfg.http2) {
+        // :method GET and :scheme http are static-table entries; :path and :authority are literals
+        // with an indexed name, not added to the table, so every HEADERS frame is identical.
+        char authority[64];
+        size_t path_len = strlen(cfg.path);
+        size_t authority_len = (size_t)snprintf(authority, sizeof(authority), "%s:%d", cfg.addr, cfg.port);
+        if (path_len > 126 || authority_len > 126) {
+            fprintf(stderr, "Path too long for HTTP/2 mode: %s\n", cfg.path);
+            return EXIT_FAILURE;
+        }
+        unsigned char *p = (unsigned char *)request + 9;
+        *p++ = 0x82;
+        *p++ = 0x86;
+        *p++ = 0x04;
+        *p++ = (unsigned char)path_len;
+        memcpy(p, cfg.path, path_len);
+        p += path_len;
+        *p++ = 0x01;
+        *p++ = (unsigned char)authority_len;
+        memcpy(p, authority, authority_len);
+        p += authority_len;
+        request_len = (int)(p - (unsigned char *)request);
+        put_frame_header((unsigned char *)request, (size_t)request_len - 9, 1, 0x5, 0); // END_STREAM | END_HEADERS
+        request_frame_len = (size_t)request_len;
+
+        // Preface, SETTINGS (push off, largest stream window) and the connection's WINDOW_UPDATE
+        unsigned char *h = h2_handshake;
+        memcpy(h, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+        h += 24;
+        put_frame_header(h, 12, 4, 0, 0);
+        h += 9;
+        const unsigned char settings[12] = { 0, 2, 0, 0, 0, 0, 0, 4, 0x7f, 0xff, 0xff, 0xff };
+        memcpy(h, settings, sizeof(settings));
+        h += sizeof(settings);
+        put_frame_header(h, 4, 8, 0, 0);
+        put32(h + 9, LOADGEN_H2_WINDOW - 65535);
+        h += 13;
+        h2_handshake_len = (size_t)(h - h2_handshake);
+    } else {
+        request_len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: %s\r\n\r\n",
+                               cfg.path, cfg.addr, cfg.port, cfg.keep_alive ? "keep-alive" : "close");
+    }
+    request_batch_len = (size_t)request_len * (size_t)cfg.pipeline;
+    request_batch = (char *)malloc(request_batch_len);
+    lc_thread *threads = (lc_thread *)calloc(cfg.threads, sizeof(lc_thread));
+    if (!request_batch || !threads) {
+        perror("Memory allocation failed");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < cfg.pipeline; i++) memcpy(request_batch + (size_t)i * request_len, request, request_len);
+
+    unsigned long long start = now_ns();
+    deadline = start + (unsigned long long)cfg.duration * 1000000000ULL;
+
+    for (int i = 0; i < cfg.threads; i++) {
+        threads[i].cfg = &cfg;
+        threads[i].num_conns = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads);
+        pthread_create(&threads[i].thread, NULL, thread_loop, &threads[i]);
+    }
+
+    size_t total = 0;
+    unsigned long errors = 0, non_2xx = 0;
+    unsigned long long bytes = 0;
+    for (int i = 0; i < cfg.threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        total += threads[i].num_latencies;
+        errors += threads[i].errors;
+        non_2xx += threads[i].non_2xx;
+        bytes += threads[i].bytes;
+    }
+    double elapsed = (double)(now_ns() - start) / 1e9;
+
+    unsigned long long *all = (unsigned long long *)malloc((total ? total : 1) * sizeof(*all));
+    if (!all) {
+        perror("Memory allocation failed");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0, off = 0; i < cfg.threads; i++) {
+        memcpy(all + off, threads[i].latencies, threads[i].num_latencies * sizeof(*all));
+        off += (int)threads[i].num_latencies;
+        free(threads[i].latencies);
+    }
+    qsort(all, total, sizeof(*all), compare_u64);
+
+    double p50 = percentile_us(all, total, 0.50), p99 = percentile_us(all, total, 0.99);
+    double p999 = percentile_us(all, total, 0.999), max = total ? (double)all[total - 1] / 1000.0 : 0.0;
+
+    printf("%-22s %9.0f req/s  p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  errors %lu  non-2xx %lu\n",
+           cfg.label, (double)total / elapsed, p50, p99, p999, errors, non_2xx);
+
+    if (cfg.output) {
+        FILE *out = fopen(cfg.output, "w");
+        if (!out) {
+            perror("Could not open loadgen output");
+            return EXIT_FAILURE;
+        }
+        fprintf(out,
+                "{\"label\": \"%s\", \"path\": \"%s\", \"protocol\": \"%s\", \"connections\": %d, \"threads\": %d, \"pipeline\": %d, "
+                "\"keep_alive\": %s, \"duration_s\": %.3f, \"requests\": %zu, \"requests_per_s\": %.1f, "
+                "\"bytes_received\": %llu, \"errors\": %lu, \"non_2xx\": %lu, "
+                "\"latency_us\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}\n",
+                cfg.label, cfg.path, cfg.http2 ? "h2c" : "http/1.1", cfg.connections, cfg.threads, cfg.pipeline,
+                cfg.keep_alive ? "true" : "false",
+                elapsed, total, (double)total / elapsed, bytes, errors, non_2xx, p50, p99, p999, max);
+        fclose(out);
+    }
+
+    free(all);
+    free(threads);
+    free(request_batch);
+    return errors > 0 && total == 0 ? EXIT_FAILURE : 0;
+}
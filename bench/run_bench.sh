@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs the microbenchmarks and a set of load scenarios against a freshly started server,
+# then writes everything to one JSON file.
+# Usage: run_bench.sh <build dir> [duration seconds] [port]
+set -e
+
+BUILD_DIR=${1:-build}
+DURATION=${2:-5}
+PORT=${3:-18090}
+WORK_DIR="$BUILD_DIR/bench"
+RESULTS="$WORK_DIR/results-$(date -u +%Y%m%dT%H%M%SZ).json"
+
+# --- Generated webroot: small and large files ---
+mkdir -p "$WORK_DIR/webroot"
+yes '<p>Small benchmark page.</p>' | head -c 2048 > "$WORK_DIR/webroot/small.html"
+yes '0123456789abcdef' | head -c 8388608 > "$WORK_DIR/webroot/large.bin"
+cp "$WORK_DIR/webroot/small.html" "$WORK_DIR/webroot/index.html"
+
+# --- Microbenchmarks ---
+"$BUILD_DIR/bench_micro" "$WORK_DIR/micro.json"
+
+# --- Server (WEB_ROOT is relative to its working directory) ---
+(cd "$WORK_DIR" && exec ../httpserver "$PORT" --log-level warn) &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+sleep 0.5
+
+LOADGEN="$BUILD_DIR/loadgen -p $PORT -d $DURATION"
+echo "--- Load scenarios (${DURATION}s each) ---"
+$LOADGEN -u /small.html -c 64  -t 4 -l small_keepalive         -o "$WORK_DIR/load1.json"
+$LOADGEN -u /small.html -c 64  -t 4 -P 16 -l small_pipelined_16 -o "$WORK_DIR/load2.json"
+$LOADGEN -u /small.html -c 32  -t 4 -C -l small_close           -o "$WORK_DIR/load3.json"
+$LOADGEN -u /large.bin  -c 8   -t 4 -l large_keepalive          -o "$WORK_DIR/load4.json"
+$LOADGEN -u /small.html -c 64  -t 4 -2 -P 16 -l small_h2c_16    -o "$WORK_DIR/load5.json"
+$LOADGEN -u /large.bin  -c 8   -t 4 -2 -P 4 -l large_h2c_4      -o "$WORK_DIR/load6.json"
+
+# --- One JSON document per run, for tracking regressions over time ---
+{
+    printf '{\n"timestamp": "%s",\n' "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+    printf '"commit": "%s",\n' "$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+    printf '"micro": '
+    cat "$WORK_DIR/micro.json"
+    printf ',\n"load": [\n'
+    cat "$WORK_DIR/load1.json"; printf ','
+    cat "$WORK_DIR/load2.json"; printf ','
+    cat "$WORK_DIR/load3.json"; printf ','
+    cat "$WORK_DIR/load4.json"; printf ','
+    cat "$WORK_DIR/load5.json"; printf ','
+    cat "$WORK_DIR/load6.json"
+    printf ']\n}\n'
+} > "$RESULTS"
+
+echo "Results written to $RESULTS"
@@ -0,0 +1,270 @@
+#include "include/http_admission.h"
+#include "include/http_metrics.h"
+#include "include/http_log.h"
+#include "include/http_config.h"
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#define ADMISSION_BUCKETS 128 // Hash chains per shard
+
+/**
+ * @brief What is known about one client address: its open connections and its request
+ *        token bucket. Entries never move while a connection refers to them.
+ */
+struct client_entry {
+    client_entry *next;
+    unsigned char addr[16]; // IPv6, or IPv4-mapped IPv6
+    unsigned shard;
+    unsigned conns;
+    double tokens;
+    uint64_t refilled_ns;
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    client_entry *buckets[ADMISSION_BUCKETS];
+    client_entry *free_list;
+    unsigned used; // entries[] handed out so far; the rest have never been used
+    client_entry entries[ADMISSION_SHARD_ENTRIES];
+} admission_shard;
+
+static admission_shard shards[ADMISSION_SHARDS];
+static pthread_once_t admission_once = PTHREAD_ONCE_INIT;
+
+static unsigned open_connections; // Across all workers (atomic)
+
+static __thread uint64_t batch_started_ns; // 0 outside an event batch
+
+static const char SHED_RESPONSE[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                    "Content-Type: text/plain\r\n"
+                                    "Content-Length: 20\r\n"
+                                    "Retry-After: " SHED_RETRY_AFTER "\r\n"
+                                    "Connection: close\r\n"
+                                    "\r\n"
+                                    "Service Unavailable\n";
+
+static void admission_init(void) {
+    for (int i = 0; i < ADMISSION_SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+    }
+}
+
+/**
+ * @brief Reduces a peer address to the 16-byte table key.
+ * @return 0 on success, -1 for families that have no address (e.g. AF_UNIX).
+ */
+static int client_key(const struct sockaddr_storage *peer, unsigned char key[16]) {
+    if (peer->ss_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)peer;
+        memset(key, 0, 10);
+        key[10] = key[11] = 0xff;
+        memcpy(key + 12, &in->sin_addr, 4);
+        return 0;
+    }
+    if (peer->ss_family == AF_INET6) {
+        memcpy(key, &((const struct sockaddr_in6 *)peer)->sin6_addr, 16);
+        return 0;
+    }
+    return -1;
+}
+
+static uint64_t client_hash(const unsigned char key[16]) {
+    uint64_t lo, hi;
+    memcpy(&lo, key, 8);
+    memcpy(&hi, key + 8, 8);
+    uint64_t h = (lo ^ (hi * 0x9E3779B97F4A7C15ULL)) * 0xC2B2AE3D27D4EB4FULL;
+    return h ^ (h >> 29);
+}
+
+/**
+ * @brief Adds whatever the bucket has earned since it was last topped up.
+ */
+static void refill(client_entry *entry, double rate, uint64_t now) {
+    double burst = rate * REQUEST_BURST_SECONDS;
+    entry->tokens += (double)(now - entry->refilled_ns) * rate / 1e9;
+    if (entry->tokens > burst) entry->tokens = burst;
+    entry->refilled_ns = now;
+}
+
+/**
+ * @brief Frees every entry that no connection holds and whose bucket is full again, i.e.
+ *        entries that would be recreated identically. Called with the shard locked.
+ */
+static void sweep(admission_shard *shard, double rate, uint64_t now) {
+    for (int b = 0; b < ADMISSION_BUCKETS; b++) {
+        client_entry **link = &shard->buckets[b];
+        while (*link) {
+            client_entry *entry = *link;
+            if (entry->conns == 0) refill(entry, rate, now);
+            if (entry->conns == 0 && entry->tokens >= rate * REQUEST_BURST_SECONDS) {
+                *link = entry->next;
+                entry->next = shard->free_list;
+                shard->free_list = entry;
+            } else {
+                link = &entry->next;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Finds or creates the entry for a key. Called with the shard locked.
+ * @return The entry, or NULL if the shard is full of clients still in use.
+ */
+static client_entry *lookup(admission_shard *shard, unsigned shard_index, const unsigned char key[16],
+                            uint64_t hash, double rate, uint64_t now) {
+    client_entry **head = &shard->buckets[(hash >> 8) % ADMISSION_BUCKETS];
+    for (client_entry *entry = *head; entry; entry = entry->next) {
+        if (memcmp(entry->addr, key, 16) == 0) return entry;
+    }
+
+    if (!shard->free_list && shard->used == ADMISSION_SHARD_ENTRIES) sweep(shard, rate, now);
+    client_entry *entry;
+    if (shard->free_list) {
+        entry = shard->free_list;
+        shard->free_list = entry->next;
+    } else if (shard->used < ADMISSION_SHARD_ENTRIES) {
+        entry = &shard->entries[shard->used++];
+    } else {
+        return NULL;
+    }
+
+    memcpy(entry->addr, key, 16);
+    entry->shard = shard_index;
+    entry->conns = 0;
+    entry->tokens = rate * REQUEST_BURST_SECONDS;
+    entry->refilled_ns = now;
+    entry->next = *head;
+    *head = entry;
+    return entry;
+}
+
+/**
+ * @brief Queueing delay of the event being handled exceeds the shedding threshold.
+ */
+static int overloaded(uint64_t now) {
+    return batch_started_ns && now - batch_started_ns > (uint64_t)SHED_QUEUE_DELAY_MS * 1000000;
+}
+
+static void reject(int fd, shed_reason reason) {
+    // Best effort and never blocking: a client whose window is full simply sees the close.
+    send(fd, SHED_RESPONSE, sizeof(SHED_RESPONSE) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+    admission_count_shed(reason);
+    metrics_count_status(503);
+}
+
+/**
+ * @brief Decides whether a freshly accepted connection may stay.
+ */
+int admission_accept(int fd, const struct sockaddr_storage *peer, admission_ticket *ticket) {
+    pthread_once(&admission_once, admission_init);
+    ticket->admitted = 0;
+    ticket->client = NULL;
+
+    const server_config *config = config_current();
+    uint64_t now = metrics_now();
+    if (overloaded(now)) {
+        reject(fd, SHED_OVERLOAD);
+        return -1;
+    }
+    if (__atomic_add_fetch(&open_connections, 1, __ATOMIC_RELAXED) > config->max_connections) {
+        __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+        log_debug("Connection limit (%u) reached; refusing socket %d.", config->max_connections, fd);
+        reject(fd, SHED_CONNECTION_LIMIT);
+        return -1;
+    }
+    ticket->admitted = 1;
+
+    unsigned char key[16];
+    unsigned max_per_client = config->max_connections_per_ip;
+    double rate = config->rate_limit_per_ip;
+    if ((max_per_client == 0 && rate <= 0) || client_key(peer, key) != 0) return 0;
+
+    uint64_t hash = client_hash(key);
+    unsigned index = (unsigned)(hash % ADMISSION_SHARDS);
+    admission_shard *shard = &shards[index];
+    pthread_mutex_lock(&shard->lock);
+    client_entry *entry = lookup(shard, index, key, hash, rate, now);
+    int refused = entry && max_per_client && entry->conns >= max_per_client;
+    if (entry && !refused) entry->conns++;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (refused) {
+        admission_release(ticket);
+        log_debug("Per-client connection limit (%u) reached; refusing socket %d.", max_per_client, fd);
+        reject(fd, SHED_CLIENT_LIMIT);
+        return -1;
+    }
+    ticket->client = entry; // NULL if the table is full: admitted without per-client limits
+    return 0;
+}
+
+/**
+ * @brief Gives back an admitted connection's slot.
+ */
+void admission_release(admission_ticket *ticket) {
+    if (!ticket->admitted) return;
+    if (ticket->client) {
+        admission_shard *shard = &shards[ticket->client->shard];
+        pthread_mutex_lock(&shard->lock);
+        ticket->client->conns--;
+        pthread_mutex_unlock(&shard->lock);
+        ticket->client = NULL;
+    }
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+    ticket->admitted = 0;
+}
+
+/**
+ * @brief Decides whether a connection's next request is served.
+ */
+int admission_request(admission_ticket *ticket, shed_reason *reason) {
+    uint64_t now = metrics_now();
+    if (overloaded(now)) {
+        *reason = SHED_OVERLOAD;
+        return -1;
+    }
+    double rate = config_current()->rate_limit_per_ip;
+    if (rate <= 0 || !ticket->client) return 0;
+
+    client_entry *entry = ticket->client;
+    admission_shard *shard = &shards[entry->shard];
+    pthread_mutex_lock(&shard->lock);
+    refill(entry, rate, now);
+    int allowed = entry->tokens >= 1.0;
+    if (allowed) entry->tokens -= 1.0;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (!allowed) {
+        *reason = SHED_RATE_LIMIT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Marks the start of a batch of ready events on the calling worker.
+ */
+void admission_batch_begin(void) {
+    batch_started_ns = metrics_now();
+}
+
+/**
+ * @brief The pre-rendered 503 response.
+ */
+const char *admission_shed_response(size_t *len) {
+    *len = sizeof(SHED_RESPONSE) - 1;
+    return SHED_RESPONSE;
+}
+
+/**
+ * @brief Counts one shed connection or request.
+ */
+void admission_count_shed(shed_reason reason) {
+    static const metrics_counter counters[SHED_REASON_COUNT] = {
+        METRIC_SHED_CONNECTION_LIMIT, METRIC_SHED_CLIENT_LIMIT, METRIC_SHED_RATE_LIMIT, METRIC_SHED_OVERLOAD};
+    metrics_add(counters[reason], 1);
+}
@@ -0,0 +1,249 @@
+#define _GNU_SOURCE // For mkostemp
+#include "include/http_body.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define UPLOAD_TEMP_SUFFIX ".upload-XXXXXX"
+
+// Chunked decoder states (RFC 9112 section 7.1); framing lines must end in CRLF.
+enum {
+    C_SIZE,          // First hex digit of a chunk size
+    C_SIZE_MORE,     // Further hex digits, or the end of the size
+    C_EXTENSION,     // Chunk extensions, skipped up to CR
+    C_SIZE_LF,
+    C_DATA,
+    C_DATA_CR,       // CRLF after the chunk data
+    C_DATA_LF,
+    C_TRAILER_START, // After the last chunk: a trailer field or the final CRLF
+    C_TRAILER,       // Trailer field, skipped up to CR
+    C_TRAILER_LF,
+    C_FINAL_LF,
+    C_DONE
+};
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Prepares a reader for one request body.
+ */
+void body_reader_init(body_reader *reader, int chunked, uint64_t content_length, uint64_t limit) {
+    memset(reader, 0, sizeof(*reader));
+    reader->chunked = chunked;
+    reader->state = C_SIZE;
+    reader->remaining = chunked ? 0 : content_length;
+    reader->limit = limit;
+}
+
+/**
+ * @brief Decodes chunked framing in place. Data bytes are moved down over the framing that
+ *        preceded them, so the decoded body ends up contiguous at the front of buf.
+ */
+static body_status decode_chunked(body_reader *reader, char *buf, size_t *len, size_t *out) {
+    size_t pos = 0, produced = 0, avail = *len;
+
+    while (pos < avail && reader->state != C_DONE) {
+        char c = buf[pos];
+
+        if (reader->state == C_DATA) {
+            size_t n = avail - pos;
+            if (n > reader->remaining) n = (size_t)reader->remaining;
+            if (produced != pos) memmove(buf + produced, buf + pos, n);
+            produced += n;
+            pos += n;
+            reader->remaining -= n;
+            reader->received += n;
+            if (reader->remaining == 0) reader->state = C_DATA_CR;
+            continue;
+        }
+
+        // Everything else is framing: bounded, so a client cannot stream it forever.
+        if (++reader->line_len > BODY_LINE_MAX) return BODY_ERROR;
+        pos++;
+
+        switch (reader->state) {
+        case C_SIZE:
+        case C_SIZE_MORE: {
+            int digit = hex_value(c);
+            if (digit >= 0) {
+                if (reader->remaining > (UINT64_MAX >> 4)) return BODY_TOO_LARGE;
+                reader->remaining = (reader->remaining << 4) | (uint64_t)digit;
+                reader->state = C_SIZE_MORE;
+            } else if (reader->state == C_SIZE) {
+                return BODY_ERROR;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                reader->state = C_EXTENSION;
+            } else if (c == '\r') {
+                reader->state = C_SIZE_LF;
+            } else {
+                return BODY_ERROR;
+            }
+            break;
+        }
+
+        case C_EXTENSION:
+            if (c == '\r') reader->state = C_SIZE_LF;
+            else if (c == '\n') return BODY_ERROR;
+            break;
+
+        case C_SIZE_LF:
+            if (c != '\n') return BODY_ERROR;
+            reader->line_len = 0;
+            if (reader->remaining == 0) {
+                reader->state = C_TRAILER_START; // Last chunk
+            } else if (reader->remaining > reader->limit - reader->received) {
+                return BODY_TOO_LARGE;
+            } else {
+                reader->state = C_DATA;
+            }
+            break;
+
+        case C_DATA_CR:
+            if (c != '\r') return BODY_ERROR;
+            reader->state = C_DATA_LF;
+            break;
+
+        case C_DATA_LF:
+            if (c != '\n') return BODY_ERROR;
+            reader->line_len = 0;
+            reader->state = C_SIZE;
+            break;
+
+        case C_TRAILER_START:
+            if (c == '\n') return BODY_ERROR;
+            reader->state = (c == '\r') ? C_FINAL_LF : C_TRAILER;
+            break;
+
+        case C_TRAILER:
+            if (c == '\r') reader->state = C_TRAILER_LF;
+            else if (c == '\n') return BODY_ERROR;
+            break;
+
+        case C_TRAILER_LF:
+            if (c != '\n') return BODY_ERROR;
+            reader->state = C_TRAILER_START;
+            break;
+
+        case C_FINAL_LF:
+            if (c != '\n') return BODY_ERROR;
+            reader->state = C_DONE;
+            break;
+        }
+    }
+
+    *len = pos;
+    *out = produced;
+    return reader->state == C_DONE ? BODY_COMPLETE : BODY_IN_PROGRESS;
+}
+
+/**
+ * @brief Decodes the next raw body bytes in place.
+ */
+body_status body_decode(body_reader *reader, char *buf, size_t *len, size_t *out) {
+    if (reader->chunked) return decode_chunked(reader, buf, len, out);
+
+    // Content-Length: the bytes are the body; only the count matters.
+    if (reader->remaining > reader->limit - reader->received) return BODY_TOO_LARGE;
+    size_t n = *len;
+    if (n > reader->remaining) n = (size_t)reader->remaining;
+    reader->remaining -= n;
+    reader->received += n;
+    *len = n;
+    *out = n;
+    return reader->remaining == 0 ? BODY_COMPLETE : BODY_IN_PROGRESS;
+}
+
+/**
+ * @brief Parses a Content-Length value strictly: digits only, no sign, no overflow.
+ */
+int body_parse_content_length(const char *value, uint64_t *length) {
+    uint64_t result = 0;
+    if (*value == '\0') return -1;
+    for (const char *p = value; *p; p++) {
+        if (*p < '0' || *p > '9') return -1;
+        if (result > (UINT64_MAX - 9) / 10) return -1;
+        result = result * 10 + (uint64_t)(*p - '0');
+    }
+    *length = result;
+    return 0;
+}
+
+
+// --- Uploads ---
+
+/**
+ * @brief Starts an upload to final_path by creating its temporary file.
+ */
+body_upload *body_upload_open(const char *final_path) {
+    size_t path_len = strlen(final_path);
+    size_t temp_size = path_len + sizeof(UPLOAD_TEMP_SUFFIX);
+    body_upload *upload = (body_upload *)malloc(sizeof(body_upload) + temp_size + path_len + 1);
+    if (!upload) return NULL;
+
+    upload->temp_path = (char *)(upload + 1);
+    upload->final_path = upload->temp_path + temp_size;
+    memcpy(upload->final_path, final_path, path_len + 1);
+    snprintf(upload->temp_path, temp_size, "%s%s", final_path, UPLOAD_TEMP_SUFFIX);
+
+    upload->fd = mkostemp(upload->temp_path, O_CLOEXEC);
+    if (upload->fd < 0) {
+        free(upload);
+        return NULL;
+    }
+    fchmod(upload->fd, 0644); // mkostemp creates 0600; uploads are meant to be served
+    return upload;
+}
+
+/**
+ * @brief Appends decoded body bytes to the upload.
+ */
+int body_upload_write(body_upload *upload, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(upload->fd, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Moves the finished file over the target and releases the upload.
+ */
+int body_upload_commit(body_upload *upload, int *created) {
+    struct stat existing;
+    *created = lstat(upload->final_path, &existing) != 0;
+
+    int result = close(upload->fd);
+    upload->fd = -1;
+    if (result == 0) result = rename(upload->temp_path, upload->final_path);
+    if (result != 0) {
+        int saved = errno;
+        unlink(upload->temp_path);
+        errno = saved;
+    }
+    free(upload);
+    return result;
+}
+
+/**
+ * @brief Discards an unfinished upload.
+ */
+void body_upload_abort(body_upload *upload) {
+    if (!upload) return;
+    if (upload->fd >= 0) close(upload->fd);
+    unlink(upload->temp_path);
+    free(upload);
+}
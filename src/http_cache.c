@@ -0,0 +1,363 @@
+#define _GNU_SOURCE // For struct stat's st_mtim
+#include "include/http_cache.h"
+#include "include/http_utils.h"
+#include "include/http_mime.h"
+#include "include/http_metrics.h"
+#include "include/http_config.h"
+#include "include/http_watch.h"
+#include "include/http_encoding.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define CACHE_BUCKETS 256 // Hash buckets per shard
+
+typedef struct {
+    // Readers (lookups) share the lock; inserts and evictions take it exclusively.
+    pthread_rwlock_t lock;
+    cache_entry *buckets[CACHE_BUCKETS];
+    cache_entry *lru_head, *lru_tail;
+    size_t bytes;
+} cache_shard;
+
+static cache_shard shards[CACHE_SHARDS];
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+// Bumped by every invalidation, so a load that raced with one does not publish what it read.
+static unsigned long invalidations; // (atomic)
+
+static void cache_init(void) {
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        pthread_rwlock_init(&shards[i].lock, NULL);
+    }
+}
+
+/**
+ * @brief FNV-1a over the request path.
+ */
+static unsigned long hash_path(const char *path) {
+    unsigned long hash = 1469598103934665603UL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static cache_shard *shard_for(unsigned long hash) {
+    return &shards[hash & (CACHE_SHARDS - 1)];
+}
+
+static cache_entry **bucket_for(cache_shard *shard, unsigned long hash) {
+    return &shard->buckets[(hash / CACHE_SHARDS) % CACHE_BUCKETS];
+}
+
+static void free_entry(cache_entry *entry) {
+    free(entry->path);
+    for (int c = 0; c < CODING_COUNT; c++) {
+        free(entry->variants[c].body);
+        free(entry->variants[c].header);
+    }
+    free(entry);
+}
+
+/**
+ * @brief Drops one reference; the entry is freed once it is evicted and no response uses it.
+ */
+void cache_release(void *arg) {
+    cache_entry *entry = (cache_entry *)arg;
+    if (__atomic_sub_fetch(&entry->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_entry(entry);
+    }
+}
+
+static int same_file(const cache_entry *entry, const struct stat *st) {
+    return entry->dev == st->st_dev && entry->ino == st->st_ino && entry->size == st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec && entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// --- Shard list maintenance (caller holds the shard's write lock) ---
+
+static void lru_unlink(cache_shard *shard, cache_entry *entry) {
+    if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+    else shard->lru_head = entry->lru_next;
+    if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+    else shard->lru_tail = entry->lru_prev;
+    entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_push_front(cache_shard *shard, cache_entry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head) shard->lru_head->lru_prev = entry;
+    else shard->lru_tail = entry;
+    shard->lru_head = entry;
+}
+
+/**
+ * @brief Removes the entry from its bucket and the eviction list.
+ * @return 1 if it was still published, 0 if another thread got there first.
+ */
+static int unpublish(cache_shard *shard, cache_entry *entry) {
+    cache_entry **link = bucket_for(shard, entry->hash);
+    while (*link && *link != entry) link = &(*link)->hash_next;
+    if (!*link) return 0;
+
+    *link = entry->hash_next;
+    lru_unlink(shard, entry);
+    shard->bytes -= entry->footprint;
+    return 1;
+}
+
+/**
+ * @brief Looks up a request path. Hits only take a shard read lock.
+ */
+cache_entry *cache_lookup(const char *path, const char *full_path) {
+    pthread_once(&cache_once, cache_init);
+
+    unsigned long hash = hash_path(path);
+    cache_shard *shard = shard_for(hash);
+    cache_entry *entry;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    for (entry = *bucket_for(shard, hash); entry; entry = entry->hash_next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            __atomic_add_fetch(&entry->refcount, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (!entry) return NULL;
+
+    // A watched web root reports changes as they happen (cache_invalidate); otherwise trust the
+    // entry for a short window, then make sure the file has not changed underneath it.
+    if (watch_active()) return entry;
+    time_t now = time(NULL);
+    if (now - __atomic_load_n(&entry->validated_at, __ATOMIC_RELAXED) >= CACHE_REVALIDATE_SECONDS) {
+        struct stat file_stat;
+        if (stat(full_path, &file_stat) == 0 && same_file(entry, &file_stat)) {
+            __atomic_store_n(&entry->validated_at, now, __ATOMIC_RELAXED);
+        } else {
+            pthread_rwlock_wrlock(&shard->lock);
+            int removed = unpublish(shard, entry);
+            pthread_rwlock_unlock(&shard->lock);
+            if (removed) cache_release(entry); // The cache's own reference
+            cache_release(entry);              // Ours
+            return NULL;
+        }
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Prebuilds the Content-Type through Last-Modified fields for one variant.
+ */
+static int build_header(const cache_entry *entry, content_coding coding, int negotiated, cache_variant *variant) {
+    char header[512];
+    const char *encoding = encoding_name(coding);
+    const char *vary = negotiated ? "Vary: Accept-Encoding\r\n" : "";
+    const file_validators *validators = &entry->validators;
+    int len;
+    if (encoding) {
+        len = snprintf(header, sizeof(header),
+                       "Content-Type: %s\r\nContent-Encoding: %s\r\nContent-Length: %zu\r\n%s"
+                       "ETag: %s\r\nLast-Modified: %s\r\n",
+                       entry->mime_type, encoding, variant->len, vary, validators->etag[coding],
+                       validators->last_modified);
+    } else {
+        len = snprintf(header, sizeof(header),
+                       "Content-Type: %s\r\nContent-Length: %zu\r\nAccept-Ranges: bytes\r\n%s"
+                       "ETag: %s\r\nLast-Modified: %s\r\n",
+                       entry->mime_type, variant->len, vary, validators->etag[coding], validators->last_modified);
+    }
+
+    variant->header = (char *)malloc(len);
+    if (!variant->header) return -1;
+    memcpy(variant->header, header, len);
+    variant->header_len = (size_t)len;
+    return 0;
+}
+
+/**
+ * @brief Reads the open file, takes or makes its encoded variants, and publishes it.
+ */
+cache_entry *cache_load(const char *path, const open_file *file) {
+    pthread_once(&cache_once, cache_init);
+
+    const server_config *config = config_current();
+    unsigned long epoch = __atomic_load_n(&invalidations, __ATOMIC_ACQUIRE);
+
+    // The entry may have been opened before a change it has not heard of yet: only a file
+    // that still is what its stat data says is worth keeping.
+    struct stat file_stat;
+    if ((uint64_t)file->st.st_size > config->cache_max_file_size || fstat(file->fd, &file_stat) == -1 ||
+        file_stat.st_size != file->st.st_size || file_stat.st_mtim.tv_sec != file->st.st_mtim.tv_sec ||
+        file_stat.st_mtim.tv_nsec != file->st.st_mtim.tv_nsec) {
+        return NULL;
+    }
+
+    cache_entry *entry = (cache_entry *)calloc(1, sizeof(cache_entry));
+    if (!entry) return NULL;
+
+    entry->path = strdup(path);
+    entry->hash = hash_path(path);
+    entry->dev = file_stat.st_dev;
+    entry->ino = file_stat.st_ino;
+    entry->size = file_stat.st_size;
+    entry->mtime = file_stat.st_mtim;
+    entry->validators = file->validators;
+    const mime_type *mime = mime_lookup(path);
+    entry->mime_type = mime->type;
+    cache_variant *raw = &entry->variants[CODING_IDENTITY];
+    raw->len = (size_t)file_stat.st_size;
+    raw->body = (unsigned char *)malloc(raw->len ? raw->len : 1);
+
+    uint64_t read_start = metrics_now();
+    int ok = entry->path && raw->body && read_fully(file->fd, raw->body, raw->len, 0) == 0;
+    metrics_observe_stage(STAGE_FILE_IO, metrics_now() - read_start);
+
+    // Encode once per coding here so hits never pay for it again; a client is later sent the
+    // smallest variant it accepts. A precompressed sidecar is taken as it is.
+    int negotiated = 0;
+    if (ok && raw->len >= config->compress_min_size && encoding_type_allowed(mime)) {
+        for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+            cache_variant *variant = &entry->variants[c];
+            if (file->sidecar_fd[c] >= 0) {
+                variant->len = (size_t)file->sidecar_size[c];
+                variant->body = (unsigned char *)malloc(variant->len);
+                read_start = metrics_now();
+                if (variant->body && read_fully(file->sidecar_fd[c], variant->body, variant->len, 0) != 0) {
+                    free(variant->body);
+                    variant->body = NULL;
+                }
+                metrics_observe_stage(STAGE_FILE_IO, metrics_now() - read_start);
+            } else if (encoding_supported((content_coding)c)) {
+                uint64_t compress_start = metrics_now();
+                variant->body = encoding_compress((content_coding)c, encoding_level((content_coding)c), raw->body,
+                                                  raw->len, &variant->len);
+                metrics_observe_stage(STAGE_COMPRESS, metrics_now() - compress_start);
+                if (variant->body && variant->len >= raw->len) {
+                    free(variant->body);
+                    variant->body = NULL;
+                }
+            }
+            if (!variant->body) variant->len = 0;
+            negotiated |= variant->body != NULL;
+        }
+    }
+    size_t footprint = sizeof(cache_entry) + strlen(path);
+    for (int c = 0; c < CODING_COUNT && ok; c++) {
+        cache_variant *variant = &entry->variants[c];
+        if (c != CODING_IDENTITY && !variant->body) continue;
+        ok = build_header(entry, (content_coding)c, negotiated, variant) == 0;
+        footprint += variant->len + variant->header_len;
+    }
+    if (!ok) {
+        free_entry(entry);
+        return NULL;
+    }
+
+    entry->footprint = footprint;
+    entry->validated_at = time(NULL);
+    entry->refcount = 2; // The cache's reference plus the caller's
+
+    cache_shard *shard = shard_for(entry->hash);
+    cache_entry *released = NULL; // Replaced and evicted entries, dropped after unlocking
+
+    pthread_rwlock_wrlock(&shard->lock);
+
+    if (__atomic_load_n(&invalidations, __ATOMIC_ACQUIRE) != epoch) {
+        // The file may have changed while it was read: serve it this once, but do not keep it.
+        pthread_rwlock_unlock(&shard->lock);
+        entry->refcount = 1;
+        return entry;
+    }
+
+    // A concurrent miss may have loaded the same path; the newer load wins.
+    for (cache_entry *old = *bucket_for(shard, entry->hash); old; old = old->hash_next) {
+        if (old->hash == entry->hash && strcmp(old->path, path) == 0) {
+            unpublish(shard, old);
+            old->hash_next = released;
+            released = old;
+            break;
+        }
+    }
+
+    // Second-chance eviction from the oldest end: recently hit entries get one more round.
+    while (shard->bytes + entry->footprint > config->cache_max_bytes / CACHE_SHARDS && shard->lru_tail) {
+        cache_entry *victim = shard->lru_tail;
+        if (__atomic_exchange_n(&victim->referenced, 0, __ATOMIC_RELAXED)) {
+            lru_unlink(shard, victim);
+            lru_push_front(shard, victim);
+            continue;
+        }
+        unpublish(shard, victim);
+        victim->hash_next = released;
+        released = victim;
+    }
+
+    cache_entry **bucket = bucket_for(shard, entry->hash);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    lru_push_front(shard, entry);
+    shard->bytes += entry->footprint;
+
+    pthread_rwlock_unlock(&shard->lock);
+
+    while (released) {
+        cache_entry *next = released->hash_next;
+        cache_release(released);
+        released = next;
+    }
+
+    return entry;
+}
+
+/**
+ * @brief Drops the entry for one path, if any.
+ */
+void cache_invalidate(const char *path) {
+    pthread_once(&cache_once, cache_init);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_ACQ_REL);
+
+    unsigned long hash = hash_path(path);
+    cache_shard *shard = shard_for(hash);
+    cache_entry *entry;
+    pthread_rwlock_wrlock(&shard->lock);
+    for (entry = *bucket_for(shard, hash); entry; entry = entry->hash_next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) break;
+    }
+    if (entry) unpublish(shard, entry);
+    pthread_rwlock_unlock(&shard->lock);
+    if (entry) cache_release(entry);
+}
+
+/**
+ * @brief Drops every entry.
+ */
+void cache_flush(void) {
+    pthread_once(&cache_once, cache_init);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_ACQ_REL);
+
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard *shard = &shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+        cache_entry *list = shard->lru_head;
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->lru_head = shard->lru_tail = NULL;
+        shard->bytes = 0;
+        pthread_rwlock_unlock(&shard->lock);
+
+        while (list) {
+            cache_entry *next = list->lru_next;
+            cache_release(list);
+            list = next;
+        }
+    }
+}
@@ -0,0 +1,409 @@
+#include "include/http_config.h"
+#include "include/http_handler.h"
+#include "include/http_conn.h"
+#include "include/http_cache.h"
+#include "include/http_fdcache.h"
+#include "include/http_encoding.h"
+#include "include/http_admission.h"
+#include "include/http_h2.h"
+#include "include/http_utils.h" // For MAX_HEADERS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+typedef enum {
+    OPT_UNSIGNED, // unsigned, plain count
+    OPT_SIZE,     // uint64_t, optional k/m/g suffix (powers of 1024)
+    OPT_STRING,   // char[CONFIG_PATH_MAX]
+    OPT_LOG_LEVEL,
+    OPT_BACKEND,
+    OPT_PRECOMPRESS
+} option_type;
+
+/**
+ * @brief One setting: its name in config files ("max_body_size") and on the command line
+ *        ("--max-body-size"), where it lives in server_config, and its valid range.
+ */
+typedef struct {
+    const char *name;
+    option_type type;
+    size_t offset;
+    uint64_t min;
+    uint64_t max;
+    int startup_only;
+} config_option;
+
+#define OPTION(field, type, min, max, startup_only) \
+    { #field, type, offsetof(server_config, field), min, max, startup_only }
+
+static const config_option OPTIONS[] = {
+    OPTION(port, OPT_UNSIGNED, 1, 65535, 1),
+    OPTION(backend, OPT_BACKEND, 0, 0, 1),
+    OPTION(workers, OPT_UNSIGNED, 0, 1024, 1),
+    OPTION(pin_workers, OPT_UNSIGNED, 0, 1, 1),
+    OPTION(listen_backlog, OPT_UNSIGNED, 1, 65535, 1),
+    OPTION(input_buffer_size, OPT_SIZE, 1024, 16 << 20, 1),
+    OPTION(output_arena_size, OPT_SIZE, 0, 16 << 20, 1),
+    OPTION(mime_types, OPT_STRING, 0, 0, 1),
+    OPTION(precompress, OPT_PRECOMPRESS, 0, 0, 1),
+    OPTION(web_root, OPT_STRING, 0, 0, 0),
+    OPTION(log_level, OPT_LOG_LEVEL, 0, 0, 0),
+    OPTION(max_headers, OPT_UNSIGNED, 1, MAX_HEADERS, 0),
+    OPTION(max_header_size, OPT_SIZE, 64, 16 << 20, 0),
+    OPTION(max_body_size, OPT_SIZE, 0, UINT64_MAX, 0),
+    OPTION(max_upload_size, OPT_SIZE, 0, UINT64_MAX, 0),
+    OPTION(cache_max_bytes, OPT_SIZE, 0, UINT64_MAX, 0),
+    OPTION(cache_max_file_size, OPT_SIZE, 0, UINT64_MAX, 0),
+    OPTION(open_file_cache_entries, OPT_UNSIGNED, 0, 1 << 20, 0),
+    OPTION(compress_types, OPT_STRING, 0, 0, 0),
+    OPTION(compress_min_size, OPT_SIZE, 0, UINT64_MAX, 0),
+    OPTION(serve_precompressed, OPT_UNSIGNED, 0, 1, 0),
+    OPTION(gzip_level, OPT_UNSIGNED, 1, 9, 0),
+    OPTION(brotli_level, OPT_UNSIGNED, 0, 11, 0),
+    OPTION(zstd_level, OPT_UNSIGNED, 1, 22, 0),
+    OPTION(header_timeout_ms, OPT_UNSIGNED, TIMER_TICK_MS, 86400000, 0),
+    OPTION(body_timeout_ms, OPT_UNSIGNED, TIMER_TICK_MS, 86400000, 0),
+    OPTION(idle_timeout_ms, OPT_UNSIGNED, TIMER_TICK_MS, 86400000, 0),
+    OPTION(write_timeout_ms, OPT_UNSIGNED, TIMER_TICK_MS, 86400000, 0),
+    OPTION(max_connections, OPT_UNSIGNED, 1, UINT_MAX, 0),
+    OPTION(max_connections_per_ip, OPT_UNSIGNED, 0, UINT_MAX, 0),
+    OPTION(rate_limit_per_ip, OPT_UNSIGNED, 0, UINT_MAX, 0),
+    OPTION(http2, OPT_UNSIGNED, 0, 1, 0),
+    OPTION(http2_max_streams, OPT_UNSIGNED, 1, 1 << 16, 0),
+};
+
+#define NUM_OPTIONS (sizeof(OPTIONS) / sizeof(OPTIONS[0]))
+
+static const server_config DEFAULT_CONFIG = {
+    .port = PORT_DEFAULT,
+    .backend = IO_BACKEND_EPOLL,
+    .workers = WORKER_THREADS,
+    .pin_workers = 1,
+    .listen_backlog = LISTEN_BACKLOG,
+    .input_buffer_size = CONN_IN_BUFFER_SIZE,
+    .output_arena_size = CONN_ARENA_SIZE,
+    .mime_types = "",
+    .precompress = PRECOMPRESS_OFF,
+    .web_root = WEB_ROOT,
+    .log_level = LOG_LEVEL_DEFAULT,
+    .max_headers = MAX_HEADERS,
+    .max_header_size = MAX_HEADER_SIZE_DEFAULT,
+    .max_body_size = MAX_BODY_SIZE_DEFAULT,
+    .max_upload_size = MAX_UPLOAD_SIZE_DEFAULT,
+    .cache_max_bytes = CACHE_MAX_BYTES,
+    .cache_max_file_size = CACHE_MAX_FILE_SIZE,
+    .open_file_cache_entries = FD_CACHE_ENTRIES,
+    .compress_types = "",
+    .compress_min_size = COMPRESS_MIN_SIZE_DEFAULT,
+    .serve_precompressed = 1,
+    .gzip_level = GZIP_LEVEL_DEFAULT,
+    .brotli_level = BROTLI_LEVEL_DEFAULT,
+    .zstd_level = ZSTD_LEVEL_DEFAULT,
+    .header_timeout_ms = CONN_HEADER_TIMEOUT_MS,
+    .body_timeout_ms = CONN_BODY_TIMEOUT_MS,
+    .idle_timeout_ms = CONN_IDLE_TIMEOUT_MS,
+    .write_timeout_ms = CONN_WRITE_TIMEOUT_MS,
+    .max_connections = MAX_CONNECTIONS_DEFAULT,
+    .max_connections_per_ip = MAX_CONNECTIONS_PER_IP_DEFAULT,
+    .rate_limit_per_ip = REQUEST_RATE_PER_IP_DEFAULT,
+    .http2 = 1,
+    .http2_max_streams = H2_MAX_STREAMS_DEFAULT,
+};
+
+// Published configs are never freed: a worker may still be reading the one just replaced,
+// and a reload is rare enough that keeping about 3 KB (mostly the path fields) per SIGHUP
+// costs nothing.
+static const server_config *current = &DEFAULT_CONFIG; // (atomic)
+
+// What config_init was given, replayed by config_reload.
+static int saved_argc;
+static char **saved_argv;
+
+static int fail(char *err, size_t err_size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+static int fail(char *err, size_t err_size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(err, err_size, fmt, args);
+    va_end(args);
+    return -1;
+}
+
+/**
+ * @brief Fills in the compiled-in defaults.
+ */
+void config_defaults(server_config *config) {
+    *config = DEFAULT_CONFIG;
+}
+
+/**
+ * @brief Finds a setting by name; on the command line dashes stand for underscores.
+ */
+static const config_option *find_option(const char *name, size_t len) {
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        const char *option = OPTIONS[i].name;
+        size_t j = 0;
+        while (j < len && option[j] && (name[j] == option[j] || (name[j] == '-' && option[j] == '_'))) j++;
+        if (j == len && option[j] == '\0') return &OPTIONS[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parses a non-negative decimal number, with a k/m/g suffix if allowed.
+ */
+static int parse_number(const char *value, int allow_suffix, uint64_t *result) {
+    uint64_t n = 0;
+    const char *p = value;
+    if (*p < '0' || *p > '9') return -1;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        if (n > (UINT64_MAX - 9) / 10) return -1;
+        n = n * 10 + (uint64_t)(*p - '0');
+    }
+
+    unsigned shift = 0;
+    if (allow_suffix && *p) {
+        switch (*p++) {
+        case 'k': case 'K': shift = 10; break;
+        case 'm': case 'M': shift = 20; break;
+        case 'g': case 'G': shift = 30; break;
+        default: return -1;
+        }
+    }
+    if (*p != '\0' || (shift && n > (UINT64_MAX >> shift))) return -1;
+    *result = n << shift;
+    return 0;
+}
+
+/**
+ * @brief Stores one setting's value after checking it.
+ */
+static int set_option(server_config *config, const config_option *option, const char *value, char *err,
+                      size_t err_size) {
+    char *field = (char *)config + option->offset;
+    uint64_t n;
+
+    switch (option->type) {
+    case OPT_UNSIGNED:
+    case OPT_SIZE:
+        if (parse_number(value, option->type == OPT_SIZE, &n) != 0) {
+            return fail(err, err_size, "invalid value '%s' for %s", value, option->name);
+        }
+        if (n < option->min || n > option->max) {
+            return fail(err, err_size, "%s must be between %llu and %llu", option->name,
+                        (unsigned long long)option->min, (unsigned long long)option->max);
+        }
+        if (option->type == OPT_SIZE) *(uint64_t *)field = n;
+        else *(unsigned *)field = (unsigned)n;
+        return 0;
+
+    case OPT_STRING:
+        if (strlen(value) >= CONFIG_PATH_MAX) return fail(err, err_size, "%s is too long", option->name);
+        strcpy(field, value);
+        return 0;
+
+    case OPT_LOG_LEVEL:
+        if (log_level_parse(value, (log_level *)field) != 0) {
+            return fail(err, err_size, "unknown log level '%s'", value);
+        }
+        return 0;
+
+    case OPT_BACKEND:
+        if (strcmp(value, "epoll") == 0) *(io_backend *)field = IO_BACKEND_EPOLL;
+        else if (strcmp(value, "io_uring") == 0) *(io_backend *)field = IO_BACKEND_URING;
+        else return fail(err, err_size, "unknown backend '%s' (epoll or io_uring)", value);
+        return 0;
+
+    case OPT_PRECOMPRESS:
+        if (strcmp(value, "off") == 0) *(precompress_mode *)field = PRECOMPRESS_OFF;
+        else if (strcmp(value, "startup") == 0) *(precompress_mode *)field = PRECOMPRESS_STARTUP;
+        else if (strcmp(value, "only") == 0) *(precompress_mode *)field = PRECOMPRESS_ONLY;
+        else return fail(err, err_size, "unknown precompress mode '%s' (off, startup or only)", value);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads "name = value" lines; blank lines and lines starting with '#' are skipped.
+ */
+static int load_file(server_config *config, const char *path, char *err, size_t err_size) {
+    FILE *file = fopen(path, "r");
+    if (!file) return fail(err, err_size, "cannot open config file %s: %s", path, strerror(errno));
+
+    char line[CONFIG_LINE_MAX];
+    char detail[256];
+    int line_no = 0, result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file)) {
+        line_no++;
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            result = fail(err, err_size, "%s:%d: line too long", path, line_no);
+            break;
+        }
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' ||
+                           line[len - 1] == '\t')) {
+            line[--len] = '\0';
+        }
+        char *name = line + strspn(line, " \t");
+        if (*name == '\0' || *name == '#') continue;
+
+        char *eq = strchr(name, '=');
+        if (!eq) {
+            result = fail(err, err_size, "%s:%d: expected 'name = value'", path, line_no);
+            break;
+        }
+        char *name_end = eq;
+        while (name_end > name && (name_end[-1] == ' ' || name_end[-1] == '\t')) name_end--;
+        char *value = eq + 1 + strspn(eq + 1, " \t");
+
+        const config_option *option = find_option(name, (size_t)(name_end - name));
+        if (!option) {
+            *name_end = '\0';
+            result = fail(err, err_size, "%s:%d: unknown setting '%s'", path, line_no, name);
+        } else if (set_option(config, option, value, detail, sizeof(detail)) != 0) {
+            result = fail(err, err_size, "%s:%d: %s", path, line_no, detail);
+        }
+    }
+
+    fclose(file);
+    return result;
+}
+
+/**
+ * @brief Checks what single settings cannot: how they relate to each other and to the system.
+ */
+static int validate(const server_config *config, char *err, size_t err_size) {
+    if (config->max_header_size >= config->input_buffer_size) {
+        return fail(err, err_size, "max_header_size (%llu) must be smaller than input_buffer_size (%llu)",
+                    (unsigned long long)config->max_header_size, (unsigned long long)config->input_buffer_size);
+    }
+    struct stat root;
+    if (stat(config->web_root, &root) != 0 || !S_ISDIR(root.st_mode)) {
+        return fail(err, err_size, "web_root %s is not a directory", config->web_root);
+    }
+    for (const char *p = config->compress_types; *p;) {
+        p += strspn(p, ", \t");
+        size_t len = strcspn(p, ", \t");
+        if (len > 0 && !memchr(p, '/', len)) {
+            return fail(err, err_size, "compress_types entry '%.*s' is not a type/subtype", (int)len, p);
+        }
+        p += len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds and validates a config from defaults, the config file and the arguments.
+ */
+int config_load(server_config *config, int argc, char **argv, char *err, size_t err_size) {
+    config_defaults(config);
+
+    // The file first, wherever --config appears, so that every flag overrides it.
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") != 0) continue;
+        if (i + 1 >= argc) return fail(err, err_size, "--config needs a file name");
+        if (load_file(config, argv[i + 1], err, err_size) != 0) return -1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--config") == 0) {
+            i++;
+            continue;
+        }
+        if (strcmp(arg, "--io-uring") == 0) {
+            config->backend = IO_BACKEND_URING;
+            continue;
+        }
+
+        const config_option *option;
+        if (arg[0] >= '0' && arg[0] <= '9') {
+            option = find_option("port", 4); // The historical positional argument
+        } else if (strncmp(arg, "--", 2) == 0 && (option = find_option(arg + 2, strlen(arg + 2)))) {
+            if (++i >= argc) return fail(err, err_size, "%s needs a value", arg);
+        } else {
+            return fail(err, err_size, "unknown option '%s'", arg);
+        }
+        if (set_option(config, option, argv[i], err, err_size) != 0) return -1;
+    }
+
+    return validate(config, err, err_size);
+}
+
+/**
+ * @brief Loads the startup config, publishes it and remembers the arguments for config_reload.
+ */
+int config_init(int argc, char **argv) {
+    server_config config;
+    char err[512];
+    if (config_load(&config, argc, argv, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Configuration error: %s\n", err);
+        return -1;
+    }
+    saved_argc = argc;
+    saved_argv = argv;
+    return config_publish(&config);
+}
+
+/**
+ * @brief The config in effect.
+ */
+const server_config *config_current(void) {
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Makes a copy of config the one in effect and applies the log level.
+ */
+int config_publish(const server_config *config) {
+    server_config *copy = (server_config *)malloc(sizeof(server_config));
+    if (!copy) {
+        log_error("Memory allocation failed for configuration: %s", strerror(errno));
+        return -1;
+    }
+    *copy = *config;
+    log_set_threshold(copy->log_level);
+    __atomic_store_n(&current, copy, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Re-reads the config file and arguments given to config_init and publishes the result.
+ */
+int config_reload(void) {
+    const server_config *running = config_current();
+    server_config config;
+    char err[512];
+    if (config_load(&config, saved_argc, saved_argv, err, sizeof(err)) != 0) {
+        log_error("Configuration reload failed, keeping the current settings: %s", err);
+        return -1;
+    }
+
+    for (size_t i = 0; i < NUM_OPTIONS; i++) {
+        const config_option *option = &OPTIONS[i];
+        if (!option->startup_only) continue;
+        size_t size = option->type == OPT_STRING ? CONFIG_PATH_MAX
+                    : option->type == OPT_SIZE ? sizeof(uint64_t)
+                    : option->type == OPT_UNSIGNED ? sizeof(unsigned)
+                    : option->type == OPT_BACKEND ? sizeof(io_backend)
+                    : option->type == OPT_PRECOMPRESS ? sizeof(precompress_mode) : sizeof(log_level);
+        char *field = (char *)&config + option->offset;
+        const char *old = (const char *)running + option->offset;
+        int changed = option->type == OPT_STRING ? strcmp(field, old) != 0 : memcmp(field, old, size) != 0;
+        if (changed) {
+            log_warn("Configuration reload: %s only changes on restart; keeping the running value.", option->name);
+            memcpy(field, old, size);
+        }
+    }
+
+    if (config_publish(&config) != 0) {
+        log_error("Configuration reload failed, keeping the current settings.");
+        return -1;
+    }
+    log_info("Configuration reloaded.");
+    return 0;
+}
@@ -0,0 +1,706 @@
+#define _GNU_SOURCE
+#include "include/http_conn.h"
+#include "include/http_handler.h"
+#include "include/http_log.h"
+#include "include/http_metrics.h"
+#include "include/http_config.h"
+#include "include/http_h2.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>     // For splice
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY
+
+// Connections (with their input buffers and arenas) are carved from slabs of this many.
+#define CONN_POOL_SLAB 16
+
+// Each worker creates and destroys its own connections, so its pool needs no lock. Sized on
+// first use from the (startup-only) buffer settings.
+static _Thread_local object_pool conn_pool;
+
+// Upper bound for one sendfile call, so a huge file cannot starve the worker's other connections.
+#define SENDFILE_CHUNK (1 << 20)
+
+// Each worker's timeouts; every connection's timer lives on the wheel of the worker that owns it.
+static _Thread_local timer_wheel conn_timers;
+static _Thread_local int conn_timers_ready;
+static _Thread_local void (*close_expired)(http_conn *conn); // For the duration of conn_expire_timeouts
+
+// Upload bytes moved per splice; matches the default pipe capacity.
+#define BODY_SPLICE_CHUNK 65536
+
+// Each worker's pipe for splicing upload bodies socket -> pipe -> file. Always left empty, so
+// the worker's connections can share it; created on first use.
+static _Thread_local int body_pipe[2] = { -1, -1 };
+
+static void release_chunk_owner(out_chunk *chunk) {
+    if (chunk->file_fd >= 0 && !chunk->release) close(chunk->file_fd);
+    if (chunk->release) chunk->release(chunk->owner);
+}
+
+static void free_chunk(http_conn *conn, out_chunk *chunk) {
+    if (chunk->borrowers > 0) {
+        chunk->orphaned = 1; // Pieces moved to another connection still point into it
+        return;
+    }
+    release_chunk_owner(chunk);
+    if (!arena_owns(&conn->out_arena, chunk)) free(chunk);
+}
+
+/**
+ * @brief Release of a piece queued by conn_output_move. Chunks that get borrowed are never
+ *        carved from an arena, so an orphaned one can be freed without its connection.
+ */
+static void return_moved_piece(void *owner) {
+    out_chunk *chunk = (out_chunk *)owner;
+    if (--chunk->borrowers == 0 && chunk->orphaned) {
+        release_chunk_owner(chunk);
+        free(chunk);
+    }
+}
+
+static out_chunk *new_chunk(http_conn *conn, size_t cap) {
+    out_chunk *chunk = (out_chunk *)arena_alloc(&conn->out_arena, sizeof(out_chunk) + cap);
+    if (!chunk) chunk = (out_chunk *)malloc(sizeof(out_chunk) + cap);
+    if (!chunk) return NULL;
+    chunk->bytes = chunk->data;
+    chunk->file_fd = -1;
+    chunk->file_off = 0;
+    chunk->len = 0;
+    chunk->off = 0;
+    chunk->cap = cap;
+    chunk->refill = NULL;
+    chunk->release = NULL;
+    chunk->owner = NULL;
+    chunk->borrowers = 0;
+    chunk->orphaned = 0;
+    return chunk;
+}
+
+static void append_chunk(http_conn *conn, out_chunk *chunk) {
+    chunk->next = NULL;
+    if (conn->out_tail) conn->out_tail->next = chunk;
+    else conn->out_head = chunk;
+    conn->out_tail = chunk;
+}
+
+/**
+ * @brief Allocates the state machine for a freshly accepted, non-blocking socket.
+ */
+http_conn *conn_create(int fd) {
+    const server_config *config = config_current();
+    if (!conn_pool.object_size) {
+        size_t size = sizeof(http_conn) + config->input_buffer_size + config->output_arena_size;
+        conn_pool = (object_pool)OBJECT_POOL_INIT(size, CONN_POOL_SLAB);
+    }
+
+    http_conn *conn = (http_conn *)pool_alloc(&conn_pool);
+    if (!conn) {
+        log_error("Memory allocation failed for connection: %s", strerror(errno));
+        return NULL;
+    }
+    memset(conn, 0, sizeof(http_conn)); // The buffers behind it need no clearing
+
+    conn->in_buf = (char *)(conn + 1);
+    arena_init(&conn->out_arena, conn->in_buf + config->input_buffer_size, config->output_arena_size);
+
+    // Responses are already coalesced into one write per batch (or corked with MSG_MORE),
+    // so Nagle would only add delayed-ACK stalls.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn->fd = fd;
+    conn->state = CONN_READING;
+    conn->in_cap = config->input_buffer_size;
+    http_request_reset(&conn->request);
+    conn->accepted_ns = metrics_now();
+    metrics_add(METRIC_CONN_ACCEPTED, 1);
+    conn_refresh_timeout(conn); // Until the first request arrives
+    return conn;
+}
+
+/**
+ * @brief Admits a freshly accepted socket and creates its connection.
+ */
+http_conn *conn_accept(int fd, const struct sockaddr_storage *peer) {
+    struct sockaddr_storage looked_up;
+    if (!peer) {
+        socklen_t peer_len = sizeof(looked_up);
+        if (getpeername(fd, (struct sockaddr *)&looked_up, &peer_len) != 0) looked_up.ss_family = AF_UNSPEC;
+        peer = &looked_up;
+    }
+
+    admission_ticket ticket;
+    if (admission_accept(fd, peer, &ticket) != 0) return NULL;
+
+    http_conn *conn = conn_create(fd);
+    if (!conn) {
+        admission_release(&ticket);
+        close(fd);
+        return NULL;
+    }
+    conn->admission = ticket;
+    return conn;
+}
+
+/**
+ * @brief Closes the socket and releases all buffers owned by the connection.
+ */
+void conn_destroy(http_conn *conn) {
+    if (!conn) return;
+    close(conn->fd);
+    metrics_add(METRIC_CONN_CLOSED, 1);
+    admission_release(&conn->admission);
+    timer_cancel(&conn_timers, &conn->timer);
+    body_upload_abort(conn->upload); // Client went away mid-upload
+    conn_output_abort(conn);
+    h2_session_destroy(conn);
+    pool_free(&conn_pool, conn);
+}
+
+/**
+ * @brief Appends response bytes to the connection's output queue.
+ */
+int conn_queue(http_conn *conn, const void *data, size_t len) {
+    const char *bytes = (const char *)data;
+
+    // Top up the last owned chunk. Bytes past its len are never part of an in-flight send.
+    out_chunk *tail = conn->out_tail;
+    if (tail && !tail->refill && tail->len < tail->cap) {
+        size_t room = tail->cap - tail->len;
+        size_t n = len < room ? len : room;
+        memcpy(tail->data + tail->len, bytes, n);
+        tail->len += n;
+        bytes += n;
+        len -= n;
+    }
+    if (len == 0) return 0;
+
+    out_chunk *chunk = new_chunk(conn, len > CONN_CHUNK_MIN ? len : CONN_CHUNK_MIN);
+    if (!chunk) {
+        log_error("Memory allocation failed for connection output buffer: %s", strerror(errno));
+        return -1;
+    }
+    memcpy(chunk->data, bytes, len);
+    chunk->len = len;
+    append_chunk(conn, chunk);
+    return 0;
+}
+
+/**
+ * @brief Queues a borrowed buffer without copying it.
+ */
+int conn_queue_ref(http_conn *conn, const void *data, size_t len, void (*release)(void *), void *owner) {
+    if (len == 0) {
+        release(owner);
+        return 0;
+    }
+
+    out_chunk *chunk = new_chunk(conn, 0);
+    if (!chunk) {
+        log_error("Memory allocation failed for borrowed chunk: %s", strerror(errno));
+        release(owner);
+        return -1;
+    }
+    chunk->bytes = (const char *)data;
+    chunk->len = len;
+    chunk->release = release;
+    chunk->owner = owner;
+    append_chunk(conn, chunk);
+    return 0;
+}
+
+/**
+ * @brief Queues output produced on demand, at most cap bytes at a time.
+ */
+int conn_queue_stream(http_conn *conn, size_t cap, ssize_t (*refill)(void *, char *, size_t),
+                      void (*release)(void *), void *owner) {
+    out_chunk *chunk = new_chunk(conn, cap);
+    if (!chunk) {
+        log_error("Memory allocation failed for stream chunk: %s", strerror(errno));
+        release(owner);
+        return -1;
+    }
+
+    ssize_t produced = refill(owner, chunk->data, cap);
+    if (produced <= 0) {
+        release(owner);
+        if (!arena_owns(&conn->out_arena, chunk)) free(chunk);
+        return produced == 0 ? 0 : -1;
+    }
+    chunk->len = (size_t)produced;
+    chunk->refill = refill;
+    chunk->release = release;
+    chunk->owner = owner;
+    append_chunk(conn, chunk);
+    return 0;
+}
+
+/**
+ * @brief Queues len bytes of an open file, starting at offset, behind any output already queued.
+ */
+int conn_queue_file(http_conn *conn, int file_fd, off_t offset, size_t len) {
+    if (len == 0) {
+        close(file_fd);
+        return 0;
+    }
+
+    out_chunk *chunk = new_chunk(conn, 0);
+    if (!chunk) {
+        log_error("Memory allocation failed for file chunk: %s", strerror(errno));
+        close(file_fd);
+        return -1;
+    }
+    chunk->bytes = NULL;
+    chunk->file_fd = file_fd;
+    chunk->file_off = offset;
+    chunk->len = len;
+    append_chunk(conn, chunk);
+    return 0;
+}
+
+/**
+ * @brief Queues len bytes of a borrowed open file, starting at offset.
+ */
+int conn_queue_file_ref(http_conn *conn, int file_fd, off_t offset, size_t len, void (*release)(void *),
+                        void *owner) {
+    if (len == 0) {
+        release(owner);
+        return 0;
+    }
+
+    out_chunk *chunk = new_chunk(conn, 0);
+    if (!chunk) {
+        log_error("Memory allocation failed for file chunk: %s", strerror(errno));
+        release(owner);
+        return -1;
+    }
+    chunk->bytes = NULL;
+    chunk->file_fd = file_fd;
+    chunk->file_off = offset;
+    chunk->len = len;
+    chunk->release = release;
+    chunk->owner = owner;
+    append_chunk(conn, chunk);
+    return 0;
+}
+
+/**
+ * @brief Accounts for n response bytes accepted by the kernel.
+ */
+void conn_note_sent(http_conn *conn, size_t n) {
+    metrics_add(METRIC_BYTES_OUT, n);
+    if (!conn->first_byte_sent) {
+        conn->first_byte_sent = 1;
+        metrics_observe_stage(STAGE_FIRST_BYTE, metrics_now() - conn->accepted_ns);
+    }
+}
+
+/**
+ * @brief Describes the memory chunks at the front of the output queue for one writev/sendmsg.
+ */
+int conn_output_iov(const http_conn *conn, struct iovec *iov, int max_iov, int *more) {
+    int count = 0;
+    const out_chunk *chunk;
+    for (chunk = conn->out_head; chunk && count < max_iov; chunk = chunk->next) {
+        if (chunk->file_fd >= 0) break;
+        if (chunk->off < chunk->len) {
+            iov[count].iov_base = (void *)(chunk->bytes + chunk->off);
+            iov[count].iov_len = chunk->len - chunk->off;
+            count++;
+        }
+        // A stream's later pieces (and whatever follows them) do not exist yet.
+        if (chunk->refill) {
+            *more = 1;
+            return count;
+        }
+    }
+    *more = (chunk != NULL);
+    return count;
+}
+
+/**
+ * @brief Marks n bytes of queued output as sent, releasing chunks as they are exhausted.
+ */
+void conn_output_advance(http_conn *conn, size_t n) {
+    do {
+        out_chunk *head = conn->out_head;
+        if (!head) return;
+
+        int exhausted;
+        if (head->file_fd >= 0) {
+            size_t step = n < head->len ? n : head->len;
+            head->file_off += step;
+            head->len -= step;
+            n -= step;
+            exhausted = (head->len == 0);
+        } else {
+            size_t left = head->len - head->off;
+            size_t step = n < left ? n : left;
+            head->off += step;
+            n -= step;
+            exhausted = (head->off == head->len);
+        }
+        if (!exhausted) return;
+
+        if (head->refill) {
+            ssize_t produced = head->refill(head->owner, head->data, head->cap);
+            if (produced > 0) {
+                head->off = 0;
+                head->len = (size_t)produced;
+                return;
+            }
+            if (produced < 0) {
+                // The body cannot be completed; anything queued behind it would be misframed.
+                log_error("Response stream failed on socket %d.", conn->fd);
+                conn_output_abort(conn);
+                return;
+            }
+        }
+
+        conn->out_head = head->next;
+        free_chunk(conn, head);
+        if (!conn->out_head) {
+            conn->out_tail = NULL;
+            arena_reset(&conn->out_arena); // Every chunk carved from it is gone
+            if (conn->h2) h2_session_pump(conn); // The streams' next round of DATA frames
+            return;
+        }
+    } while (n > 0);
+}
+
+/**
+ * @brief Drops every queued chunk and marks the connection for closing.
+ */
+void conn_output_abort(http_conn *conn) {
+    while (conn->out_head) {
+        out_chunk *next = conn->out_head->next;
+        free_chunk(conn, conn->out_head);
+        conn->out_head = next;
+    }
+    conn->out_tail = NULL;
+    arena_reset(&conn->out_arena);
+    conn->state = CONN_CLOSING;
+}
+
+/**
+ * @brief Moves up to max bytes from the front of src's output queue to the back of dst's.
+ */
+ssize_t conn_output_move(http_conn *dst, http_conn *src, size_t max) {
+    out_chunk *head = src->out_head;
+    if (!head) return 0;
+
+    size_t n;
+    if (head->refill) {
+        // Its buffer is refilled once this piece is taken, so the piece has to be a copy.
+        n = head->len - head->off < max ? head->len - head->off : max;
+        if (conn_queue(dst, head->bytes + head->off, n) != 0) return -1;
+    } else {
+        int rc;
+        head->borrowers++;
+        if (head->file_fd >= 0) {
+            n = head->len < max ? head->len : max;
+            rc = conn_queue_file_ref(dst, head->file_fd, head->file_off, n, return_moved_piece, head);
+        } else {
+            n = head->len - head->off < max ? head->len - head->off : max;
+            rc = conn_queue_ref(dst, head->bytes + head->off, n, return_moved_piece, head);
+        }
+        if (rc != 0) return -1;
+    }
+    conn_output_advance(src, n); // An exhausted head is orphaned until its pieces are sent
+    return (ssize_t)n;
+}
+
+/**
+ * @brief Runs process_single_request for every complete request in the buffered input.
+ *
+ * Responses are only queued here; the caller flushes them together once the batch is done.
+ */
+void conn_process_input(http_conn *conn) {
+    int result = REQUEST_INCOMPLETE;
+
+    while (conn->state == CONN_READING && conn->in_off < conn->in_len) {
+        if (conn->h2) {
+            h2_process_input(conn); // Consumes every byte it is given
+            return;
+        }
+        if (conn->requests_served == 0 && conn->in_off == 0 && conn->request.pos == 0 && config_current()->http2) {
+            int preface = h2_detect_preface(conn);
+            if (preface < 0) break; // Too few bytes to tell yet
+            if (preface > 0) {
+                if (h2_session_start(conn) != 0) conn->state = CONN_CLOSING;
+                continue;
+            }
+        }
+        conn->in_buf[conn->in_len] = '\0';
+
+        size_t consumed = 0;
+        result = process_single_request(conn, &consumed);
+        if (result == REQUEST_INCOMPLETE) break;
+
+        conn->in_off += consumed;
+        http_request_reset(&conn->request);
+        if (!result) conn->state = CONN_CLOSING; // Anything pipelined behind it is dropped
+    }
+
+    // Move the partial request (if any) to the front so the buffer can keep filling.
+    if (conn->in_off > 0) {
+        memmove(conn->in_buf, conn->in_buf + conn->in_off, conn->in_len - conn->in_off);
+        conn->in_len -= conn->in_off;
+        conn->in_off = 0;
+    }
+
+    if (result == REQUEST_INCOMPLETE && conn->state == CONN_READING && conn->in_len + 1 >= conn->in_cap) {
+        // Buffer is full and still holds no complete request.
+        if (conn->request.header_len == 0) {
+            send_error_response(conn, 431, "Request Header Fields Too Large", "close");
+        } else {
+            send_error_response(conn, 400, "Bad Request", "close");
+        }
+        conn->state = CONN_CLOSING;
+    }
+}
+
+/**
+ * @brief Whether the rest of the current request's body can bypass in_buf: an upload with a
+ *        Content-Length whose buffered bytes have all been written out already.
+ */
+static int body_splice_ready(const http_conn *conn) {
+    return conn->upload && !conn->body.chunked && conn->body.remaining > 0 &&
+           conn->in_len - conn->in_off == conn->request.header_len;
+}
+
+static void body_pipe_reset(void) {
+    close(body_pipe[0]);
+    close(body_pipe[1]);
+    body_pipe[0] = body_pipe[1] = -1;
+}
+
+/**
+ * @brief Moves up to BODY_SPLICE_CHUNK upload bytes from the socket into the upload file
+ *        through the worker's pipe, then lets the handler answer once the body is complete.
+ */
+static conn_io_result splice_body(http_conn *conn) {
+    if (body_pipe[0] < 0 && pipe2(body_pipe, O_CLOEXEC) < 0) {
+        log_error("pipe2 failed: %s", strerror(errno));
+        body_pipe[0] = body_pipe[1] = -1;
+        return CONN_IO_ERROR;
+    }
+
+    size_t want = conn->body.remaining < BODY_SPLICE_CHUNK ? (size_t)conn->body.remaining : BODY_SPLICE_CHUNK;
+    ssize_t moved = splice(conn->fd, NULL, body_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved < 0) {
+        if (errno == EINTR) return CONN_IO_DONE;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return CONN_IO_AGAIN;
+        if (errno == ECONNRESET) log_debug("Client on socket %d reset the connection.", conn->fd);
+        else log_error("Read error on socket %d: %s", conn->fd, strerror(errno));
+        return CONN_IO_ERROR;
+    }
+    if (moved == 0) {
+        log_debug("Client on socket %d disconnected mid-upload.", conn->fd);
+        conn->state = CONN_CLOSING; // conn_destroy discards the partial upload
+        return CONN_IO_DONE;
+    }
+
+    for (ssize_t left = moved; left > 0;) {
+        ssize_t written = splice(body_pipe[0], NULL, conn->upload->fd, NULL, (size_t)left, SPLICE_F_MOVE);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            log_error("Could not write upload body to %s: %s", conn->upload->temp_path, strerror(errno));
+            body_pipe_reset(); // Whatever is left in it belongs to no one now
+            body_upload_abort(conn->upload);
+            conn->upload = NULL;
+            send_error_response(conn, 500, "Internal Server Error", "close");
+            conn->state = CONN_CLOSING;
+            return CONN_IO_DONE;
+        }
+        left -= written;
+    }
+
+    metrics_add(METRIC_BYTES_IN, (uint64_t)moved);
+    conn->body.remaining -= (uint64_t)moved;
+    conn->body.received += (uint64_t)moved;
+    if (conn->body.remaining == 0) conn_process_input(conn);
+    return CONN_IO_DONE;
+}
+
+/**
+ * @brief Reads everything currently available on the socket and runs
+ *        process_single_request for each complete request.
+ *
+ * The socket is edge-triggered, so reading continues until it reports EAGAIN.
+ */
+conn_io_result conn_on_readable(http_conn *conn) {
+    while (conn->state == CONN_READING) {
+        if (body_splice_ready(conn)) {
+            conn_io_result spliced = splice_body(conn);
+            if (spliced != CONN_IO_DONE) return spliced;
+            continue;
+        }
+
+        ssize_t valread = read(conn->fd, conn->in_buf + conn->in_len, conn->in_cap - conn->in_len - 1);
+        if (valread < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return CONN_IO_AGAIN;
+            if (errno == ECONNRESET) log_debug("Client on socket %d reset the connection.", conn->fd);
+            else log_error("Read error on socket %d: %s", conn->fd, strerror(errno));
+            return CONN_IO_ERROR;
+        }
+        if (valread == 0) {
+            log_debug("Client on socket %d disconnected gracefully.", conn->fd);
+            conn->state = CONN_CLOSING; // Still deliver anything already queued
+            break;
+        }
+
+        conn->in_len += valread;
+        metrics_add(METRIC_BYTES_IN, (uint64_t)valread);
+        conn_process_input(conn);
+    }
+
+    return CONN_IO_DONE;
+}
+
+/**
+ * @brief Writes as much queued output as the socket accepts without blocking,
+ *        using sendfile for file chunks.
+ */
+conn_io_result conn_flush(http_conn *conn) {
+    while (conn_has_pending_output(conn)) {
+        out_chunk *head = conn->out_head;
+        ssize_t written;
+        uint64_t write_start = metrics_now();
+
+        if (head->file_fd >= 0) {
+            size_t count = head->len < SENDFILE_CHUNK ? head->len : SENDFILE_CHUNK;
+            off_t offset = head->file_off;
+            written = sendfile(conn->fd, head->file_fd, &offset, count);
+            if (written == 0) {
+                log_error("File shrank while being sent on socket %d.", conn->fd);
+                return CONN_IO_ERROR;
+            }
+        } else {
+            // Every response queued by this batch goes out in one call. MSG_MORE holds back a
+            // short tail (e.g. a header) so it shares a segment with the file data behind it.
+            struct iovec iov[CONN_MAX_IOV];
+            int more = 0;
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = conn_output_iov(conn, iov, CONN_MAX_IOV, &more);
+            written = msg.msg_iovlen > 0 ? sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0))
+                                         : 0; // Drained chunk in front of a file chunk
+        }
+
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return CONN_IO_AGAIN;
+            if (errno == EPIPE || errno == ECONNRESET) {
+                log_debug("Client on socket %d went away mid-response: %s", conn->fd, strerror(errno));
+            } else {
+                log_error("Error writing response data on socket %d: %s", conn->fd, strerror(errno));
+            }
+            return CONN_IO_ERROR;
+        }
+        if (written > 0) {
+            metrics_observe_stage(STAGE_WRITE, metrics_now() - write_start);
+            conn_note_sent(conn, (size_t)written);
+        }
+        conn_output_advance(conn, (size_t)written);
+    }
+
+    return CONN_IO_DONE;
+}
+
+// --- Timeouts ---
+
+static timer_wheel *worker_timers(void) {
+    if (!conn_timers_ready) {
+        timer_wheel_init(&conn_timers, metrics_now() / 1000000);
+        conn_timers_ready = 1;
+    }
+    return &conn_timers;
+}
+
+static conn_timeout_phase current_phase(const http_conn *conn) {
+    if (conn_has_pending_output(conn)) return TIMEOUT_WRITE;
+    if (conn->state == CONN_CLOSING) return TIMEOUT_NONE;
+    if (conn->h2) return h2_session_active(conn) ? TIMEOUT_BODY : TIMEOUT_IDLE;
+    if (conn->request.header_len > 0) return TIMEOUT_BODY;
+    if (conn->in_len > 0 || conn->requests_served == 0) return TIMEOUT_HEADER;
+    return TIMEOUT_IDLE;
+}
+
+/**
+ * @brief Re-arms the connection's timeout after an event.
+ */
+void conn_refresh_timeout(http_conn *conn) {
+    const server_config *config = config_current();
+    const unsigned timeout_ms[] = {
+        [TIMEOUT_HEADER] = config->header_timeout_ms,
+        [TIMEOUT_BODY] = config->body_timeout_ms,
+        [TIMEOUT_IDLE] = config->idle_timeout_ms,
+        [TIMEOUT_WRITE] = config->write_timeout_ms,
+    };
+    timer_wheel *wheel = worker_timers();
+    conn_timeout_phase phase = current_phase(conn);
+
+    if (phase == TIMEOUT_NONE) {
+        timer_cancel(wheel, &conn->timer);
+    } else if (phase != conn->timeout_phase || phase == TIMEOUT_BODY || phase == TIMEOUT_WRITE ||
+               (phase == TIMEOUT_HEADER && conn->timeout_request != conn->requests_served)) {
+        // Header and idle timers are not pushed back by progress: a trickle of bytes must not
+        // keep a connection alive forever.
+        timer_arm(wheel, &conn->timer, metrics_now() / 1000000 + timeout_ms[phase]);
+        conn->timeout_request = conn->requests_served;
+    }
+    conn->timeout_phase = phase;
+}
+
+static void on_timer_expired(timer_node *node) {
+    static const metrics_counter counters[] = {
+        [TIMEOUT_HEADER] = METRIC_TIMEOUT_HEADER,
+        [TIMEOUT_BODY] = METRIC_TIMEOUT_BODY,
+        [TIMEOUT_IDLE] = METRIC_TIMEOUT_IDLE,
+        [TIMEOUT_WRITE] = METRIC_TIMEOUT_WRITE,
+    };
+    static const char *const names[] = {
+        [TIMEOUT_HEADER] = "header", [TIMEOUT_BODY] = "body", [TIMEOUT_IDLE] = "idle", [TIMEOUT_WRITE] = "write",
+    };
+    http_conn *conn = (http_conn *)((char *)node - offsetof(http_conn, timer));
+    conn_timeout_phase phase = conn->timeout_phase;
+    conn->timeout_phase = TIMEOUT_NONE;
+    if (phase == TIMEOUT_NONE) return;
+
+    metrics_add(counters[phase], 1);
+    log_debug("Connection on socket %d timed out (%s).", conn->fd, names[phase]);
+    close_expired(conn);
+}
+
+/**
+ * @brief Turns the calling worker's timer wheel and closes every timed-out connection.
+ */
+void conn_expire_timeouts(void (*close_conn)(http_conn *conn)) {
+    close_expired = close_conn;
+    timer_advance(worker_timers(), metrics_now() / 1000000, on_timer_expired);
+}
+
+/**
+ * @brief How long the calling worker's event loop may wait before conn_expire_timeouts is due.
+ */
+int conn_timeout_wait_ms(void) {
+    return timer_wait_ms(worker_timers());
+}
+
+/**
+ * @brief Returns non-zero while queued output is still waiting for the socket.
+ */
+int conn_has_pending_output(const http_conn *conn) {
+    const out_chunk *head = conn->out_head;
+    if (!head) return 0;
+    if (head->file_fd >= 0) return 1;
+    return head->off < head->len || head->next != NULL;
+}
@@ -0,0 +1,367 @@
+#include "include/http_encoding.h"
+#include "include/http_utils.h"
+#include "include/http_config.h"
+#include "include/http_log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strncasecmp
+#include <stdint.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define QVALUE_ONE 1000
+
+static const char *const CODING_NAMES[CODING_COUNT] = { NULL, "gzip", "br", "zstd" };
+static const char *const ETAG_SUFFIXES[CODING_COUNT] = { "", "-gz", "-br", "-zst" };
+static const char *const FILE_SUFFIXES[CODING_COUNT] = { "", ".gz", ".br", ".zst" };
+
+struct encoder_stream {
+    content_coding coding;
+    gzip_stream *gz;
+#ifdef HAVE_BROTLI
+    BrotliEncoderState *br;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+};
+
+/**
+ * @brief Parses a qvalue ("0", "0.5", "1.000") into thousandths.
+ * @return The weight, or 0 if it is malformed (an element we cannot read is not an offer).
+ */
+static unsigned parse_qvalue(const char *p, size_t len) {
+    if (len == 0 || (p[0] != '0' && p[0] != '1')) return 0;
+    unsigned q = (p[0] - '0') * QVALUE_ONE;
+    if (len > 1) {
+        if (p[1] != '.' || len > 5) return 0;
+        unsigned scale = QVALUE_ONE / 10;
+        for (size_t i = 2; i < len; i++, scale /= 10) {
+            if (p[i] < '0' || p[i] > '9') return 0;
+            q += (p[i] - '0') * scale;
+        }
+    }
+    return q > QVALUE_ONE ? 0 : q;
+}
+
+static int token_is(const char *token, size_t len, const char *name) {
+    return strlen(name) == len && strncasecmp(token, name, len) == 0;
+}
+
+/**
+ * @brief Parses an Accept-Encoding value.
+ */
+void encoding_parse_accept(const char *header, accepted_codings *accepted) {
+    memset(accepted, 0, sizeof(*accepted));
+    accepted->q[CODING_IDENTITY] = 1;
+    if (!header) return;
+
+    int listed[CODING_COUNT] = {0};
+    int star_listed = 0;
+    unsigned star_q = 0;
+    const char *p = header;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (!*p) break;
+        const char *token = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t token_len = (size_t)(p - token);
+
+        // Parameters: only q matters.
+        unsigned q = QVALUE_ONE;
+        while (*p && *p != ',') {
+            if (*p++ != ';') continue;
+            while (*p == ' ' || *p == '\t') p++;
+            if ((*p == 'q' || *p == 'Q') && p[1] == '=') {
+                const char *value = p + 2;
+                p = value;
+                while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+                q = parse_qvalue(value, (size_t)(p - value));
+            }
+        }
+
+        if (token_is(token, token_len, "*")) {
+            star_listed = 1;
+            star_q = q;
+            continue;
+        }
+        for (int c = 0; c < CODING_COUNT; c++) {
+            const char *name = c == CODING_IDENTITY ? "identity" : CODING_NAMES[c];
+            if (token_is(token, token_len, name) || (c == CODING_GZIP && token_is(token, token_len, "x-gzip"))) {
+                accepted->q[c] = (unsigned short)q;
+                listed[c] = 1;
+            }
+        }
+    }
+
+    for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+        if (!listed[c] && star_listed) accepted->q[c] = (unsigned short)star_q;
+    }
+    // Identity stays acceptable unless excluded explicitly or by "*;q=0".
+    if (!listed[CODING_IDENTITY] && star_listed && star_q == 0) accepted->q[CODING_IDENTITY] = 0;
+}
+
+/**
+ * @brief Whether this build can produce the coding.
+ */
+int encoding_supported(content_coding coding) {
+    switch (coding) {
+    case CODING_IDENTITY:
+    case CODING_GZIP:
+        return 1;
+#ifdef HAVE_BROTLI
+    case CODING_BROTLI:
+        return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case CODING_ZSTD:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *encoding_name(content_coding coding) {
+    return CODING_NAMES[coding];
+}
+
+const char *encoding_etag_suffix(content_coding coding) {
+    return ETAG_SUFFIXES[coding];
+}
+
+const char *encoding_file_suffix(content_coding coding) {
+    return FILE_SUFFIXES[coding];
+}
+
+/**
+ * @brief Which coding a file name's suffix says the file holds.
+ */
+content_coding encoding_from_file_name(const char *name, size_t *base_len) {
+    size_t len = strlen(name);
+    for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+        size_t suffix_len = strlen(FILE_SUFFIXES[c]);
+        if (len > suffix_len && strcmp(name + len - suffix_len, FILE_SUFFIXES[c]) == 0) {
+            if (base_len) *base_len = len - suffix_len;
+            return (content_coding)c;
+        }
+    }
+    if (base_len) *base_len = len;
+    return CODING_IDENTITY;
+}
+
+/**
+ * @brief Chooses the smallest ready-made variant among those the client weights highest.
+ */
+content_coding encoding_choose_smallest(const accepted_codings *accepted, const size_t lengths[CODING_COUNT]) {
+    content_coding best = CODING_IDENTITY;
+    unsigned best_q = accepted->q[CODING_IDENTITY];
+    for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+        unsigned q = accepted->q[c];
+        if (q == 0 || lengths[c] == 0) continue;
+        if (q > best_q || (q == best_q && lengths[c] < lengths[best])) {
+            best = (content_coding)c;
+            best_q = q;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Chooses the fastest encoder among those the client weights highest.
+ */
+content_coding encoding_choose_fastest(const accepted_codings *accepted) {
+    static const content_coding by_speed[] = { CODING_ZSTD, CODING_GZIP, CODING_BROTLI };
+    content_coding best = CODING_IDENTITY;
+    unsigned best_q = 0; // Any acceptable coding beats sending the body as it is
+    for (size_t i = 0; i < sizeof(by_speed) / sizeof(by_speed[0]); i++) {
+        content_coding c = by_speed[i];
+        if (accepted->q[c] > best_q && encoding_supported(c)) {
+            best = c;
+            best_q = accepted->q[c];
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Whether responses of this type are compressed.
+ */
+int encoding_type_allowed(const mime_type *mime) {
+    const char *types = config_current()->compress_types;
+    if (!types[0]) return mime->compressible;
+
+    // Comma- or space-separated "type/subtype" entries; "type/*" matches a whole top-level type.
+    size_t type_len = strcspn(mime->type, "; ");
+    for (const char *p = types; *p;) {
+        p += strspn(p, ", \t");
+        size_t len = strcspn(p, ", \t");
+        if (len >= 2 && p[len - 1] == '*' && p[len - 2] == '/') {
+            if (type_len > len - 1 && strncasecmp(mime->type, p, len - 1) == 0) return 1;
+        } else if (len > 0 && len == type_len && strncasecmp(mime->type, p, len) == 0) {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+/**
+ * @brief The configured level of a coding.
+ */
+int encoding_level(content_coding coding) {
+    const server_config *config = config_current();
+    switch (coding) {
+    case CODING_GZIP:
+        return (int)config->gzip_level;
+    case CODING_BROTLI:
+        return (int)config->brotli_level;
+    case CODING_ZSTD:
+        return (int)config->zstd_level;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Compresses data in one piece.
+ */
+unsigned char *encoding_compress(content_coding coding, int level, const unsigned char *data, size_t len,
+                                 size_t *out_len) {
+    *out_len = 0;
+    if (len == 0) return NULL;
+
+    switch (coding) {
+    case CODING_GZIP:
+        return compress_data_gzip(data, len, level, out_len);
+#ifdef HAVE_BROTLI
+    case CODING_BROTLI: {
+        size_t cap = BrotliEncoderMaxCompressedSize(len);
+        unsigned char *out = cap ? (unsigned char *)malloc(cap) : NULL;
+        if (!out) return NULL;
+        if (!BrotliEncoderCompress(level, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, len, data, &cap, out)) {
+            log_error("Brotli compression failed.");
+            free(out);
+            return NULL;
+        }
+        *out_len = cap;
+        return out;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CODING_ZSTD: {
+        size_t cap = ZSTD_compressBound(len);
+        unsigned char *out = (unsigned char *)malloc(cap);
+        if (!out) return NULL;
+        size_t n = ZSTD_compress(out, cap, data, len, level);
+        if (ZSTD_isError(n)) {
+            log_error("zstd compression failed: %s", ZSTD_getErrorName(n));
+            free(out);
+            return NULL;
+        }
+        *out_len = n;
+        return out;
+    }
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Starts an incremental compressor.
+ */
+encoder_stream *encoder_stream_create(content_coding coding, int level) {
+    if (coding == CODING_IDENTITY || !encoding_supported(coding)) return NULL;
+    encoder_stream *stream = (encoder_stream *)calloc(1, sizeof(encoder_stream));
+    if (!stream) return NULL;
+    stream->coding = coding;
+
+    int ok = 0;
+    switch (coding) {
+    case CODING_GZIP:
+        ok = (stream->gz = gzip_stream_create(level)) != NULL;
+        break;
+#ifdef HAVE_BROTLI
+    case CODING_BROTLI:
+        stream->br = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+        ok = stream->br && BrotliEncoderSetParameter(stream->br, BROTLI_PARAM_QUALITY, (uint32_t)level) &&
+             BrotliEncoderSetParameter(stream->br, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case CODING_ZSTD:
+        stream->zstd = ZSTD_createCCtx();
+        ok = stream->zstd && !ZSTD_isError(ZSTD_CCtx_setParameter(stream->zstd, ZSTD_c_compressionLevel, level));
+        break;
+#endif
+    default:
+        break;
+    }
+    if (!ok) {
+        encoder_stream_destroy(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+/**
+ * @brief Feeds input to the compressor and collects whatever output is ready.
+ */
+int encoder_stream_compress(encoder_stream *stream, const unsigned char *in, size_t in_len, int finish,
+                            unsigned char *out, size_t out_cap, size_t *in_used, size_t *out_len) {
+    switch (stream->coding) {
+    case CODING_GZIP:
+        return gzip_stream_compress(stream->gz, in, in_len, finish, out, out_cap, in_used, out_len);
+#ifdef HAVE_BROTLI
+    case CODING_BROTLI: {
+        size_t avail_in = in_len, avail_out = out_cap;
+        const uint8_t *next_in = in;
+        uint8_t *next_out = out;
+        if (!BrotliEncoderCompressStream(stream->br, finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+                                         &avail_in, &next_in, &avail_out, &next_out, NULL)) {
+            log_error("Brotli compression failed.");
+            return -1;
+        }
+        *in_used = in_len - avail_in;
+        *out_len = out_cap - avail_out;
+        return BrotliEncoderIsFinished(stream->br) ? 1 : 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CODING_ZSTD: {
+        ZSTD_inBuffer input = { in, in_len, 0 };
+        ZSTD_outBuffer output = { out, out_cap, 0 };
+        size_t remaining = ZSTD_compressStream2(stream->zstd, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(remaining)) {
+            log_error("zstd compression failed: %s", ZSTD_getErrorName(remaining));
+            return -1;
+        }
+        *in_used = input.pos;
+        *out_len = output.pos;
+        return finish && remaining == 0 ? 1 : 0;
+    }
+#endif
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Releases the compressor.
+ */
+void encoder_stream_destroy(encoder_stream *stream) {
+    if (!stream) return;
+    gzip_stream_destroy(stream->gz);
+#ifdef HAVE_BROTLI
+    if (stream->br) BrotliEncoderDestroyInstance(stream->br);
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(stream->zstd);
+#endif
+    free(stream);
+}
@@ -0,0 +1,277 @@
+#define _GNU_SOURCE // For O_CLOEXEC, strdup and pthread_rwlock_t
+#include "include/http_fdcache.h"
+#include "include/http_watch.h"
+#include "include/http_config.h"
+#include "include/http_mime.h"
+#include "include/http_encoding.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h> // For PATH_MAX
+#include <pthread.h>
+
+#define FD_CACHE_BUCKETS 128 // Hash buckets per shard
+
+typedef struct {
+    // Readers (lookups) share the lock; inserts, evictions and invalidations take it exclusively.
+    pthread_rwlock_t lock;
+    open_file *buckets[FD_CACHE_BUCKETS];
+    open_file *lru_head, *lru_tail;
+    unsigned count;
+} fd_shard;
+
+static fd_shard shards[FD_CACHE_SHARDS];
+static pthread_once_t fd_cache_once = PTHREAD_ONCE_INIT;
+
+// Bumped by every invalidation, so a miss that raced with one does not publish what it opened.
+static unsigned long invalidations; // (atomic)
+
+static void fd_cache_init(void) {
+    for (int i = 0; i < FD_CACHE_SHARDS; i++) {
+        pthread_rwlock_init(&shards[i].lock, NULL);
+    }
+}
+
+/**
+ * @brief FNV-1a over the full path.
+ */
+static unsigned long hash_path(const char *path) {
+    unsigned long hash = 1469598103934665603UL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+static fd_shard *shard_for(unsigned long hash) {
+    return &shards[hash & (FD_CACHE_SHARDS - 1)];
+}
+
+static open_file **bucket_for(fd_shard *shard, unsigned long hash) {
+    return &shard->buckets[(hash / FD_CACHE_SHARDS) % FD_CACHE_BUCKETS];
+}
+
+/**
+ * @brief Drops one reference; the descriptor is closed with the last one.
+ */
+void open_file_release(void *arg) {
+    open_file *file = (open_file *)arg;
+    if (__atomic_sub_fetch(&file->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(file->fd);
+        for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+            if (file->sidecar_fd[c] >= 0) close(file->sidecar_fd[c]);
+        }
+        free(file->path);
+        free(file);
+    }
+}
+
+// --- Shard list maintenance (caller holds the shard's write lock) ---
+
+static void lru_unlink(fd_shard *shard, open_file *file) {
+    if (file->lru_prev) file->lru_prev->lru_next = file->lru_next;
+    else shard->lru_head = file->lru_next;
+    if (file->lru_next) file->lru_next->lru_prev = file->lru_prev;
+    else shard->lru_tail = file->lru_prev;
+    file->lru_prev = file->lru_next = NULL;
+}
+
+static void lru_push_front(fd_shard *shard, open_file *file) {
+    file->lru_prev = NULL;
+    file->lru_next = shard->lru_head;
+    if (shard->lru_head) shard->lru_head->lru_prev = file;
+    else shard->lru_tail = file;
+    shard->lru_head = file;
+}
+
+static void unpublish(fd_shard *shard, open_file *file) {
+    open_file **link = bucket_for(shard, file->hash);
+    while (*link != file) link = &(*link)->hash_next;
+    *link = file->hash_next;
+    lru_unlink(shard, file);
+    shard->count--;
+}
+
+static open_file *find(fd_shard *shard, const char *path, unsigned long hash) {
+    for (open_file *file = *bucket_for(shard, hash); file; file = file->hash_next) {
+        if (file->hash == hash && strcmp(file->path, path) == 0) return file;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens the precompressed siblings worth serving in place of the file. One older than
+ *        the file was written for a previous version of it.
+ */
+static void open_sidecars(open_file *file, const char *full_path) {
+    for (int c = 0; c < CODING_COUNT; c++) file->sidecar_fd[c] = -1;
+    const server_config *config = config_current();
+    if (!config->serve_precompressed || (uint64_t)file->st.st_size < config->compress_min_size ||
+        !encoding_type_allowed(mime_lookup(full_path))) {
+        return;
+    }
+
+    char path[PATH_MAX];
+    for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+        int len = snprintf(path, sizeof(path), "%s%s", full_path, encoding_file_suffix((content_coding)c));
+        if (len < 0 || (size_t)len >= sizeof(path)) continue;
+        int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd == -1) continue;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size < file->st.st_size &&
+            (st.st_mtim.tv_sec > file->st.st_mtim.tv_sec ||
+             (st.st_mtim.tv_sec == file->st.st_mtim.tv_sec && st.st_mtim.tv_nsec >= file->st.st_mtim.tv_nsec))) {
+            file->sidecar_fd[c] = fd;
+            file->sidecar_size[c] = st.st_size;
+        } else {
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief Opens and fstat()s a file. O_NONBLOCK keeps a FIFO in the web root from blocking
+ *        the worker; it has no effect on regular files.
+ */
+static open_file *open_fresh(const char *full_path, unsigned long hash) {
+    int fd = open(full_path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) return NULL;
+
+    open_file *file = (open_file *)calloc(1, sizeof(open_file));
+    if (!file || fstat(fd, &file->st) == -1 || !(file->path = strdup(full_path))) {
+        int saved = errno;
+        if (file) free(file->path);
+        free(file);
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    if (!S_ISREG(file->st.st_mode)) {
+        free(file->path);
+        free(file);
+        close(fd);
+        errno = EISDIR;
+        return NULL;
+    }
+    file->fd = fd;
+    file->hash = hash;
+    file_validators_init(&file->validators, &file->st);
+    open_sidecars(file, full_path);
+    file->refcount = 1;
+    return file;
+}
+
+/**
+ * @brief Returns the open file for a normalized full path.
+ */
+open_file *open_file_get(const char *full_path) {
+    pthread_once(&fd_cache_once, fd_cache_init);
+
+    unsigned long hash = hash_path(full_path);
+    unsigned limit = config_current()->open_file_cache_entries;
+    if (limit == 0 || !watch_active()) return open_fresh(full_path, hash);
+
+    fd_shard *shard = shard_for(hash);
+    pthread_rwlock_rdlock(&shard->lock);
+    open_file *file = find(shard, full_path, hash);
+    if (file) {
+        __atomic_add_fetch(&file->refcount, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&file->referenced, 1, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    if (file) return file;
+
+    unsigned long epoch = __atomic_load_n(&invalidations, __ATOMIC_ACQUIRE);
+    file = open_fresh(full_path, hash);
+    if (!file) return NULL;
+
+    open_file *released = NULL; // Replaced and evicted entries, dropped after unlocking
+    pthread_rwlock_wrlock(&shard->lock);
+    if (__atomic_load_n(&invalidations, __ATOMIC_ACQUIRE) != epoch) {
+        // The file may have changed since it was opened: serve it this once, but do not keep it.
+        pthread_rwlock_unlock(&shard->lock);
+        return file;
+    }
+
+    // A concurrent miss may have opened the same path; the newer one wins.
+    open_file *old = find(shard, full_path, hash);
+    if (old) {
+        unpublish(shard, old);
+        old->hash_next = released;
+        released = old;
+    }
+
+    // Second-chance eviction from the oldest end: recently hit entries get one more round.
+    unsigned shard_limit = (limit + FD_CACHE_SHARDS - 1) / FD_CACHE_SHARDS;
+    while (shard->count >= shard_limit && shard->lru_tail) {
+        open_file *victim = shard->lru_tail;
+        if (__atomic_exchange_n(&victim->referenced, 0, __ATOMIC_RELAXED)) {
+            lru_unlink(shard, victim);
+            lru_push_front(shard, victim);
+            continue;
+        }
+        unpublish(shard, victim);
+        victim->hash_next = released;
+        released = victim;
+    }
+
+    open_file **bucket = bucket_for(shard, hash);
+    file->hash_next = *bucket;
+    *bucket = file;
+    lru_push_front(shard, file);
+    shard->count++;
+    file->refcount = 2; // The cache's reference plus the caller's
+    pthread_rwlock_unlock(&shard->lock);
+
+    while (released) {
+        open_file *next = released->hash_next;
+        open_file_release(released);
+        released = next;
+    }
+    return file;
+}
+
+/**
+ * @brief Forgets the entry for one path, if any.
+ */
+void open_file_invalidate(const char *full_path) {
+    pthread_once(&fd_cache_once, fd_cache_init);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_ACQ_REL);
+
+    unsigned long hash = hash_path(full_path);
+    fd_shard *shard = shard_for(hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    open_file *file = find(shard, full_path, hash);
+    if (file) unpublish(shard, file);
+    pthread_rwlock_unlock(&shard->lock);
+    if (file) open_file_release(file);
+}
+
+/**
+ * @brief Forgets every entry.
+ */
+void open_file_flush(void) {
+    pthread_once(&fd_cache_once, fd_cache_init);
+    __atomic_add_fetch(&invalidations, 1, __ATOMIC_ACQ_REL);
+
+    for (int i = 0; i < FD_CACHE_SHARDS; i++) {
+        fd_shard *shard = &shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+        open_file *list = shard->lru_head;
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->lru_head = shard->lru_tail = NULL;
+        shard->count = 0;
+        pthread_rwlock_unlock(&shard->lock);
+
+        while (list) {
+            open_file *next = list->lru_next;
+            open_file_release(list);
+            list = next;
+        }
+    }
+}
@@ -0,0 +1,1286 @@
+#define _GNU_SOURCE // For memmem
+#include "include/http_h2.h"
+#include "include/http_hpack.h"
+#include "include/http_handler.h"
+#include "include/http_response.h"
+#include "include/http_config.h"
+#include "include/http_metrics.h"
+#include "include/http_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strncasecmp
+#include <stdint.h>
+#include <errno.h>
+
+// Frame types (RFC 9113 6).
+enum {
+    FRAME_DATA,
+    FRAME_HEADERS,
+    FRAME_PRIORITY,
+    FRAME_RST_STREAM,
+    FRAME_SETTINGS,
+    FRAME_PUSH_PROMISE,
+    FRAME_PING,
+    FRAME_GOAWAY,
+    FRAME_WINDOW_UPDATE,
+    FRAME_CONTINUATION
+};
+
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+enum {
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH,
+    SETTINGS_MAX_CONCURRENT_STREAMS,
+    SETTINGS_INITIAL_WINDOW_SIZE,
+    SETTINGS_MAX_FRAME_SIZE,
+    SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+// Error codes (RFC 9113 7).
+enum {
+    H2_NO_ERROR,
+    H2_PROTOCOL_ERROR,
+    H2_INTERNAL_ERROR,
+    H2_FLOW_CONTROL_ERROR,
+    H2_SETTINGS_TIMEOUT,
+    H2_STREAM_CLOSED,
+    H2_FRAME_SIZE_ERROR,
+    H2_REFUSED_STREAM,
+    H2_CANCEL,
+    H2_COMPRESSION_ERROR,
+    H2_CONNECT_ERROR,
+    H2_ENHANCE_YOUR_CALM
+};
+
+#define WINDOW_MAX 0x7fffffff
+#define HEADER_BLOCK_SLACK 1024            // Encoded header block allowed beyond max_header_size
+#define MAX_REQUEST_FIELDS (MAX_HEADERS + 4) // Regular fields plus the pseudo-header fields
+#define RESPONSE_BLOCK_SIZE (RESPONSE_HEAD_SIZE * 2) // Encoded response header block, worst case
+#define UPGRADE_SETTINGS_MAX (6 * 32)       // HTTP2-Settings payload; a longer one is answered as HTTP/1.1
+
+struct h2_stream {
+    http_conn conn;       // What the handler answers on; conn.stream points back here
+    h2_session *session;
+    h2_stream *next;
+    uint32_t id;
+    int64_t send_window;
+    int64_t recv_window;
+    uint32_t recv_unacked; // DATA bytes taken in since its last WINDOW_UPDATE
+    int has_length;        // The request announced a Content-Length, which DATA must match
+    int remote_closed;     // END_STREAM received: the request is complete
+    int responded;         // Handler has run (or an error response was queued)
+    char *fields;          // Decoded request fields, which conn.request points into
+    char *body;            // POST body kept for the echo (up to BODY_ECHO_MAX)
+    size_t body_len;
+    char head[RESPONSE_HEAD_SIZE]; // HTTP/1.1 header block the handler queued
+    size_t head_len;
+};
+
+struct h2_session {
+    http_conn *conn;
+    hpack_table decoder;
+    hpack_table encoder;
+    size_t preface_left; // Bytes of the client preface still expected
+
+    // Frame being read. Payloads are taken in as they arrive; fixed-size fields that straddle
+    // two reads are gathered in scratch.
+    unsigned char header[H2_FRAME_HEADER_SIZE];
+    size_t header_len;
+    int in_frame;
+    unsigned char type;
+    unsigned char flags;
+    uint32_t stream_id;
+    uint32_t frame_len;
+    size_t frame_left;
+    size_t prefix_left; // Pad length and priority fields still to come
+    size_t pad_left;    // Trailing padding
+    unsigned char scratch[16];
+    size_t scratch_len;
+
+    // Header block assembled from HEADERS and CONTINUATION frames.
+    unsigned char *block;
+    size_t block_len;
+    size_t block_cap;
+    uint32_t block_stream; // Nonzero while CONTINUATION frames are expected
+    int block_end_stream;
+
+    // Decoded fields of the block being processed.
+    char *fields;
+    size_t fields_cap;
+
+    // The peer's settings, and the flow-control windows in both directions.
+    uint32_t peer_max_frame;
+    uint32_t peer_initial_window;
+    int64_t send_window;
+    int64_t recv_window;
+    uint32_t recv_unacked;
+
+    h2_stream *streams; // Open streams; the pump starts with the first and rotates
+    h2_stream *streams_tail;
+    unsigned num_streams;
+    unsigned max_streams;
+    uint32_t last_stream_id; // Highest stream the client has opened
+    int goaway_received;     // No new streams; close once the open ones are done
+    int failed;              // GOAWAY sent with an error; nothing more is sent or read
+    int data_queued;         // DATA frames in the connection's queue since it last drained
+};
+
+// --- Wire helpers ---
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void put_frame_header(unsigned char *p, size_t len, int type, int flags, uint32_t stream_id) {
+    p[0] = (unsigned char)(len >> 16);
+    p[1] = (unsigned char)(len >> 8);
+    p[2] = (unsigned char)len;
+    p[3] = (unsigned char)type;
+    p[4] = (unsigned char)flags;
+    put32(p + 5, stream_id & WINDOW_MAX);
+}
+
+/**
+ * @brief Queues a frame whose payload is small enough to copy.
+ */
+static int queue_frame(h2_session *s, int type, int flags, uint32_t stream_id, const void *payload, size_t len) {
+    unsigned char header[H2_FRAME_HEADER_SIZE];
+    put_frame_header(header, len, type, flags, stream_id);
+    if (conn_queue(s->conn, header, sizeof(header)) != 0) return -1;
+    return len > 0 ? conn_queue(s->conn, payload, len) : 0;
+}
+
+static void send_rst(h2_session *s, uint32_t stream_id, uint32_t code) {
+    unsigned char payload[4];
+    put32(payload, code);
+    queue_frame(s, FRAME_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+}
+
+static void send_window_update(h2_session *s, uint32_t stream_id, uint32_t increment) {
+    unsigned char payload[4];
+    put32(payload, increment);
+    queue_frame(s, FRAME_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+/**
+ * @brief Ends the connection over a protocol violation: GOAWAY with the last stream it
+ *        processed, then close once the queue is out. Streams still open are dropped.
+ */
+static void connection_error(h2_session *s, uint32_t code, const char *why) {
+    if (!s->failed) {
+        unsigned char payload[8];
+        put32(payload, s->last_stream_id);
+        put32(payload + 4, code);
+        queue_frame(s, FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+        log_warn("HTTP/2 error on socket %d: %s. Sending GOAWAY...", s->conn->fd, why);
+    }
+    s->failed = 1;
+    s->conn->state = CONN_CLOSING;
+}
+
+// --- Streams ---
+
+static h2_stream *find_stream(const h2_session *s, uint32_t id) {
+    for (h2_stream *st = s->streams; st; st = st->next) {
+        if (st->id == id) return st;
+    }
+    return NULL;
+}
+
+static h2_stream *open_stream(h2_session *s, uint32_t id) {
+    h2_stream *st = (h2_stream *)calloc(1, sizeof(h2_stream));
+    if (!st) return NULL;
+
+    http_conn *conn = &st->conn;
+    conn->fd = s->conn->fd; // For log lines
+    conn->state = CONN_READING;
+    conn->stream = st;
+    arena_init(&conn->out_arena, NULL, 0); // Its chunks are borrowed by DATA frames (conn_output_move)
+    conn->accepted_ns = s->conn->accepted_ns;
+    conn->request_started_ns = metrics_now();
+    http_request_reset(&conn->request);
+
+    st->session = s;
+    st->id = id;
+    st->send_window = s->peer_initial_window;
+    st->recv_window = H2_RECV_WINDOW;
+    if (s->streams_tail) s->streams_tail->next = st;
+    else s->streams = st;
+    s->streams_tail = st;
+    s->num_streams++;
+    metrics_add(METRIC_H2_STREAMS, 1);
+    return st;
+}
+
+/**
+ * @brief Forgets a stream. Pieces of its output already moved into DATA frames stay valid
+ *        (see conn_output_move).
+ */
+static void close_stream(h2_session *s, h2_stream *st) {
+    h2_stream **link = &s->streams, *prev = NULL;
+    while (*link != st) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = st->next;
+    if (s->streams_tail == st) s->streams_tail = prev;
+    s->num_streams--;
+
+    body_upload_abort(st->conn.upload);
+    conn_output_abort(&st->conn);
+    free(st->fields);
+    free(st->body);
+    free(st);
+
+    if (s->goaway_received && s->num_streams == 0) s->conn->state = CONN_CLOSING;
+}
+
+static void reset_stream(h2_session *s, h2_stream *st, uint32_t code) {
+    send_rst(s, st->id, code);
+    close_stream(s, st);
+}
+
+/**
+ * @brief The response has been sent in full. A client still sending its request is told to
+ *        stop (RFC 9113 8.1).
+ */
+static void complete_stream(h2_session *s, h2_stream *st) {
+    if (!st->remote_closed) send_rst(s, st->id, H2_NO_ERROR);
+    close_stream(s, st);
+}
+
+/**
+ * @brief Takes the HTTP/1.1 header block the handler queued on a stream's conn.
+ */
+int h2_stream_set_head(http_conn *stream_conn, const char *head, size_t len) {
+    h2_stream *st = stream_conn->stream;
+    if (st->head_len > 0 || len > sizeof(st->head)) return -1;
+    memcpy(st->head, head, len);
+    st->head_len = len;
+    return 0;
+}
+
+// --- Responses ---
+
+static int is_connection_specific(const char *name, size_t len) {
+    static const char *const names[] = { "connection", "keep-alive", "proxy-connection", "transfer-encoding",
+                                         "upgrade" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == len && strncasecmp(name, names[i], len) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Whether a response field changes with every response, so indexing it would only
+ *        push the reusable ones out of the peer's table.
+ */
+static int is_per_response(const char *name, size_t len) {
+    static const char *const names[] = { "content-length", "etag", "last-modified", "content-range" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == len && memcmp(name, names[i], len) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Re-encodes the stream's HTTP/1.1 header block as one HEADERS frame: the status line
+ *        becomes :status, names are lowercased and connection-specific fields dropped.
+ * @return 0 on success, -1 if the block could not be encoded (the encoder's table may have
+ *         moved on, so the connection cannot continue).
+ */
+static int send_headers(h2_session *s, h2_stream *st, int end_stream) {
+    unsigned char frame[H2_FRAME_HEADER_SIZE + RESPONSE_BLOCK_SIZE];
+    unsigned char *block = frame + H2_FRAME_HEADER_SIZE;
+    size_t len = 0;
+
+    const char *p = st->head, *end = st->head + st->head_len;
+    const char *eol = memmem(p, (size_t)(end - p), "\r\n", 2);
+    if (!eol || eol - p < 12) return -1; // "HTTP/1.1 200"
+    int n = hpack_encode_field(&s->encoder, block, RESPONSE_BLOCK_SIZE, ":status", 7, p + 9, 3, HPACK_INDEX);
+    if (n < 0) return -1;
+    len += (size_t)n;
+
+    for (p = eol + 2; p < end && (eol = memmem(p, (size_t)(end - p), "\r\n", 2)) != NULL && eol > p; p = eol + 2) {
+        const char *colon = memchr(p, ':', (size_t)(eol - p));
+        if (!colon) return -1;
+        size_t name_len = (size_t)(colon - p);
+        if (is_connection_specific(p, name_len)) continue;
+
+        char name[64];
+        if (name_len >= sizeof(name)) return -1;
+        for (size_t i = 0; i < name_len; i++) {
+            name[i] = (p[i] >= 'A' && p[i] <= 'Z') ? (char)(p[i] + 32) : p[i];
+        }
+        const char *value = colon + 1;
+        while (value < eol && *value == ' ') value++;
+
+        n = hpack_encode_field(&s->encoder, block + len, RESPONSE_BLOCK_SIZE - len, name, name_len, value,
+                               (size_t)(eol - value), is_per_response(name, name_len) ? HPACK_NO_INDEX : HPACK_INDEX);
+        if (n < 0) return -1;
+        len += (size_t)n;
+    }
+
+    put_frame_header(frame, len, FRAME_HEADERS, FLAG_END_HEADERS | (end_stream ? FLAG_END_STREAM : 0), st->id);
+    return conn_queue(s->conn, frame, H2_FRAME_HEADER_SIZE + len);
+}
+
+/**
+ * @brief Sends the response the handler has just queued on a stream: HEADERS now (ending the
+ *        stream if there is no body), the body later as DATA (see h2_session_pump).
+ */
+static void finish_response(h2_session *s, h2_stream *st) {
+    st->responded = 1;
+    body_upload_abort(st->conn.upload); // Only left over if the request failed
+    st->conn.upload = NULL;
+
+    if (st->conn.state == CONN_CLOSING || st->head_len == 0) {
+        reset_stream(s, st, H2_INTERNAL_ERROR); // Nothing that can be sent as a response
+        return;
+    }
+    int end_stream = st->conn.out_head == NULL;
+    if (send_headers(s, st, end_stream) != 0) {
+        connection_error(s, H2_INTERNAL_ERROR, "response header block could not be encoded");
+        return;
+    }
+    if (end_stream) complete_stream(s, st);
+}
+
+/**
+ * @brief Answers a stream with an error before its request reaches the router.
+ */
+static void fail_stream(h2_session *s, h2_stream *st, int status_code, const char *status_text) {
+    body_upload_abort(st->conn.upload);
+    st->conn.upload = NULL;
+    send_error_response(&st->conn, status_code, status_text, "keep-alive");
+    metrics_observe_route(ROUTE_OTHER, metrics_now() - st->conn.request_started_ns);
+    finish_response(s, st);
+}
+
+/**
+ * @brief The request is complete: runs the same router as HTTP/1.x and sends what it queued.
+ */
+static void respond(h2_session *s, h2_stream *st) {
+    http_conn *conn = &st->conn;
+    if (st->has_length && conn->body.remaining > 0) {
+        reset_stream(s, st, H2_PROTOCOL_ERROR); // Shorter than its Content-Length: malformed
+        return;
+    }
+
+    metrics_add(METRIC_REQUESTS, 1);
+    if (s->conn->requests_served++ > 0) metrics_add(METRIC_REQUESTS_REUSED, 1);
+
+    // Bodies too long to keep were read and discarded; those get the default page.
+    const char *body = NULL;
+    if (st->body_len == conn->body.received) body = st->body ? st->body : "";
+    dispatch_request(conn, body, st->body_len, "keep-alive");
+    finish_response(s, st);
+}
+
+/**
+ * @brief Takes in DATA bytes for a stream's request body.
+ */
+static void receive_body(h2_session *s, h2_stream *st, const unsigned char *data, size_t len) {
+    http_conn *conn = &st->conn;
+    if (st->has_length) {
+        if (len > conn->body.remaining) {
+            reset_stream(s, st, H2_PROTOCOL_ERROR); // Longer than its Content-Length: malformed
+            return;
+        }
+        conn->body.remaining -= len;
+    }
+    conn->body.received += len;
+    if (conn->body.received > conn->body.limit) {
+        log_warn("Request body on socket %d exceeds %llu bytes. Sending 413 error...", conn->fd,
+                 (unsigned long long)conn->body.limit);
+        fail_stream(s, st, 413, "Content Too Large");
+        return;
+    }
+
+    if (conn->upload) {
+        if (body_upload_write(conn->upload, (const char *)data, len) != 0) {
+            log_error("Could not write upload body to %s: %s", conn->upload->temp_path, strerror(errno));
+            fail_stream(s, st, 500, "Internal Server Error");
+        }
+        return;
+    }
+    if (!http_slice_equals(conn->request.method, "POST") || conn->body.received > BODY_ECHO_MAX) return;
+    if (!st->body && !(st->body = (char *)malloc(BODY_ECHO_MAX))) return; // Answered with the default page
+    memcpy(st->body + st->body_len, data, len);
+    st->body_len += len;
+}
+
+// --- Requests ---
+
+/**
+ * @brief Keeps the decoded fields (laid out back to back in s->fields) with the stream.
+ */
+static int keep_fields(h2_session *s, h2_stream *st, hpack_field *fields, int count) {
+    size_t used = 0;
+    if (count > 0) used = (size_t)(fields[count - 1].value + fields[count - 1].value_len + 1 - s->fields);
+    if (used == 0) return 0;
+    if (!(st->fields = (char *)malloc(used))) return -1;
+    memcpy(st->fields, s->fields, used);
+    for (int i = 0; i < count; i++) {
+        fields[i].name = st->fields + (fields[i].name - s->fields);
+        fields[i].value = st->fields + (fields[i].value - s->fields);
+    }
+    return 0;
+}
+
+/**
+ * @brief Fills in the stream's http_request from its fields, as the HTTP/1.x parser would
+ *        have: :method, :path and :authority (as Host) plus the regular fields.
+ * @return 0 on success, 431 if there are too many fields, -1 if the request is malformed
+ *         (RFC 9113 8.2 and 8.3).
+ */
+static int build_request(h2_stream *st, const hpack_field *fields, int count) {
+    http_request *req = &st->conn.request;
+    const server_config *config = config_current();
+    const hpack_field *authority = NULL;
+    int scheme = 0, regular = 0;
+    size_t size = 0;
+
+    for (int i = 0; i < count; i++) {
+        const hpack_field *f = &fields[i];
+        size += f->name_len + f->value_len + 4; // As it would have been in HTTP/1.1
+        if (memchr(f->value, '\0', f->value_len) || memchr(f->value, '\r', f->value_len) ||
+            memchr(f->value, '\n', f->value_len)) {
+            return -1;
+        }
+
+        if (f->name[0] == ':') {
+            if (regular) return -1; // Pseudo-header fields come first
+            http_slice *slot = NULL;
+            if (strcmp(f->name, ":method") == 0) slot = &req->method;
+            else if (strcmp(f->name, ":path") == 0) slot = &req->target;
+            else if (strcmp(f->name, ":scheme") == 0 && !scheme) scheme = 1;
+            else if (strcmp(f->name, ":authority") == 0 && !authority) authority = f;
+            else return -1;
+            if (slot) {
+                if (slot->ptr) return -1;
+                slot->ptr = f->value;
+                slot->len = f->value_len;
+            }
+            continue;
+        }
+        regular = 1;
+        for (size_t j = 0; j < f->name_len; j++) {
+            if (f->name[j] >= 'A' && f->name[j] <= 'Z') return -1;
+        }
+        if (is_connection_specific(f->name, f->name_len) ||
+            (strcmp(f->name, "te") == 0 && strcmp(f->value, "trailers") != 0)) {
+            return -1;
+        }
+        if (req->num_headers == MAX_HEADERS || req->num_headers >= (int)config->max_headers) return 431;
+        http_header_slice *h = &req->headers[req->num_headers++];
+        h->name.ptr = f->name;
+        h->name.len = f->name_len;
+        h->value.ptr = f->value;
+        h->value.len = f->value_len;
+        int id = http_header_lookup(f->name, f->name_len);
+        if (id >= 0 && !req->known[id]) req->known[id] = (unsigned char)req->num_headers;
+        if (id == HDR_CONTENT_LENGTH && strcmp(req->headers[req->known[id] - 1].value.ptr, f->value) != 0) {
+            return -1; // As in http_parse_request: only the first copy is read, so they must agree
+        }
+    }
+    if (!req->method.ptr || !req->target.ptr || !scheme) return -1;
+    if (req->target.ptr[0] != '/' && strcmp(req->target.ptr, "*") != 0) return -1;
+
+    if (authority && !req->known[HDR_HOST]) {
+        if (req->num_headers == MAX_HEADERS) return 431;
+        http_header_slice *h = &req->headers[req->num_headers++];
+        h->name.ptr = "host";
+        h->name.len = 4;
+        h->value.ptr = authority->value;
+        h->value.len = authority->value_len;
+        req->known[HDR_HOST] = (unsigned char)req->num_headers;
+    }
+    req->version.ptr = "HTTP/2.0";
+    req->version.len = 8;
+    req->header_len = size > 0 ? size : 1;
+    return 0;
+}
+
+/**
+ * @brief Starts a new stream's request: admission, then the body's destination.
+ * @param status 0 if the request was built, otherwise the error status to answer with.
+ */
+static void begin_stream(h2_session *s, h2_stream *st, int status, int end_stream) {
+    http_conn *conn = &st->conn;
+    st->remote_closed = end_stream;
+    if (status == 431) {
+        log_warn("Request header fields too large on socket %d. Sending 431 error...", conn->fd);
+        fail_stream(s, st, 431, "Request Header Fields Too Large");
+        return;
+    }
+
+    shed_reason shed;
+    if (admission_request(&s->conn->admission, &shed) != 0) {
+        admission_count_shed(shed);
+        fail_stream(s, st, 503, "Service Unavailable");
+        return;
+    }
+
+    if (begin_request_body(conn) != 0) {
+        metrics_observe_route(ROUTE_OTHER, metrics_now() - conn->request_started_ns);
+        finish_response(s, st);
+        return;
+    }
+    st->has_length = http_request_header_id(&conn->request, HDR_CONTENT_LENGTH) != NULL;
+    if (conn->body.remaining > conn->body.limit) {
+        fail_stream(s, st, 413, "Content Too Large");
+        return;
+    }
+    if (end_stream) respond(s, st);
+}
+
+/**
+ * @brief Decodes a complete header block and acts on it: a new request, or trailers that end
+ *        one (their fields are not used).
+ */
+static void process_block(h2_session *s) {
+    uint32_t id = s->block_stream;
+    int end_stream = s->block_end_stream;
+    s->block_stream = 0;
+
+    hpack_field fields[MAX_REQUEST_FIELDS];
+    int count = hpack_decode(&s->decoder, s->block, s->block_len, fields, MAX_REQUEST_FIELDS, s->fields,
+                             s->fields_cap);
+    s->block_len = 0;
+    if (count == -1) {
+        connection_error(s, H2_COMPRESSION_ERROR, "undecodable header block");
+        return;
+    }
+
+    h2_stream *st = find_stream(s, id);
+    if (st) {
+        if (st->remote_closed) reset_stream(s, st, H2_STREAM_CLOSED);
+        else if (!end_stream) reset_stream(s, st, H2_PROTOCOL_ERROR); // Trailers must end the stream
+        else if (st->responded) st->remote_closed = 1;
+        else {
+            st->remote_closed = 1;
+            respond(s, st);
+        }
+        return;
+    }
+    if (id <= s->last_stream_id) return; // A stream already reset; its frames are ignored
+    s->last_stream_id = id;
+
+    if (s->goaway_received || s->num_streams >= s->max_streams) {
+        send_rst(s, id, H2_REFUSED_STREAM);
+        return;
+    }
+    if (!(st = open_stream(s, id))) {
+        send_rst(s, id, H2_REFUSED_STREAM);
+        return;
+    }
+
+    int status = 431; // Also for HPACK_TOO_LARGE
+    if (count >= 0) {
+        if (keep_fields(s, st, fields, count) != 0) {
+            reset_stream(s, st, H2_INTERNAL_ERROR);
+            return;
+        }
+        status = build_request(st, fields, count);
+        if (status < 0) {
+            log_warn("Malformed HTTP/2 request on socket %d, stream %u.", s->conn->fd, (unsigned)id);
+            reset_stream(s, st, H2_PROTOCOL_ERROR);
+            return;
+        }
+    }
+    begin_stream(s, st, status, end_stream);
+}
+
+// --- Settings ---
+
+/**
+ * @brief Applies one of the peer's settings.
+ * @return H2_NO_ERROR, or the error code of the connection error it causes.
+ */
+static uint32_t apply_setting(h2_session *s, unsigned id, uint32_t value) {
+    switch (id) {
+    case SETTINGS_HEADER_TABLE_SIZE:
+        hpack_encoder_set_limit(&s->encoder, value);
+        break;
+    case SETTINGS_ENABLE_PUSH:
+        if (value > 1) return H2_PROTOCOL_ERROR;
+        break;
+    case SETTINGS_INITIAL_WINDOW_SIZE: {
+        if (value > WINDOW_MAX) return H2_FLOW_CONTROL_ERROR;
+        int64_t delta = (int64_t)value - s->peer_initial_window;
+        for (h2_stream *st = s->streams; st; st = st->next) {
+            st->send_window += delta;
+            if (st->send_window > WINDOW_MAX) return H2_FLOW_CONTROL_ERROR;
+        }
+        s->peer_initial_window = value;
+        break;
+    }
+    case SETTINGS_MAX_FRAME_SIZE:
+        if (value < H2_MAX_FRAME_SIZE || value > 16777215) return H2_PROTOCOL_ERROR;
+        s->peer_max_frame = value;
+        break;
+    default:
+        break; // Nothing to do for the rest, and unknown settings are ignored
+    }
+    return H2_NO_ERROR;
+}
+
+/**
+ * @brief Queues the server's SETTINGS and opens the connection window as wide as a stream's.
+ */
+static int send_preface(h2_session *s) {
+    const server_config *config = config_current();
+    unsigned char payload[18];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    put32(payload + 2, s->max_streams);
+    payload[6] = 0;
+    payload[7] = SETTINGS_INITIAL_WINDOW_SIZE;
+    put32(payload + 8, H2_RECV_WINDOW);
+    payload[12] = 0;
+    payload[13] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    put32(payload + 14, (uint32_t)config->max_header_size);
+    if (queue_frame(s, FRAME_SETTINGS, 0, 0, payload, sizeof(payload)) != 0) return -1;
+    send_window_update(s, 0, H2_RECV_WINDOW - H2_DEFAULT_WINDOW);
+    s->recv_window = H2_RECV_WINDOW;
+    metrics_add(METRIC_H2_CONNECTIONS, 1);
+    return 0;
+}
+
+// --- Frame reader ---
+
+/**
+ * @brief Checks a frame header against the connection state before its payload is read.
+ * @return 0 to read the payload, -1 after a connection error.
+ */
+static int begin_frame(h2_session *s) {
+    const unsigned char *h = s->header;
+    s->frame_len = ((uint32_t)h[0] << 16) | ((uint32_t)h[1] << 8) | h[2];
+    s->type = h[3];
+    s->flags = h[4];
+    s->stream_id = get32(h + 5) & WINDOW_MAX;
+    s->frame_left = s->frame_len;
+    s->prefix_left = 0;
+    s->pad_left = 0;
+    s->scratch_len = 0;
+
+    if (s->frame_len > H2_MAX_FRAME_SIZE) {
+        connection_error(s, H2_FRAME_SIZE_ERROR, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+        return -1;
+    }
+    if (s->block_stream && (s->type != FRAME_CONTINUATION || s->stream_id != s->block_stream)) {
+        connection_error(s, H2_PROTOCOL_ERROR, "header block interrupted");
+        return -1;
+    }
+
+    size_t fixed = 0; // Payload size of frames that have exactly one
+    int on_stream = 1;
+    switch (s->type) {
+    case FRAME_DATA: {
+        if (s->flags & FLAG_PADDED) s->prefix_left = 1;
+        if (s->stream_id == 0 || s->stream_id > s->last_stream_id) {
+            connection_error(s, H2_PROTOCOL_ERROR, "DATA on an idle stream");
+            return -1;
+        }
+        s->recv_window -= s->frame_len;
+        if (s->recv_window < 0) {
+            connection_error(s, H2_FLOW_CONTROL_ERROR, "connection window exceeded");
+            return -1;
+        }
+        h2_stream *st = find_stream(s, s->stream_id);
+        if (st && st->remote_closed) {
+            reset_stream(s, st, H2_STREAM_CLOSED);
+        } else if (st && (st->recv_window -= s->frame_len) < 0) {
+            reset_stream(s, st, H2_FLOW_CONTROL_ERROR);
+        }
+        break;
+    }
+    case FRAME_HEADERS:
+        if (s->flags & FLAG_PADDED) s->prefix_left += 1;
+        if (s->flags & FLAG_PRIORITY) s->prefix_left += 5;
+        if ((s->stream_id & 1) == 0) {
+            connection_error(s, H2_PROTOCOL_ERROR, "HEADERS on a server-initiated stream");
+            return -1;
+        }
+        s->block_stream = s->stream_id;
+        s->block_end_stream = s->flags & FLAG_END_STREAM;
+        s->block_len = 0;
+        break;
+    case FRAME_CONTINUATION:
+        if (!s->block_stream) {
+            connection_error(s, H2_PROTOCOL_ERROR, "CONTINUATION without HEADERS");
+            return -1;
+        }
+        break;
+    case FRAME_PRIORITY:
+        fixed = 5;
+        break;
+    case FRAME_RST_STREAM:
+        fixed = 4;
+        if (s->stream_id > s->last_stream_id) {
+            connection_error(s, H2_PROTOCOL_ERROR, "RST_STREAM on an idle stream");
+            return -1;
+        }
+        break;
+    case FRAME_SETTINGS:
+        on_stream = 0;
+        if ((s->flags & FLAG_ACK) ? s->frame_len != 0 : s->frame_len % 6 != 0) {
+            connection_error(s, H2_FRAME_SIZE_ERROR, "bad SETTINGS length");
+            return -1;
+        }
+        break;
+    case FRAME_PUSH_PROMISE:
+        connection_error(s, H2_PROTOCOL_ERROR, "PUSH_PROMISE from a client");
+        return -1;
+    case FRAME_PING:
+        on_stream = 0;
+        fixed = 8;
+        break;
+    case FRAME_GOAWAY:
+        on_stream = 0;
+        if (s->frame_len < 8) {
+            connection_error(s, H2_FRAME_SIZE_ERROR, "bad GOAWAY length");
+            return -1;
+        }
+        break;
+    case FRAME_WINDOW_UPDATE:
+        on_stream = -1; // Either
+        fixed = 4;
+        break;
+    default:
+        on_stream = -1; // Unknown types are ignored
+        break;
+    }
+
+    if ((on_stream == 1 && s->stream_id == 0) || (on_stream == 0 && s->stream_id != 0)) {
+        connection_error(s, H2_PROTOCOL_ERROR, "frame on the wrong stream");
+        return -1;
+    }
+    if (fixed && s->frame_len != fixed) {
+        connection_error(s, H2_FRAME_SIZE_ERROR, "bad frame length");
+        return -1;
+    }
+    if (s->prefix_left > s->frame_len) {
+        connection_error(s, H2_PROTOCOL_ERROR, "frame too short for its padding or priority");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Handles the pad length and priority fields once gathered.
+ */
+static int end_prefix(h2_session *s) {
+    if (s->flags & FLAG_PADDED) {
+        s->pad_left = s->scratch[0];
+        if (s->pad_left > s->frame_left) {
+            connection_error(s, H2_PROTOCOL_ERROR, "padding longer than the frame");
+            return -1;
+        }
+    }
+    s->scratch_len = 0;
+    return 0;
+}
+
+/**
+ * @brief Takes in frame content (the payload minus padding fields).
+ */
+static void frame_content(h2_session *s, const unsigned char *p, size_t n) {
+    switch (s->type) {
+    case FRAME_DATA: {
+        h2_stream *st = find_stream(s, s->stream_id);
+        if (st && !st->responded) receive_body(s, st, p, n);
+        break;
+    }
+    case FRAME_HEADERS:
+    case FRAME_CONTINUATION:
+        if (n > s->block_cap - s->block_len) {
+            connection_error(s, H2_ENHANCE_YOUR_CALM, "header block too large");
+            return;
+        }
+        memcpy(s->block + s->block_len, p, n);
+        s->block_len += n;
+        break;
+    case FRAME_SETTINGS:
+        while (n > 0 && !s->failed) {
+            size_t take = 6 - s->scratch_len < n ? 6 - s->scratch_len : n;
+            memcpy(s->scratch + s->scratch_len, p, take);
+            s->scratch_len += take;
+            p += take;
+            n -= take;
+            if (s->scratch_len == 6) {
+                s->scratch_len = 0;
+                uint32_t code = apply_setting(s, ((unsigned)s->scratch[0] << 8) | s->scratch[1], get32(s->scratch + 2));
+                if (code != H2_NO_ERROR) connection_error(s, code, "invalid setting");
+            }
+        }
+        break;
+    case FRAME_PRIORITY:
+    case FRAME_RST_STREAM:
+    case FRAME_PING:
+    case FRAME_GOAWAY:
+    case FRAME_WINDOW_UPDATE: {
+        size_t take = sizeof(s->scratch) - s->scratch_len < n ? sizeof(s->scratch) - s->scratch_len : n;
+        memcpy(s->scratch + s->scratch_len, p, take); // GOAWAY debug data beyond it is dropped
+        s->scratch_len += take;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Credits consumed DATA back to the client once half a window's worth has built up.
+ */
+static void credit_data(h2_session *s, h2_stream *st, uint32_t len) {
+    s->recv_unacked += len;
+    if (s->recv_unacked >= H2_RECV_WINDOW / 2) {
+        send_window_update(s, 0, s->recv_unacked);
+        s->recv_window += s->recv_unacked;
+        s->recv_unacked = 0;
+    }
+    if (st && !st->remote_closed) {
+        st->recv_unacked += len;
+        if (st->recv_unacked >= H2_RECV_WINDOW / 2) {
+            send_window_update(s, st->id, st->recv_unacked);
+            st->recv_window += st->recv_unacked;
+            st->recv_unacked = 0;
+        }
+    }
+}
+
+/**
+ * @brief Acts on a frame once its whole payload has been taken in.
+ */
+static void end_frame(h2_session *s) {
+    h2_stream *st = s->stream_id ? find_stream(s, s->stream_id) : NULL;
+    switch (s->type) {
+    case FRAME_DATA:
+        if (st && (s->flags & FLAG_END_STREAM)) {
+            st->remote_closed = 1;
+            if (!st->responded) respond(s, st);
+            st = NULL; // Nothing more to credit it, and respond may have closed it
+        }
+        credit_data(s, st, s->frame_len);
+        break;
+    case FRAME_HEADERS:
+    case FRAME_CONTINUATION:
+        if (s->flags & FLAG_END_HEADERS) process_block(s);
+        break;
+    case FRAME_RST_STREAM:
+        if (st) close_stream(s, st);
+        break;
+    case FRAME_SETTINGS:
+        if (!(s->flags & FLAG_ACK)) queue_frame(s, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+        break;
+    case FRAME_PING:
+        if (!(s->flags & FLAG_ACK)) queue_frame(s, FRAME_PING, FLAG_ACK, 0, s->scratch, 8);
+        break;
+    case FRAME_GOAWAY:
+        s->goaway_received = 1;
+        if (s->num_streams == 0) s->conn->state = CONN_CLOSING;
+        break;
+    case FRAME_WINDOW_UPDATE: {
+        uint32_t increment = get32(s->scratch) & WINDOW_MAX;
+        if (s->stream_id == 0) {
+            if (increment == 0 || (s->send_window += increment) > WINDOW_MAX) {
+                connection_error(s, increment ? H2_FLOW_CONTROL_ERROR : H2_PROTOCOL_ERROR, "bad WINDOW_UPDATE");
+            }
+        } else if (st) {
+            if (increment == 0) reset_stream(s, st, H2_PROTOCOL_ERROR);
+            else if ((st->send_window += increment) > WINDOW_MAX) reset_stream(s, st, H2_FLOW_CONTROL_ERROR);
+        } else if (s->stream_id > s->last_stream_id) {
+            connection_error(s, H2_PROTOCOL_ERROR, "WINDOW_UPDATE on an idle stream");
+        }
+        break;
+    }
+    default:
+        break; // PRIORITY is advisory; unknown frame types are ignored
+    }
+}
+
+/**
+ * @brief Consumes the frames buffered in in_buf.
+ */
+void h2_process_input(http_conn *conn) {
+    h2_session *s = conn->h2;
+    const unsigned char *p = (const unsigned char *)conn->in_buf + conn->in_off;
+    const unsigned char *end = (const unsigned char *)conn->in_buf + conn->in_len;
+
+    while (p < end && conn->state == CONN_READING && !s->failed) {
+        size_t avail = (size_t)(end - p);
+        if (s->preface_left > 0) {
+            size_t n = avail < s->preface_left ? avail : s->preface_left;
+            if (memcmp(p, H2_PREFACE + (H2_PREFACE_LEN - s->preface_left), n) != 0) {
+                connection_error(s, H2_PROTOCOL_ERROR, "invalid connection preface");
+                break;
+            }
+            p += n;
+            s->preface_left -= n;
+            continue;
+        }
+
+        if (!s->in_frame) {
+            size_t n = H2_FRAME_HEADER_SIZE - s->header_len;
+            if (n > avail) n = avail;
+            memcpy(s->header + s->header_len, p, n);
+            s->header_len += n;
+            p += n;
+            if (s->header_len < H2_FRAME_HEADER_SIZE) break;
+            s->header_len = 0;
+            if (begin_frame(s) != 0) break;
+            s->in_frame = 1;
+        } else if (s->prefix_left > 0) {
+            size_t n = avail < s->prefix_left ? avail : s->prefix_left;
+            memcpy(s->scratch + s->scratch_len, p, n);
+            s->scratch_len += n;
+            s->prefix_left -= n;
+            s->frame_left -= n;
+            p += n;
+            if (s->prefix_left == 0 && end_prefix(s) != 0) break;
+        } else {
+            size_t n = avail < s->frame_left ? avail : s->frame_left;
+            size_t content = s->frame_left - s->pad_left;
+            if (content > 0) {
+                if (n > content) n = content;
+                frame_content(s, p, n);
+            } else {
+                s->pad_left -= n; // Padding is skipped
+            }
+            s->frame_left -= n;
+            p += n;
+        }
+
+        if (s->in_frame && s->frame_left == 0 && !s->failed) {
+            s->in_frame = 0;
+            end_frame(s);
+        }
+    }
+
+    conn->in_off = conn->in_len = 0; // Everything has been taken in
+    h2_session_pump(conn);
+}
+
+// --- Output ---
+
+/**
+ * @brief Moves the next DATA frame's worth of a stream's queued response onto the connection.
+ * @return Payload bytes queued, or -1 on allocation failure.
+ */
+static ssize_t send_data(h2_session *s, h2_stream *st, size_t budget) {
+    http_conn *src = &st->conn;
+    if (src->state == CONN_CLOSING) {
+        reset_stream(s, st, H2_INTERNAL_ERROR); // Its body could not be produced
+        return 0;
+    }
+
+    size_t max = budget < s->peer_max_frame ? budget : s->peer_max_frame;
+    if (st->send_window < (int64_t)max) max = st->send_window > 0 ? (size_t)st->send_window : 0;
+    if (s->send_window < (int64_t)max) max = s->send_window > 0 ? (size_t)s->send_window : 0;
+
+    // What is queued, up to the first stream chunk (whose later pieces do not exist yet).
+    size_t avail = 0;
+    int complete = 1;
+    for (const out_chunk *chunk = src->out_head; chunk; chunk = chunk->next) {
+        avail += chunk->file_fd >= 0 ? chunk->len : chunk->len - chunk->off;
+        if (chunk->refill) {
+            complete = 0;
+            break;
+        }
+    }
+    size_t n = avail < max ? avail : max;
+    int end_stream = complete && n == avail;
+    if (n == 0 && !end_stream) return 0;
+
+    unsigned char header[H2_FRAME_HEADER_SIZE];
+    put_frame_header(header, n, FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, st->id);
+    if (conn_queue(s->conn, header, sizeof(header)) != 0) return -1;
+    for (size_t moved = 0; moved < n;) {
+        ssize_t m = conn_output_move(s->conn, src, n - moved);
+        if (m < 0 || (m == 0 && !src->out_head)) return -1;
+        moved += (size_t)m;
+    }
+    s->send_window -= (int64_t)n;
+    st->send_window -= (int64_t)n;
+    s->data_queued = 1;
+
+    if (end_stream) complete_stream(s, st);
+    return (ssize_t)n;
+}
+
+/**
+ * @brief Moves up to H2_SEND_ROUND of the streams' queued output into DATA frames.
+ */
+void h2_session_pump(http_conn *conn) {
+    h2_session *s = conn->h2;
+    if (!s || s->failed) return;
+    if (!conn->out_head) s->data_queued = 0;
+    if (s->data_queued) return; // Called again once the connection's queue drains
+
+    size_t budget = H2_SEND_ROUND;
+    int progress = 1;
+    while (budget > 0 && progress) {
+        progress = 0;
+        h2_stream *next;
+        for (h2_stream *st = s->streams; st && budget > 0; st = next) {
+            next = st->next;
+            if (!st->responded) continue;
+            ssize_t n = send_data(s, st, budget);
+            if (n < 0) {
+                log_error("Could not queue HTTP/2 DATA on socket %d.", conn->fd);
+                conn_output_abort(conn);
+                s->failed = 1;
+                return;
+            }
+            if (n > 0) {
+                budget -= (size_t)n < budget ? (size_t)n : budget;
+                progress = 1;
+            }
+        }
+    }
+
+    // The next round starts with the next stream, so none is always served first.
+    h2_stream *first = s->streams;
+    if (first && first->next) {
+        s->streams = first->next;
+        first->next = NULL;
+        s->streams_tail->next = first;
+        s->streams_tail = first;
+    }
+}
+
+// --- Session ---
+
+/**
+ * @brief Looks for the client connection preface at the start of a new connection's input.
+ */
+int h2_detect_preface(const http_conn *conn) {
+    size_t have = conn->in_len - conn->in_off;
+    size_t n = have < H2_PREFACE_LEN ? have : H2_PREFACE_LEN;
+    if (memcmp(conn->in_buf + conn->in_off, H2_PREFACE, n) != 0) return 0;
+    return n == H2_PREFACE_LEN ? 1 : -1;
+}
+
+static h2_session *session_create(http_conn *conn) {
+    const server_config *config = config_current();
+    h2_session *s = (h2_session *)calloc(1, sizeof(h2_session));
+    if (!s) return NULL;
+    s->fields_cap = config->max_header_size;
+    s->block_cap = config->max_header_size + HEADER_BLOCK_SLACK;
+    s->fields = (char *)malloc(s->fields_cap);
+    s->block = (unsigned char *)malloc(s->block_cap);
+    if (!s->fields || !s->block) {
+        free(s->fields);
+        free(s->block);
+        free(s);
+        return NULL;
+    }
+    s->conn = conn;
+    hpack_table_init(&s->decoder, HPACK_TABLE_SIZE_DEFAULT);
+    hpack_table_init(&s->encoder, HPACK_TABLE_SIZE_DEFAULT);
+    s->preface_left = H2_PREFACE_LEN;
+    s->peer_max_frame = H2_MAX_FRAME_SIZE;
+    s->peer_initial_window = H2_DEFAULT_WINDOW;
+    s->send_window = H2_DEFAULT_WINDOW;
+    s->recv_window = H2_DEFAULT_WINDOW;
+    s->max_streams = config->http2_max_streams;
+    conn->h2 = s;
+    return s;
+}
+
+/**
+ * @brief Switches a connection to HTTP/2 and queues the server's SETTINGS.
+ */
+int h2_session_start(http_conn *conn) {
+    h2_session *s = session_create(conn);
+    if (!s) {
+        log_error("Memory allocation failed for HTTP/2 session: %s", strerror(errno));
+        return -1;
+    }
+    log_debug("Connection on socket %d switched to HTTP/2.", conn->fd);
+    return send_preface(s);
+}
+
+/**
+ * @brief Whether any stream is still open.
+ */
+int h2_session_active(const http_conn *conn) {
+    return conn->h2 && conn->h2->num_streams > 0;
+}
+
+/**
+ * @brief Releases the session and every stream still open.
+ */
+void h2_session_destroy(http_conn *conn) {
+    h2_session *s = conn->h2;
+    if (!s) return;
+    s->goaway_received = 0; // No state changes on the way out
+    while (s->streams) close_stream(s, s->streams);
+    hpack_table_free(&s->decoder);
+    hpack_table_free(&s->encoder);
+    free(s->fields);
+    free(s->block);
+    free(s);
+    conn->h2 = NULL;
+}
+
+// --- Upgrade from HTTP/1.1 ---
+
+/**
+ * @brief Whether a comma-separated header value lists token (case-insensitively).
+ */
+static int list_has_token(const char *list, const char *token) {
+    size_t token_len = strlen(token);
+    for (const char *p = list; *p;) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        const char *start = p;
+        while (*p && *p != ',') p++;
+        const char *stop = p;
+        while (stop > start && (stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+        if ((size_t)(stop - start) == token_len && strncasecmp(start, token, token_len) == 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Decodes the base64url HTTP2-Settings value (RFC 9113 3.2.1, no padding required).
+ * @return Bytes written, or -1 if it is malformed or longer than cap.
+ */
+static int decode_settings_value(const char *value, unsigned char *out, size_t cap) {
+    size_t len = 0;
+    uint32_t bits = 0;
+    int nbits = 0;
+    for (const char *p = value; *p && *p != '='; p++) {
+        int v;
+        if (*p >= 'A' && *p <= 'Z') v = *p - 'A';
+        else if (*p >= 'a' && *p <= 'z') v = *p - 'a' + 26;
+        else if (*p >= '0' && *p <= '9') v = *p - '0' + 52;
+        else if (*p == '-' || *p == '+') v = 62;
+        else if (*p == '_' || *p == '/') v = 63;
+        else return -1;
+        bits = (bits << 6) | (uint32_t)v;
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            if (len == cap) return -1;
+            out[len++] = (unsigned char)(bits >> nbits);
+        }
+    }
+    return (int)len;
+}
+
+/**
+ * @brief Whether a complete HTTP/1.1 request asks to continue in cleartext HTTP/2.
+ */
+int h2_upgrade_requested(const http_conn *conn) {
+    const http_request *req = &conn->request;
+    if (!config_current()->http2 || conn->upload || !http_slice_equals(req->version, "HTTP/1.1")) return 0;
+    const char *upgrade = http_request_header_id(req, HDR_UPGRADE);
+    const char *connection = http_request_header_id(req, HDR_CONNECTION);
+    return upgrade && connection && http_request_header_id(req, HDR_HTTP2_SETTINGS) &&
+           list_has_token(upgrade, "h2c") && list_has_token(connection, "upgrade");
+}
+
+/**
+ * @brief Copies one field into s->fields, lowercasing the name.
+ */
+static int copy_field(h2_session *s, size_t *used, hpack_field *field, const char *name, size_t name_len,
+                      const char *value, size_t value_len) {
+    if (name_len + value_len + 2 > s->fields_cap - *used) return -1;
+    char *out = s->fields + *used;
+    for (size_t i = 0; i < name_len; i++) out[i] = (name[i] >= 'A' && name[i] <= 'Z') ? (char)(name[i] + 32) : name[i];
+    out[name_len] = '\0';
+    memcpy(out + name_len + 1, value, value_len);
+    out[name_len + 1 + value_len] = '\0';
+    field->name = out;
+    field->name_len = name_len;
+    field->value = out + name_len + 1;
+    field->value_len = value_len;
+    *used += name_len + value_len + 2;
+    return 0;
+}
+
+/**
+ * @brief Answers 101 Switching Protocols and takes the request over as stream 1.
+ */
+int h2_upgrade(http_conn *conn) {
+    const http_request *req = &conn->request;
+    unsigned char settings[UPGRADE_SETTINGS_MAX];
+    int settings_len = decode_settings_value(http_request_header_id(req, HDR_HTTP2_SETTINGS), settings,
+                                             sizeof(settings));
+    if (settings_len < 0 || settings_len % 6 != 0) return -1;
+
+    h2_session *s = session_create(conn);
+    if (!s) return -1;
+
+    // The request as stream 1 (already half-closed: it had no body), minus the fields that
+    // only concerned the HTTP/1.1 connection.
+    hpack_field fields[MAX_REQUEST_FIELDS];
+    int count = 0;
+    size_t used = 0;
+    int ok = copy_field(s, &used, &fields[count++], ":method", 7, req->method.ptr, req->method.len) == 0 &&
+             copy_field(s, &used, &fields[count++], ":scheme", 7, "http", 4) == 0 &&
+             copy_field(s, &used, &fields[count++], ":path", 5, req->target.ptr, req->target.len) == 0;
+    for (int i = 0; ok && i < req->num_headers; i++) { // MAX_HEADERS of them at most, so they fit
+        const http_header_slice *h = &req->headers[i];
+        if (is_connection_specific(h->name.ptr, h->name.len) || strcasecmp(h->name.ptr, "http2-settings") == 0 ||
+            strcasecmp(h->name.ptr, "te") == 0) {
+            continue;
+        }
+        ok = copy_field(s, &used, &fields[count++], h->name.ptr, h->name.len, h->value.ptr, h->value.len) == 0;
+    }
+    if (!ok) {
+        h2_session_destroy(conn);
+        return -1; // Too large to restate; answered as HTTP/1.1 instead
+    }
+
+    static const char SWITCHING[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    if (conn_queue(conn, SWITCHING, sizeof(SWITCHING) - 1) != 0 || send_preface(s) != 0) {
+        h2_session_destroy(conn);
+        conn_output_abort(conn);
+        return 0; // Nothing can be answered now
+    }
+    log_debug("Connection on socket %d upgraded to HTTP/2.", conn->fd);
+
+    for (int i = 0; i + 6 <= settings_len; i += 6) {
+        uint32_t code = apply_setting(s, ((unsigned)settings[i] << 8) | settings[i + 1], get32(settings + i + 2));
+        if (code != H2_NO_ERROR) {
+            connection_error(s, code, "invalid HTTP2-Settings");
+            return 0;
+        }
+    }
+
+    s->last_stream_id = 1;
+    h2_stream *st = open_stream(s, 1);
+    if (!st) {
+        send_rst(s, 1, H2_REFUSED_STREAM);
+        return 0;
+    }
+    st->conn.request_started_ns = conn->request_started_ns;
+    if (keep_fields(s, st, fields, count) != 0) {
+        reset_stream(s, st, H2_INTERNAL_ERROR);
+        return 0;
+    }
+    int status = build_request(st, fields, count);
+    if (status < 0) {
+        reset_stream(s, st, H2_PROTOCOL_ERROR);
+        return 0;
+    }
+    begin_stream(s, st, status, 1);
+    return 0;
+}
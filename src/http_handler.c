@@ -1,295 +1,904 @@
+#define _GNU_SOURCE // For pread
 #include "include/http_handler.h"
+#include "include/http_cache.h"
+#include "include/http_fdcache.h"
+#include "include/http_encoding.h"
+#include "include/http_mime.h"
+#include "include/http_response.h"
+#include "include/http_log.h"
+#include "include/http_metrics.h"
+#include "include/http_body.h"
+#include "include/http_config.h"
+#include "include/http_h2.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <strings.h> // For strcasecmp
 #include <sys/stat.h>
-#include <fcntl.h>
-
-// --- Response Templates ---
-const char *HTTP_200_HEADER_TEMPLATE =
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: %s\r\n"
-    "Content-Length: %zu\r\n"
-    "Connection: %s\r\n"
-    "\r\n";
-
-const char *HTTP_ERROR_HEADER_TEMPLATE =
-    "HTTP/1.1 %d %s\r\n"
-    "Content-Type: text/html\r\n"
-    "Content-Length: %zu\r\n"
-    "Connection: %s\r\n"
-    "\r\n";
+#include <errno.h>
+
+// --- Static Header Fragments ---
+static const char CONTENT_TYPE_HTML[] = "Content-Type: text/html\r\n";
+static const char TRANSFER_ENCODING_CHUNKED[] = "Transfer-Encoding: chunked\r\n";
+static const char VARY_ACCEPT_ENCODING[] = "Vary: Accept-Encoding\r\n";
+static const char CONTENT_TYPE_METRICS[] = "Content-Type: text/plain; version=0.0.4\r\n";
+static const char ACCEPT_RANGES_BYTES[] = "Accept-Ranges: bytes\r\n";
+static const char DEFAULT_PAGE[] = "<h1>OK</h1><p>Request processed successfully.</p>";
+
+#define BODY_LENGTH_UNKNOWN ((size_t)-1) // Access log: streamed body, length not known up front
+
+static void send_metrics_response(http_conn *conn, const char *connection_header);
 
 /**
- * @brief Thread entry point. Implements the persistent connection loop.
+ * @brief Accounts for the response just queued: counts its status and writes the one-line
+ *        access-log record: fd "request line" status body-bytes connection.
  */
-void *client_handler(void *socket_desc) {
-    int client_sock = *(int*)socket_desc;
-    free(socket_desc);
+static void log_access(const http_conn *conn, int status_code, size_t body_len, const char *connection_header) {
+    metrics_count_status(status_code);
+    if (log_threshold > LOG_INFO) return;
 
-    int keep_alive = 1;
-    printf("[Thread %lu] Starting request loop for socket %d...\n", (unsigned long)pthread_self(), client_sock);
+    const http_request *req = &conn->request;
+    char bytes[24] = "-";
+    if (body_len != BODY_LENGTH_UNKNOWN) snprintf(bytes, sizeof(bytes), "%zu", body_len);
+
+    if (req->header_len > 0) {
+        log_info("%d \"%s %s %s\" %d %s %s", conn->fd, req->method.ptr, req->target.ptr, req->version.ptr,
+                 status_code, bytes, connection_header);
+    } else {
+        log_info("%d \"-\" %d %s %s", conn->fd, status_code, bytes, connection_header); // Request never parsed
+    }
+}
 
-    while (keep_alive) {
-        keep_alive = process_single_request(client_sock);
+/**
+ * @brief Maps a request target to its file under the configured web root ("/" is the index page).
+ * @return 0 on success, -1 if the target tries to leave the web root.
+ */
+static int resolve_path(const http_request *req, char *full_path, size_t size, const char **final_path) {
+    const char *path = req->target.ptr;
+    if (strstr(path, "..")) return -1;
+
+    *final_path = strcmp(path, "/") == 0 ? "/index.html" : path;
+    snprintf(full_path, size, "%s/%s", config_current()->web_root, *final_path);
+    path_normalize(full_path); // One cache key (and watch path) per file, however it is spelled
+    return 0;
+}
 
-        if (keep_alive) {
-            printf("[Thread %lu] Connection kept alive. Waiting for next request...\n", (unsigned long)pthread_self());
+/**
+ * @brief Works out how the body of a freshly parsed request is framed and where it goes.
+ */
+int begin_request_body(http_conn *conn) {
+    const http_request *req = &conn->request;
+    const char *transfer_encoding = http_request_header_id(req, HDR_TRANSFER_ENCODING);
+    const char *content_length_str = http_request_header_id(req, HDR_CONTENT_LENGTH);
+    uint64_t content_length = 0;
+
+    conn->body_held = 0;
+    if (transfer_encoding) {
+        // Both framings at once is how requests get smuggled past proxies.
+        if (content_length_str) {
+            send_error_response(conn, 400, "Bad Request", "close");
+            return -1;
+        }
+        if (strcasecmp(transfer_encoding, "chunked") != 0) {
+            send_error_response(conn, 501, "Not Implemented", "close");
+            return -1;
         }
+    } else if (content_length_str && body_parse_content_length(content_length_str, &content_length) != 0) {
+        send_error_response(conn, 400, "Bad Request", "close");
+        return -1;
     }
 
-    printf("[Thread %lu terminated] Closing connection: %d\n", (unsigned long)pthread_self(), client_sock);
-    close(client_sock);
+    int is_put = http_slice_equals(req->method, "PUT");
+    const server_config *config = config_current();
+    body_reader_init(&conn->body, transfer_encoding != NULL, content_length,
+                     is_put ? config->max_upload_size : config->max_body_size);
+    if (!is_put || conn->body.remaining > conn->body.limit) return 0; // Oversized: body_decode reports it
+
+    // A directory cannot be replaced, and "/" would otherwise map to the index page as for GET.
+    if (req->target.len == 0 || req->target.ptr[req->target.len - 1] == '/') {
+        send_error_response(conn, 409, "Conflict", "close");
+        return -1;
+    }
 
-    return NULL;
+    char full_path[BUFFER_SIZE];
+    const char *final_path;
+    struct stat existing;
+    if (resolve_path(req, full_path, sizeof(full_path), &final_path) != 0 ||
+        (stat(full_path, &existing) == 0 && !S_ISREG(existing.st_mode))) {
+        send_error_response(conn, 403, "Forbidden", "close");
+        return -1;
+    }
+
+    conn->upload = body_upload_open(full_path);
+    if (!conn->upload) {
+        int saved = errno;
+        log_warn("Could not create upload file for %s: %s", full_path, strerror(saved));
+        if (saved == ENOENT || saved == ENOTDIR) send_error_response(conn, 404, "Not Found", "close");
+        else if (saved == EACCES || saved == EROFS) send_error_response(conn, 403, "Forbidden", "close");
+        else send_error_response(conn, 500, "Internal Server Error", "close");
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * @brief Handles reading a single request, extracting the URL path, parsing headers, and responding.
+ * @brief Removes n bytes at at from the input buffer, closing the gap.
  */
-int process_single_request(int client_sock) {
-    char buffer[BUFFER_SIZE] = {0};
-    long valread;
-    http_header request_headers[MAX_HEADERS];
-    int num_headers = 0;
-    char *request_body_start = NULL;
-
-    const char *content_length_str = NULL;
-    size_t content_length = 0;
-    size_t body_already_read = 0;
-    char method[16] = {0};
-
-    // Read the client's request
-    valread = read(client_sock, buffer, BUFFER_SIZE - 1);
-
-    if (valread <= 0) {
-        if (valread == 0) printf("Client disconnected gracefully.\n");
-        else perror("Read error");
-        return 0; // Terminate persistent connection
-    }
-
-    buffer[valread] = '\0';
-    printf("--- Request Received by Thread %lu (%ld bytes) ---\n%s\n--------------------------------------\n",
-           (unsigned long)pthread_self(), valread, buffer);
-
-    // --- 1. Extract Method and Path ---
-    char* path = extract_path(buffer);
-    if (!path) {
-        fprintf(stderr, "[Error]: Could not extract a valid path. Sending 400 error...\n");
-        send_error_response(client_sock, 400, "Bad Request", "close");
-        return 0;
+static void drop_input(http_conn *conn, char *at, size_t n) {
+    char *end = conn->in_buf + conn->in_len;
+    memmove(at, at + n, (size_t)(end - (at + n)));
+    conn->in_len -= n;
+}
+
+/**
+ * @brief Ends a request whose body cannot be received: discards any upload and queues the
+ *        error response. The rest of the body is never read, so the connection closes.
+ */
+static void fail_request_body(http_conn *conn, int status_code, const char *status_text) {
+    body_upload_abort(conn->upload);
+    conn->upload = NULL;
+    send_error_response(conn, status_code, status_text, "close");
+}
+
+/**
+ * @brief Decodes whatever part of the body has arrived behind the headers and hands it on,
+ *        so the input buffer never holds more than one read's worth of a large body.
+ * @return BODY_IN_PROGRESS or BODY_COMPLETE; anything else means an error response has
+ *         been queued.
+ */
+static body_status receive_request_body(http_conn *conn, char *request, size_t request_len) {
+    http_request *req = &conn->request;
+    if (!conn->body.chunked && conn->body.remaining == 0) return BODY_COMPLETE; // No body
+
+    char *raw = request + req->header_len + conn->body_held;
+    size_t raw_len = request_len - req->header_len - conn->body_held;
+    size_t consumed = raw_len, decoded = 0;
+    body_status status = body_decode(&conn->body, raw, &consumed, &decoded);
+    if (status == BODY_TOO_LARGE) {
+        log_warn("Request body on socket %d exceeds %llu bytes. Sending 413 error...", conn->fd,
+                 (unsigned long long)conn->body.limit);
+        fail_request_body(conn, 413, "Content Too Large");
+        return status;
+    }
+    if (status == BODY_ERROR) {
+        log_warn("Malformed chunked body on socket %d. Sending 400 error...", conn->fd);
+        fail_request_body(conn, 400, "Bad Request");
+        return status;
+    }
+
+    int echo = http_slice_equals(req->method, "POST") && conn->body.received <= BODY_ECHO_MAX &&
+               req->header_len + BODY_ECHO_MAX + 1 < conn->in_cap;
+    if (echo) {
+        // Keep the decoded bytes where they are, right behind the held ones; drop the framing.
+        conn->body_held += decoded;
+        drop_input(conn, raw + decoded, consumed - decoded);
+        return status;
+    }
+
+    if (conn->upload && decoded > 0 && body_upload_write(conn->upload, raw, decoded) != 0) {
+        log_error("Could not write upload body to %s: %s", conn->upload->temp_path, strerror(errno));
+        fail_request_body(conn, 500, "Internal Server Error");
+        return BODY_ERROR;
+    }
+    // Too long to echo after all: whatever was held goes too.
+    drop_input(conn, raw - conn->body_held, conn->body_held + consumed);
+    conn->body_held = 0;
+    return status;
+}
+
+/**
+ * @brief Moves a completed upload into place and answers 201 (new file) or 204 (replaced).
+ */
+static void send_upload_response(http_conn *conn, const char *connection_header) {
+    int created = 0;
+    body_upload *upload = conn->upload;
+    conn->upload = NULL;
+    if (body_upload_commit(upload, &created) != 0) {
+        log_error("Could not store upload: %s", strerror(errno));
+        send_error_response(conn, 500, "Internal Server Error", connection_header);
+        return;
+    }
+
+    int status = created ? 201 : 204;
+    http_response res;
+    response_begin(&res, status, created ? "Created" : "No Content");
+    if (created) response_add_content_length(&res, 0); // 204 must not carry one
+    response_end(&res, connection_header);
+    if (response_queue(conn, &res) != 0) {
+        log_error("Could not queue response data.");
+        return;
+    }
+    log_access(conn, status, 0, connection_header);
+}
+
+/**
+ * @brief Handles a single request from the connection's input buffer: parses the request
+ *        line and headers in place, receives the body, and queues the response.
+ */
+int process_single_request(http_conn *conn, size_t *consumed) {
+    http_request *req = &conn->request;
+    char *request = conn->in_buf + conn->in_off;
+    size_t request_len = conn->in_len - conn->in_off;
+
+    // --- 1. Parse Request Line and Headers (resumes where the previous read stopped) ---
+    uint64_t parse_start = metrics_now();
+    if (req->pos == 0) conn->request_started_ns = parse_start;
+    int headers_were_complete = req->header_len > 0; // Re-entered while waiting for the body
+
+    parse_result parsed = http_parse_request(req, request, request_len);
+    if (parsed == PARSE_COMPLETE && !headers_were_complete) {
+        metrics_observe_stage(STAGE_PARSE, metrics_now() - parse_start);
     }
-    sscanf(buffer, "%15s", method);
 
-    // --- 2. Read and Parse Headers ---
-    request_body_start = strstr(buffer, "\r\n\r\n");
-    if (request_body_start) {
-        *request_body_start = '\0';
-        request_body_start += 4;
+    // The configured header limits sit below the parser's own (MAX_HEADERS, the input buffer).
+    const server_config *config = config_current();
+    if (parsed == PARSE_INCOMPLETE) {
+        if (request_len <= config->max_header_size) return REQUEST_INCOMPLETE;
+        parsed = PARSE_ERROR;
+        req->error_status = 431;
+    } else if (parsed == PARSE_COMPLETE && !headers_were_complete &&
+               (req->header_len > config->max_header_size || req->num_headers > (int)config->max_headers)) {
+        parsed = PARSE_ERROR;
+        req->error_status = 431;
+    }
+    if (parsed == PARSE_ERROR) {
+        if (req->error_status == 431) {
+            log_warn("Request header fields too large on socket %d. Sending 431 error...", conn->fd);
+            send_error_response(conn, 431, "Request Header Fields Too Large", "close");
+        } else {
+            log_warn("Malformed request line or header on socket %d. Sending 400 error...", conn->fd);
+            send_error_response(conn, 400, "Bad Request", "close");
+        }
+        metrics_observe_route(ROUTE_OTHER, metrics_now() - conn->request_started_ns);
+        return 0;
     }
-    num_headers = parse_headers(buffer, request_headers, MAX_HEADERS);
 
-    // --- Determine Connection Status ---
+    // --- 2. Determine Connection Status ---
     int keep_alive = 1;
     const char *connection_status = "keep-alive";
 
-    const char *conn_header = get_header_value(request_headers, num_headers, "Connection");
+    const char *conn_header = http_request_header_id(req, HDR_CONNECTION);
     if (conn_header && strcasecmp(conn_header, "close") == 0) {
         keep_alive = 0;
         connection_status = "close";
     }
 
-    // --- 3. Read Request Body (for POST/PUT) ---
-    content_length_str = get_header_value(request_headers, num_headers, "Content-Length");
-    if (content_length_str) {
-        content_length = (size_t)atol(content_length_str);
+    // --- 3. Admission: over its rate or behind on events, the request gets the canned 503 ---
+    shed_reason shed;
+    if (!headers_were_complete && admission_request(&conn->admission, &shed) != 0) {
+        size_t shed_len;
+        const char *shed_response = admission_shed_response(&shed_len);
+        conn_queue(conn, shed_response, shed_len);
+        admission_count_shed(shed);
+        log_access(conn, 503, BODY_LENGTH_UNKNOWN, "close");
+        metrics_observe_route(ROUTE_OTHER, metrics_now() - conn->request_started_ns);
+        return 0; // Its body is never read; the connection closes once the 503 is out
     }
 
-    char *body_buffer = NULL;
-    int is_post_or_put = (strcmp(method, "POST") == 0 || strcmp(method, "PUT") == 0);
-
-    if (content_length > 0 && request_body_start) {
-        body_already_read = valread - (request_body_start - buffer);
-        if (body_already_read > content_length) { body_already_read = content_length; }
-
-        if (content_length < BUFFER_SIZE * 2) {
-            body_buffer = (char *)malloc(content_length + 1);
-            if (body_buffer) {
-                memcpy(body_buffer, request_body_start, body_already_read);
-                body_buffer[content_length] = '\0';
+    // --- 4. Receive the Body (decoded chunk by chunk as it arrives) ---
+    if (!headers_were_complete && begin_request_body(conn) != 0) {
+        metrics_observe_route(ROUTE_OTHER, metrics_now() - conn->request_started_ns);
+        return 0;
+    }
 
-                size_t total_read = body_already_read;
-                while (total_read < content_length) {
-                    long current_read = read(client_sock, body_buffer + total_read, content_length - total_read);
-                    if (current_read <= 0) break;
-                    total_read += current_read;
-                }
-            }
-        } else {
-            fprintf(stderr, "[Warning]: Request body too large (%zu bytes). Skipping body read.\n", content_length);
+    body_status body_status = receive_request_body(conn, request, request_len);
+    if (body_status == BODY_IN_PROGRESS) {
+        // A client that asked to be told before sending the body hears back now.
+        const char *expect = http_request_header_id(req, HDR_EXPECT);
+        if (!headers_were_complete && conn->body.received == 0 && expect && strcasecmp(expect, "100-continue") == 0 &&
+            !http_slice_equals(req->version, "HTTP/1.0")) {
+            static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            conn_queue(conn, CONTINUE, sizeof(CONTINUE) - 1);
         }
+        return REQUEST_INCOMPLETE;
     }
+    if (body_status != BODY_COMPLETE) {
+        metrics_observe_route(ROUTE_OTHER, metrics_now() - conn->request_started_ns);
+        return 0;
+    }
+    *consumed = req->header_len + conn->body_held;
 
-    // --- 4. Response (Router) ---
-    if (strcmp(method, "GET") == 0) {
-        send_file_response(client_sock, path, request_headers, num_headers, connection_status);
-    } else if (strcmp(method, "HEAD") == 0) {
-        send_generic_response(client_sock, NULL, connection_status);
-    } else if (is_post_or_put) {
-        send_generic_response(client_sock, body_buffer, connection_status);
-    } else {
-        send_error_response(client_sock, 501, "Not Implemented", connection_status);
+    if (log_threshold <= LOG_DEBUG) {
+        log_debug("Request on socket %d (%zu bytes, body %llu): %s %s %s", conn->fd, *consumed,
+                  (unsigned long long)conn->body.received, req->method.ptr, req->target.ptr, req->version.ptr);
+        for (int i = 0; i < req->num_headers; i++) {
+            log_debug("  %s: %s", req->headers[i].name.ptr, req->headers[i].value.ptr);
+        }
     }
 
-    free(path);
-    if (body_buffer) free(body_buffer);
+    // --- 5. Switch to HTTP/2 if asked to; the request is answered as its first stream ---
+    if (conn->body.received == 0 && h2_upgrade_requested(conn) && h2_upgrade(conn) == 0) return 1;
+
+    // --- 6. Response ---
+    metrics_add(METRIC_REQUESTS, 1);
+    if (conn->requests_served++ > 0) metrics_add(METRIC_REQUESTS_REUSED, 1);
 
+    // Bodies too long to keep were read and discarded; those get the default page.
+    dispatch_request(conn, conn->body_held == conn->body.received ? request + req->header_len : NULL,
+                     conn->body_held, connection_status);
     return keep_alive;
 }
 
 
+/**
+ * @brief Routes a complete request to its response (static files, metrics, uploads, echo).
+ */
+void dispatch_request(http_conn *conn, const char *body, size_t body_len, const char *connection_header) {
+    const http_request *req = &conn->request;
+    metrics_route route;
+    if (http_slice_equals(req->method, "GET") && http_slice_equals(req->target, METRICS_PATH)) {
+        route = ROUTE_METRICS;
+        send_metrics_response(conn, connection_header);
+    } else if (http_slice_equals(req->method, "GET")) {
+        // HTTP/1.0 clients cannot decode chunked bodies.
+        int allow_chunked = !http_slice_equals(req->version, "HTTP/1.0");
+        route = ROUTE_STATIC;
+        send_file_response(conn, req, allow_chunked, connection_header);
+    } else if (http_slice_equals(req->method, "HEAD")) {
+        route = ROUTE_HEAD;
+        send_generic_response(conn, NULL, 0, connection_header);
+    } else if (http_slice_equals(req->method, "PUT")) {
+        route = ROUTE_UPLOAD;
+        send_upload_response(conn, connection_header);
+    } else if (http_slice_equals(req->method, "POST")) {
+        route = ROUTE_ECHO;
+        if (body) {
+            send_generic_response(conn, body, body_len, connection_header);
+        } else {
+            send_generic_response(conn, DEFAULT_PAGE, sizeof(DEFAULT_PAGE) - 1, connection_header);
+        }
+    } else {
+        route = ROUTE_OTHER;
+        send_error_response(conn, 501, "Not Implemented", connection_header);
+    }
+    metrics_observe_route(route, metrics_now() - conn->request_started_ns);
+}
+
 /**
  * @brief Sends an HTTP error response (e.g., 404 Not Found).
  */
-void send_error_response(int client_sock, int status_code, const char *status_text, const char *connection_header) {
+void send_error_response(http_conn *conn, int status_code, const char *status_text, const char *connection_header) {
     char body_buffer[BUFFER_SIZE];
-    snprintf(body_buffer, BUFFER_SIZE,
+    int body_len = snprintf(body_buffer, BUFFER_SIZE,
              "<html><head><title>%d %s</title></head><body><h1>Error %d: %s</h1><p>The requested resource could not be found.</p></body></html>",
              status_code, status_text, status_code, status_text);
 
-    size_t body_len = strlen(body_buffer);
-    char header_buffer[BUFFER_SIZE];
-
-    size_t header_len = snprintf(header_buffer, BUFFER_SIZE, HTTP_ERROR_HEADER_TEMPLATE,
-                                 status_code, status_text, body_len, connection_header);
+    http_response res;
+    response_begin(&res, status_code, status_text);
+    response_add_raw(&res, CONTENT_TYPE_HTML, sizeof(CONTENT_TYPE_HTML) - 1);
+    response_add_content_length(&res, (size_t)body_len);
+    response_end(&res, connection_header);
 
-    write(client_sock, header_buffer, header_len);
-    write(client_sock, body_buffer, body_len);
+    if (response_queue(conn, &res) != 0 || conn_queue(conn, body_buffer, (size_t)body_len) != 0) {
+        log_error("Could not queue response data.");
+        return;
+    }
 
-    printf("[Response Sent]: %d %s (Connection: %s)\n", status_code, status_text, connection_header);
+    log_access(conn, status_code, (size_t)body_len, connection_header);
 }
 
 /**
  * @brief Sends a generic 200 OK response, optionally echoing a body.
  */
-void send_generic_response(int client_sock, const char* body, const char *connection_header) {
-    const char *final_body = body ? body : "<h1>OK</h1><p>Request processed successfully.</p>";
+void send_generic_response(http_conn *conn, const char* body, size_t body_len, const char *connection_header) {
+    const char *final_body = body ? body : DEFAULT_PAGE;
 
-    size_t body_len = strlen(final_body);
-    char header_buffer[BUFFER_SIZE];
+    if (!body) body_len = sizeof(DEFAULT_PAGE) - 1;
 
-    size_t header_len = snprintf(header_buffer, BUFFER_SIZE, HTTP_200_HEADER_TEMPLATE,
-                                 "text/html", body_len, connection_header);
+    http_response res;
+    response_begin(&res, 200, "OK");
+    response_add_raw(&res, CONTENT_TYPE_HTML, sizeof(CONTENT_TYPE_HTML) - 1);
+    response_add_content_length(&res, body_len);
+    response_end(&res, connection_header);
 
-    write(client_sock, header_buffer, header_len);
-    if (body) {
-        write(client_sock, final_body, body_len);
+    if (response_queue(conn, &res) != 0 || (body && conn_queue(conn, final_body, body_len) != 0)) {
+        log_error("Could not queue response data.");
+        return;
     }
 
-    printf("[Response Complete]: 200 OK Generic (Connection: %s, Content-Length: %zu bytes)\n", connection_header, body_len);
+    log_access(conn, 200, body_len, connection_header);
 }
 
 
 /**
- * @brief Attempts to find and send a file located in the WEB_ROOT directory.
+ * @brief Serves the aggregated counters and histograms in Prometheus text format.
  */
-void send_file_response(int client_sock, const char* path, const http_header headers[], int num_headers, const char *connection_header) {
-    char full_path[BUFFER_SIZE];
+static void send_metrics_response(http_conn *conn, const char *connection_header) {
+    size_t body_len = 0;
+    char *body = metrics_render(&body_len);
+    if (!body) {
+        send_error_response(conn, 500, "Internal Server Error", connection_header);
+        return;
+    }
 
-    if (strstr(path, "..")) {
-        send_error_response(client_sock, 403, "Forbidden", connection_header);
+    http_response res;
+    response_begin(&res, 200, "OK");
+    response_add_raw(&res, CONTENT_TYPE_METRICS, sizeof(CONTENT_TYPE_METRICS) - 1);
+    response_add_content_length(&res, body_len);
+    response_end(&res, connection_header);
+
+    if (response_queue(conn, &res) != 0) {
+        free(body);
+        log_error("Could not queue response data.");
+        return;
+    }
+    if (conn_queue_ref(conn, body, body_len, free, body) != 0) {
+        log_error("Could not queue response data.");
         return;
     }
 
-    const char *final_path = path;
-    if (strcmp(path, "/") == 0) {
-        final_path = "/index.html";
+    log_access(conn, 200, body_len, connection_header);
+}
+
+/**
+ * @brief Evaluates the request's preconditions against the representation it would get.
+ *        If-None-Match takes precedence; If-Modified-Since only applies without it.
+ * @return 1 if the client's copy is current and a 304 should be sent instead.
+ */
+static int is_not_modified(const http_request *req, const char *etag, time_t mtime) {
+    const char *if_none_match = http_request_header_id(req, HDR_IF_NONE_MATCH);
+    if (if_none_match) return etag_list_matches(if_none_match, etag);
+
+    const char *if_modified_since = http_request_header_id(req, HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    return if_modified_since && parse_http_date(if_modified_since, &since) == 0 && mtime <= since;
+}
+
+/**
+ * @brief Sends 304 Not Modified with the validators (and Vary) the full response would have carried.
+ */
+static void send_not_modified_response(http_conn *conn, const char *etag, const char *last_modified,
+                                       int negotiated, const char *connection_header) {
+    http_response res;
+    response_begin(&res, 304, "Not Modified");
+    response_add_header(&res, "ETag", etag);
+    response_add_header(&res, "Last-Modified", last_modified);
+    if (negotiated) response_add_raw(&res, VARY_ACCEPT_ENCODING, sizeof(VARY_ACCEPT_ENCODING) - 1);
+    response_end(&res, connection_header);
+
+    if (response_queue(conn, &res) != 0) {
+        log_error("Could not queue response data.");
+        return;
     }
 
-    snprintf(full_path, BUFFER_SIZE, "%s%s", WEB_ROOT, final_path);
+    log_access(conn, 304, 0, connection_header);
+}
 
-    struct stat file_stat;
-    if (stat(full_path, &file_stat) == -1) {
-        send_error_response(client_sock, 404, "Not Found", connection_header);
+/**
+ * @brief Queues a 200 response for a cached file: the prebuilt header fields and a borrowed
+ *        reference to the cached body of the smallest variant the client accepts (no copy,
+ *        no compression), or a 304 if the client's copy is still current.
+ *        Consumes the caller's reference to entry.
+ */
+static void send_cached_response(http_conn *conn, const http_request *req, cache_entry *entry,
+                                 const accepted_codings *accepted, const char *connection_header) {
+    size_t lengths[CODING_COUNT];
+    int negotiated = 0;
+    for (int c = 0; c < CODING_COUNT; c++) {
+        lengths[c] = entry->variants[c].body ? entry->variants[c].len : 0;
+        negotiated |= c != CODING_IDENTITY && entry->variants[c].body;
+    }
+    content_coding coding = encoding_choose_smallest(accepted, lengths);
+    const cache_variant *variant = &entry->variants[coding];
+    const unsigned char *body = variant->body;
+    size_t body_len = variant->len;
+
+    const file_validators *validators = &entry->validators;
+    const char *etag = validators->etag[coding];
+    if (is_not_modified(req, etag, validators->mtime)) {
+        send_not_modified_response(conn, etag, validators->last_modified, negotiated, connection_header);
+        cache_release(entry);
+        return;
+    }
+
+    http_response res;
+    response_begin(&res, 200, "OK");
+    response_add_raw(&res, variant->header, variant->header_len);
+    response_end(&res, connection_header);
+
+    if (coding != CODING_IDENTITY) {
+        metrics_add(METRIC_COMPRESS_IN, entry->variants[CODING_IDENTITY].len);
+        metrics_add(METRIC_COMPRESS_OUT, body_len);
+    }
+
+    if (response_queue(conn, &res) != 0) {
+        cache_release(entry);
+        log_error("Could not queue response data.");
         return;
     }
-    if (!S_ISREG(file_stat.st_mode)) {
-        send_error_response(client_sock, 403, "Forbidden", connection_header);
+    if (conn_queue_ref(conn, body, body_len, cache_release, entry) != 0) {
+        log_error("Could not queue response data.");
         return;
     }
 
-    // --- Read entire file into memory ---
-    size_t file_size = file_stat.st_size;
-    unsigned char *file_content = (unsigned char *)malloc(file_size);
-    if (!file_content) {
-        send_error_response(client_sock, 500, "Internal Server Error", connection_header);
+    log_access(conn, 200, body_len, connection_header);
+}
+
+/**
+ * @brief State of a file being compressed into HTTP chunks one window at a time.
+ */
+typedef struct {
+    open_file *file;
+    off_t file_off; // Next byte to compress; the descriptor is shared, so its position is not used
+    encoder_stream *encoder;
+    unsigned char window[COMPRESS_STREAM_WINDOW];
+    size_t window_len;
+    size_t window_off;
+    int chunked;    // Framed as HTTP/1.1 chunks; an HTTP/2 stream's DATA frames need none
+    int eof;        // Whole file has been read
+    int finished;   // Compressor has terminated its stream
+    int terminated; // Zero-length last chunk has been emitted
+} compressed_file_stream;
+
+static void release_compressed_file_stream(void *owner) {
+    compressed_file_stream *stream = (compressed_file_stream *)owner;
+    open_file_release(stream->file);
+    encoder_stream_destroy(stream->encoder);
+    free(stream);
+}
+
+/**
+ * @brief Produces the next HTTP chunk: "<size>\r\n<compressed bytes>\r\n", plus the final
+ *        "0\r\n\r\n" once the compressor is done (or just the bytes, unchunked). Reads more of
+ *        the file only as needed.
+ */
+static ssize_t refill_compressed_file_stream(void *owner, char *buf, size_t cap) {
+    compressed_file_stream *stream = (compressed_file_stream *)owner;
+    if (stream->terminated) return 0;
+
+    // Fixed-width size line (leading zeros are valid) so the payload can be written in place.
+    const size_t prefix_len = stream->chunked ? 10 : 0; // 8 hex digits + CRLF
+    unsigned char *payload = (unsigned char *)buf + prefix_len;
+    size_t payload_cap = cap - prefix_len - (stream->chunked ? COMPRESS_STREAM_FRAMING_TAIL : 0);
+    size_t produced = 0;
+
+    // Encoders buffer internally, so keep feeding windows until one emits something.
+    while (produced == 0 && !stream->finished) {
+        if (stream->window_off == stream->window_len && !stream->eof) {
+            uint64_t read_start = metrics_now();
+            ssize_t n = pread(stream->file->fd, stream->window, COMPRESS_STREAM_WINDOW, stream->file_off);
+            metrics_observe_stage(STAGE_FILE_IO, metrics_now() - read_start);
+            if (n < 0) {
+                log_error("Error reading file for compression: %s", strerror(errno));
+                return -1;
+            }
+            stream->file_off += n;
+            stream->window_len = (size_t)n;
+            stream->window_off = 0;
+            if (n == 0) stream->eof = 1;
+        }
+
+        size_t used = 0, out = 0;
+        uint64_t compress_start = metrics_now();
+        int rc = encoder_stream_compress(stream->encoder, stream->window + stream->window_off,
+                                         stream->window_len - stream->window_off, stream->eof,
+                                         payload, payload_cap, &used, &out);
+        metrics_observe_stage(STAGE_COMPRESS, metrics_now() - compress_start);
+        if (rc < 0) return -1;
+        metrics_add(METRIC_COMPRESS_IN, used);
+        metrics_add(METRIC_COMPRESS_OUT, out);
+        if (rc == 1) stream->finished = 1;
+        stream->window_off += used;
+        produced += out;
+    }
+
+    size_t len = 0;
+    if (!stream->chunked) {
+        stream->terminated = stream->finished;
+        return (ssize_t)produced;
+    }
+    if (produced > 0) {
+        char size_line[16];
+        snprintf(size_line, sizeof(size_line), "%08x\r\n", (unsigned)produced);
+        memcpy(buf, size_line, prefix_len);
+        len = prefix_len + produced;
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+    }
+    if (stream->finished) {
+        memcpy(buf + len, "0\r\n\r\n", 5);
+        len += 5;
+        stream->terminated = 1;
+    }
+    return (ssize_t)len;
+}
+
+/**
+ * @brief Queues a compressed response for a file too large to cache. The body is compressed
+ *        incrementally as the socket drains, so memory stays at one window per response.
+ *        Takes over the caller's reference to file.
+ */
+static void send_compressed_stream_response(http_conn *conn, open_file *file, content_coding coding,
+                                            const char *mime_type, const char *connection_header) {
+    compressed_file_stream *stream = (compressed_file_stream *)calloc(1, sizeof(compressed_file_stream));
+    if (stream) stream->encoder = encoder_stream_create(coding, encoding_level(coding));
+    if (!stream || !stream->encoder) {
+        free(stream);
+        open_file_release(file);
+        send_error_response(conn, 500, "Internal Server Error", connection_header);
         return;
     }
+    stream->file = file;
+    stream->chunked = conn->stream == NULL;
+
+    http_response res;
+    response_begin(&res, 200, "OK");
+    response_add_header(&res, "Content-Type", mime_type);
+    response_add_header(&res, "Content-Encoding", encoding_name(coding));
+    if (stream->chunked) response_add_raw(&res, TRANSFER_ENCODING_CHUNKED, sizeof(TRANSFER_ENCODING_CHUNKED) - 1);
+    response_add_raw(&res, VARY_ACCEPT_ENCODING, sizeof(VARY_ACCEPT_ENCODING) - 1);
+    response_add_header(&res, "ETag", file->validators.etag[coding]);
+    response_add_header(&res, "Last-Modified", file->validators.last_modified);
+    response_end(&res, connection_header);
+
+    if (response_queue(conn, &res) != 0) {
+        release_compressed_file_stream(stream);
+        log_error("Could not queue response data.");
+        return;
+    }
+    if (conn_queue_stream(conn, COMPRESS_STREAM_CHUNK_SIZE, refill_compressed_file_stream,
+                          release_compressed_file_stream, stream) != 0) {
+        // The header is already queued, so the response can only be cut short.
+        conn_output_abort(conn);
+        return;
+    }
+
+    log_access(conn, 200, BODY_LENGTH_UNKNOWN, connection_header);
+}
 
-    int file_fd = open(full_path, O_RDONLY);
-    if (file_fd == -1 || read(file_fd, file_content, file_size) != (ssize_t)file_size) {
-        close(file_fd);
-        free(file_content);
-        send_error_response(client_sock, 500, "Internal Server Error", connection_header);
+/**
+ * @brief Decides whether a Range header may be honoured: without If-Range always; with it
+ *        only if the entity tag (strong comparison) or the date still names this version.
+ */
+static int if_range_matches(const http_request *req, const file_validators *validators) {
+    const char *if_range = http_request_header_id(req, HDR_IF_RANGE);
+    if (!if_range) return 1;
+    if (if_range[0] == '"') return strcmp(if_range, validators->etag[CODING_IDENTITY]) == 0;
+    if (strncmp(if_range, "W/", 2) == 0) return 0; // Weak tags never match here
+
+    time_t date;
+    return parse_http_date(if_range, &date) == 0 && date == validators->mtime;
+}
+
+/**
+ * @brief Formats one multipart/byteranges part header (with the CRLF ending the previous part).
+ * @return Length written; the part header always fits in cap.
+ */
+static int format_part_header(char *buf, size_t cap, const char *boundary, const char *mime_type,
+                              const byte_range *range, off_t file_size) {
+    return snprintf(buf, cap, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                    boundary, mime_type, (long long)range->first, (long long)range->last, (long long)file_size);
+}
+
+/**
+ * @brief Sends 416 with the "bytes * /size" Content-Range the client needs to retry.
+ */
+static void send_range_not_satisfiable_response(http_conn *conn, off_t file_size, const char *connection_header) {
+    char content_range[64];
+    snprintf(content_range, sizeof(content_range), "bytes */%lld", (long long)file_size);
+
+    http_response res;
+    response_begin(&res, 416, "Range Not Satisfiable");
+    response_add_header(&res, "Content-Range", content_range);
+    response_add_content_length(&res, 0);
+    response_end(&res, connection_header);
+
+    if (response_queue(conn, &res) != 0) {
+        log_error("Could not queue response data.");
         return;
     }
-    close(file_fd);
 
-    // --- Check for compression eligibility ---
-    const char *mime_type = get_mime_type(final_path);
-    const char *accept_encoding = get_header_value(headers, num_headers, "Accept-Encoding");
+    log_access(conn, 416, 0, connection_header);
+}
 
-    unsigned char *output_content = file_content;
-    size_t output_size = file_size;
-    const char *content_encoding = NULL;
+/**
+ * @brief Queues a 206 response: one range as a plain body, several as multipart/byteranges.
+ *        Every range is a file chunk sent from its offset (sendfile/splice), never read into
+ *        memory; only the part headers are copied. Takes over the caller's reference to file.
+ */
+static void send_range_response(http_conn *conn, open_file *file, off_t file_size, const char *mime_type,
+                                const file_validators *validators, const byte_range *ranges, int num_ranges,
+                                const char *connection_header) {
+    http_response res;
+    response_begin(&res, 206, "Partial Content");
+    response_add_raw(&res, ACCEPT_RANGES_BYTES, sizeof(ACCEPT_RANGES_BYTES) - 1);
+    response_add_header(&res, "ETag", validators->etag[CODING_IDENTITY]);
+    response_add_header(&res, "Last-Modified", validators->last_modified);
+
+    char part_header[512];
+    char boundary[24];
+    size_t body_len = 0;
+
+    if (num_ranges == 1) {
+        snprintf(part_header, sizeof(part_header), "bytes %lld-%lld/%lld", (long long)ranges[0].first,
+                 (long long)ranges[0].last, (long long)file_size);
+        body_len = (size_t)(ranges[0].last - ranges[0].first + 1);
+        response_add_header(&res, "Content-Type", mime_type);
+        response_add_header(&res, "Content-Range", part_header);
+    } else {
+        snprintf(boundary, sizeof(boundary), "%016llx",
+                 (unsigned long long)(metrics_now() ^ (uint64_t)validators->mtime));
+        for (int i = 0; i < num_ranges; i++) {
+            body_len += (size_t)format_part_header(part_header, sizeof(part_header), boundary, mime_type,
+                                                   &ranges[i], file_size);
+            body_len += (size_t)(ranges[i].last - ranges[i].first + 1);
+        }
+        body_len += strlen(boundary) + 8; // "\r\n--" boundary "--\r\n"
 
-    int is_compressible =
-        (strcmp(mime_type, "text/html") == 0 ||
-         strcmp(mime_type, "text/css") == 0 ||
-         strcmp(mime_type, "application/javascript") == 0);
+        char content_type[64];
+        snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+        response_add_header(&res, "Content-Type", content_type);
+    }
+    response_add_content_length(&res, body_len);
+    response_end(&res, connection_header);
 
-    if (is_compressible && accept_encoding && strstr(accept_encoding, "gzip")) {
-        size_t compressed_len = 0;
-        unsigned char *compressed_data = compress_data_gzip(file_content, file_size, &compressed_len);
+    if (response_queue(conn, &res) != 0) {
+        open_file_release(file);
+        log_error("Could not queue response data.");
+        return;
+    }
 
-        if (compressed_data && compressed_len > 0 && compressed_len < file_size) {
-            output_content = compressed_data;
-            output_size = compressed_len;
-            content_encoding = "gzip";
-            free(file_content);
-        } else if (compressed_data) {
-            free(compressed_data);
+    int queued = 0;
+    if (num_ranges == 1) {
+        queued = conn_queue_file_ref(conn, file->fd, ranges[0].first, body_len, open_file_release, file);
+    } else {
+        // Every part sends from the same shared descriptor and holds its own reference to it.
+        for (int i = 0; i < num_ranges && queued == 0; i++) {
+            int part_len = format_part_header(part_header, sizeof(part_header), boundary, mime_type,
+                                              &ranges[i], file_size);
+            if (conn_queue(conn, part_header, (size_t)part_len) != 0) {
+                queued = -1;
+                break;
+            }
+            __atomic_add_fetch(&file->refcount, 1, __ATOMIC_RELAXED);
+            queued = conn_queue_file_ref(conn, file->fd, ranges[i].first,
+                                         (size_t)(ranges[i].last - ranges[i].first + 1), open_file_release, file);
+        }
+        open_file_release(file);
+        if (queued == 0) {
+            int end_len = snprintf(part_header, sizeof(part_header), "\r\n--%s--\r\n", boundary);
+            queued = conn_queue(conn, part_header, (size_t)end_len);
         }
     }
 
-    // --- Build and send Header ---
-    char header_buffer[BUFFER_SIZE * 2];
-    size_t header_len;
+    if (queued != 0) {
+        // The header is already queued, so the response can only be cut short.
+        log_error("Could not queue response data.");
+        conn_output_abort(conn);
+        return;
+    }
 
-    if (content_encoding) {
-        header_len = snprintf(header_buffer, BUFFER_SIZE * 2,
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Type: %s\r\n"
-            "Content-Encoding: %s\r\n"
-            "Content-Length: %zu\r\n"
-            "Connection: %s\r\n"
-            "\r\n",
-            mime_type, content_encoding, output_size, connection_header);
+    log_access(conn, 206, body_len, connection_header);
+}
 
-    } else {
-        header_len = snprintf(header_buffer, BUFFER_SIZE * 2, HTTP_200_HEADER_TEMPLATE,
-                              mime_type, output_size, connection_header);
+/**
+ * @brief Attempts to find and send a file located in the web root directory.
+ */
+void send_file_response(http_conn *conn, const http_request *req, int allow_chunked, const char *connection_header) {
+    char full_path[BUFFER_SIZE];
+    const char *final_path;
+    if (resolve_path(req, full_path, sizeof(full_path), &final_path) != 0) {
+        send_error_response(conn, 403, "Forbidden", connection_header);
+        return;
     }
 
-    if (write(client_sock, header_buffer, header_len) != -1 &&
-        write(client_sock, output_content, output_size) != -1) {
-        printf("[Response Complete]: Sent %zu bytes (%s). Connection: %s.\n",
-           output_size, content_encoding ? content_encoding : "uncompressed", connection_header);
+    accepted_codings accepted;
+    encoding_parse_accept(http_request_header_id(req, HDR_ACCEPT_ENCODING), &accepted);
+    const char *range_header = http_request_header_id(req, HDR_RANGE);
+
+    // --- Hot path: serve straight from the content cache (ranges are sent from the file) ---
+    // Keyed by the full path, so a web root changed by a reload never serves the old root's files.
+    cache_entry *entry = range_header ? NULL : cache_lookup(full_path, full_path);
+    if (entry) {
+        send_cached_response(conn, req, entry, &accepted, connection_header);
+        return;
+    }
+
+    // Open descriptor and stat data, kept across requests while the web root is watched.
+    uint64_t io_start = metrics_now();
+    open_file *file = open_file_get(full_path);
+    if (!file) {
+        metrics_observe_stage(STAGE_FILE_IO, metrics_now() - io_start);
+        if (errno == ENOENT || errno == ENOTDIR) send_error_response(conn, 404, "Not Found", connection_header);
+        else if (errno == EISDIR || errno == EACCES) send_error_response(conn, 403, "Forbidden", connection_header);
+        else send_error_response(conn, 500, "Internal Server Error", connection_header);
+        return;
+    }
+    const struct stat *file_stat = &file->st;
+
+    // --- Revalidation: answer 304 from the stat data alone, before any open/read/compress ---
+    // The tag is that of the representation served below; a cached file is rechecked against
+    // its entry, since which variants pay off is only known once it has been compressed.
+    // Ranges always refer to the identity representation.
+    const mime_type *mime = mime_lookup(final_path);
+    const char *mime_type = mime->type;
+    const file_validators *validators = &file->validators;
+    if (range_header && !if_range_matches(req, validators)) range_header = NULL;
+    const server_config *config = config_current();
+    int negotiated = (uint64_t)file_stat->st_size >= config->compress_min_size && encoding_type_allowed(mime);
+    content_coding coding = CODING_IDENTITY;
+    if (negotiated && !range_header) {
+        // A precompressed sidecar costs nothing to send; without one, compress while sending.
+        size_t lengths[CODING_COUNT] = { (size_t)file_stat->st_size };
+        for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+            lengths[c] = file->sidecar_fd[c] >= 0 ? (size_t)file->sidecar_size[c] : 0;
+        }
+        coding = encoding_choose_smallest(&accepted, lengths);
+        if (coding == CODING_IDENTITY && allow_chunked) coding = encoding_choose_fastest(&accepted);
+    }
+    const char *etag = validators->etag[coding];
+    if (is_not_modified(req, etag, validators->mtime)) {
+        metrics_observe_stage(STAGE_FILE_IO, metrics_now() - io_start);
+        send_not_modified_response(conn, etag, validators->last_modified, negotiated, connection_header);
+        open_file_release(file);
+        return;
+    }
+
+    byte_range ranges[MAX_RANGES];
+    int num_ranges = range_header ? parse_byte_ranges(range_header, file_stat->st_size, ranges, MAX_RANGES) : -1;
+    if (num_ranges == 0) {
+        metrics_observe_stage(STAGE_FILE_IO, metrics_now() - io_start);
+        send_range_not_satisfiable_response(conn, file_stat->st_size, connection_header);
+        open_file_release(file);
+        return;
+    }
+
+    if (num_ranges < 0 && (uint64_t)file_stat->st_size <= config->cache_max_file_size) {
+        entry = cache_load(full_path, file);
+        if (entry) {
+            open_file_release(file);
+            send_cached_response(conn, req, entry, &accepted, connection_header);
+            return;
+        }
+    }
+    metrics_observe_stage(STAGE_FILE_IO, metrics_now() - io_start);
+    size_t file_size = file_stat->st_size;
+
+    // --- Byte ranges: each one sent zero-copy from its offset ---
+    if (num_ranges > 0) {
+        send_range_response(conn, file, file_stat->st_size, mime_type, validators, ranges, num_ranges,
+                            connection_header);
+        return;
+    }
+
+    // --- Large text asset without a sidecar: compress window by window into chunked encoding ---
+    if (coding != CODING_IDENTITY && file->sidecar_fd[coding] < 0) {
+        send_compressed_stream_response(conn, file, coding, mime_type, connection_header);
+        return;
+    }
+
+    // --- Build and queue Header: the file itself or its precompressed sidecar ---
+    int body_fd = file->fd;
+    size_t body_len = file_size;
+    http_response res;
+    response_begin(&res, 200, "OK");
+    response_add_header(&res, "Content-Type", mime_type);
+    if (coding != CODING_IDENTITY) {
+        body_fd = file->sidecar_fd[coding];
+        body_len = (size_t)file->sidecar_size[coding];
+        response_add_header(&res, "Content-Encoding", encoding_name(coding));
+        response_add_content_length(&res, body_len);
+    } else {
+        response_add_content_length(&res, body_len);
+        response_add_raw(&res, ACCEPT_RANGES_BYTES, sizeof(ACCEPT_RANGES_BYTES) - 1);
+    }
+    if (negotiated) response_add_raw(&res, VARY_ACCEPT_ENCODING, sizeof(VARY_ACCEPT_ENCODING) - 1);
+    response_add_header(&res, "ETag", validators->etag[coding]);
+    response_add_header(&res, "Last-Modified", validators->last_modified);
+    response_end(&res, connection_header);
+
+    // --- Queue Body: sent straight from the page cache ---
+    int queued = response_queue(conn, &res);
+    if (queued == 0) {
+        queued = conn_queue_file_ref(conn, body_fd, 0, body_len, open_file_release, file);
     } else {
-        perror("Error writing response data");
+        open_file_release(file);
     }
 
-    free(output_content);
+    if (queued == 0) {
+        log_access(conn, 200, body_len, connection_header);
+    } else {
+        log_error("Could not queue response data.");
+    }
 }
@@ -0,0 +1,598 @@
+#include "include/http_hpack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define HUFFMAN_EOS 256
+#define HUFFMAN_NODES 512 // Internal nodes of a code with 257 leaves, with room to spare
+
+// --- Static table (RFC 7541 Appendix A); index 1 is STATIC_TABLE[0] ---
+static const struct {
+    const char *name;
+    const char *value;
+} STATIC_TABLE[HPACK_STATIC_ENTRIES] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+// --- Huffman code (RFC 7541 Appendix B): code and bit length of every octet, then EOS ---
+static const struct {
+    uint32_t code;
+    unsigned char bits;
+} HUFFMAN[HUFFMAN_EOS + 1] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 }, { 0xfffffe4, 28 },
+    { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 }, { 0xfffffe8, 28 }, { 0xffffea, 24 },
+    { 0x3ffffffc, 30 }, { 0xfffffe9, 28 }, { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 },
+    { 0xfffffec, 28 }, { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 }, { 0xffffff4, 28 },
+    { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 }, { 0xffffff8, 28 }, { 0xffffff9, 28 },
+    { 0xffffffa, 28 }, { 0xffffffb, 28 }, { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 },
+    { 0xffa, 12 }, { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 }, { 0xfa, 8 },
+    { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 }, { 0x0, 5 }, { 0x1, 5 },
+    { 0x2, 5 }, { 0x19, 6 }, { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 },
+    { 0x1d, 6 }, { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 }, { 0x1ffa, 13 },
+    { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 }, { 0x5f, 7 }, { 0x60, 7 },
+    { 0x61, 7 }, { 0x62, 7 }, { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 },
+    { 0x66, 7 }, { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 }, { 0x6f, 7 },
+    { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 }, { 0xfc, 8 }, { 0x73, 7 },
+    { 0xfd, 8 }, { 0x1ffb, 13 }, { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 },
+    { 0x22, 6 }, { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 }, { 0x27, 6 },
+    { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 }, { 0x28, 6 }, { 0x29, 6 },
+    { 0x2a, 6 }, { 0x7, 5 }, { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 },
+    { 0x8, 5 }, { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 }, { 0x7fc, 11 },
+    { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 }, { 0xfffe6, 20 }, { 0x3fffd2, 22 },
+    { 0xfffe7, 20 }, { 0xfffe8, 20 }, { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 },
+    { 0x7fffd9, 23 }, { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 }, { 0xffffec, 24 },
+    { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 }, { 0xffffee, 24 }, { 0x7fffe1, 23 },
+    { 0x7fffe2, 23 }, { 0x7fffe3, 23 }, { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 },
+    { 0x7fffe5, 23 }, { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 }, { 0x3fffdc, 22 },
+    { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 }, { 0x7fffea, 23 }, { 0x3fffdd, 22 },
+    { 0x3fffde, 22 }, { 0xfffff0, 24 }, { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 },
+    { 0x7fffec, 23 }, { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 }, { 0xfffea, 20 },
+    { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 }, { 0x7ffff0, 23 }, { 0x3fffe5, 22 },
+    { 0x3fffe6, 22 }, { 0x7ffff1, 23 }, { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 },
+    { 0x7fff1, 19 }, { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 }, { 0x7ffffdf, 27 },
+    { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 }, { 0x7fff2, 19 }, { 0x1fffe3, 21 },
+    { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 }, { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 },
+    { 0xfffff2, 24 }, { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 }, { 0xfffec, 20 },
+    { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 }, { 0x3fffe9, 22 }, { 0x1fffe7, 21 },
+    { 0x1fffe8, 21 }, { 0x7ffff3, 23 }, { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 },
+    { 0x1ffffef, 25 }, { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 }, { 0x7ffffe7, 27 },
+    { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 }, { 0x7ffffeb, 27 }, { 0xffffffe, 28 },
+    { 0x7ffffec, 27 }, { 0x7ffffed, 27 }, { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 },
+    { 0x3ffffee, 26 }, { 0x3fffffff, 30 },
+};
+
+// Decoding walks a binary tree built from the code on first use: tree[n][bit] is the next
+// internal node, or -(symbol + 1) at a leaf; 0 (the root) never appears as a child.
+static short huffman_tree[HUFFMAN_NODES][2];
+static pthread_once_t huffman_once = PTHREAD_ONCE_INIT;
+
+static void huffman_build(void) {
+    int nodes = 1;
+    for (int sym = 0; sym <= HUFFMAN_EOS; sym++) {
+        int node = 0;
+        for (int bit = HUFFMAN[sym].bits - 1; bit >= 0; bit--) {
+            int b = (HUFFMAN[sym].code >> bit) & 1;
+            if (bit == 0) {
+                huffman_tree[node][b] = (short)-(sym + 1);
+            } else {
+                if (huffman_tree[node][b] == 0) huffman_tree[node][b] = (short)nodes++;
+                node = huffman_tree[node][b];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decodes a Huffman-coded string. The padding must be a prefix of EOS (all ones) of
+ *        at most 7 bits, and EOS itself must not appear.
+ * @return Decoded length, or -1 on a malformed string or if out_cap is too small.
+ */
+static long huffman_decode(const unsigned char *in, size_t len, char *out, size_t out_cap) {
+    pthread_once(&huffman_once, huffman_build);
+    size_t n = 0;
+    int node = 0, depth = 0, ones = 1;
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int b = (in[i] >> bit) & 1;
+            int next = huffman_tree[node][b];
+            depth++;
+            ones &= b;
+            if (next < 0) {
+                int sym = -next - 1;
+                if (sym == HUFFMAN_EOS || n == out_cap) return -1;
+                out[n++] = (char)sym;
+                node = depth = 0;
+                ones = 1;
+            } else {
+                node = next;
+            }
+        }
+    }
+    if (depth > 7 || !ones) return -1;
+    return (long)n;
+}
+
+static size_t huffman_length(const char *s, size_t len) {
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++) bits += HUFFMAN[(unsigned char)s[i]].bits;
+    return (bits + 7) / 8;
+}
+
+static void huffman_encode(const char *s, size_t len, unsigned char *out) {
+    uint64_t acc = 0;
+    int pending = 0; // Bits of acc not yet written
+    for (size_t i = 0; i < len; i++) {
+        acc = (acc << HUFFMAN[(unsigned char)s[i]].bits) | HUFFMAN[(unsigned char)s[i]].code;
+        pending += HUFFMAN[(unsigned char)s[i]].bits;
+        while (pending >= 8) {
+            pending -= 8;
+            *out++ = (unsigned char)(acc >> pending);
+        }
+        acc &= (1u << pending) - 1;
+    }
+    if (pending > 0) *out = (unsigned char)((acc << (8 - pending)) | (0xffu >> pending)); // Padded with EOS
+}
+
+// --- Primitive representations (RFC 7541 5.1, 5.2) ---
+
+/**
+ * @brief Encodes value with an N-bit prefix, first carrying the representation's flag bits.
+ * @return Bytes written, or -1 if out_cap is too small.
+ */
+static int encode_int(unsigned char *out, size_t out_cap, unsigned char first, int prefix_bits, size_t value) {
+    size_t max_prefix = (1u << prefix_bits) - 1;
+    if (out_cap == 0) return -1;
+    if (value < max_prefix) {
+        out[0] = (unsigned char)(first | value);
+        return 1;
+    }
+    out[0] = (unsigned char)(first | max_prefix);
+    value -= max_prefix;
+    size_t n = 1;
+    for (; value >= 128; value >>= 7) {
+        if (n == out_cap) return -1;
+        out[n++] = (unsigned char)(0x80 | (value & 0x7f));
+    }
+    if (n == out_cap) return -1;
+    out[n++] = (unsigned char)value;
+    return (int)n;
+}
+
+/**
+ * @brief Decodes an N-bit prefix integer at *p and moves past it. Values beyond 2^32 are
+ *        rejected, as no length or index can be that large.
+ */
+static int decode_int(const unsigned char **p, const unsigned char *end, int prefix_bits, size_t *value) {
+    if (*p >= end) return -1;
+    size_t max_prefix = (1u << prefix_bits) - 1;
+    size_t v = **p & max_prefix;
+    (*p)++;
+    if (v == max_prefix) {
+        int shift = 0;
+        unsigned char b;
+        do {
+            if (*p >= end || shift > 28) return -1;
+            b = **p;
+            (*p)++;
+            v += (size_t)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        if (v > UINT32_MAX) return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+static int encode_string(unsigned char *out, size_t out_cap, const char *s, size_t len) {
+    size_t huffman_len = huffman_length(s, len);
+    int huffman = huffman_len < len;
+    size_t body_len = huffman ? huffman_len : len;
+    int n = encode_int(out, out_cap, huffman ? 0x80 : 0, 7, body_len);
+    if (n < 0 || body_len > out_cap - (size_t)n) return -1;
+    if (huffman) huffman_encode(s, len, out + n);
+    else memcpy(out + n, s, len);
+    return n + (int)body_len;
+}
+
+/**
+ * @brief Room a string literal at p needs once decoded, NUL included (an upper bound for
+ *        Huffman-coded ones), or 0 if its length is malformed.
+ */
+static size_t string_room(const unsigned char *p, const unsigned char *end) {
+    const unsigned char *q = p;
+    size_t len;
+    if (decode_int(&q, end, 7, &len) != 0) return 0;
+    // Each octet of code carries at most 8/5 symbols (the shortest codes are 5 bits).
+    return ((*p & 0x80) ? len * 8 / 5 : len) + 2;
+}
+
+/**
+ * @brief Decodes a string literal into out (NUL-terminated) and moves past it. out_cap
+ *        must be at least string_room.
+ * @return Its length, or -1 if malformed.
+ */
+static long decode_string(const unsigned char **p, const unsigned char *end, char *out, size_t out_cap) {
+    int huffman = (**p & 0x80) != 0;
+    size_t len;
+    if (decode_int(p, end, 7, &len) != 0 || len > (size_t)(end - *p)) return -1;
+    const unsigned char *raw = *p;
+    *p += len;
+
+    long n = (long)len;
+    if (huffman) n = huffman_decode(raw, len, out, out_cap - 1);
+    else memcpy(out, raw, len);
+    if (n >= 0) out[n] = '\0';
+    return n;
+}
+
+// --- Dynamic table ---
+
+/**
+ * @brief Initializes an empty table.
+ */
+void hpack_table_init(hpack_table *table, size_t limit) {
+    memset(table, 0, sizeof(hpack_table));
+    table->max_size = limit;
+    table->limit = limit;
+}
+
+/**
+ * @brief Releases every entry.
+ */
+void hpack_table_free(hpack_table *table) {
+    for (size_t i = 0; i < table->count; i++) {
+        free((char *)table->entries[(table->head + i) % table->cap].name);
+    }
+    free(table->entries);
+    memset(table, 0, sizeof(hpack_table));
+}
+
+static void evict_to(hpack_table *table, size_t size) {
+    while (table->size > size && table->count > 0) {
+        hpack_field *oldest = &table->entries[(table->head + table->count - 1) % table->cap];
+        table->size -= oldest->name_len + oldest->value_len + HPACK_ENTRY_OVERHEAD;
+        free((char *)oldest->name);
+        table->count--;
+    }
+}
+
+/**
+ * @brief Inserts an entry as the newest, evicting the oldest ones to make room. One larger
+ *        than the whole table empties it and is not kept (RFC 7541 4.4).
+ */
+static int table_add(hpack_table *table, const char *name, size_t name_len, const char *value, size_t value_len) {
+    size_t size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    if (size > table->max_size) {
+        evict_to(table, 0);
+        return 0;
+    }
+    evict_to(table, table->max_size - size);
+
+    if (table->count == table->cap) {
+        size_t cap = table->cap ? table->cap * 2 : 16;
+        hpack_field *grown = (hpack_field *)malloc(cap * sizeof(hpack_field));
+        if (!grown) return -1;
+        for (size_t i = 0; i < table->count; i++) grown[i] = table->entries[(table->head + i) % table->cap];
+        free(table->entries);
+        table->entries = grown;
+        table->cap = cap;
+        table->head = 0;
+    }
+    char *copy = (char *)malloc(name_len + value_len + 2);
+    if (!copy) return -1;
+    memcpy(copy, name, name_len);
+    copy[name_len] = '\0';
+    memcpy(copy + name_len + 1, value, value_len);
+    copy[name_len + 1 + value_len] = '\0';
+
+    table->head = (table->head + table->cap - 1) % table->cap;
+    table->entries[table->head] = (hpack_field){ copy, name_len, copy + name_len + 1, value_len };
+    table->count++;
+    table->size += size;
+    return 0;
+}
+
+/**
+ * @brief Looks up an index of either table.
+ */
+static int table_get(const hpack_table *table, size_t index, hpack_field *field) {
+    if (index == 0) return -1;
+    if (index <= HPACK_STATIC_ENTRIES) {
+        field->name = STATIC_TABLE[index - 1].name;
+        field->name_len = strlen(field->name);
+        field->value = STATIC_TABLE[index - 1].value;
+        field->value_len = strlen(field->value);
+        return 0;
+    }
+    index -= HPACK_STATIC_ENTRIES + 1;
+    if (index >= table->count) return -1;
+    *field = table->entries[(table->head + index) % table->cap];
+    return 0;
+}
+
+/**
+ * @brief Applies the peer's SETTINGS_HEADER_TABLE_SIZE to an encoding table.
+ */
+void hpack_encoder_set_limit(hpack_table *table, size_t limit) {
+    table->limit = limit;
+    size_t max_size = limit < HPACK_TABLE_SIZE_DEFAULT ? limit : HPACK_TABLE_SIZE_DEFAULT;
+    if (max_size != table->max_size) {
+        table->max_size = max_size;
+        evict_to(table, max_size);
+        table->update_pending = 1;
+    }
+}
+
+// --- Header blocks ---
+
+/**
+ * @brief Where hpack_decode puts strings: straight into the caller's buffer while they are
+ *        sure to fit, otherwise through a scratch buffer first.
+ */
+typedef struct {
+    char *out;
+    size_t out_cap;
+    size_t used;
+    char *scratch;
+    size_t scratch_cap;
+    int too_large;
+} decode_buffer;
+
+/**
+ * @brief Decodes a literal field's value (and its name, unless the name is indexed) and stores them
+ *        as one field in the buffer: "name\0value\0".
+ */
+static int decode_literal(decode_buffer *buf, const unsigned char **p, const unsigned char *end,
+                          const hpack_field *indexed_name, hpack_field *field) {
+    if (*p >= end) return -1;
+    size_t value_room = string_room(*p, end);
+    size_t name_room = indexed_name ? indexed_name->name_len + 1 : 0;
+    if (!indexed_name) {
+        name_room = string_room(*p, end);
+        if (name_room == 0) return -1;
+        // The value's room depends on where the name ends.
+        const unsigned char *q = *p;
+        size_t raw;
+        if (decode_int(&q, end, 7, &raw) != 0 || raw >= (size_t)(end - q)) return -1;
+        value_room = string_room(q + raw, end);
+    }
+    if (value_room == 0) return -1;
+
+    size_t room = name_room + value_room;
+    char *dst = buf->out + buf->used;
+    int direct = !buf->too_large && room <= buf->out_cap - buf->used;
+    if (!direct) {
+        if (buf->scratch_cap < room) {
+            char *grown = (char *)realloc(buf->scratch, room);
+            if (!grown) return -1;
+            buf->scratch = grown;
+            buf->scratch_cap = room;
+        }
+        dst = buf->scratch;
+    }
+
+    long name_len;
+    if (indexed_name) {
+        name_len = (long)indexed_name->name_len;
+        memcpy(dst, indexed_name->name, (size_t)name_len + 1);
+    } else {
+        name_len = decode_string(p, end, dst, name_room);
+    }
+    if (name_len < 0 || *p >= end) return -1;
+    long value_len = decode_string(p, end, dst + name_len + 1, value_room);
+    if (value_len < 0) return -1;
+
+    size_t total = (size_t)name_len + (size_t)value_len + 2;
+    if (!direct) {
+        if (!buf->too_large && total <= buf->out_cap - buf->used) {
+            memcpy(buf->out + buf->used, dst, total);
+            dst = buf->out + buf->used;
+        } else {
+            buf->too_large = 1;
+        }
+    }
+    *field = (hpack_field){ dst, (size_t)name_len, dst + name_len + 1, (size_t)value_len };
+    if (dst != buf->scratch) buf->used += total;
+    return 0;
+}
+
+/**
+ * @brief Decodes one complete header block, updating the table as it goes.
+ */
+int hpack_decode(hpack_table *table, const unsigned char *block, size_t len, hpack_field *fields, int max_fields,
+                 char *out, size_t out_cap) {
+    const unsigned char *p = block, *end = block + len;
+    decode_buffer buf = { out, out_cap, 0, NULL, 0, 0 };
+    int count = 0, rc = 0;
+
+    while (p < end && rc == 0) {
+        unsigned char b = *p;
+        hpack_field field;
+        if ((b & 0xe0) == 0x20) {
+            // Dynamic table size update: only before the first field.
+            size_t size;
+            if (count > 0 || buf.too_large || decode_int(&p, end, 5, &size) != 0 || size > table->limit) {
+                rc = -1;
+                break;
+            }
+            table->max_size = size;
+            evict_to(table, size);
+            continue;
+        }
+
+        size_t index;
+        if (b & 0x80) {
+            // Indexed field: copied out, as a later eviction may free the entry.
+            if (decode_int(&p, end, 7, &index) != 0 || table_get(table, index, &field) != 0) {
+                rc = -1;
+                break;
+            }
+            size_t total = field.name_len + field.value_len + 2;
+            if (!buf.too_large && total <= buf.out_cap - buf.used) {
+                char *dst = buf.out + buf.used;
+                memcpy(dst, field.name, field.name_len + 1);
+                memcpy(dst + field.name_len + 1, field.value, field.value_len + 1);
+                field.name = dst;
+                field.value = dst + field.name_len + 1;
+                buf.used += total;
+            } else {
+                buf.too_large = 1;
+            }
+        } else {
+            // Literal with incremental indexing (01), without indexing (0000) or never indexed (0001).
+            int incremental = (b & 0x40) != 0;
+            hpack_field name;
+            if (decode_int(&p, end, incremental ? 6 : 4, &index) != 0 ||
+                (index > 0 && table_get(table, index, &name) != 0) ||
+                decode_literal(&buf, &p, end, index > 0 ? &name : NULL, &field) != 0 ||
+                (incremental && table_add(table, field.name, field.name_len, field.value, field.value_len) != 0)) {
+                rc = -1;
+                break;
+            }
+        }
+
+        if (!buf.too_large && count < max_fields) fields[count] = field;
+        else buf.too_large = 1;
+        count++;
+    }
+    free(buf.scratch);
+    if (rc != 0) return -1;
+    return buf.too_large ? HPACK_TOO_LARGE : count;
+}
+
+/**
+ * @brief Finds the best index for a field: 1 + the entry holding both name and value
+ *        (*exact set), or else one holding the name; 0 if neither table has it.
+ */
+static size_t find_index(const hpack_table *table, const char *name, size_t name_len, const char *value,
+                         size_t value_len, int *exact) {
+    size_t name_index = 0;
+    *exact = 0;
+    for (size_t i = 0; i < HPACK_STATIC_ENTRIES; i++) {
+        const char *entry_name = STATIC_TABLE[i].name;
+        if (strncmp(entry_name, name, name_len) != 0 || entry_name[name_len] != '\0') continue;
+        if (strlen(STATIC_TABLE[i].value) == value_len && memcmp(STATIC_TABLE[i].value, value, value_len) == 0) {
+            *exact = 1;
+            return i + 1;
+        }
+        if (!name_index) name_index = i + 1;
+    }
+    for (size_t i = 0; i < table->count; i++) {
+        const hpack_field *entry = &table->entries[(table->head + i) % table->cap];
+        if (entry->name_len != name_len || memcmp(entry->name, name, name_len) != 0) continue;
+        if (entry->value_len == value_len && memcmp(entry->value, value, value_len) == 0) {
+            *exact = 1;
+            return HPACK_STATIC_ENTRIES + 1 + i;
+        }
+        if (!name_index) name_index = HPACK_STATIC_ENTRIES + 1 + i;
+    }
+    return name_index;
+}
+
+/**
+ * @brief Appends the representation of one field to out.
+ */
+int hpack_encode_field(hpack_table *table, unsigned char *out, size_t out_cap, const char *name, size_t name_len,
+                       const char *value, size_t value_len, hpack_indexing indexing) {
+    size_t n = 0;
+    int w;
+    if (table->update_pending) {
+        if ((w = encode_int(out, out_cap, 0x20, 5, table->max_size)) < 0) return -1;
+        n += (size_t)w;
+    }
+
+    int exact;
+    size_t index = find_index(table, name, name_len, value, value_len, &exact);
+    if (exact) {
+        if ((w = encode_int(out + n, out_cap - n, 0x80, 7, index)) < 0) return -1;
+        n += (size_t)w;
+    } else {
+        if (indexing == HPACK_INDEX) w = encode_int(out + n, out_cap - n, 0x40, 6, index);
+        else w = encode_int(out + n, out_cap - n, indexing == HPACK_NEVER_INDEX ? 0x10 : 0x00, 4, index);
+        if (w < 0) return -1;
+        n += (size_t)w;
+        if (index == 0) {
+            if ((w = encode_string(out + n, out_cap - n, name, name_len)) < 0) return -1;
+            n += (size_t)w;
+        }
+        if ((w = encode_string(out + n, out_cap - n, value, value_len)) < 0) return -1;
+        n += (size_t)w;
+        // Out of memory here would leave the two tables out of step: the block must not be sent.
+        if (indexing == HPACK_INDEX && table_add(table, name, name_len, value, value_len) != 0) return -1;
+    }
+    table->update_pending = 0;
+    return (int)n;
+}
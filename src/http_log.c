@@ -0,0 +1,223 @@
+#define _GNU_SOURCE // For gmtime_r, nanosleep
+#include "include/http_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <strings.h> // For strcasecmp
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#define LOG_WRITE_BUFFER (64 * 1024) // Writer-side batch per output stream
+
+typedef struct {
+    time_t timestamp;
+    unsigned short len;
+    unsigned char level;
+    char text[LOG_RECORD_SIZE];
+} log_record;
+
+/**
+ * @brief Single-producer/single-consumer ring: the owning thread advances head, the writer
+ *        thread advances tail. Neither side ever waits for the other.
+ */
+typedef struct log_ring {
+    struct log_ring *next; // Registry of every thread's ring, pushed once per thread
+    size_t head;           // Written only by the owning thread (atomic)
+    size_t tail;           // Written only by the writer thread (atomic)
+    unsigned long dropped; // Records lost because the ring was full (atomic)
+    log_record slots[LOG_RING_SLOTS];
+} log_ring;
+
+log_level log_threshold = LOG_LEVEL_DEFAULT;
+
+static log_ring *rings;       // Lock-free registry head (atomic)
+static int writer_running;    // Set once the writer thread owns the output (atomic)
+static _Thread_local log_ring *thread_ring;
+
+static const char *const level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+/**
+ * @brief Changes the threshold at runtime. Threads pick it up at their next log call.
+ */
+void log_set_threshold(log_level threshold) {
+    __atomic_store_n(&log_threshold, threshold, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Parses "debug", "info", "warn", "error" or "off".
+ */
+int log_level_parse(const char *name, log_level *level) {
+    static const char *const names[] = { "debug", "info", "warn", "error", "off" };
+    for (int i = 0; i <= LOG_OFF; i++) {
+        if (strcasecmp(name, names[i]) == 0) {
+            *level = (log_level)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Returns the calling thread's ring, registering a new one on first use.
+ */
+static log_ring *ring_for_thread(void) {
+    if (thread_ring) return thread_ring;
+
+    log_ring *ring = (log_ring *)calloc(1, sizeof(log_ring));
+    if (!ring) return NULL;
+
+    ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // ring->next was refreshed by the failed exchange; retry.
+    }
+    thread_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Renders one record as "<UTC time> <LEVEL> <text>\n".
+ */
+static size_t format_record(const log_record *record, char *out, size_t cap) {
+    struct tm tm;
+    gmtime_r(&record->timestamp, &tm);
+    size_t len = strftime(out, cap, "%Y-%m-%dT%H:%M:%SZ ", &tm);
+    int n = snprintf(out + len, cap - len, "%-5s %.*s\n", level_names[record->level], (int)record->len, record->text);
+    if (n < 0) return len;
+    return len + ((size_t)n < cap - len ? (size_t)n : cap - len - 1);
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) return; // Nowhere to report a failing log stream
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+/**
+ * @brief Formats a record into the calling thread's ring without blocking or locking.
+ */
+void log_write(log_level level, const char *fmt, ...) {
+    if (level < log_threshold || level >= LOG_OFF) return;
+
+    log_record local;
+    log_record *record = &local;
+    log_ring *ring = NULL;
+
+    if (__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE)) {
+        ring = ring_for_thread();
+        if (!ring) return;
+        size_t head = ring->head;
+        if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == LOG_RING_SLOTS) {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        record = &ring->slots[head & (LOG_RING_SLOTS - 1)];
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(record->text, sizeof(record->text), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+
+    record->len = (unsigned short)((size_t)n < sizeof(record->text) ? (size_t)n : sizeof(record->text) - 1);
+    record->level = (unsigned char)level;
+    record->timestamp = time(NULL);
+
+    if (ring) {
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    } else {
+        // No writer thread yet: write through.
+        char line[LOG_RECORD_SIZE + 64];
+        size_t len = format_record(record, line, sizeof(line));
+        write_all(level >= LOG_WARN ? STDERR_FILENO : STDOUT_FILENO, line, len);
+    }
+}
+
+/**
+ * @brief Total records dropped so far because a thread's ring was full.
+ */
+unsigned long log_dropped(void) {
+    unsigned long total = 0;
+    for (log_ring *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        total += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/**
+ * @brief Background writer: drains every ring into two batch buffers (stdout and stderr)
+ *        and writes each with one call. Request threads never wait on it.
+ */
+static void *writer_loop(void *arg) {
+    (void)arg;
+    static char out_buf[LOG_WRITE_BUFFER], err_buf[LOG_WRITE_BUFFER];
+    unsigned long reported_drops = 0;
+
+    while (1) {
+        size_t out_len = 0, err_len = 0;
+        int drained = 0;
+
+        for (log_ring *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+            size_t tail = ring->tail;
+            size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+            for (; tail != head; tail++) {
+                const log_record *record = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+                int is_err = record->level >= LOG_WARN;
+                char *buf = is_err ? err_buf : out_buf;
+                size_t *len = is_err ? &err_len : &out_len;
+
+                if (LOG_WRITE_BUFFER - *len < LOG_RECORD_SIZE + 64) {
+                    write_all(is_err ? STDERR_FILENO : STDOUT_FILENO, buf, *len);
+                    *len = 0;
+                }
+                *len += format_record(record, buf + *len, LOG_WRITE_BUFFER - *len);
+                drained++;
+            }
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        unsigned long drops = log_dropped();
+        if (drops != reported_drops) {
+            int n = snprintf(err_buf + err_len, LOG_WRITE_BUFFER - err_len,
+                             "[Warning]: Log rings full, dropped %lu records (%lu total).\n",
+                             drops - reported_drops, drops);
+            if (n > 0 && (size_t)n < LOG_WRITE_BUFFER - err_len) err_len += (size_t)n;
+            reported_drops = drops;
+        }
+
+        if (out_len) write_all(STDOUT_FILENO, out_buf, out_len);
+        if (err_len) write_all(STDERR_FILENO, err_buf, err_len);
+
+        if (!drained) {
+            struct timespec pause = { 0, LOG_FLUSH_INTERVAL_MS * 1000000L };
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sets the threshold and starts the background writer thread.
+ */
+int log_init(log_level threshold) {
+    log_threshold = threshold;
+    if (__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE)) return 0;
+
+    // Anything printed through stdio before this point must not be reordered after ring output.
+    fflush(stdout);
+
+    pthread_t writer;
+    if (pthread_create(&writer, NULL, writer_loop, NULL) != 0) {
+        perror("Failed to start log writer thread");
+        return -1;
+    }
+    pthread_detach(writer);
+    __atomic_store_n(&writer_running, 1, __ATOMIC_RELEASE);
+    return 0;
+}
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE // For clock_gettime
+#include "include/http_metrics.h"
+#include "include/http_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_STATUS 600
+
+typedef struct {
+    uint64_t buckets[METRICS_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+} metrics_histogram;
+
+/**
+ * @brief One thread's metrics. Only the owning thread writes them (plain relaxed stores,
+ *        no lock prefix); /metrics reads every thread's block with relaxed loads.
+ */
+typedef struct metrics_thread {
+    struct metrics_thread *next; // Registry of every thread's block, pushed once per thread
+    uint64_t counters[METRIC_COUNT];
+    uint64_t status[METRICS_MAX_STATUS];
+    metrics_histogram stages[STAGE_COUNT];
+    metrics_histogram routes[ROUTE_COUNT];
+} metrics_thread;
+
+static metrics_thread *threads; // Lock-free registry head (atomic)
+static _Thread_local metrics_thread *thread_metrics;
+
+static const char *const stage_names[STAGE_COUNT] = { "first_byte", "parse", "file_io", "compress", "write" };
+static const char *const route_names[ROUTE_COUNT] = { "static", "echo", "upload", "head", "metrics", "other" };
+
+// Cumulative bucket bounds exposed to Prometheus, in seconds.
+static const double export_bounds[] = { 1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1, 5 };
+
+/**
+ * @brief Monotonic clock in nanoseconds.
+ */
+uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static metrics_thread *metrics_for_thread(void) {
+    if (thread_metrics) return thread_metrics;
+
+    metrics_thread *block = (metrics_thread *)calloc(1, sizeof(metrics_thread));
+    if (!block) return NULL;
+
+    block->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // block->next was refreshed by the failed exchange; retry.
+    }
+    thread_metrics = block;
+    return block;
+}
+
+// Single-writer increment: readers may see the old or new value, never a torn one.
+static inline void bump(uint64_t *slot, uint64_t n) {
+    __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Adds n to one of the calling thread's counters.
+ */
+void metrics_add(metrics_counter counter, uint64_t n) {
+    metrics_thread *m = metrics_for_thread();
+    if (m) bump(&m->counters[counter], n);
+}
+
+/**
+ * @brief Counts one response with the given HTTP status code.
+ */
+void metrics_count_status(int status_code) {
+    metrics_thread *m = metrics_for_thread();
+    if (m && status_code >= 0 && status_code < METRICS_MAX_STATUS) bump(&m->status[status_code], 1);
+}
+
+/**
+ * @brief Log-linear bucket index: exact below 2 * METRICS_SUB_BUCKETS, then
+ *        METRICS_SUB_BUCKETS buckets per power of two.
+ */
+static unsigned bucket_index(uint64_t ns) {
+    if (ns < 2 * METRICS_SUB_BUCKETS) return (unsigned)ns;
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(ns);
+    unsigned shift = exponent - METRICS_SUB_BITS;
+    unsigned index = (shift + 1) * METRICS_SUB_BUCKETS + (unsigned)((ns >> shift) - METRICS_SUB_BUCKETS);
+    return index < METRICS_HIST_BUCKETS ? index : METRICS_HIST_BUCKETS - 1;
+}
+
+/**
+ * @brief Exclusive upper bound, in nanoseconds, of the values that land in a bucket.
+ */
+static uint64_t bucket_upper_bound(unsigned index) {
+    if (index < 2 * METRICS_SUB_BUCKETS) return index + 1;
+    unsigned shift = index / METRICS_SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t)(METRICS_SUB_BUCKETS + index % METRICS_SUB_BUCKETS) << shift;
+    return lower + (1ULL << shift);
+}
+
+static void observe(metrics_histogram *hist, uint64_t ns) {
+    bump(&hist->buckets[bucket_index(ns)], 1);
+    bump(&hist->count, 1);
+    bump(&hist->sum_ns, ns);
+}
+
+/**
+ * @brief Records one sample in a lifecycle stage histogram.
+ */
+void metrics_observe_stage(metrics_stage stage, uint64_t ns) {
+    metrics_thread *m = metrics_for_thread();
+    if (m) observe(&m->stages[stage], ns);
+}
+
+/**
+ * @brief Records one whole-request latency sample for a route.
+ */
+void metrics_observe_route(metrics_route route, uint64_t ns) {
+    metrics_thread *m = metrics_for_thread();
+    if (m) observe(&m->routes[route], ns);
+}
+
+
+// --- Rendering ---
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int failed;
+} text_buffer;
+
+static void emit(text_buffer *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void emit(text_buffer *out, const char *fmt, ...) {
+    if (out->failed) return;
+    while (1) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out->buf + out->len, out->cap - out->len, fmt, args);
+        va_end(args);
+        if (n < 0) {
+            out->failed = 1;
+            return;
+        }
+        if ((size_t)n < out->cap - out->len) {
+            out->len += (size_t)n;
+            return;
+        }
+        size_t cap = out->cap * 2 + (size_t)n;
+        char *grown = (char *)realloc(out->buf, cap);
+        if (!grown) {
+            out->failed = 1;
+            return;
+        }
+        out->buf = grown;
+        out->cap = cap;
+    }
+}
+
+static void sum_histogram(metrics_histogram *total, const metrics_histogram *hist) {
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        total->buckets[i] += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    }
+    total->count += __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    total->sum_ns += __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED);
+}
+
+static void emit_histogram(text_buffer *out, const char *name, const char *label, const char *value,
+                           const metrics_histogram *hist) {
+    unsigned index = 0;
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < sizeof(export_bounds) / sizeof(export_bounds[0]); b++) {
+        // A bucket straddling a bound is counted at the next bound up.
+        uint64_t bound_ns = (uint64_t)(export_bounds[b] * 1e9);
+        while (index < METRICS_HIST_BUCKETS && bucket_upper_bound(index) <= bound_ns) {
+            cumulative += hist->buckets[index++];
+        }
+        emit(out, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, value, export_bounds[b],
+             (unsigned long long)cumulative);
+    }
+    emit(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value, (unsigned long long)hist->count);
+    emit(out, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, (double)hist->sum_ns / 1e9);
+    emit(out, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)hist->count);
+}
+
+/**
+ * @brief Sums every thread's counters and histograms into Prometheus text exposition format.
+ */
+char *metrics_render(size_t *len) {
+    metrics_thread *total = (metrics_thread *)calloc(1, sizeof(metrics_thread));
+    text_buffer out = { (char *)malloc(16384), 0, 16384, 0 };
+    if (!total || !out.buf) {
+        free(total);
+        free(out.buf);
+        return NULL;
+    }
+
+    for (metrics_thread *m = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); m; m = m->next) {
+        for (int i = 0; i < METRIC_COUNT; i++) total->counters[i] += __atomic_load_n(&m->counters[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < METRICS_MAX_STATUS; i++) total->status[i] += __atomic_load_n(&m->status[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < STAGE_COUNT; i++) sum_histogram(&total->stages[i], &m->stages[i]);
+        for (int i = 0; i < ROUTE_COUNT; i++) sum_histogram(&total->routes[i], &m->routes[i]);
+    }
+
+    const uint64_t *c = total->counters;
+    uint64_t active = c[METRIC_CONN_ACCEPTED] - c[METRIC_CONN_CLOSED];
+    double reuse = c[METRIC_REQUESTS] ? (double)c[METRIC_REQUESTS_REUSED] / (double)c[METRIC_REQUESTS] : 0.0;
+    uint64_t saved = c[METRIC_COMPRESS_IN] > c[METRIC_COMPRESS_OUT] ? c[METRIC_COMPRESS_IN] - c[METRIC_COMPRESS_OUT] : 0;
+
+    emit(&out, "# TYPE httpserver_connections_accepted_total counter\nhttpserver_connections_accepted_total %llu\n",
+         (unsigned long long)c[METRIC_CONN_ACCEPTED]);
+    emit(&out, "# TYPE httpserver_connections_active gauge\nhttpserver_connections_active %llu\n",
+         (unsigned long long)active);
+    emit(&out, "# TYPE httpserver_requests_total counter\nhttpserver_requests_total %llu\n",
+         (unsigned long long)c[METRIC_REQUESTS]);
+    emit(&out, "# HELP httpserver_keepalive_reuse_ratio Share of requests served on an already used connection.\n"
+               "# TYPE httpserver_keepalive_reuse_ratio gauge\nhttpserver_keepalive_reuse_ratio %.6f\n", reuse);
+    emit(&out, "# TYPE httpserver_received_bytes_total counter\nhttpserver_received_bytes_total %llu\n",
+         (unsigned long long)c[METRIC_BYTES_IN]);
+    emit(&out, "# TYPE httpserver_sent_bytes_total counter\nhttpserver_sent_bytes_total %llu\n",
+         (unsigned long long)c[METRIC_BYTES_OUT]);
+    emit(&out, "# TYPE httpserver_compression_input_bytes_total counter\nhttpserver_compression_input_bytes_total %llu\n",
+         (unsigned long long)c[METRIC_COMPRESS_IN]);
+    emit(&out, "# TYPE httpserver_compression_output_bytes_total counter\nhttpserver_compression_output_bytes_total %llu\n",
+         (unsigned long long)c[METRIC_COMPRESS_OUT]);
+    emit(&out, "# TYPE httpserver_compression_saved_bytes_total counter\nhttpserver_compression_saved_bytes_total %llu\n",
+         (unsigned long long)saved);
+    emit(&out, "# HELP httpserver_connection_timeouts_total Connections closed because a timeout expired.\n"
+               "# TYPE httpserver_connection_timeouts_total counter\n"
+               "httpserver_connection_timeouts_total{phase=\"header\"} %llu\n"
+               "httpserver_connection_timeouts_total{phase=\"body\"} %llu\n"
+               "httpserver_connection_timeouts_total{phase=\"idle\"} %llu\n"
+               "httpserver_connection_timeouts_total{phase=\"write\"} %llu\n",
+         (unsigned long long)c[METRIC_TIMEOUT_HEADER], (unsigned long long)c[METRIC_TIMEOUT_BODY],
+         (unsigned long long)c[METRIC_TIMEOUT_IDLE], (unsigned long long)c[METRIC_TIMEOUT_WRITE]);
+    emit(&out, "# HELP httpserver_shed_total Connections and requests refused with 503 by admission control.\n"
+               "# TYPE httpserver_shed_total counter\n"
+               "httpserver_shed_total{reason=\"connection_limit\"} %llu\n"
+               "httpserver_shed_total{reason=\"client_limit\"} %llu\n"
+               "httpserver_shed_total{reason=\"rate_limit\"} %llu\n"
+               "httpserver_shed_total{reason=\"overload\"} %llu\n",
+         (unsigned long long)c[METRIC_SHED_CONNECTION_LIMIT], (unsigned long long)c[METRIC_SHED_CLIENT_LIMIT],
+         (unsigned long long)c[METRIC_SHED_RATE_LIMIT], (unsigned long long)c[METRIC_SHED_OVERLOAD]);
+    emit(&out, "# TYPE httpserver_http2_connections_total counter\nhttpserver_http2_connections_total %llu\n",
+         (unsigned long long)c[METRIC_H2_CONNECTIONS]);
+    emit(&out, "# TYPE httpserver_http2_streams_total counter\nhttpserver_http2_streams_total %llu\n",
+         (unsigned long long)c[METRIC_H2_STREAMS]);
+    emit(&out, "# TYPE httpserver_log_dropped_total counter\nhttpserver_log_dropped_total %lu\n", log_dropped());
+
+    emit(&out, "# TYPE httpserver_responses_total counter\n");
+    for (int code = 0; code < METRICS_MAX_STATUS; code++) {
+        if (total->status[code]) {
+            emit(&out, "httpserver_responses_total{code=\"%d\"} %llu\n", code, (unsigned long long)total->status[code]);
+        }
+    }
+
+    emit(&out, "# HELP httpserver_stage_duration_seconds Time spent in each phase of the request lifecycle.\n"
+               "# TYPE httpserver_stage_duration_seconds histogram\n");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        emit_histogram(&out, "httpserver_stage_duration_seconds", "stage", stage_names[i], &total->stages[i]);
+    }
+    emit(&out, "# HELP httpserver_request_duration_seconds Time from a request's first parsed byte until its response is queued.\n"
+               "# TYPE httpserver_request_duration_seconds histogram\n");
+    for (int i = 0; i < ROUTE_COUNT; i++) {
+        emit_histogram(&out, "httpserver_request_duration_seconds", "route", route_names[i], &total->routes[i]);
+    }
+
+    free(total);
+    if (out.failed) {
+        free(out.buf);
+        return NULL;
+    }
+    *len = out.len;
+    return out.buf;
+}
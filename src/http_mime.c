@@ -0,0 +1,191 @@
+#define _GNU_SOURCE // For getline, strdup, strtok_r
+#include "include/http_mime.h"
+#include "include/http_phash.h"
+#include "include/http_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strcasecmp, strncasecmp
+#include <pthread.h>
+
+/**
+ * @brief One immutable generation of the extension table. Tables (and the strings they
+ *        point to) are never freed, so entries handed out earlier survive a reload.
+ */
+typedef struct {
+    mime_type *entries;
+    const char **keys; // entries[i].extension, as the perfect hash wants them
+    int count;
+    perfect_hash hash;
+} mime_table;
+
+typedef struct {
+    const char *extension;
+    const char *type;
+} mime_mapping;
+
+static const mime_mapping builtin_types[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "css", "text/css" },
+    { "js", "application/javascript" },
+    { "mjs", "application/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "png", "image/png" },
+    { "gif", "image/gif" },
+    { "webp", "image/webp" },
+    { "ico", "image/x-icon" },
+    { "pdf", "application/pdf" },
+    { "wasm", "application/wasm" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "mp4", "video/mp4" },
+    { "webm", "video/webm" },
+    { "mp3", "audio/mpeg" },
+    { "zip", "application/zip" },
+    { "gz", "application/gzip" },
+};
+
+static const mime_type default_type = { "", "application/octet-stream", 0 };
+
+static mime_table *current_table; // Published with release/acquire
+static pthread_once_t builtin_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief The compressibility rule applied to every type.
+ */
+int mime_type_is_compressible(const char *type) {
+    if (strncasecmp(type, "text/", 5) == 0) return 1;
+    if (strcasecmp(type, "application/javascript") == 0 || strcasecmp(type, "application/json") == 0 ||
+        strcasecmp(type, "application/xml") == 0 || strcasecmp(type, "image/svg+xml") == 0) {
+        return 1;
+    }
+    size_t len = strlen(type);
+    return len > 5 && (strcasecmp(type + len - 5, "+json") == 0 || strcasecmp(type + len - 4, "+xml") == 0);
+}
+
+/**
+ * @brief Builds a table from mappings in precedence order (later mappings win).
+ * @return The new table, or NULL on allocation failure.
+ */
+static mime_table *build_table(const mime_mapping *mappings, int count) {
+    mime_table *table = (mime_table *)calloc(1, sizeof(mime_table));
+    if (table) table->entries = (mime_type *)malloc(sizeof(mime_type) * (size_t)(count ? count : 1));
+    if (table) table->keys = (const char **)malloc(sizeof(char *) * (size_t)(count ? count : 1));
+    if (!table || !table->entries || !table->keys) goto fail;
+
+    // Walk backwards so the last mapping of an extension is the one kept.
+    for (int i = count - 1; i >= 0; i--) {
+        int seen = 0;
+        for (int j = 0; j < table->count && !seen; j++) {
+            seen = strcasecmp(table->keys[j], mappings[i].extension) == 0;
+        }
+        if (seen) continue;
+
+        mime_type *entry = &table->entries[table->count];
+        entry->extension = mappings[i].extension;
+        entry->type = mappings[i].type;
+        entry->compressible = mime_type_is_compressible(entry->type);
+        table->keys[table->count++] = entry->extension;
+    }
+
+    if (phash_build(&table->hash, table->keys, table->count) != 0) goto fail;
+    return table;
+
+fail:
+    if (table) {
+        free(table->entries);
+        free(table->keys);
+        free(table);
+    }
+    return NULL;
+}
+
+static void load_builtin_types(void) {
+    mime_table *table = build_table(builtin_types, (int)(sizeof(builtin_types) / sizeof(builtin_types[0])));
+    if (!table) {
+        log_error("Could not build the MIME type table; serving everything as %s.", default_type.type);
+        return;
+    }
+    __atomic_store_n(&current_table, table, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Resolves the extension of a request path with one perfect-hash probe.
+ */
+const mime_type *mime_lookup(const char *path) {
+    pthread_once(&builtin_once, load_builtin_types);
+
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return &default_type; // No extension in the last segment
+
+    const mime_table *table = __atomic_load_n(&current_table, __ATOMIC_ACQUIRE);
+    if (!table) return &default_type;
+    int index = phash_find(&table->hash, dot + 1, strlen(dot + 1));
+    return index >= 0 ? &table->entries[index] : &default_type;
+}
+
+/**
+ * @brief Extends the built-in table from a mime.types file.
+ */
+int mime_load_types(const char *path) {
+    pthread_once(&builtin_once, load_builtin_types);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        log_error("Could not open MIME types file %s.", path);
+        return -1;
+    }
+
+    int builtin_count = (int)(sizeof(builtin_types) / sizeof(builtin_types[0]));
+    int count = builtin_count, cap = builtin_count + 256;
+    mime_mapping *mappings = (mime_mapping *)malloc(sizeof(mime_mapping) * (size_t)cap);
+    char *line = NULL;
+    size_t line_cap = 0;
+    int ok = mappings != NULL;
+    if (ok) memcpy(mappings, builtin_types, sizeof(builtin_types));
+
+    while (ok && getline(&line, &line_cap, file) != -1) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char *save = NULL;
+        char *type = strtok_r(line, " \t\r\n", &save);
+        if (!type || !strchr(type, '/')) continue;
+        const char *interned_type = NULL; // Shared by every extension on this line
+
+        for (char *ext = strtok_r(NULL, " \t\r\n", &save); ext && ok; ext = strtok_r(NULL, " \t\r\n", &save)) {
+            if (count == cap) {
+                cap *= 2;
+                mime_mapping *grown = (mime_mapping *)realloc(mappings, sizeof(mime_mapping) * (size_t)cap);
+                if (!grown) {
+                    ok = 0;
+                    break;
+                }
+                mappings = grown;
+            }
+            if (!interned_type) interned_type = strdup(type);
+            mappings[count].extension = strdup(ext);
+            mappings[count].type = interned_type;
+            if (!interned_type || !mappings[count].extension) ok = 0;
+            else count++;
+        }
+    }
+    free(line);
+    fclose(file);
+
+    mime_table *table = ok ? build_table(mappings, count) : NULL;
+    free(mappings); // The table keeps the strings, not the array
+    if (!table) {
+        log_error("Could not build the MIME type table from %s.", path);
+        return -1;
+    }
+
+    __atomic_store_n(&current_table, table, __ATOMIC_RELEASE);
+    return count - builtin_count;
+}
@@ -0,0 +1,270 @@
+#include "include/http_parser.h"
+#include "include/http_phash.h"
+#include "include/http_scan.h"
+#include <string.h>
+#include <strings.h> // For strncasecmp
+#include <pthread.h>
+
+// Parser states, one per position in the request grammar.
+enum {
+    S_METHOD,
+    S_TARGET,
+    S_VERSION,
+    S_REQUEST_LINE_LF,
+    S_LINE_START,
+    S_HEADER_NAME,
+    S_HEADER_VALUE_WS,
+    S_HEADER_VALUE,
+    S_HEADER_LF,
+    S_FINAL_LF,
+    S_DONE
+};
+
+// Spelled as they appear on the wire; indexed by http_header_id.
+static const char *const known_header_names[HDR_COUNT] = {
+    [HDR_HOST] = "Host",
+    [HDR_CONNECTION] = "Connection",
+    [HDR_CONTENT_LENGTH] = "Content-Length",
+    [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [HDR_EXPECT] = "Expect",
+    [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+    [HDR_RANGE] = "Range",
+    [HDR_IF_RANGE] = "If-Range",
+    [HDR_IF_NONE_MATCH] = "If-None-Match",
+    [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+    [HDR_UPGRADE] = "Upgrade",
+    [HDR_HTTP2_SETTINGS] = "HTTP2-Settings",
+};
+
+static perfect_hash known_headers;
+static pthread_once_t known_headers_once = PTHREAD_ONCE_INIT;
+
+static void build_known_headers(void) {
+    // Only fails on allocation failure; lookups then report every header as unknown.
+    phash_build(&known_headers, known_header_names, HDR_COUNT);
+}
+
+/**
+ * @brief Maps a header name to its http_header_id (case-insensitively).
+ */
+int http_header_lookup(const char *name, size_t len) {
+    pthread_once(&known_headers_once, build_known_headers);
+    return phash_find(&known_headers, name, len);
+}
+
+/**
+ * @brief Prepares the parser for a new request.
+ */
+void http_request_reset(http_request *req) {
+    req->state = S_METHOD;
+    req->pos = 0;
+    req->mark = 0;
+    req->base = NULL;
+    req->num_headers = 0;
+    memset(req->known, 0, sizeof(req->known));
+    req->header_id = -1;
+    req->header_len = 0;
+    req->error_status = 0;
+    req->method.ptr = req->target.ptr = req->version.ptr = NULL;
+    req->method.len = req->target.len = req->version.len = 0;
+}
+
+static void rebase_slice(http_slice *slice, const char *old_base, const char *new_base) {
+    if (slice->ptr) slice->ptr = new_base + (slice->ptr - old_base);
+}
+
+/**
+ * @brief Moves every slice to a buffer that now lives at a different address.
+ */
+static void rebase(http_request *req, const char *new_base) {
+    const char *old_base = req->base;
+    rebase_slice(&req->method, old_base, new_base);
+    rebase_slice(&req->target, old_base, new_base);
+    rebase_slice(&req->version, old_base, new_base);
+    // Includes the header whose name has been seen but whose value is still arriving.
+    for (int i = 0; i <= req->num_headers && i < MAX_HEADERS; i++) {
+        rebase_slice(&req->headers[i].name, old_base, new_base);
+        rebase_slice(&req->headers[i].value, old_base, new_base);
+    }
+}
+
+static parse_result fail(http_request *req, int status) {
+    req->error_status = status;
+    return PARSE_ERROR;
+}
+
+/**
+ * @brief Writes '\0' after each slice so callers can treat them as C strings.
+ */
+static void terminate_slices(http_request *req, char *buf) {
+    buf[req->method.ptr - buf + req->method.len] = '\0';
+    buf[req->target.ptr - buf + req->target.len] = '\0';
+    buf[req->version.ptr - buf + req->version.len] = '\0';
+    for (int i = 0; i < req->num_headers; i++) {
+        buf[req->headers[i].name.ptr - buf + req->headers[i].name.len] = '\0';
+        buf[req->headers[i].value.ptr - buf + req->headers[i].value.len] = '\0';
+    }
+}
+
+/**
+ * @brief Parses as much of buf as is available, resuming where the previous call stopped.
+ */
+parse_result http_parse_request(http_request *req, char *buf, size_t len) {
+    if (req->base && req->base != buf) rebase(req, buf);
+    req->base = buf;
+    if (req->state == S_DONE) return PARSE_COMPLETE;
+
+    const scan_kernels *scan = scan_active();
+    size_t pos = req->pos;
+    while (pos < len) {
+        unsigned char c = (unsigned char)buf[pos];
+
+        switch (req->state) {
+        case S_METHOD:
+            pos += scan->token_end(buf + pos, len - pos);
+            if (pos == len) break;
+            if (buf[pos] != ' ' || pos == req->mark) return fail(req, 400);
+            req->method.ptr = buf + req->mark;
+            req->method.len = pos - req->mark;
+            req->mark = ++pos;
+            req->state = S_TARGET;
+            break;
+
+        case S_TARGET:
+            pos += scan->target_end(buf + pos, len - pos);
+            if (pos == len) break;
+            if (buf[pos] != ' ' || pos == req->mark) return fail(req, 400);
+            req->target.ptr = buf + req->mark;
+            req->target.len = pos - req->mark;
+            req->mark = ++pos;
+            req->state = S_VERSION;
+            break;
+
+        case S_VERSION:
+            while (pos < len && buf[pos] != '\r' && buf[pos] != '\n') pos++;
+            if (pos == len) break;
+            req->version.ptr = buf + req->mark;
+            req->version.len = pos - req->mark;
+            if (req->version.len != 8 || strncmp(req->version.ptr, "HTTP/1.", 7) != 0) return fail(req, 400);
+            req->state = (buf[pos] == '\r') ? S_REQUEST_LINE_LF : S_LINE_START;
+            pos++;
+            break;
+
+        case S_REQUEST_LINE_LF:
+        case S_HEADER_LF:
+            if (c != '\n') return fail(req, 400);
+            pos++;
+            req->state = S_LINE_START;
+            break;
+
+        case S_LINE_START:
+            if (c == '\r') {
+                pos++;
+                req->state = S_FINAL_LF;
+            } else if (c == '\n') {
+                pos++;
+                req->state = S_DONE;
+            } else {
+                if (req->num_headers == MAX_HEADERS) return fail(req, 431);
+                req->mark = pos;
+                req->state = S_HEADER_NAME;
+            }
+            break;
+
+        case S_HEADER_NAME:
+            pos += scan->token_end(buf + pos, len - pos);
+            if (pos == len) break;
+            if (buf[pos] != ':' || pos == req->mark) return fail(req, 400);
+            req->headers[req->num_headers].name.ptr = buf + req->mark;
+            req->headers[req->num_headers].name.len = pos - req->mark;
+            int id = http_header_lookup(buf + req->mark, pos - req->mark);
+            if (id >= 0 && !req->known[id]) req->known[id] = (unsigned char)(req->num_headers + 1);
+            // Only the first copy is ever looked up, so a second framing header must not be
+            // one another server in the chain could read differently (request smuggling).
+            if (id == HDR_TRANSFER_ENCODING && req->known[id] != req->num_headers + 1) return fail(req, 400);
+            req->header_id = id;
+            pos++;
+            req->state = S_HEADER_VALUE_WS;
+            break;
+
+        case S_HEADER_VALUE_WS:
+            while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t')) pos++;
+            if (pos == len) break;
+            req->mark = pos;
+            req->state = S_HEADER_VALUE;
+            break;
+
+        case S_HEADER_VALUE: {
+            pos += scan->line_end(buf + pos, len - pos);
+            if (pos == len) break;
+            if (buf[pos] == '\0') return fail(req, 400);
+
+            // Trim trailing whitespace from the value.
+            size_t end = pos;
+            while (end > req->mark && (buf[end - 1] == ' ' || buf[end - 1] == '\t')) end--;
+            http_header_slice *header = &req->headers[req->num_headers++];
+            header->value.ptr = buf + req->mark;
+            header->value.len = end - req->mark;
+            if (req->header_id == HDR_CONTENT_LENGTH && req->known[HDR_CONTENT_LENGTH] != req->num_headers) {
+                const http_slice *first = &req->headers[req->known[HDR_CONTENT_LENGTH] - 1].value;
+                if (first->len != header->value.len || memcmp(first->ptr, header->value.ptr, first->len) != 0) {
+                    return fail(req, 400); // Copies that agree are harmless; ones that differ are not
+                }
+            }
+
+            req->state = (buf[pos] == '\r') ? S_HEADER_LF : S_LINE_START;
+            pos++;
+            break;
+        }
+
+        case S_FINAL_LF:
+            if (c != '\n') return fail(req, 400);
+            pos++;
+            req->state = S_DONE;
+            break;
+        }
+
+        if (req->state == S_DONE) {
+            req->pos = pos;
+            req->header_len = pos;
+            terminate_slices(req, buf);
+            return PARSE_COMPLETE;
+        }
+    }
+
+    req->pos = pos;
+    return PARSE_INCOMPLETE;
+}
+
+/**
+ * @brief Case-insensitive header lookup on a completed request. Known headers are a table
+ *        hit; any other name falls back to a scan.
+ */
+const char *http_request_header(const http_request *req, const char *name) {
+    size_t name_len = strlen(name);
+    int id = http_header_lookup(name, name_len);
+    if (id >= 0) return http_request_header_id(req, (http_header_id)id);
+
+    for (int i = 0; i < req->num_headers; i++) {
+        if (req->headers[i].name.len == name_len &&
+            strncasecmp(req->headers[i].name.ptr, name, name_len) == 0) {
+            return req->headers[i].value.ptr;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks up a known header on a completed request in constant time.
+ */
+const char *http_request_header_id(const http_request *req, http_header_id id) {
+    int slot = req->known[id];
+    return slot ? req->headers[slot - 1].value.ptr : NULL;
+}
+
+/**
+ * @brief Compares a slice to a C string, case-sensitively.
+ */
+int http_slice_equals(http_slice slice, const char *str) {
+    return strlen(str) == slice.len && memcmp(slice.ptr, str, slice.len) == 0;
+}
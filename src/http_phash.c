@@ -0,0 +1,173 @@
+#include "include/http_phash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // For strncasecmp
+
+#define PHASH_MAX_SEED (1u << 20) // Give up on a bucket (and grow the table) after this many tries
+
+static inline uint64_t load_word(const char *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/**
+ * @brief Hashes the length and up to three 8-byte words (front, middle, back) instead of
+ *        every byte, so a lookup costs the same for any key length. Keys of up to 24 bytes
+ *        are covered completely; longer ones that differ only elsewhere clash, and
+ *        phash_build rejects such sets. OR-ing 0x20 into every byte folds ASCII case (it
+ *        also folds a few punctuation pairs, which the final compare tells apart).
+ */
+static uint32_t phash_hash(const char *key, size_t len) {
+    const uint64_t fold = 0x2020202020202020ULL;
+    uint64_t a = 0, b = 0, c = 0;
+    if (len >= 8) {
+        a = load_word(key) | fold;
+        b = load_word(key + len - 8) | fold;
+        if (len > 16) c = load_word(key + len / 2 - 4) | fold;
+    } else {
+        // Assembled in a register: a short memcpy into a stack word stalls store forwarding.
+        for (size_t i = 0; i < len; i++) a |= (uint64_t)(unsigned char)key[i] << (8 * i);
+        a |= fold;
+    }
+    uint64_t h = (a * 0x9e3779b97f4a7c15ULL) ^ (b * 0xc2b2ae3d27d4eb4fULL) ^ (c * 0x165667b19e3779f9ULL) ^ len;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/**
+ * @brief Mixes a key's hash with a bucket seed; the avalanche makes the low bits (which pick
+ *        the slot) depend on every bit of both. Bucket and slot both derive from one phash_hash.
+ */
+static uint32_t phash_mix(uint32_t h, uint32_t seed) {
+    h ^= seed * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * @brief One placement attempt at a given table size.
+ * @return 0 on success, 1 if some bucket could not be placed (retry larger), -1 on allocation
+ *         failure or keys that can never be separated.
+ */
+static int try_build(perfect_hash *ph, const char *const *keys, int count) {
+    uint32_t slot_count = ph->slot_mask + 1;
+    int *bucket_of = (int *)malloc(sizeof(int) * (size_t)count);
+    int *order = (int *)malloc(sizeof(int) * (size_t)count);   // Keys grouped by bucket, largest first
+    int *bucket_size = (int *)calloc(ph->bucket_count, sizeof(int));
+    uint32_t *pending = (uint32_t *)malloc(sizeof(uint32_t) * (size_t)count);
+    uint32_t *key_hash = (uint32_t *)malloc(sizeof(uint32_t) * (size_t)count);
+    int result = -1;
+    if (!bucket_of || !order || !bucket_size || !pending || !key_hash) goto out;
+
+    for (uint32_t s = 0; s < slot_count; s++) ph->slots[s] = -1;
+    for (int i = 0; i < count; i++) {
+        key_hash[i] = phash_hash(keys[i], strlen(keys[i]));
+        bucket_of[i] = (int)(key_hash[i] % ph->bucket_count);
+        bucket_size[bucket_of[i]]++;
+    }
+
+    // Place crowded buckets first, while the table is still empty.
+    int placed_keys = 0;
+    for (int size = count; size > 0 && placed_keys < count; size--) {
+        for (uint32_t b = 0; b < ph->bucket_count; b++) {
+            if (bucket_size[b] != size) continue;
+
+            int members = 0;
+            for (int i = 0; i < count; i++) {
+                if (bucket_of[i] != (int)b) continue;
+                // Equal hashes collide under every seed: duplicate keys (or a 32-bit hash clash).
+                for (int m = 0; m < members; m++) {
+                    if (key_hash[order[m]] == key_hash[i]) goto out;
+                }
+                order[members++] = i;
+            }
+
+            uint32_t seed;
+            for (seed = 1; seed < PHASH_MAX_SEED; seed++) {
+                int ok = 1;
+                for (int m = 0; m < members && ok; m++) {
+                    pending[m] = phash_mix(key_hash[order[m]], seed) & ph->slot_mask;
+                    if (ph->slots[pending[m]] != -1) ok = 0;
+                    for (int prev = 0; prev < m && ok; prev++) {
+                        if (pending[prev] == pending[m]) ok = 0;
+                    }
+                }
+                if (ok) break;
+            }
+            if (seed == PHASH_MAX_SEED) {
+                result = 1;
+                goto out;
+            }
+
+            ph->seeds[b] = seed;
+            for (int m = 0; m < members; m++) ph->slots[pending[m]] = order[m];
+            placed_keys += members;
+        }
+    }
+    result = 0;
+
+out:
+    free(bucket_of);
+    free(order);
+    free(bucket_size);
+    free(pending);
+    free(key_hash);
+    return result;
+}
+
+/**
+ * @brief Builds a table over count distinct keys.
+ */
+int phash_build(perfect_hash *ph, const char *const *keys, int count) {
+    memset(ph, 0, sizeof(*ph));
+    ph->keys = keys;
+
+    // Two slots per key keeps the search short; grow if a bucket still cannot be placed.
+    uint32_t slot_count = 8;
+    while (slot_count < 2u * (uint32_t)count) slot_count <<= 1;
+
+    for (int attempt = 0; attempt < 4; attempt++, slot_count <<= 1) {
+        ph->slot_mask = slot_count - 1;
+        ph->bucket_count = (uint32_t)count / 2 + 1;
+        ph->seeds = (uint32_t *)calloc(ph->bucket_count, sizeof(uint32_t));
+        ph->slots = (int *)malloc(sizeof(int) * slot_count);
+        if (!ph->seeds || !ph->slots) {
+            phash_free(ph);
+            return -1;
+        }
+
+        int rc = try_build(ph, keys, count);
+        if (rc == 0) return 0;
+        phash_free(ph);
+        ph->keys = keys;
+        if (rc < 0) return -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Looks up key[0..len).
+ */
+int phash_find(const perfect_hash *ph, const char *key, size_t len) {
+    if (!ph->slots) return -1;
+    uint32_t h = phash_hash(key, len);
+    int index = ph->slots[phash_mix(h, ph->seeds[h % ph->bucket_count]) & ph->slot_mask];
+    if (index < 0) return -1;
+
+    const char *candidate = ph->keys[index];
+    return strncasecmp(candidate, key, len) == 0 && candidate[len] == '\0' ? index : -1;
+}
+
+/**
+ * @brief Releases the table (not the keys).
+ */
+void phash_free(perfect_hash *ph) {
+    free(ph->seeds);
+    free(ph->slots);
+    ph->seeds = NULL;
+    ph->slots = NULL;
+}
@@ -0,0 +1,71 @@
+#include "include/http_pool.h"
+#include <stdlib.h>
+#include <stdint.h> // For uintptr_t
+
+/**
+ * @brief Takes an object from the pool, adding a slab if the free list is empty.
+ */
+void *pool_alloc(object_pool *pool) {
+    if (pool->free_list) {
+        void *object = pool->free_list;
+        pool->free_list = *(void **)object;
+        return object;
+    }
+
+    if (pool->slab_left == 0) {
+        // malloc memory is aligned for any type, which covers POOL_ALIGNMENT on our targets.
+        char *slab = (char *)malloc(pool->object_size * pool->objects_per_slab);
+        if (!slab) return NULL;
+        pool->slab_next = slab;
+        pool->slab_left = pool->objects_per_slab;
+    }
+
+    void *object = pool->slab_next;
+    pool->slab_next += pool->object_size;
+    pool->slab_left--;
+    return object;
+}
+
+/**
+ * @brief Returns an object to the pool's free list.
+ */
+void pool_free(object_pool *pool, void *object) {
+    if (!object) return;
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+}
+
+/**
+ * @brief Points the arena at buf (cap bytes).
+ */
+void arena_init(arena *a, void *buf, size_t cap) {
+    a->base = (char *)buf;
+    a->cap = cap;
+    a->used = 0;
+}
+
+/**
+ * @brief Carves size bytes from the arena, or returns NULL if it is full.
+ */
+void *arena_alloc(arena *a, size_t size) {
+    uintptr_t start = ((uintptr_t)(a->base + a->used) + POOL_ALIGNMENT - 1) & ~(uintptr_t)(POOL_ALIGNMENT - 1);
+    size_t offset = (size_t)(start - (uintptr_t)a->base);
+    if (offset > a->cap || size > a->cap - offset) return NULL;
+    a->used = offset + size;
+    return a->base + offset;
+}
+
+/**
+ * @brief Returns non-zero if ptr was handed out by this arena.
+ */
+int arena_owns(const arena *a, const void *ptr) {
+    const char *p = (const char *)ptr;
+    return p >= a->base && p < a->base + a->cap;
+}
+
+/**
+ * @brief Releases every allocation at once.
+ */
+void arena_reset(arena *a) {
+    a->used = 0;
+}
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE // For DT_DIR and friends in struct dirent, pread and futimens
+#include "include/http_precompress.h"
+#include "include/http_encoding.h"
+#include "include/http_mime.h"
+#include "include/http_config.h"
+#include "include/http_body.h"
+#include "include/http_metrics.h"
+#include "include/http_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t cap;
+    size_t next;       // Next path to hand out (atomic)
+    unsigned written;  // Sidecars written (atomic)
+    unsigned current;  // Sidecars found up to date (atomic)
+    unsigned failed;   // Files or sidecars that could not be processed (atomic)
+} precompress_job;
+
+static int sidecar_level(content_coding coding) {
+    switch (coding) {
+    case CODING_GZIP:
+        return PRECOMPRESS_GZIP_LEVEL;
+    case CODING_BROTLI:
+        return PRECOMPRESS_BROTLI_LEVEL;
+    case CODING_ZSTD:
+        return PRECOMPRESS_ZSTD_LEVEL;
+    default:
+        return 0;
+    }
+}
+
+static int add_path(precompress_job *job, const char *path) {
+    if (job->count == job->cap) {
+        size_t cap = job->cap ? job->cap * 2 : 256;
+        char **grown = (char **)realloc(job->paths, cap * sizeof(char *));
+        if (!grown) return -1;
+        job->paths = grown;
+        job->cap = cap;
+    }
+    if (!(job->paths[job->count] = strdup(path))) return -1;
+    job->count++;
+    return 0;
+}
+
+/**
+ * @brief Collects the files under path that are served compressed. Symlinked files are
+ *        included, symlinked directories are not followed (they could loop).
+ */
+static int collect(precompress_job *job, const char *path, int depth) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        log_error("Cannot read directory %s: %s", path, strerror(errno));
+        return -1;
+    }
+    const server_config *config = config_current();
+    int rc = 0;
+    struct dirent *ent;
+    char child[CONFIG_PATH_MAX * 2];
+    while (rc == 0 && (ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        unsigned char type = ent->d_type;
+        if (type == DT_DIR || type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(child, &st) != 0) continue;
+            if (S_ISDIR(st.st_mode)) {
+                if (depth < PRECOMPRESS_MAX_DEPTH) rc = collect(job, child, depth + 1);
+                continue;
+            }
+        }
+        // Sidecars are never compressed again themselves.
+        if (encoding_from_file_name(ent->d_name, NULL) != CODING_IDENTITY) continue;
+        struct stat st;
+        if (stat(child, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size < config->compress_min_size ||
+            !encoding_type_allowed(mime_lookup(child))) {
+            continue;
+        }
+        rc = add_path(job, child);
+    }
+    closedir(dir);
+    return rc;
+}
+
+static int up_to_date(const char *sidecar, const struct stat *file_st) {
+    struct stat st;
+    if (stat(sidecar, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    return st.st_mtim.tv_sec > file_st->st_mtim.tv_sec ||
+           (st.st_mtim.tv_sec == file_st->st_mtim.tv_sec && st.st_mtim.tv_nsec >= file_st->st_mtim.tv_nsec);
+}
+
+/**
+ * @brief Compresses the file into a temporary sidecar and moves it into place.
+ * @return 1 if written, 0 if it would not have been smaller than the file, -1 on error.
+ */
+static int write_sidecar(int fd, const struct stat *file_st, const char *sidecar, content_coding coding,
+                         unsigned char *in, unsigned char *out) {
+    encoder_stream *encoder = encoder_stream_create(coding, sidecar_level(coding));
+    if (!encoder) return -1;
+    body_upload *upload = body_upload_open(sidecar);
+    if (!upload) {
+        encoder_stream_destroy(encoder);
+        return -1;
+    }
+
+    off_t offset = 0;
+    size_t in_len = 0, in_pos = 0, total = 0;
+    int finish = 0, rc = 0;
+    while (rc == 0) {
+        if (in_pos == in_len && !finish) {
+            ssize_t n = pread(fd, in, PRECOMPRESS_BUFFER_SIZE, offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                rc = -1;
+                break;
+            }
+            in_len = (size_t)n;
+            in_pos = 0;
+            offset += n;
+            finish = n == 0 || offset >= file_st->st_size;
+        }
+        size_t used, produced;
+        rc = encoder_stream_compress(encoder, in + in_pos, in_len - in_pos, finish, out, PRECOMPRESS_BUFFER_SIZE,
+                                     &used, &produced);
+        if (rc < 0) break;
+        in_pos += used;
+        total += produced;
+        if (total >= (size_t)file_st->st_size) {
+            rc = 2; // Not worth keeping
+            break;
+        }
+        if (body_upload_write(upload, (const char *)out, produced) != 0) rc = -1;
+    }
+    encoder_stream_destroy(encoder);
+    if (rc != 1) {
+        body_upload_abort(upload);
+        return rc == 2 ? 0 : -1;
+    }
+
+    // The file's own mtime marks which version of it the sidecar holds (see open_sidecars).
+    struct timespec times[2] = { file_st->st_atim, file_st->st_mtim };
+    int created;
+    if (fchmod(upload->fd, file_st->st_mode & 0777) != 0 || futimens(upload->fd, times) != 0) {
+        body_upload_abort(upload);
+        return -1;
+    }
+    return body_upload_commit(upload, &created) == 0 ? 1 : -1;
+}
+
+/**
+ * @brief Brings every supported coding's sidecar of one file up to date.
+ */
+static void precompress_file(precompress_job *job, const char *path, unsigned char *in, unsigned char *out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0) {
+        log_error("Cannot precompress %s: %s", path, strerror(errno));
+        __atomic_add_fetch(&job->failed, 1, __ATOMIC_RELAXED);
+        if (fd != -1) close(fd);
+        return;
+    }
+
+    char sidecar[CONFIG_PATH_MAX * 2 + 8];
+    for (int c = CODING_IDENTITY + 1; c < CODING_COUNT; c++) {
+        if (!encoding_supported((content_coding)c)) continue;
+        snprintf(sidecar, sizeof(sidecar), "%s%s", path, encoding_file_suffix((content_coding)c));
+        if (up_to_date(sidecar, &st)) {
+            __atomic_add_fetch(&job->current, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        int rc = write_sidecar(fd, &st, sidecar, (content_coding)c, in, out);
+        if (rc > 0) {
+            __atomic_add_fetch(&job->written, 1, __ATOMIC_RELAXED);
+        } else if (rc < 0) {
+            log_error("Cannot write %s: %s", sidecar, strerror(errno));
+            __atomic_add_fetch(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    close(fd);
+}
+
+static void *precompress_loop(void *arg) {
+    precompress_job *job = (precompress_job *)arg;
+    unsigned char *in = (unsigned char *)malloc(PRECOMPRESS_BUFFER_SIZE);
+    unsigned char *out = (unsigned char *)malloc(PRECOMPRESS_BUFFER_SIZE);
+    if (!in || !out) {
+        free(in);
+        free(out);
+        return NULL; // The other threads take over its share
+    }
+
+    size_t i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count) {
+        precompress_file(job, job->paths[i], in, out);
+    }
+    free(in);
+    free(out);
+    return NULL;
+}
+
+/**
+ * @brief Writes the precompressed sidecars of every compressed file under root.
+ */
+int precompress_tree(const char *root, unsigned threads) {
+    uint64_t start = metrics_now();
+    precompress_job job;
+    memset(&job, 0, sizeof(job));
+    int rc = collect(&job, root, 0);
+
+    if (threads == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = num_cpus > 0 ? (unsigned)num_cpus : 1;
+    }
+    if (threads > job.count) threads = job.count > 0 ? (unsigned)job.count : 1;
+
+    pthread_t *helpers = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    unsigned started = 0;
+    while (helpers && started + 1 < threads && pthread_create(&helpers[started], NULL, precompress_loop, &job) == 0) {
+        started++;
+    }
+    precompress_loop(&job); // This thread takes a share as well
+    for (unsigned i = 0; i < started; i++) pthread_join(helpers[i], NULL);
+    free(helpers);
+
+    // A share left over because no thread could get buffers counts as failed.
+    if (job.next < job.count) job.failed += (unsigned)(job.count - job.next);
+    for (size_t i = 0; i < job.count; i++) free(job.paths[i]);
+    free(job.paths);
+
+    log_info("Precompressed %zu files under %s with %u threads in %.1f s: %u sidecars written, %u up to date, "
+             "%u failed.", job.count, root, started + 1, (double)(metrics_now() - start) / 1e9, job.written,
+             job.current, job.failed);
+    return rc == 0 && job.failed == 0 ? 0 : -1;
+}
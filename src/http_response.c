@@ -0,0 +1,148 @@
+#define _GNU_SOURCE // For gmtime_r
+#include "include/http_response.h"
+#include "include/http_h2.h"
+#include "include/http_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAGMENT(s) s, sizeof(s) - 1
+
+typedef struct {
+    int status_code;
+    const char *line;
+    size_t len;
+} status_fragment;
+
+// Status lines the server sends routinely; anything else is formatted on demand.
+static const status_fragment status_lines[] = {
+    { 200, FRAGMENT("HTTP/1.1 200 OK\r\n") },
+    { 201, FRAGMENT("HTTP/1.1 201 Created\r\n") },
+    { 204, FRAGMENT("HTTP/1.1 204 No Content\r\n") },
+    { 206, FRAGMENT("HTTP/1.1 206 Partial Content\r\n") },
+    { 304, FRAGMENT("HTTP/1.1 304 Not Modified\r\n") },
+    { 400, FRAGMENT("HTTP/1.1 400 Bad Request\r\n") },
+    { 403, FRAGMENT("HTTP/1.1 403 Forbidden\r\n") },
+    { 404, FRAGMENT("HTTP/1.1 404 Not Found\r\n") },
+    { 413, FRAGMENT("HTTP/1.1 413 Content Too Large\r\n") },
+    { 416, FRAGMENT("HTTP/1.1 416 Range Not Satisfiable\r\n") },
+    { 431, FRAGMENT("HTTP/1.1 431 Request Header Fields Too Large\r\n") },
+    { 500, FRAGMENT("HTTP/1.1 500 Internal Server Error\r\n") },
+    { 501, FRAGMENT("HTTP/1.1 501 Not Implemented\r\n") },
+    { 503, FRAGMENT("HTTP/1.1 503 Service Unavailable\r\n") },
+};
+
+static const char CONNECTION_KEEP_ALIVE[] = "Connection: keep-alive\r\n\r\n";
+static const char CONNECTION_CLOSE[] = "Connection: close\r\n\r\n";
+
+// Each worker thread keeps its own Date line and rebuilds it when the second changes.
+static _Thread_local time_t date_second = -1;
+static _Thread_local char date_line[64];
+static _Thread_local size_t date_len;
+
+/**
+ * @brief Returns "Date: <IMF-fixdate>\r\n" for the current second.
+ */
+static const char *current_date_line(size_t *len) {
+    time_t now = time(NULL);
+    if (now != date_second) {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        date_len = strftime(date_line, sizeof(date_line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        date_second = now;
+    }
+    *len = date_len;
+    return date_line;
+}
+
+static void append(http_response *res, const char *bytes, size_t len) {
+    if (res->overflow || len > RESPONSE_HEAD_SIZE - res->len) {
+        res->overflow = 1;
+        return;
+    }
+    memcpy(res->head + res->len, bytes, len);
+    res->len += len;
+}
+
+/**
+ * @brief Starts a response with its status line and the cached Date header.
+ */
+void response_begin(http_response *res, int status_code, const char *status_text) {
+    res->len = 0;
+    res->overflow = 0;
+
+    int found = 0;
+    for (size_t i = 0; i < sizeof(status_lines) / sizeof(status_lines[0]); i++) {
+        if (status_lines[i].status_code == status_code) {
+            append(res, status_lines[i].line, status_lines[i].len);
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        char line[128];
+        int len = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", status_code, status_text);
+        append(res, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+    }
+
+    size_t date_len;
+    const char *date = current_date_line(&date_len);
+    append(res, date, date_len);
+}
+
+/**
+ * @brief Appends one "Name: value" header field.
+ */
+void response_add_header(http_response *res, const char *name, const char *value) {
+    append(res, name, strlen(name));
+    append(res, ": ", 2);
+    append(res, value, strlen(value));
+    append(res, "\r\n", 2);
+}
+
+/**
+ * @brief Appends prebuilt header lines verbatim.
+ */
+void response_add_raw(http_response *res, const char *lines, size_t len) {
+    append(res, lines, len);
+}
+
+/**
+ * @brief Appends "Content-Length: <len>" without going through printf.
+ */
+void response_add_content_length(http_response *res, size_t len) {
+    char digits[24];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = (char)('0' + len % 10);
+        len /= 10;
+    } while (len > 0);
+
+    append(res, "Content-Length: ", 16);
+    append(res, digits + pos, sizeof(digits) - pos);
+    append(res, "\r\n", 2);
+}
+
+/**
+ * @brief Appends the Connection field and the blank line that ends the header block.
+ */
+void response_end(http_response *res, const char *connection_header) {
+    if (strcmp(connection_header, "close") == 0) {
+        append(res, CONNECTION_CLOSE, sizeof(CONNECTION_CLOSE) - 1);
+    } else {
+        append(res, CONNECTION_KEEP_ALIVE, sizeof(CONNECTION_KEEP_ALIVE) - 1);
+    }
+}
+
+/**
+ * @brief Copies the finished header block onto the connection's output queue (or hands it to
+ *        the HTTP/2 stream, which re-encodes it as HEADERS).
+ */
+int response_queue(http_conn *conn, const http_response *res) {
+    if (res->overflow) {
+        log_error("Response header block exceeds %d bytes.", RESPONSE_HEAD_SIZE);
+        return -1;
+    }
+    if (conn->stream) return h2_stream_set_head(conn, res->head, res->len);
+    return conn_queue(conn, res->head, res->len);
+}
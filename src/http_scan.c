@@ -0,0 +1,204 @@
+#include "include/http_scan.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+// RFC 9110 tchar: characters allowed in methods and header names.
+static const unsigned char token_chars[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1, 0, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// --- Scalar kernels (also finish the tail of every vector kernel) ---
+
+static size_t scalar_line_end(const char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && p[i] != '\r' && p[i] != '\n' && p[i] != '\0') i++;
+    return i;
+}
+
+static size_t scalar_target_end(const char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && (unsigned char)p[i] > ' ' && p[i] != 0x7f) i++;
+    return i;
+}
+
+static size_t scalar_token_end(const char *p, size_t len) {
+    size_t i = 0;
+    while (i < len && token_chars[(unsigned char)p[i]]) i++;
+    return i;
+}
+
+static const scan_kernels scalar_kernels = { "scalar", scalar_line_end, scalar_target_end, scalar_token_end };
+
+#ifdef SCAN_HAVE_X86
+
+// tchar as a nibble table: byte c is a token character iff
+// TOKEN_LO[c & 0xf] & TOKEN_HI[c >> 4] is non-zero. Each high nibble 2..7 owns one bit, and
+// TOKEN_LO[l] sets the bits of the rows in which low nibble l is allowed.
+#define TOKEN_LO 0x3a, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3e, 0x3e, 0x3d, 0x15, 0x34, 0x15, 0x3d, 0x1c
+#define TOKEN_HI 0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0, 0, 0, 0, 0, 0, 0, 0
+
+// --- SSE4.2 kernels: 16 bytes per step ---
+
+__attribute__((target("sse4.2")))
+static size_t sse42_line_end(const char *p, size_t len) {
+    const __m128i delimiters = _mm_setr_epi8('\r', '\n', '\0', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+        int index = _mm_cmpestri(delimiters, 3, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) return i + (size_t)index;
+    }
+    return i + scalar_line_end(p + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t sse42_target_end(const char *p, size_t len) {
+    const __m128i ranges = _mm_setr_epi8(0x00, 0x20, 0x7f, 0x7f, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+        int index = _mm_cmpestri(ranges, 4, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (index < 16) return i + (size_t)index;
+    }
+    return i + scalar_target_end(p + i, len - i);
+}
+
+// tchar has ten ranges, more than PCMPESTRI takes, so tokens use the PSHUFB nibble table.
+__attribute__((target("sse4.2")))
+static size_t sse42_token_end(const char *p, size_t len) {
+    const __m128i lo_table = _mm_setr_epi8(TOKEN_LO);
+    const __m128i hi_table = _mm_setr_epi8(TOKEN_HI);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lo = _mm_shuffle_epi8(lo_table, _mm_and_si128(block, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+        __m128i invalid = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+        unsigned mask = (unsigned)_mm_movemask_epi8(invalid);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    return i + scalar_token_end(p + i, len - i);
+}
+
+static const scan_kernels sse42_kernels = { "sse4.2", sse42_line_end, sse42_target_end, sse42_token_end };
+
+// --- AVX2 kernels: 32 bytes per step ---
+
+__attribute__((target("avx2")))
+static size_t avx2_line_end(const char *p, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i nul = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, lf)),
+                                      _mm256_cmpeq_epi8(block, nul));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    _mm256_zeroupper(); // The legacy-SSE tail would otherwise pay for dirty upper halves
+    return i + sse42_line_end(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_target_end(const char *p, size_t len) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+        // Unsigned c <= ' ' is min(c, ' ') == c.
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(block, space), block);
+        __m256i hit = _mm256_or_si256(control, _mm256_cmpeq_epi8(block, del));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return i + sse42_target_end(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_token_end(const char *p, size_t len) {
+    const __m256i lo_table = _mm256_setr_epi8(TOKEN_LO, TOKEN_LO);
+    const __m256i hi_table = _mm256_setr_epi8(TOKEN_HI, TOKEN_HI);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(block, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(block, 4), nibble));
+        __m256i invalid = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256());
+        unsigned mask = (unsigned)_mm256_movemask_epi8(invalid);
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+    _mm256_zeroupper();
+    return i + sse42_token_end(p + i, len - i);
+}
+
+static const scan_kernels avx2_kernels = { "avx2", avx2_line_end, avx2_target_end, avx2_token_end };
+
+#endif // SCAN_HAVE_X86
+
+static const scan_kernels *active_kernels; // Chosen on first use (atomic; racing first uses agree)
+
+/**
+ * @brief A specific level's kernels, or NULL if unsupported here.
+ */
+const scan_kernels *scan_kernels_for(scan_level level) {
+    switch (level) {
+    case SCAN_SCALAR:
+        return &scalar_kernels;
+#ifdef SCAN_HAVE_X86
+    case SCAN_SSE42:
+        return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("ssse3") ? &sse42_kernels : NULL;
+    case SCAN_AVX2:
+        // The AVX2 tails fall back to the SSE4.2 kernels.
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2") ? &avx2_kernels : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * @brief Caps the level scan_active picks.
+ */
+void scan_limit(scan_level max_level) {
+    const scan_kernels *best = &scalar_kernels;
+    for (int level = SCAN_SCALAR; level <= (int)max_level && level < SCAN_LEVEL_COUNT; level++) {
+        const scan_kernels *kernels = scan_kernels_for((scan_level)level);
+        if (kernels) best = kernels;
+    }
+    __atomic_store_n(&active_kernels, best, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief The kernels the parser uses: the best level this CPU supports.
+ */
+const scan_kernels *scan_active(void) {
+    const scan_kernels *kernels = __atomic_load_n(&active_kernels, __ATOMIC_ACQUIRE);
+    if (kernels) return kernels;
+    scan_limit(SCAN_LEVEL_COUNT - 1);
+    return __atomic_load_n(&active_kernels, __ATOMIC_ACQUIRE);
+}
@@ -1,32 +1,164 @@
+#define _GNU_SOURCE // For accept4, CPU_SET and pthread_setaffinity_np
 #include "include/http_server.h"
 #include "include/http_handler.h"
+#include "include/http_uring.h"
+#include "include/http_log.h"
+#include "include/http_config.h"
+#include "include/http_watch.h"
+#include "include/http_cache.h"
+#include "include/http_fdcache.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
 #include <pthread.h>
+#include <sched.h>
+
+typedef struct {
+    int id;
+    int listen_fd;
+    int epoll_fd;
+    io_backend backend;
+    pthread_t thread;
+} worker_t;
 
 /**
- * @brief Initializes and runs the HTTP server loop.
+ * @brief Raises the open-file soft limit to the hard limit so each worker can hold
+ *        thousands of idle keep-alive sockets.
+ */
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+            perror("setrlimit(RLIMIT_NOFILE) failed");
+        }
+    }
+}
+
+/**
+ * @brief Accepts every pending connection and registers it with the worker's epoll set.
+ */
+static void accept_connections(worker_t *worker) {
+    while (1) {
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        int new_socket = accept4(worker->listen_fd, (struct sockaddr *)&peer, &peer_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) log_error("Accept failed: %s", strerror(errno));
+            return;
+        }
+
+        http_conn *conn = conn_accept(new_socket, &peer);
+        if (!conn) continue; // Refused (already answered with 503) or out of memory
+
+        // Edge-triggered: one notification per readiness change, for both directions.
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, new_socket, &event) < 0) {
+            log_error("epoll_ctl(ADD) failed for client socket: %s", strerror(errno));
+            conn_destroy(conn);
+            continue;
+        }
+
+        log_debug("Connection accepted on socket %d by worker %d.", new_socket, worker->id);
+    }
+}
+
+/**
+ * @brief Advances a connection's state machine after a readiness event.
+ * @return 1 if the connection is still alive, 0 if it has been closed.
  */
-int run_server(int port) {
-    int server_fd, new_socket;
+static int handle_connection_event(http_conn *conn, uint32_t events) {
+    if (events & EPOLLERR) {
+        conn_destroy(conn);
+        return 0;
+    }
+
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && conn_on_readable(conn) == CONN_IO_ERROR) {
+        conn_destroy(conn);
+        return 0;
+    }
+
+    conn_io_result flushed = conn_flush(conn);
+    if (flushed == CONN_IO_ERROR || (flushed == CONN_IO_DONE && conn->state == CONN_CLOSING)) {
+        log_debug("Connection closed on socket %d.", conn->fd);
+        conn_destroy(conn);
+        return 0;
+    }
+
+    conn_refresh_timeout(conn);
+    return 1;
+}
+
+/**
+ * @brief Worker thread entry point. Runs one event loop (io_uring or epoll) over the
+ *        worker's own listener and every connection it has accepted.
+ */
+static void *worker_loop(void *arg) {
+    worker_t *worker = (worker_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (worker->backend == IO_BACKEND_URING) {
+        if (uring_run_worker(worker->listen_fd, worker->id) == 0) return NULL;
+        log_warn("Worker %d: io_uring setup failed. Falling back to epoll.", worker->id);
+    }
+
+    while (1) {
+        // Sleep no longer than the next timeout check (forever if no connection has a timer).
+        int ready = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, conn_timeout_wait_ms());
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            break;
+        }
+
+        admission_batch_begin();
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections(worker);
+            } else {
+                handle_connection_event((http_conn *)events[i].data.ptr, events[i].events);
+            }
+        }
+
+        // After the events, so none of them refers to a connection closed here.
+        conn_expire_timeouts(conn_destroy);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Creates a non-blocking SO_REUSEPORT listener bound to the given port.
+ *        Every worker owns one, so the kernel spreads incoming connections across them.
+ * @return The listening socket, or -1 on error.
+ */
+static int create_listener(int port) {
+    int server_fd;
     struct sockaddr_in address;
-    int addrlen = sizeof(address);
     int opt = 1;
 
     // 1. Create socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
         perror("Socket creation failed");
-        return EXIT_FAILURE;
+        return -1;
     }
 
-    // 2. Attach socket to the defined port
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    // 2. Attach socket to the defined port, shared with the other workers' listeners
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
         perror("setsockopt failed");
         close(server_fd);
-        return EXIT_FAILURE;
+        return -1;
     }
 
     address.sin_family = AF_INET;
@@ -37,49 +169,152 @@ int run_server(int port) {
     if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("Bind failed");
         close(server_fd);
-        return EXIT_FAILURE;
+        return -1;
     }
 
     // 4. Start listening
-    if (listen(server_fd, MAX_CONNECTIONS) < 0) {
+    if (listen(server_fd, (int)config_current()->listen_backlog) < 0) {
         perror("Listen failed");
         close(server_fd);
-        return EXIT_FAILURE;
+        return -1;
     }
 
-    printf("--- Simple HTTP Server (Concurrent) ---\n");
-    printf("Listening on port %d. Ready to accept connections...\n", port);
+    return server_fd;
+}
 
-    // Main server loop
-    while(1) {
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-            perror("Accept failed");
-            continue;
-        }
+/**
+ * @brief Creates the worker's listener and epoll set, then starts its thread, pinned to one
+ *        CPU when pin_workers is set. A CPU the process may not use (a cpuset or container
+ *        limit) only costs the pinning: the worker runs wherever the scheduler puts it.
+ * @return 0 on success, -1 on error (nothing is left open).
+ */
+static int start_worker(worker_t *worker, int id, int port, int num_cpus, io_backend backend) {
+    worker->id = id;
+    worker->backend = backend;
+    worker->listen_fd = create_listener(port);
+    if (worker->listen_fd < 0) return -1;
 
-        int *new_sock_ptr = (int *)malloc(sizeof(int));
-        if (new_sock_ptr == NULL) {
-            perror("Memory allocation failed for new socket pointer");
-            close(new_socket);
-            continue;
+    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (worker->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        close(worker->listen_fd);
+        return -1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // NULL marks the listening socket
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->listen_fd, &event) < 0) {
+        perror("epoll_ctl(ADD) failed for listening socket");
+        close(worker->epoll_fd);
+        close(worker->listen_fd);
+        return -1;
+    }
+
+    int rc = pthread_create(&worker->thread, NULL, worker_loop, worker);
+    if (rc != 0) {
+        fprintf(stderr, "Could not create worker thread %d\n", id);
+        close(worker->epoll_fd);
+        close(worker->listen_fd);
+        return -1;
+    }
+
+    if (config_current()->pin_workers) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(id % num_cpus, &cpus);
+        rc = pthread_setaffinity_np(worker->thread, sizeof(cpus), &cpus);
+        if (rc != 0) {
+            log_warn("Could not pin worker %d to CPU %d (%s); leaving it unpinned.", id, id % num_cpus, strerror(rc));
         }
-        *new_sock_ptr = new_socket;
+    }
 
-        pthread_t thread_id;
+    return 0;
+}
 
-        // Create a new thread to handle the client request
-        if (pthread_create(&thread_id, NULL, client_handler, (void*)new_sock_ptr) < 0) {
-            perror("Could not create thread");
-            free(new_sock_ptr);
-            close(new_socket);
-            continue;
+/**
+ * @brief Reload thread: the only one with SIGHUP unblocked (main blocks it before starting
+ *        any thread), so reloads run here, never inside a worker's event loop.
+ */
+static void *reload_loop(void *arg) {
+    (void)arg;
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    while (1) {
+        int sig;
+        if (sigwait(&signals, &sig) == 0 && sig == SIGHUP) {
+            log_info("SIGHUP received. Reloading configuration...");
+            if (config_reload() == 0) {
+                // Cached variants were compressed, and sidecars chosen, under the old settings.
+                cache_flush();
+                open_file_flush();
+                watch_refresh();
+            }
         }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Initializes and runs the HTTP server loop.
+ */
+int run_server(int port, io_backend backend) {
+    // Writes to a peer that has gone away must fail with EPIPE instead of killing the process.
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1) num_cpus = 1;
+    unsigned configured_workers = config_current()->workers;
+    int num_workers = configured_workers > 0 ? (int)configured_workers : (int)num_cpus;
 
-        pthread_detach(thread_id);
-        printf("\n[Connection accepted] Socket FD: %d. Handed off to thread ID: %lu\n", new_socket, (unsigned long)thread_id);
+    if (backend == IO_BACKEND_URING && !uring_supported()) {
+        log_warn("io_uring is not available on this kernel. Using epoll.");
+        backend = IO_BACKEND_EPOLL;
     }
 
-    // Should not be reached
-    close(server_fd);
-    return EXIT_SUCCESS;
+    // Before the first request, so the caches can trust their entries from the start.
+    watch_start();
+
+    worker_t *workers = (worker_t *)calloc(num_workers, sizeof(worker_t));
+    if (!workers) {
+        perror("Memory allocation failed for workers");
+        return EXIT_FAILURE;
+    }
+
+    // Each worker gets its own SO_REUSEPORT listener and epoll loop, and owns every
+    // connection it accepts for that connection's lifetime.
+    int started = 0;
+    for (int i = 0; i < num_workers; i++) {
+        if (start_worker(&workers[started], i, port, (int)num_cpus, backend) == 0) started++;
+    }
+
+    if (started == 0) {
+        free(workers);
+        return EXIT_FAILURE;
+    }
+
+    pthread_t reloader;
+    if (pthread_create(&reloader, NULL, reload_loop, NULL) == 0) {
+        pthread_detach(reloader);
+    } else {
+        log_warn("Could not start the reload thread; SIGHUP will be ignored.");
+    }
+
+    log_info("--- Simple HTTP Server (%s, %d workers%s) ---",
+             backend == IO_BACKEND_URING ? "io_uring" : "epoll", started, config_current()->pin_workers ? ", pinned" : "");
+    log_info("Listening on port %d. Ready to accept connections...", port);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    // Only reached if every worker has failed
+    for (int i = 0; i < started; i++) {
+        close(workers[i].epoll_fd);
+        close(workers[i].listen_fd);
+    }
+    free(workers);
+    return EXIT_FAILURE;
 }
@@ -0,0 +1,119 @@
+#include "include/http_timer.h"
+#include <string.h>
+
+#define TIMER_SLOT_MASK (TIMER_SLOTS - 1)
+#define TIMER_MAX_DELTA ((1ULL << (TIMER_LEVEL_BITS * TIMER_LEVELS)) - 1)
+
+static void unlink_node(timer_node *node) {
+    *node->pprev = node->next;
+    if (node->next) node->next->pprev = node->pprev;
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+static void push_node(timer_node **head, timer_node *node) {
+    node->next = *head;
+    if (*head) (*head)->pprev = &node->next;
+    node->pprev = head;
+    *head = node;
+}
+
+/**
+ * @brief Files a timer under the lowest level whose span covers its remaining delay. The
+ *        slot is taken from the expiry's own bits at that level, so the slot comes round
+ *        exactly when the timer's block of ticks begins.
+ */
+static void place_node(timer_wheel *wheel, timer_node *node) {
+    uint64_t delta = node->expires - wheel->now;
+    if (delta > TIMER_MAX_DELTA) {
+        delta = TIMER_MAX_DELTA;
+        node->expires = wheel->now + delta;
+    }
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ULL << (TIMER_LEVEL_BITS * (level + 1)))) level++;
+    unsigned slot = (unsigned)(node->expires >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK;
+    push_node(&wheel->slots[level][slot], node);
+}
+
+/**
+ * @brief Starts an empty wheel at the given monotonic time.
+ */
+void timer_wheel_init(timer_wheel *wheel, uint64_t now_ms) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now_ms / TIMER_TICK_MS;
+}
+
+/**
+ * @brief (Re)arms a timer to fire at a monotonic time.
+ */
+void timer_arm(timer_wheel *wheel, timer_node *node, uint64_t deadline_ms) {
+    uint64_t expires = (deadline_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (node->pprev) unlink_node(node);
+    else wheel->armed++;
+    node->expires = expires > wheel->now ? expires : wheel->now + 1;
+    place_node(wheel, node);
+}
+
+/**
+ * @brief Disarms a timer; harmless if it is not armed.
+ */
+void timer_cancel(timer_wheel *wheel, timer_node *node) {
+    if (!node->pprev) return;
+    unlink_node(node);
+    wheel->armed--;
+}
+
+/**
+ * @brief Re-files every timer of a higher-level slot one level (or more) down.
+ */
+static void cascade(timer_wheel *wheel, int level, unsigned slot) {
+    timer_node *list = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    while (list) {
+        timer_node *node = list;
+        list = node->next;
+        node->next = NULL;
+        place_node(wheel, node);
+    }
+}
+
+/**
+ * @brief Turns the wheel up to now_ms, calling expire for every timer that has come due.
+ */
+void timer_advance(timer_wheel *wheel, uint64_t now_ms, void (*expire)(timer_node *node)) {
+    uint64_t target = now_ms / TIMER_TICK_MS;
+    while (wheel->now < target) {
+        if (!wheel->armed) {
+            wheel->now = target; // Nothing to fire or cascade on the way
+            break;
+        }
+        uint64_t tick = ++wheel->now;
+
+        // At the start of each higher-level block, its slot's timers move down.
+        for (int level = 1; level < TIMER_LEVELS; level++) {
+            if (tick & ((1ULL << (TIMER_LEVEL_BITS * level)) - 1)) break;
+            cascade(wheel, level, (unsigned)(tick >> (TIMER_LEVEL_BITS * level)) & TIMER_SLOT_MASK);
+        }
+
+        // Detach the due slot first: callbacks may arm or cancel any timer, these included.
+        timer_node **slot = &wheel->slots[0][tick & TIMER_SLOT_MASK];
+        if (!*slot) continue;
+        timer_node *due = *slot;
+        due->pprev = &due;
+        *slot = NULL;
+        while (due) {
+            timer_node *node = due;
+            unlink_node(node);
+            wheel->armed--;
+            expire(node);
+        }
+    }
+}
+
+/**
+ * @brief How long an event loop may sleep before the wheel needs turning.
+ */
+int timer_wait_ms(const timer_wheel *wheel) {
+    return wheel->armed ? TIMER_TICK_MS : -1;
+}
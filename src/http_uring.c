@@ -0,0 +1,604 @@
+#define _GNU_SOURCE
+#include "include/http_uring.h"
+#include "include/http_handler.h"
+#include "include/http_log.h"
+#include "include/http_metrics.h"
+#include "include/http_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Operation tag stored in the low bits of each SQE's user_data (the rest is the uring_conn pointer).
+#define OP_ACCEPT 1
+#define OP_RECV   2
+#define OP_SEND   3
+#define OP_SPLICE_IN  4 // File chunk -> connection pipe
+#define OP_SPLICE_OUT 5 // Connection pipe -> socket
+#define OP_TICK   6     // Timer for turning the timeout wheel
+#define OP_MASK   7ULL
+
+// Bytes moved per splice; matches the default pipe capacity.
+#define SPLICE_CHUNK 65536
+
+#define RECV_BUFFER_GROUP 0
+
+typedef struct {
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local_tail; // Next SQE slot we will fill
+    unsigned unsubmitted;   // SQEs filled but not yet handed to the kernel
+
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+} uring_ring;
+
+typedef struct {
+    uring_ring ring;
+    int listen_fd;
+    int worker_id;
+    int multishot_accept;
+
+    // Provided-buffer ring for multishot recv (NULL when the kernel lacks it).
+    struct io_uring_buf_ring *buf_ring;
+    char *buf_base;
+    unsigned short buf_tail;
+    int multishot_recv;
+
+    // A TIMEOUT operation wakes the loop while connections have timeouts armed.
+    struct __kernel_timespec tick_ts;
+    int tick_armed;
+} uring_worker;
+
+typedef struct {
+    http_conn *conn;
+
+    // File chunks travel file -> pipe -> socket without entering user space.
+    int pipe_fds[2];   // Created on first use; -1 until then
+    size_t pipe_bytes; // Spliced into the pipe but not yet out to the socket
+
+    // Gathered memory chunks of the in-flight SENDMSG; must stay put until it completes.
+    struct iovec send_iov[CONN_MAX_IOV];
+    struct msghdr send_msg;
+
+    int recv_armed;
+    int send_armed; // A SENDMSG or SPLICE for this connection is in flight
+    uint64_t send_started_ns; // Submission time of that operation, for the write histogram
+    int shut;       // shutdown() issued; released once no operation is in flight
+} uring_conn;
+
+// Per-worker slab pool for uring_conn (the io_uring worker's only per-connection object
+// besides the http_conn, which comes from http_conn.c's own pool).
+#define URING_CONN_POOL_SLAB 64
+static _Thread_local object_pool uring_conn_pool = OBJECT_POOL_INIT(sizeof(uring_conn), URING_CONN_POOL_SLAB);
+
+
+// --- Raw ring plumbing ---
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ring_exit(uring_ring *ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->ring_fd >= 0) close(ring->ring_fd);
+}
+
+/**
+ * @brief Creates the ring and maps its submission and completion queues.
+ * @return 0 on success, -1 on error.
+ */
+static int ring_init(uring_ring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+
+    // Only the owning worker submits, so let the kernel skip cross-thread task work.
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    ring->ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring->ring_fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        ring->ring_fd = sys_io_uring_setup(entries, &params);
+    }
+    if (ring->ring_fd < 0) return -1;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        ring_exit(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            ring_exit(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ring_exit(ring);
+        return -1;
+    }
+
+    char *sq = (char *)ring->sq_ptr;
+    char *cq = (char *)ring->cq_ptr;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sq_local_tail = *ring->sq_tail;
+    return 0;
+}
+
+/**
+ * @brief Hands every filled SQE to the kernel, optionally waiting for completions.
+ * @return 0 on success, -1 on a fatal error.
+ */
+static int ring_submit(uring_ring *ring, unsigned wait_for) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    while (1) {
+        int ret = sys_io_uring_enter(ring->ring_fd, ring->unsubmitted, wait_for,
+                                     wait_for ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            ring->unsubmitted -= (unsigned)ret;
+            return 0;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EBUSY) return 0; // Reap completions, then retry
+        perror("io_uring_enter failed");
+        return -1;
+    }
+}
+
+/**
+ * @brief Returns a zeroed SQE, flushing the queue to the kernel first if it is full.
+ */
+static struct io_uring_sqe *ring_get_sqe(uring_ring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) {
+        if (ring_submit(ring, 0) < 0) return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries) return NULL;
+    }
+
+    unsigned index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    ring->unsubmitted++;
+    return sqe;
+}
+
+static uint64_t tag(uring_conn *uc, unsigned op) {
+    return (uint64_t)(uintptr_t)uc | op;
+}
+
+
+// --- Provided buffers for multishot recv ---
+
+static void recv_buffer_recycle(uring_worker *w, unsigned short bid) {
+    struct io_uring_buf *buf = &w->buf_ring->bufs[w->buf_tail & (URING_RECV_BUFFERS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(w->buf_base + (size_t)bid * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bid;
+    w->buf_tail++;
+    __atomic_store_n(&w->buf_ring->tail, w->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Registers a ring of provided buffers so one multishot recv per connection can
+ *        keep delivering data without being re-armed. Optional (Linux 5.19+).
+ */
+static void recv_buffers_init(uring_worker *w) {
+    size_t ring_len = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring_mem = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_mem == MAP_FAILED) return;
+
+    char *base = (char *)malloc((size_t)URING_RECV_BUFFERS * BUFFER_SIZE);
+    if (!base) {
+        munmap(ring_mem, ring_len);
+        return;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring_mem;
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(w->ring.ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        free(base);
+        munmap(ring_mem, ring_len);
+        return;
+    }
+
+    w->buf_ring = (struct io_uring_buf_ring *)ring_mem;
+    w->buf_base = base;
+    w->buf_tail = 0;
+    for (unsigned short bid = 0; bid < URING_RECV_BUFFERS; bid++) {
+        recv_buffer_recycle(w, bid);
+    }
+    w->multishot_recv = 1;
+}
+
+
+// --- Operation submission ---
+
+static void arm_accept(uring_worker *w) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&w->ring);
+    if (!sqe) return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = w->listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (w->multishot_accept) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = tag(NULL, OP_ACCEPT);
+}
+
+static void arm_recv(uring_worker *w, uring_conn *uc) {
+    http_conn *conn = uc->conn;
+    struct io_uring_sqe *sqe = ring_get_sqe(&w->ring);
+    if (!sqe) return;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    if (w->multishot_recv) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUFFER_GROUP;
+    } else {
+        // Single-shot: receive straight into the connection's input buffer.
+        sqe->addr = (uint64_t)(uintptr_t)(conn->in_buf + conn->in_len);
+        sqe->len = (unsigned)(conn->in_cap - conn->in_len - 1);
+    }
+    sqe->user_data = tag(uc, OP_RECV);
+    uc->recv_armed = 1;
+}
+
+static void arm_tick(uring_worker *w) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&w->ring);
+    if (!sqe) return;
+    w->tick_ts.tv_sec = 0;
+    w->tick_ts.tv_nsec = (long long)conn_timeout_wait_ms() * 1000000LL;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&w->tick_ts;
+    sqe->len = 1;
+    sqe->user_data = tag(NULL, OP_TICK);
+    w->tick_armed = 1;
+}
+
+static void release_if_idle(uring_conn *uc) {
+    if (!uc->shut || uc->recv_armed || uc->send_armed) return;
+    log_debug("Connection closed on socket %d.", uc->conn->fd);
+    conn_destroy(uc->conn);
+    if (uc->pipe_fds[0] >= 0) {
+        close(uc->pipe_fds[0]);
+        close(uc->pipe_fds[1]);
+    }
+    pool_free(&uring_conn_pool, uc);
+}
+
+/**
+ * @brief Drops any unsent output and starts tearing the connection down.
+ */
+static void abort_conn(uring_conn *uc) {
+    conn_output_abort(uc->conn);
+    uc->pipe_bytes = 0;
+}
+
+static void prep_splice(struct io_uring_sqe *sqe, int fd_in, uint64_t off_in, int fd_out, unsigned len) {
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = fd_in;
+    sqe->splice_off_in = off_in;
+    sqe->fd = fd_out;
+    sqe->off = (uint64_t)-1; // Pipes and sockets have no offset
+    sqe->len = len;
+    sqe->splice_flags = SPLICE_F_MOVE;
+}
+
+/**
+ * @brief Submits the next SENDMSG or SPLICE for the head of the output queue, or shuts the
+ *        socket down once a closing connection has nothing left to send.
+ */
+static void pump_output(uring_worker *w, uring_conn *uc) {
+    http_conn *conn = uc->conn;
+    if (uc->send_armed || uc->shut) return;
+
+    while (uc->pipe_bytes > 0 || conn_has_pending_output(conn)) {
+        out_chunk *head = conn->out_head;
+        if (uc->pipe_bytes == 0 && head->file_fd < 0 && head->off == head->len) {
+            conn_output_advance(conn, 0); // Drained memory chunk in front of a file chunk
+            continue;
+        }
+
+        struct io_uring_sqe *sqe = ring_get_sqe(&w->ring);
+        if (!sqe) return;
+
+        if (uc->pipe_bytes > 0) {
+            // Whatever is in the pipe goes out before anything queued behind it.
+            prep_splice(sqe, uc->pipe_fds[0], (uint64_t)-1, conn->fd, (unsigned)uc->pipe_bytes);
+            sqe->user_data = tag(uc, OP_SPLICE_OUT);
+        } else if (head->file_fd >= 0) {
+            if (uc->pipe_fds[0] < 0 && pipe2(uc->pipe_fds, O_CLOEXEC) < 0) {
+                log_error("pipe2 failed: %s", strerror(errno));
+                uc->pipe_fds[0] = uc->pipe_fds[1] = -1;
+                sqe->opcode = IORING_OP_NOP; // Slot is already taken; complete it harmlessly
+                sqe->user_data = 0;
+                abort_conn(uc);
+                break;
+            }
+            unsigned len = head->len < SPLICE_CHUNK ? (unsigned)head->len : SPLICE_CHUNK;
+            prep_splice(sqe, head->file_fd, (uint64_t)head->file_off, uc->pipe_fds[1], len);
+            sqe->user_data = tag(uc, OP_SPLICE_IN);
+        } else {
+            // Every response queued by this batch goes out in one submission.
+            int more = 0;
+            memset(&uc->send_msg, 0, sizeof(uc->send_msg));
+            uc->send_msg.msg_iov = uc->send_iov;
+            uc->send_msg.msg_iovlen = conn_output_iov(conn, uc->send_iov, CONN_MAX_IOV, &more);
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = conn->fd;
+            sqe->addr = (uint64_t)(uintptr_t)&uc->send_msg;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+            sqe->user_data = tag(uc, OP_SEND);
+        }
+        uc->send_armed = 1;
+        uc->send_started_ns = metrics_now();
+        return;
+    }
+
+    if (conn->state == CONN_CLOSING) {
+        // Completes the outstanding recv (with 0), after which the connection is released.
+        shutdown(conn->fd, SHUT_RDWR);
+        uc->shut = 1;
+    }
+}
+
+
+/**
+ * @brief Timeout expiry: shuts the socket down, which also fails any send still in flight
+ *        (a client that stopped reading), and releases the connection once nothing is pending.
+ */
+static void close_timed_out(http_conn *conn) {
+    uring_conn *uc = (uring_conn *)conn->owner;
+    if (uc->shut) return;
+    conn->state = CONN_CLOSING;
+    if (!uc->send_armed) abort_conn(uc); // An in-flight send still uses the queued chunks
+    shutdown(conn->fd, SHUT_RDWR);
+    uc->shut = 1;
+    release_if_idle(uc);
+}
+
+
+// --- Completion handlers ---
+
+static void on_accept(uring_worker *w, int res, unsigned flags) {
+    if (res >= 0) {
+        // Multishot accept has no per-completion address buffer, so the peer is looked up.
+        http_conn *conn = conn_accept(res, NULL);
+        uring_conn *uc = conn ? (uring_conn *)pool_alloc(&uring_conn_pool) : NULL;
+        if (!uc) {
+            conn_destroy(conn);
+        } else {
+            memset(uc, 0, sizeof(uring_conn));
+            uc->conn = conn;
+            conn->owner = uc;
+            uc->pipe_fds[0] = uc->pipe_fds[1] = -1;
+            arm_recv(w, uc);
+            log_debug("Connection accepted on socket %d by worker %d (io_uring).", res, w->worker_id);
+        }
+    } else if (res == -EINVAL && w->multishot_accept) {
+        w->multishot_accept = 0; // Kernel predates multishot accept
+    } else if (res != -EINTR && res != -ECONNABORTED) {
+        log_error("Accept failed: %s", strerror(-res));
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) arm_accept(w);
+}
+
+static void on_recv(uring_worker *w, uring_conn *uc, int res, unsigned flags) {
+    http_conn *conn = uc->conn;
+    if (!(flags & IORING_CQE_F_MORE)) uc->recv_armed = 0;
+
+    if (res > 0) metrics_add(METRIC_BYTES_IN, (uint64_t)res);
+
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        unsigned short bid = (unsigned short)(flags >> IORING_CQE_BUFFER_SHIFT);
+        const char *data = w->buf_base + (size_t)bid * BUFFER_SIZE;
+        size_t len = (size_t)res;
+
+        while (len > 0 && conn->state == CONN_READING) {
+            size_t room = conn->in_cap - conn->in_len - 1;
+            size_t chunk = len < room ? len : room;
+            memcpy(conn->in_buf + conn->in_len, data, chunk);
+            conn->in_len += chunk;
+            data += chunk;
+            len -= chunk;
+            conn_process_input(conn);
+        }
+        recv_buffer_recycle(w, bid);
+    } else if (res > 0) {
+        conn->in_len += (size_t)res;
+        conn_process_input(conn);
+    } else if (res == 0) {
+        if (!uc->shut) log_debug("Client on socket %d disconnected gracefully.", conn->fd);
+        conn->state = CONN_CLOSING; // Still deliver anything already queued
+    } else if (res == -EINVAL && w->multishot_recv) {
+        w->multishot_recv = 0; // Kernel predates multishot recv; fall back to single-shot
+    } else if (res != -ENOBUFS && res != -EINTR) {
+        if (res == -ECONNRESET) log_debug("Client on socket %d reset the connection.", conn->fd);
+        else if (!uc->shut) log_error("Read error on socket %d: %s", conn->fd, strerror(-res));
+        abort_conn(uc);
+    }
+
+    if (!uc->recv_armed && !uc->shut && conn->state == CONN_READING) arm_recv(w, uc);
+    pump_output(w, uc);
+    if (!uc->shut) conn_refresh_timeout(conn);
+    release_if_idle(uc);
+}
+
+static void on_send(uring_worker *w, uring_conn *uc, unsigned op, int res) {
+    uc->send_armed = 0;
+
+    if (res > 0) {
+        if (op != OP_SPLICE_IN) {
+            metrics_observe_stage(STAGE_WRITE, metrics_now() - uc->send_started_ns);
+            conn_note_sent(uc->conn, (size_t)res);
+        }
+        if (op == OP_SPLICE_OUT) {
+            uc->pipe_bytes -= (size_t)res;
+        } else {
+            // SENDMSG progress, or file bytes now parked in the pipe.
+            if (op == OP_SPLICE_IN) uc->pipe_bytes = (size_t)res;
+            conn_output_advance(uc->conn, (size_t)res);
+        }
+    } else if (res == 0 && op == OP_SPLICE_IN) {
+        log_error("File shrank while being sent on socket %d.", uc->conn->fd);
+        abort_conn(uc);
+    } else if (res < 0 && res != -EINTR && res != -EAGAIN) {
+        if (res == -EPIPE || res == -ECONNRESET) {
+            log_debug("Client on socket %d went away mid-response: %s", uc->conn->fd, strerror(-res));
+        } else if (!uc->shut) {
+            log_error("Error writing response data on socket %d: %s", uc->conn->fd, strerror(-res));
+        }
+        abort_conn(uc);
+    }
+
+    pump_output(w, uc);
+    if (!uc->shut) conn_refresh_timeout(uc->conn);
+    release_if_idle(uc);
+}
+
+
+// --- Public API ---
+
+/**
+ * @brief Checks whether the running kernel supports the io_uring operations the backend needs.
+ */
+int uring_supported(void) {
+    uring_ring ring;
+    if (ring_init(&ring, 8) < 0) return 0;
+
+    size_t probe_len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_len);
+    int supported = 0;
+
+    if (probe && sys_io_uring_register(ring.ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        const unsigned needed[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SPLICE };
+        supported = 1;
+        for (size_t i = 0; i < sizeof(needed) / sizeof(needed[0]); i++) {
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = 0;
+            }
+        }
+    }
+
+    free(probe);
+    ring_exit(&ring);
+    return supported;
+}
+
+/**
+ * @brief Runs a worker's event loop on io_uring.
+ */
+int uring_run_worker(int listen_fd, int worker_id) {
+    uring_worker w;
+    memset(&w, 0, sizeof(w));
+    w.listen_fd = listen_fd;
+    w.worker_id = worker_id;
+    w.multishot_accept = 1;
+
+    if (ring_init(&w.ring, URING_ENTRIES) < 0) {
+        perror("io_uring_setup failed");
+        return -1;
+    }
+    recv_buffers_init(&w);
+
+    // io_uring parks the accept itself; a non-blocking listener would just bounce with EAGAIN.
+    int fl = fcntl(listen_fd, F_GETFL);
+    if (fl >= 0) fcntl(listen_fd, F_SETFL, fl & ~O_NONBLOCK);
+
+    arm_accept(&w);
+
+    while (1) {
+        // One syscall submits everything queued since the last pass and waits for work,
+        // or for the next timeout check while any connection has a timer armed.
+        if (!w.tick_armed && conn_timeout_wait_ms() >= 0) arm_tick(&w);
+        if (ring_submit(&w.ring, 1) < 0) break;
+        admission_batch_begin();
+
+        unsigned head = *w.ring.cq_head;
+        unsigned tail = __atomic_load_n(w.ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &w.ring.cqes[head & *w.ring.cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            head++;
+            __atomic_store_n(w.ring.cq_head, head, __ATOMIC_RELEASE);
+
+            uring_conn *uc = (uring_conn *)(uintptr_t)(user_data & ~OP_MASK);
+            switch (user_data & OP_MASK) {
+            case OP_ACCEPT: on_accept(&w, res, flags); break;
+            case OP_RECV:   on_recv(&w, uc, res, flags); break;
+            case OP_SEND:
+            case OP_SPLICE_IN:
+            case OP_SPLICE_OUT: on_send(&w, uc, (unsigned)(user_data & OP_MASK), res); break;
+            case OP_TICK:   w.tick_armed = 0; break;
+            }
+
+            tail = __atomic_load_n(w.ring.cq_tail, __ATOMIC_ACQUIRE);
+        }
+
+        conn_expire_timeouts(close_timed_out);
+    }
+
+    ring_exit(&w.ring);
+    return 0;
+}
@@ -1,9 +1,18 @@
+#define _GNU_SOURCE // For strptime, timegm, gmtime_r, pread and struct stat's st_mtim
 #include "include/http_utils.h"
+#include "include/http_mime.h"
+#include "include/http_log.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <zlib.h>
+
+// zlib windowBits: 15 (32 KB window) + 16 selects the gzip wrapper instead of zlib's.
+#define GZIP_WINDOW_BITS (15 + 16)
 #include <strings.h> // For strcasecmp
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>  // For INT64_MAX
 
 /**
  * @brief Extracts the request path (e.g., "/index.html") from the HTTP request line.
@@ -99,57 +108,260 @@ const char* get_header_value(const http_header headers[], int num_headers, const
 }
 
 /**
- * @brief Simple utility to determine the MIME type based on file extension.
+ * @brief Determines the MIME type from the file extension (see mime_lookup).
  */
 const char *get_mime_type(const char *path) {
-    const char *ext = strrchr(path, '.');
-    if (!ext) return "application/octet-stream";
+    return mime_lookup(path)->type;
+}
+
+/**
+ * @brief Decides whether responses of the given MIME type are worth compressing (text assets).
+ */
+int is_compressible_mime(const char *mime_type) {
+    return mime_type_is_compressible(mime_type);
+}
+
+/**
+ * @brief Derives strong ETags (inode, size, mtime in nanoseconds) and Last-Modified from st.
+ */
+void file_validators_init(file_validators *validators, const struct stat *st) {
+    unsigned long long mtime_ns = (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL +
+                                  (unsigned long long)st->st_mtim.tv_nsec;
+    for (int c = 0; c < CODING_COUNT; c++) {
+        snprintf(validators->etag[c], ETAG_SIZE, "\"%llx-%llx-%llx%s\"", (unsigned long long)st->st_ino,
+                 (unsigned long long)st->st_size, mtime_ns, encoding_etag_suffix((content_coding)c));
+    }
+    validators->mtime = st->st_mtim.tv_sec;
+    format_http_date(validators->mtime, validators->last_modified);
+}
+
+/**
+ * @brief Formats t as an IMF-fixdate into out[HTTP_DATE_SIZE].
+ */
+void format_http_date(time_t t, char *out) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, HTTP_DATE_SIZE, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/**
+ * @brief Parses an IMF-fixdate such as an If-Modified-Since value.
+ */
+int parse_http_date(const char *value, time_t *t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') return -1;
+    *t = timegm(&tm);
+    return 0;
+}
 
-    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "text/html";
-    if (strcmp(ext, ".css") == 0) return "text/css";
-    if (strcmp(ext, ".js") == 0) return "application/javascript";
-    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
-    if (strcmp(ext, ".png") == 0) return "image/png";
-    if (strcmp(ext, ".gif") == 0) return "image/gif";
-    if (strcmp(ext, ".json") == 0) return "application/json";
-    if (strcmp(ext, ".pdf") == 0) return "application/pdf";
-    if (strcmp(ext, ".ico") == 0) return "image/x-icon";
+/**
+ * @brief Checks an If-None-Match value against etag (weak comparison: "W/" is ignored).
+ */
+int etag_list_matches(const char *list, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        if (*p == '*') return 1;
+        if (strncmp(p, "W/", 2) == 0) p += 2;
+        if (*p != '"') break; // Not an entity tag; the whole field is invalid
 
-    // Default MIME type for unknown extensions
-    return "application/octet-stream";
+        const char *close = strchr(p + 1, '"');
+        if (!close) break;
+        size_t tag_len = (size_t)(close - p) + 1;
+        if (tag_len == etag_len && memcmp(p, etag, etag_len) == 0) return 1;
+        p = close + 1;
+    }
+    return 0;
 }
 
+/**
+ * @brief Parses an unsigned decimal position; advances *p past the digits.
+ * @return 0 on success, -1 if there are no digits or the value overflows.
+ */
+static int parse_position(const char **p, off_t *value) {
+    const char *s = *p;
+    off_t v = 0;
+    if (*s < '0' || *s > '9') return -1;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        if (v > (INT64_MAX - (*s - '0')) / 10) return -1;
+        v = v * 10 + (*s - '0');
+    }
+    *value = v;
+    *p = s;
+    return 0;
+}
 
 /**
- * @brief Uses zlib's compress2 to compress the given data into Gzip format.
+ * @brief Parses a "Range: bytes=..." value against a file of the given size.
  */
-unsigned char* compress_data_gzip(const unsigned char *data, size_t data_len, size_t *compressed_len) {
+int parse_byte_ranges(const char *value, off_t size, byte_range ranges[], int max) {
+    if (strncasecmp(value, "bytes=", 6) != 0) return -1;
+    const char *p = value + 6;
+    int count = 0, parts = 0;
+
+    while (1) {
+        while (*p == ' ' || *p == '\t') p++;
+        off_t first, last;
+        if (*p == '-') {
+            // Suffix range: the final N bytes.
+            p++;
+            off_t suffix;
+            if (parse_position(&p, &suffix) != 0) return -1;
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+            if (suffix == 0) first = size; // Unsatisfiable
+        } else {
+            if (parse_position(&p, &first) != 0 || *p++ != '-') return -1;
+            last = size - 1;
+            if (*p >= '0' && *p <= '9') {
+                if (parse_position(&p, &last) != 0 || last < first) return -1;
+                if (last > size - 1) last = size - 1;
+            }
+        }
+
+        if (++parts > max) return -1;
+        if (first < size) {
+            ranges[count].first = first;
+            ranges[count].last = last;
+            count++;
+        }
+
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+        if (*p++ != ',') return -1;
+    }
+    return count;
+}
+
+/**
+ * @brief Collapses repeated slashes and "." segments in place.
+ */
+void path_normalize(char *path) {
+    char *out = path;
+    const char *in = path;
+    while (*in) {
+        if (*in == '/' && out > path && out[-1] == '/') {
+            in++; // "//"
+        } else if (*in == '.' && (in == path || in[-1] == '/') && out > path && (in[1] == '/' || in[1] == '\0')) {
+            in += in[1] ? 2 : 1; // "/./" or a trailing "/."
+        } else {
+            *out++ = *in++;
+        }
+    }
+    if (out > path + 1 && out[-1] == '/' && in[-1] == '.') out--; // "a/." -> "a"
+    *out = '\0';
+}
+
+/**
+ * @brief Reads exactly len bytes from fd at offset, retrying on short reads.
+ */
+int read_fully(int fd, unsigned char *buf, size_t len, off_t offset) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = pread(fd, buf + total, len - total, offset + (off_t)total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        total += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Compresses the given data into a single gzip member (RFC 1952) with deflate.
+ */
+unsigned char* compress_data_gzip(const unsigned char *data, size_t data_len, int level, size_t *compressed_len) {
+    *compressed_len = 0;
     if (data_len == 0) {
-        *compressed_len = 0;
         return NULL;
     }
 
-    // Determine the maximum size for the compressed buffer
-    unsigned long bound = compressBound(data_len);
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int rc = deflateInit2(&strm, level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+        log_error("gzip compression failed: error %d", rc);
+        return NULL;
+    }
 
+    // deflateBound accounts for the gzip header and trailer.
+    unsigned long bound = deflateBound(&strm, data_len);
     unsigned char *compressed_data = (unsigned char *)malloc(bound);
     if (!compressed_data) {
-        perror("Memory allocation failed for compressed buffer");
-        *compressed_len = 0;
+        log_error("Memory allocation failed for compressed buffer.");
+        deflateEnd(&strm);
         return NULL;
     }
 
-    // Use compress2 for simple, single-shot compression.
-    unsigned long dest_len = bound;
-    int compress_result = compress2(compressed_data, &dest_len, data, data_len, Z_DEFAULT_COMPRESSION);
+    strm.next_in = (unsigned char *)data;
+    strm.avail_in = data_len;
+    strm.next_out = compressed_data;
+    strm.avail_out = bound;
+    rc = deflate(&strm, Z_FINISH);
+    deflateEnd(&strm);
 
-    if (compress_result == Z_OK) {
-        *compressed_len = (size_t)dest_len;
-        return compressed_data;
-    } else {
-        fprintf(stderr, "Compression failed. Error code: %d\n", compress_result);
+    if (rc != Z_STREAM_END) {
+        log_error("gzip compression failed: error %d", rc);
         free(compressed_data);
-        *compressed_len = 0;
         return NULL;
     }
+
+    *compressed_len = (size_t)strm.total_out;
+    return compressed_data;
+}
+
+struct gzip_stream {
+    z_stream strm;
+};
+
+/**
+ * @brief Starts an incremental gzip compressor.
+ */
+gzip_stream *gzip_stream_create(int level) {
+    gzip_stream *gz = (gzip_stream *)calloc(1, sizeof(gzip_stream));
+    if (!gz) {
+        log_error("Memory allocation failed for gzip stream.");
+        return NULL;
+    }
+
+    int rc = deflateInit2(&gz->strm, level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+        log_error("gzip compression failed: error %d", rc);
+        free(gz);
+        return NULL;
+    }
+    return gz;
+}
+
+/**
+ * @brief Feeds input to the compressor and collects whatever output is ready.
+ */
+int gzip_stream_compress(gzip_stream *gz, const unsigned char *in, size_t in_len, int finish,
+                         unsigned char *out, size_t out_cap, size_t *in_used, size_t *out_len) {
+    gz->strm.next_in = (unsigned char *)in;
+    gz->strm.avail_in = in_len;
+    gz->strm.next_out = out;
+    gz->strm.avail_out = out_cap;
+
+    int rc = deflate(&gz->strm, finish ? Z_FINISH : Z_NO_FLUSH);
+
+    *in_used = in_len - gz->strm.avail_in;
+    *out_len = out_cap - gz->strm.avail_out;
+
+    if (rc == Z_STREAM_END) return 1;
+    if (rc == Z_OK || rc == Z_BUF_ERROR) return 0; // Z_BUF_ERROR: no progress possible yet, not fatal
+    log_error("gzip compression failed: error %d", rc);
+    return -1;
+}
+
+/**
+ * @brief Releases the compressor.
+ */
+void gzip_stream_destroy(gzip_stream *gz) {
+    if (!gz) return;
+    deflateEnd(&gz->strm);
+    free(gz);
 }
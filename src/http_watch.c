@@ -0,0 +1,233 @@
+#define _GNU_SOURCE // For DT_DIR and friends in struct dirent
+#include "include/http_watch.h"
+#include "include/http_cache.h"
+#include "include/http_fdcache.h"
+#include "include/http_config.h"
+#include "include/http_log.h"
+#include "include/http_utils.h"
+#include "include/http_encoding.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+// Anything that can change what a name in a watched directory refers to, or its contents,
+// size, mtime (and so its ETag) or permissions.
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// Events after which individual invalidations are not enough: a directory changed shape.
+#define WATCH_REBUILD_MASK (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// Owned by the watch thread (and by watch_start before the thread exists).
+static int inotify_fd = -1;
+static char **dir_paths; // Indexed by watch descriptor
+static int dir_paths_cap;
+static char watched_root[CONFIG_PATH_MAX];
+static int tree_has_symlinks;
+static int tree_too_deep; // Some directory sits below WATCH_MAX_DEPTH and is not watched
+
+static int wake_fd = -1; // eventfd written by watch_refresh
+static int active;       // (atomic)
+
+static void forget_watches(void) {
+    if (inotify_fd >= 0) close(inotify_fd);
+    inotify_fd = -1;
+    for (int i = 0; i < dir_paths_cap; i++) {
+        free(dir_paths[i]);
+        dir_paths[i] = NULL;
+    }
+}
+
+static int remember_dir(int wd, const char *path) {
+    if (wd >= dir_paths_cap) {
+        int cap = dir_paths_cap ? dir_paths_cap : 64;
+        while (cap <= wd) cap *= 2;
+        char **grown = (char **)realloc(dir_paths, cap * sizeof(char *));
+        if (!grown) return -1;
+        memset(grown + dir_paths_cap, 0, (cap - dir_paths_cap) * sizeof(char *));
+        dir_paths = grown;
+        dir_paths_cap = cap;
+    }
+    free(dir_paths[wd]); // The same directory reached again
+    dir_paths[wd] = strdup(path);
+    return dir_paths[wd] ? 0 : -1;
+}
+
+/**
+ * @brief Watches path and every directory below it.
+ * @return 0 on success, -1 if any directory could not be watched (errno set).
+ */
+static int watch_tree(const char *path, int depth) {
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_MASK);
+    if (wd < 0 || remember_dir(wd, path) != 0) return -1;
+
+    DIR *dir = opendir(path);
+    if (!dir) return -1;
+    int rc = 0;
+    struct dirent *ent;
+    char child[CONFIG_PATH_MAX * 2];
+    while (rc == 0 && (ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(child, &st) != 0) continue;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        }
+        // A change to a symlink's target is reported under the target's name, not the link's.
+        if (type == DT_LNK) tree_has_symlinks = 1;
+        if (type == DT_DIR && depth >= WATCH_MAX_DEPTH) tree_too_deep = 1;
+        else if (type == DT_DIR) rc = watch_tree(child, depth + 1);
+    }
+    closedir(dir);
+    return rc;
+}
+
+/**
+ * @brief Watches the current web root from scratch, then flushes both caches: anything that
+ *        changed before its directory was watched has to be read again.
+ */
+static void rebuild(void) {
+    __atomic_store_n(&active, 0, __ATOMIC_RELEASE);
+    forget_watches();
+
+    snprintf(watched_root, sizeof(watched_root), "%s", config_current()->web_root);
+    path_normalize(watched_root);
+    tree_has_symlinks = 0;
+    tree_too_deep = 0;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    int ok = inotify_fd >= 0 && watch_tree(watched_root, 0) == 0;
+    if (!ok) {
+        log_warn("Cannot watch %s for changes (%s); cached files will be revalidated by stat().", watched_root,
+                 strerror(errno));
+        forget_watches();
+    } else if (tree_has_symlinks) {
+        log_info("%s contains symlinks; cached files will be revalidated by stat().", watched_root);
+    } else if (tree_too_deep) {
+        log_info("%s has directories more than %d levels deep; cached files will be revalidated by stat().",
+                 watched_root, WATCH_MAX_DEPTH);
+    }
+
+    cache_flush();
+    open_file_flush();
+    if (ok && !tree_has_symlinks && !tree_too_deep) __atomic_store_n(&active, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Applies one batch of inotify events.
+ * @return 1 if the watches must be rebuilt.
+ */
+static int handle_events(const char *buf, ssize_t len) {
+    char path[CONFIG_PATH_MAX * 2];
+    for (const char *p = buf; p < buf + len;) {
+        const struct inotify_event *event = (const struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & WATCH_REBUILD_MASK) return 1;
+        // A directory appearing, disappearing or moving changes every path below it; a new
+        // symlink is something the watches cannot follow.
+        if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+            return 1;
+        }
+        if (event->wd < 0 || event->wd >= dir_paths_cap || !dir_paths[event->wd] || event->len == 0) continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir_paths[event->wd], event->name);
+        path_normalize(path);
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            struct stat st;
+            if (lstat(path, &st) == 0 && S_ISLNK(st.st_mode)) return 1;
+        }
+        cache_invalidate(path);
+        open_file_invalidate(path);
+
+        // A precompressed sidecar appearing, changing or going away changes how its file is sent.
+        size_t base_len;
+        if (encoding_from_file_name(path, &base_len) != CODING_IDENTITY) {
+            path[base_len] = '\0';
+            cache_invalidate(path);
+            open_file_invalidate(path);
+        }
+    }
+    return 0;
+}
+
+static void *watch_loop(void *arg) {
+    (void)arg;
+    _Alignas(struct inotify_event) char buf[WATCH_EVENT_BUFFER];
+    while (1) {
+        struct pollfd fds[2] = {{wake_fd, POLLIN, 0}, {inotify_fd, POLLIN, 0}};
+        int n = poll(fds, inotify_fd >= 0 ? 2 : 1, inotify_fd >= 0 ? -1 : WATCH_RETRY_MS);
+        if (n < 0 && errno != EINTR) {
+            log_error("Watch thread poll failed: %s", strerror(errno));
+            break;
+        }
+
+        int must_rebuild = inotify_fd < 0 && n == 0; // Time to try the root again
+        if (n > 0 && (fds[0].revents & POLLIN)) {
+            uint64_t ignored;
+            if (read(wake_fd, &ignored, sizeof(ignored)) < 0) { /* Nothing to do */ }
+            char root[CONFIG_PATH_MAX];
+            snprintf(root, sizeof(root), "%s", config_current()->web_root);
+            path_normalize(root);
+            if (strcmp(root, watched_root) != 0) must_rebuild = 1;
+        }
+        if (n > 0 && inotify_fd >= 0 && (fds[1].revents & POLLIN)) {
+            ssize_t len;
+            while (!must_rebuild && (len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+                must_rebuild = handle_events(buf, len);
+            }
+        }
+        if (must_rebuild) rebuild();
+    }
+    __atomic_store_n(&active, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Watches the web root and starts the thread that reports changes to the caches.
+ */
+int watch_start(void) {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        log_warn("Could not create the watch thread's eventfd: %s", strerror(errno));
+        return -1;
+    }
+
+    rebuild();
+    pthread_t watcher;
+    if (pthread_create(&watcher, NULL, watch_loop, NULL) != 0) {
+        __atomic_store_n(&active, 0, __ATOMIC_RELEASE);
+        forget_watches();
+        log_warn("Could not start the watch thread; cached files will be revalidated by stat().");
+        return -1;
+    }
+    pthread_detach(watcher);
+    return 0;
+}
+
+/**
+ * @brief Whether every change under the current web root is being reported.
+ */
+int watch_active(void) {
+    return __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Asks the watch thread to follow a reloaded config.
+ */
+void watch_refresh(void) {
+    uint64_t one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {
+        log_warn("Could not wake the watch thread: %s", strerror(errno));
+    }
+}
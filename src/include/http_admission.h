@@ -0,0 +1,83 @@
+#ifndef HTTP_ADMISSION_H
+#define HTTP_ADMISSION_H
+
+#include <stddef.h>     // For size_t
+#include <stdint.h>     // For uint64_t
+#include <sys/socket.h> // For struct sockaddr_storage
+
+// --- Configuration Constants ---
+// The first three are the defaults of the max_connections* and rate_limit_per_ip settings.
+#define MAX_CONNECTIONS_DEFAULT 16384       // Open connections across all workers
+#define MAX_CONNECTIONS_PER_IP_DEFAULT 1024 // Open connections from one client address; 0 = no limit
+#define REQUEST_RATE_PER_IP_DEFAULT 0       // Sustained requests per second per address; 0 = no limit
+#define REQUEST_BURST_SECONDS 2             // Token bucket depth, in seconds of the rate
+#define SHED_QUEUE_DELAY_MS 100             // Shed new work once a worker's ready events wait this long
+#define SHED_RETRY_AFTER "1"                // Retry-After (seconds) on every 503
+
+// Client table: ADMISSION_SHARDS independently locked shards of ADMISSION_SHARD_ENTRIES
+// addresses each. Addresses beyond that are admitted without per-client limits.
+#define ADMISSION_SHARDS 64
+#define ADMISSION_SHARD_ENTRIES 256
+
+// --- Data Structures ---
+
+typedef struct client_entry client_entry;
+
+/**
+ * @brief Why a connection or request was turned away (each is counted separately).
+ */
+typedef enum {
+    SHED_CONNECTION_LIMIT, // MAX_CONNECTIONS reached
+    SHED_CLIENT_LIMIT,     // The client's connection cap reached
+    SHED_RATE_LIMIT,       // The client's token bucket is empty
+    SHED_OVERLOAD,         // The worker is too far behind on ready events
+    SHED_REASON_COUNT
+} shed_reason;
+
+/**
+ * @brief An admitted connection's claim on the limits, released when it closes.
+ */
+typedef struct {
+    int admitted;
+    client_entry *client; // NULL if the client table was full
+} admission_ticket;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Decides whether a freshly accepted connection may stay. A rejected socket has been
+ *        sent the pre-rendered 503 and closed.
+ * @return 0 if admitted (ticket filled in), -1 if rejected.
+ */
+int admission_accept(int fd, const struct sockaddr_storage *peer, admission_ticket *ticket);
+
+/**
+ * @brief Gives back an admitted connection's slot.
+ */
+void admission_release(admission_ticket *ticket);
+
+/**
+ * @brief Decides whether a connection's next request is served: takes a token from the
+ *        client's bucket and checks the worker's queueing delay.
+ * @return -1 if it must be shed (reason set), 0 otherwise.
+ */
+int admission_request(admission_ticket *ticket, shed_reason *reason);
+
+/**
+ * @brief Marks the start of a batch of ready events on the calling worker; the queueing
+ *        delay of each event handled in the batch is measured from here.
+ */
+void admission_batch_begin(void);
+
+/**
+ * @brief The pre-rendered 503 response (with Retry-After and Connection: close).
+ */
+const char *admission_shed_response(size_t *len);
+
+/**
+ * @brief Counts one shed connection or request.
+ */
+void admission_count_shed(shed_reason reason);
+
+#endif // HTTP_ADMISSION_H
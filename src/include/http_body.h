@@ -0,0 +1,92 @@
+#ifndef HTTP_BODY_H
+#define HTTP_BODY_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint64_t
+
+// --- Configuration Constants ---
+#define BODY_LINE_MAX 4096 // Longest chunk-size line (with extensions) or trailer section accepted
+
+// --- Data Structures ---
+
+typedef enum {
+    BODY_IN_PROGRESS, // Every byte given was consumed; more are expected
+    BODY_COMPLETE,    // The body ended; bytes after it belong to the next request
+    BODY_ERROR,       // Malformed chunked framing
+    BODY_TOO_LARGE    // The body exceeds the reader's limit
+} body_status;
+
+/**
+ * @brief Incremental request-body decoder for Content-Length and chunked framing. It keeps
+ *        no buffer of its own: callers feed whatever has arrived and get the decoded bytes
+ *        back in place, so a body of any size passes through a fixed-size input buffer.
+ */
+typedef struct {
+    int chunked;
+    int state;          // Chunked decoder state
+    uint64_t remaining; // Content-Length: bytes still to come; chunked: bytes left in the current chunk
+    uint64_t received;  // Decoded body bytes so far
+    uint64_t limit;     // Largest decoded body accepted
+    size_t line_len;    // Chunked: bytes of the current size line or trailer section
+} body_reader;
+
+/**
+ * @brief A PUT body on its way to a file: written to a temporary file next to the target,
+ *        which replaces the target only once the whole body has arrived.
+ */
+typedef struct {
+    int fd;
+    char *temp_path;
+    char *final_path;
+} body_upload;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Prepares a reader for one request body.
+ * @param chunked Non-zero for Transfer-Encoding: chunked; content_length is then ignored.
+ */
+void body_reader_init(body_reader *reader, int chunked, uint64_t content_length, uint64_t limit);
+
+/**
+ * @brief Decodes the next raw body bytes in place.
+ * @param buf Raw bytes as received; on return buf[0..*out) holds the decoded body bytes
+ *        among them (chunk framing removed).
+ * @param len In: bytes available. Out: bytes consumed; less than given only on BODY_COMPLETE,
+ *        when the rest belongs to the next request.
+ * @param out Set to the number of decoded bytes.
+ */
+body_status body_decode(body_reader *reader, char *buf, size_t *len, size_t *out);
+
+/**
+ * @brief Parses a Content-Length value strictly: digits only, no sign, no overflow.
+ * @return 0 on success, -1 if the value is malformed.
+ */
+int body_parse_content_length(const char *value, uint64_t *length);
+
+/**
+ * @brief Starts an upload to final_path by creating its temporary file.
+ * @return The upload, or NULL if the file cannot be created (errno is set).
+ */
+body_upload *body_upload_open(const char *final_path);
+
+/**
+ * @brief Appends decoded body bytes to the upload.
+ * @return 0 on success, -1 on a write error.
+ */
+int body_upload_write(body_upload *upload, const char *buf, size_t len);
+
+/**
+ * @brief Moves the finished file over the target and releases the upload.
+ * @param created Set to 1 if the target did not exist before, 0 if it was replaced.
+ * @return 0 on success, -1 on error (the temporary file is removed either way).
+ */
+int body_upload_commit(body_upload *upload, int *created);
+
+/**
+ * @brief Discards an unfinished upload: removes the temporary file and releases it.
+ */
+void body_upload_abort(body_upload *upload);
+
+#endif // HTTP_BODY_H
@@ -0,0 +1,95 @@
+#ifndef HTTP_CACHE_H
+#define HTTP_CACHE_H
+
+#include <stddef.h>    // For size_t
+#include <time.h>      // For time_t, struct timespec
+#include <sys/types.h> // For dev_t, ino_t, off_t
+#include "http_utils.h" // For file_validators
+#include "http_encoding.h" // For content_coding
+#include "http_fdcache.h"  // For open_file
+
+// --- Configuration Constants ---
+#define CACHE_MAX_BYTES (64 * 1024 * 1024) // Default total budget for cached bodies and headers
+#define CACHE_MAX_FILE_SIZE (1024 * 1024)  // Default; larger files are streamed with sendfile instead
+#define CACHE_SHARDS 16                    // Independent locks; must be a power of two
+#define CACHE_REVALIDATE_SECONDS 1         // How long a hit is trusted before stat()ing again, unless watched
+
+// --- Data Structures ---
+
+/**
+ * @brief One representation of a cached file: its bytes and the prebuilt Content-Type through
+ *        Last-Modified fields (plus Vary when the file has encoded variants); the caller adds
+ *        the status line, Date and Connection.
+ */
+typedef struct {
+    unsigned char *body; // NULL for an encoding that is not offered
+    size_t len;
+    char *header;
+    size_t header_len;
+} cache_variant;
+
+/**
+ * @brief An immutable cached file: the raw bytes, every encoded variant that pays off and
+ *        their prebuilt response headers. Entries are reference counted, so a response can keep sending one
+ *        after it has been evicted or replaced.
+ */
+typedef struct cache_entry {
+    struct cache_entry *hash_next;            // Shard hash chain
+    struct cache_entry *lru_prev, *lru_next;  // Shard eviction list, newest first
+    char *path;
+    unsigned long hash;
+
+    // File identity used for revalidation.
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    file_validators validators; // ETags and Last-Modified, also baked into the headers below
+
+    const char *mime_type;
+    cache_variant variants[CODING_COUNT]; // Indexed by content_coding; identity is always present
+
+    size_t footprint;       // Bytes charged against the shard's budget
+    time_t validated_at;    // Last time the file was confirmed unchanged (atomic)
+    int referenced;         // Second-chance bit, set on every hit (atomic)
+    int refcount;           // Owners: the cache itself plus each in-flight response (atomic)
+} cache_entry;
+
+// --- Function Declarations ---
+
+/**
+ * @brief Looks up a request path (e.g., "/index.html"). Hits only take a shard read lock.
+ *        While the web root is watched (http_watch.h) changes arrive through
+ *        cache_invalidate and hits make no syscalls; otherwise the file is re-stat()ed at
+ *        most once per CACHE_REVALIDATE_SECONDS.
+ * @return A referenced entry that must be returned with cache_release, or NULL on a miss.
+ */
+cache_entry *cache_lookup(const char *path, const char *full_path);
+
+/**
+ * @brief Reads an open file (http_fdcache.h) and, if its type is compressible, takes each
+ *        coding's variant from its precompressed sidecar or else compresses it once per
+ *        supported coding (keeping only variants smaller than the file). Then publishes it,
+ *        evicting the least recently used entries of its shard if needed.
+ * @return A referenced entry that must be returned with cache_release, or NULL if the file
+ *         is too large, cannot be read or has changed since it was opened.
+ */
+cache_entry *cache_load(const char *path, const open_file *file);
+
+/**
+ * @brief Drops one reference; the entry is freed once it is evicted and no response uses it.
+ *        Takes void * so it can be passed directly as a conn_queue_ref release callback.
+ */
+void cache_release(void *entry);
+
+/**
+ * @brief Drops the entry for one path, if any; responses already sending it finish with it.
+ */
+void cache_invalidate(const char *path);
+
+/**
+ * @brief Drops every entry.
+ */
+void cache_flush(void);
+
+#endif // HTTP_CACHE_H
@@ -0,0 +1,109 @@
+#ifndef HTTP_CONFIG_H
+#define HTTP_CONFIG_H
+
+#include <stddef.h>     // For size_t
+#include <stdint.h>     // For uint64_t
+#include "http_server.h" // For io_backend
+#include "http_log.h"    // For log_level
+#include "http_precompress.h" // For precompress_mode
+
+// --- Configuration Constants ---
+#define CONFIG_PATH_MAX 1024 // Longest string setting (web_root, mime_types, compress_types)
+#define CONFIG_LINE_MAX 4096 // Longest line in a config file
+
+// --- Data Structures ---
+
+/**
+ * @brief Every runtime tunable. The defaults are the compile-time constants of the modules
+ *        that use them; a config file (--config FILE, "name = value" lines) overrides them and
+ *        command-line flags (--name-with-dashes VALUE) override the file.
+ *
+ *        A published config is immutable: SIGHUP builds a new one and swaps the pointer, so a
+ *        worker that has loaded config_current() keeps a consistent view for as long as it
+ *        holds it. Settings in the first group shape objects created at startup (listeners,
+ *        threads, connection slabs) and only change on restart.
+ */
+typedef struct {
+    // Startup only
+    unsigned port;
+    io_backend backend;
+    unsigned workers;           // 0 = one per online CPU
+    unsigned pin_workers;       // 1 pins worker N to CPU N so its connections stay cache-local
+    unsigned listen_backlog;
+    uint64_t input_buffer_size; // Per connection: header block plus small buffered bodies
+    uint64_t output_arena_size; // Per connection: queued response chunks before falling back to malloc
+    char mime_types[CONFIG_PATH_MAX]; // Extra extension table loaded at startup; "" for none
+    precompress_mode precompress; // off, startup (write sidecars, then serve) or only (write them and exit)
+
+    // Reloadable
+    char web_root[CONFIG_PATH_MAX];
+    log_level log_level;
+    unsigned max_headers;       // At most MAX_HEADERS
+    uint64_t max_header_size;   // Request line plus header fields, in bytes
+    uint64_t max_body_size;
+    uint64_t max_upload_size;
+    uint64_t cache_max_bytes;
+    uint64_t cache_max_file_size;
+    unsigned open_file_cache_entries; // Open descriptors kept for files served; 0 opens every time
+    char compress_types[CONFIG_PATH_MAX]; // e.g. "text/*, application/json"; "" for the MIME table's rule
+    uint64_t compress_min_size; // Smaller files are always sent as they are
+    unsigned serve_precompressed; // 1 to send "<file>.gz/.br/.zst" sidecars in place of compressing
+    unsigned gzip_level;        // 1 (fastest) to 9 (smallest)
+    unsigned brotli_level;      // 0 to 11
+    unsigned zstd_level;        // 1 to 22
+    unsigned header_timeout_ms;
+    unsigned body_timeout_ms;
+    unsigned idle_timeout_ms;
+    unsigned write_timeout_ms;
+    unsigned max_connections;
+    unsigned max_connections_per_ip;
+    unsigned rate_limit_per_ip;
+    unsigned http2;             // 1 to accept cleartext HTTP/2 (prior knowledge or Upgrade: h2c)
+    unsigned http2_max_streams; // Concurrent streams per HTTP/2 connection
+} server_config;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Fills in the compiled-in defaults.
+ */
+void config_defaults(server_config *config);
+
+/**
+ * @brief Builds and validates a config: defaults, then the file named by --config (if any),
+ *        then the remaining command-line arguments. A bare number is taken as the port and
+ *        --io-uring as "--backend io_uring".
+ * @param err Receives a one-line description of the first problem found.
+ * @return 0 on success, -1 on any unknown setting, malformed or out-of-range value.
+ */
+int config_load(server_config *config, int argc, char **argv, char *err, size_t err_size);
+
+/**
+ * @brief Loads the startup config (reporting problems on stderr), publishes it and remembers
+ *        the arguments for config_reload. Call before any thread is started.
+ * @return 0 on success, -1 if the configuration is invalid or could not be published.
+ */
+int config_init(int argc, char **argv);
+
+/**
+ * @brief The config in effect. Cheap enough to call per request; until config_init or
+ *        config_publish is called it is the defaults.
+ */
+const server_config *config_current(void);
+
+/**
+ * @brief Makes a copy of config the one in effect and applies the log level.
+ * @return 0 on success, -1 if the copy could not be allocated (the running config stays).
+ */
+int config_publish(const server_config *config);
+
+/**
+ * @brief Re-reads the config file and arguments given to config_init and publishes the
+ *        result. Startup-only settings keep their running values (with a warning if they
+ *        changed); an invalid config is reported and the running one stays in effect.
+ * @return 0 on success, -1 if the new config was rejected or could not be published.
+ */
+int config_reload(void);
+
+#endif // HTTP_CONFIG_H
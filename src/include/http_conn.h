@@ -0,0 +1,278 @@
+#ifndef HTTP_CONN_H
+#define HTTP_CONN_H
+
+#include <stddef.h>    // For size_t
+#include <sys/types.h> // For off_t, ssize_t
+#include <sys/uio.h>   // For struct iovec
+#include <stdint.h>    // For uint64_t
+#include "http_parser.h" // For http_request
+#include "http_pool.h"   // For arena
+#include "http_body.h"   // For body_reader, body_upload
+#include "http_timer.h"  // For timer_node
+#include "http_admission.h" // For admission_ticket
+
+// --- Configuration Constants ---
+#define CONN_MAX_IOV 64             // Queued chunks gathered into one writev/sendmsg
+#define CONN_ARENA_SIZE (16 * 1024) // Per-connection space for queued chunks, reset once output drains
+#define CONN_CHUNK_MIN 512          // Smallest owned chunk, so a header and a short body share one
+
+// Default input buffer: room for a full header block plus the largest body we buffer (see
+// process_single_request). Both buffer sizes can be set at startup (see http_config.h).
+#define CONN_IN_BUFFER_SIZE (BUFFER_SIZE * 3)
+
+// Default timeouts, in milliseconds. A request's header block must be complete this long after it
+// starts (or after the connection opens), however slowly it trickles in; bodies and queued
+// output must make some progress this often; an idle keep-alive connection is closed after
+// CONN_IDLE_TIMEOUT_MS.
+#define CONN_HEADER_TIMEOUT_MS 10000
+#define CONN_BODY_TIMEOUT_MS 30000
+#define CONN_IDLE_TIMEOUT_MS 15000
+#define CONN_WRITE_TIMEOUT_MS 30000
+
+// --- Data Structures ---
+
+/**
+ * @brief Lifecycle of a non-blocking client connection.
+ */
+typedef enum {
+    CONN_READING, // Waiting for (the rest of) a request
+    CONN_CLOSING  // No more requests; flush queued output, then close
+} conn_state;
+
+/**
+ * @brief Which timeout currently applies to a connection.
+ */
+typedef enum {
+    TIMEOUT_NONE,   // Closing with nothing left to send
+    TIMEOUT_HEADER, // Waiting for (the rest of) a header block
+    TIMEOUT_BODY,   // Receiving a request body
+    TIMEOUT_IDLE,   // Keep-alive, between requests
+    TIMEOUT_WRITE   // Output queued that the client has not taken yet
+} conn_timeout_phase;
+
+/**
+ * @brief One piece of queued output: bytes in memory (copied into the chunk, borrowed
+ *        from a longer-lived owner such as the content cache, or produced on demand by a
+ *        stream), or a byte range of an open file, which is sent straight from the page cache.
+ */
+typedef struct out_chunk {
+    struct out_chunk *next;
+    const char *bytes; // Memory chunks: data[] or the borrowed buffer
+    int file_fd;       // -1 for memory chunks; owned (closed once sent) unless release is set
+    off_t file_off;    // File chunks: offset of the next byte to send
+    size_t len;        // Memory chunks: bytes stored; file chunks: bytes left to send
+    size_t off;        // Memory chunks: bytes already sent
+    size_t cap;        // Capacity of data[]; 0 for borrowed and file chunks
+
+    // Stream chunks: refills data[] once it has been sent; returns bytes produced, 0 at the end, -1 on error.
+    ssize_t (*refill)(void *owner, char *buf, size_t cap);
+
+    // Borrowed and stream chunks: called once the chunk is finished (or dropped) to release its owner.
+    void (*release)(void *owner);
+    void *owner;
+
+    // Pieces of it queued on another connection by conn_output_move that still point into it.
+    // A chunk its own queue has dropped meanwhile is orphaned, and freed with the last piece.
+    unsigned borrowers;
+    int orphaned;
+    char data[];
+} out_chunk;
+
+typedef struct http_conn {
+    int fd;
+    conn_state state;
+
+    // Input: bytes read from the socket that have not been consumed yet. Leftovers after
+    // a request (the start of a pipelined one) stay buffered for the next pass.
+    char *in_buf;
+    size_t in_len;
+    size_t in_cap;
+    size_t in_off; // Start of the request being parsed; consumed bytes are compacted away
+
+    // Parser state for the request at the front of in_buf; survives partial reads.
+    http_request request;
+
+    // Its body, decoded as it arrives. Decoded bytes are either kept right behind the headers
+    // (body_held of them, for bodies small enough to echo) or passed on and dropped from in_buf.
+    body_reader body;
+    size_t body_held;
+    body_upload *upload; // PUT body being written to its file; NULL otherwise
+
+    // Lifecycle timestamps (metrics_now) and counts feeding /metrics.
+    uint64_t accepted_ns;
+    uint64_t request_started_ns;
+    unsigned long requests_served;
+    int first_byte_sent;
+
+    // Output: chunks queued for the socket, sent in order from out_head. Chunks come from
+    // out_arena (malloc only when it is full or for large stream buffers); the arena is
+    // reset whenever the queue drains, so a typical response allocates nothing.
+    out_chunk *out_head;
+    out_chunk *out_tail;
+    arena out_arena;
+
+    // Timeout of the current phase, on the owning worker's timer wheel.
+    timer_node timer;
+    conn_timeout_phase timeout_phase;
+    unsigned long timeout_request; // requests_served when the header timer was armed
+
+    void *owner; // Backend state wrapping this connection (io_uring), or NULL
+
+    admission_ticket admission; // Its share of the connection limits, released on destroy
+
+    // HTTP/2 (http_h2.h): the session of a connection that has switched protocols, and on a
+    // stream's own connection the stream it answers. Both NULL for HTTP/1.x.
+    struct h2_session *h2;
+    struct h2_stream *stream;
+} http_conn;
+
+/**
+ * @brief Result of a non-blocking socket operation.
+ */
+typedef enum {
+    CONN_IO_DONE,  // Operation finished (or the socket has been drained)
+    CONN_IO_AGAIN, // Socket would block; wait for the next readiness event
+    CONN_IO_ERROR  // Fatal error or peer gone; the connection must be closed
+} conn_io_result;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Allocates the state machine for a freshly accepted, non-blocking socket. The
+ *        connection, its input buffer and its output arena are one object from the calling
+ *        thread's slab pool.
+ * @return New connection, or NULL on allocation failure.
+ */
+http_conn *conn_create(int fd);
+
+/**
+ * @brief Admits a freshly accepted socket (see admission_accept) and creates its connection.
+ *        The socket is owned from here on: it is closed on every failure.
+ * @param peer The client's address, or NULL to look it up.
+ * @return New connection, or NULL if the socket was refused or allocation failed.
+ */
+http_conn *conn_accept(int fd, const struct sockaddr_storage *peer);
+
+/**
+ * @brief Closes the socket and releases all buffers owned by the connection.
+ */
+void conn_destroy(http_conn *conn);
+
+/**
+ * @brief Appends response bytes to the connection's output queue.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int conn_queue(http_conn *conn, const void *data, size_t len);
+
+/**
+ * @brief Queues a borrowed buffer without copying it. release(owner) is called once the
+ *        bytes have been sent or the connection is destroyed.
+ * @return 0 on success, -1 on allocation failure (release is called immediately).
+ */
+int conn_queue_ref(http_conn *conn, const void *data, size_t len, void (*release)(void *), void *owner);
+
+/**
+ * @brief Queues output produced on demand, at most cap bytes at a time, so arbitrarily long
+ *        bodies need only one buffer. refill is called once now and again each time the
+ *        previous piece has been sent; release(owner) is called when the stream is finished.
+ * @return 0 on success, -1 on allocation or refill failure (release is called immediately).
+ */
+int conn_queue_stream(http_conn *conn, size_t cap, ssize_t (*refill)(void *, char *, size_t),
+                      void (*release)(void *), void *owner);
+
+/**
+ * @brief Queues len bytes of an open file, starting at offset, behind any output already queued.
+ *        The connection takes ownership of file_fd and closes it once the range is sent.
+ * @return 0 on success, -1 on allocation failure (file_fd is closed).
+ */
+int conn_queue_file(http_conn *conn, int file_fd, off_t offset, size_t len);
+
+/**
+ * @brief Like conn_queue_file, but file_fd is borrowed: release(owner) is called instead of
+ *        closing it. The range is always sent from its own offset, never the descriptor's file
+ *        position, so any number of responses can send from one descriptor at once.
+ * @return 0 on success, -1 on allocation failure (release is called immediately).
+ */
+int conn_queue_file_ref(http_conn *conn, int file_fd, off_t offset, size_t len, void (*release)(void *),
+                        void *owner);
+
+/**
+ * @brief Accounts for n response bytes accepted by the kernel (bytes-out counter and the
+ *        accept-to-first-byte histogram). Called by every backend after a successful send.
+ */
+void conn_note_sent(http_conn *conn, size_t n);
+
+/**
+ * @brief Describes the memory chunks at the front of the output queue, in order, so they can
+ *        be sent with a single writev/sendmsg. Stops at a file chunk and after a stream chunk.
+ * @param more Set to 1 if further output is queued behind the described chunks (worth
+ *        sending with MSG_MORE), 0 otherwise.
+ * @return Number of entries filled (0 if the head is a file chunk or nothing is pending).
+ */
+int conn_output_iov(const http_conn *conn, struct iovec *iov, int max_iov, int *more);
+
+/**
+ * @brief Marks n bytes of queued output as sent, releasing chunks as they are exhausted.
+ *        Used by backends that submit the output themselves.
+ */
+void conn_output_advance(http_conn *conn, size_t n);
+
+/**
+ * @brief Drops every queued chunk and marks the connection for closing.
+ */
+void conn_output_abort(http_conn *conn);
+
+/**
+ * @brief Moves up to max bytes from the front of src's output queue to the back of dst's,
+ *        without copying memory or file chunks: dst borrows them, and src's chunk lives on
+ *        until every piece has been sent or dropped. Stream chunks are copied, one refill at
+ *        a time. Stops at the end of src's head chunk; src must not own an arena.
+ * @return Bytes moved, or -1 on allocation failure.
+ */
+ssize_t conn_output_move(http_conn *dst, http_conn *src, size_t max);
+
+/**
+ * @brief Runs process_single_request for every complete request in the buffered input,
+ *        in order, once in_len has grown. Used by backends that receive into in_buf themselves.
+ */
+void conn_process_input(http_conn *conn);
+
+/**
+ * @brief Reads everything currently available on the socket and runs
+ *        process_single_request for each complete request. Upload bodies that need no
+ *        decoding are spliced from the socket into their file without entering user space.
+ */
+conn_io_result conn_on_readable(http_conn *conn);
+
+/**
+ * @brief Writes as much queued output as the socket accepts without blocking,
+ *        using sendfile for file chunks.
+ */
+conn_io_result conn_flush(http_conn *conn);
+
+/**
+ * @brief Re-arms the connection's timeout after an event: a new phase (or a new request)
+ *        starts its timer afresh, and body and write timers restart on every event, since
+ *        events mean progress. Called by every backend once it has handled an event.
+ */
+void conn_refresh_timeout(http_conn *conn);
+
+/**
+ * @brief Turns the calling worker's timer wheel and hands every connection whose timeout
+ *        has passed to close_conn, after counting it.
+ */
+void conn_expire_timeouts(void (*close_conn)(http_conn *conn));
+
+/**
+ * @brief How long the calling worker's event loop may wait before conn_expire_timeouts is due.
+ * @return Milliseconds, or -1 if none of its connections has a timer armed.
+ */
+int conn_timeout_wait_ms(void);
+
+/**
+ * @brief Returns non-zero while queued output is still waiting for the socket.
+ */
+int conn_has_pending_output(const http_conn *conn);
+
+#endif // HTTP_CONN_H
@@ -0,0 +1,132 @@
+#ifndef HTTP_ENCODING_H
+#define HTTP_ENCODING_H
+
+#include <stddef.h>    // For size_t
+#include "http_mime.h" // For mime_type
+
+// --- Configuration Constants ---
+// Defaults of the gzip_level, brotli_level, zstd_level and compress_min_size settings (http_config.h).
+#define GZIP_LEVEL_DEFAULT 6          // zlib's own default trade-off
+#define BROTLI_LEVEL_DEFAULT 5        // Past 5 brotli slows sharply for little gain per request
+#define ZSTD_LEVEL_DEFAULT 3          // zstd's own default
+#define COMPRESS_MIN_SIZE_DEFAULT 256 // Below this, framing eats most of the savings
+
+// gzip is always built in; brotli and zstd when the Makefile finds their headers (HAVE_BROTLI,
+// HAVE_ZSTD). A client is never offered a coding this build cannot produce, except from a
+// precompressed sidecar file (http_precompress.h), which needs no encoder.
+
+// --- Data Structures ---
+
+/**
+ * @brief Content codings a response can be sent in. The order is not a preference.
+ */
+typedef enum {
+    CODING_IDENTITY,
+    CODING_GZIP,
+    CODING_BROTLI,
+    CODING_ZSTD,
+    CODING_COUNT
+} content_coding;
+
+/**
+ * @brief A parsed Accept-Encoding header: the q-value of each coding in thousandths, 0 where
+ *        the client refuses it. Identity that is neither listed nor excluded gets the
+ *        smallest non-zero weight, so it is only chosen when nothing else is acceptable.
+ */
+typedef struct {
+    unsigned short q[CODING_COUNT];
+} accepted_codings;
+
+/**
+ * @brief Incremental compressor for bodies too large to compress in one piece.
+ */
+typedef struct encoder_stream encoder_stream;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Parses an Accept-Encoding value (RFC 9110 12.5.3): codings with optional ";q=",
+ *        "*" for everything not listed, "x-gzip" as gzip. NULL (no header) accepts identity only.
+ */
+void encoding_parse_accept(const char *header, accepted_codings *accepted);
+
+/**
+ * @brief Whether this build can produce the coding.
+ */
+int encoding_supported(content_coding coding);
+
+/**
+ * @brief The Content-Encoding token ("gzip", "br", "zstd"), or NULL for identity.
+ */
+const char *encoding_name(content_coding coding);
+
+/**
+ * @brief Suffix that gives an entity tag per coding ("-gz", "-br", "-zst"; "" for identity).
+ */
+const char *encoding_etag_suffix(content_coding coding);
+
+/**
+ * @brief Suffix of a precompressed sidecar file ("x.css.gz", ".br", ".zst"; "" for identity).
+ */
+const char *encoding_file_suffix(content_coding coding);
+
+/**
+ * @brief Which coding a file name's sidecar suffix says it holds.
+ * @param base_len If not NULL, receives the length of the name without the suffix.
+ * @return CODING_IDENTITY if the name has no sidecar suffix.
+ */
+content_coding encoding_from_file_name(const char *name, size_t *base_len);
+
+/**
+ * @brief Chooses among ready-made variants (e.g. a cached file's or precompressed sidecars):
+ *        the smallest of those the client weights highest. lengths[c] is 0 where there is no
+ *        variant; identity always counts. A ready-made variant needs no encoder, so this
+ *        build's support does not matter.
+ */
+content_coding encoding_choose_smallest(const accepted_codings *accepted, const size_t lengths[CODING_COUNT]);
+
+/**
+ * @brief Chooses a coding for a body compressed while it is sent: the fastest encoder (zstd,
+ *        then gzip, then brotli) among those the client weights highest.
+ */
+content_coding encoding_choose_fastest(const accepted_codings *accepted);
+
+/**
+ * @brief Whether responses of this type are compressed: the compress_types setting if set,
+ *        otherwise the MIME table's rule.
+ */
+int encoding_type_allowed(const mime_type *mime);
+
+/**
+ * @brief The configured level of a coding (gzip_level, brotli_level or zstd_level).
+ */
+int encoding_level(content_coding coding);
+
+/**
+ * @brief Compresses data in one piece.
+ * @return Dynamically allocated buffer, or NULL on error or for identity.
+ */
+unsigned char *encoding_compress(content_coding coding, int level, const unsigned char *data, size_t len,
+                                 size_t *out_len);
+
+/**
+ * @brief Starts an incremental compressor.
+ * @return New stream, or NULL on error or for identity.
+ */
+encoder_stream *encoder_stream_create(content_coding coding, int level);
+
+/**
+ * @brief Feeds input to the compressor and collects whatever output is ready. Same contract
+ *        as gzip_stream_compress: once finish is set, keep passing the unconsumed input.
+ * @return 1 once the stream has been terminated, 0 if more calls are needed, -1 on error.
+ */
+int encoder_stream_compress(encoder_stream *stream, const unsigned char *in, size_t in_len, int finish,
+                            unsigned char *out, size_t out_cap, size_t *in_used, size_t *out_len);
+
+/**
+ * @brief Releases the compressor.
+ */
+void encoder_stream_destroy(encoder_stream *stream);
+
+#endif // HTTP_ENCODING_H
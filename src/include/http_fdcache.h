@@ -0,0 +1,70 @@
+#ifndef HTTP_FDCACHE_H
+#define HTTP_FDCACHE_H
+
+#include <sys/stat.h>   // For struct stat
+#include "http_utils.h" // For file_validators
+#include "http_encoding.h" // For CODING_COUNT
+
+// --- Configuration Constants ---
+#define FD_CACHE_ENTRIES 1024 // Default bound on open files kept across requests
+#define FD_CACHE_SHARDS 16    // Independent locks; must be a power of two
+
+// --- Data Structures ---
+
+/**
+ * @brief An open file and what fstat() said about it, shared by every response that sends
+ *        it. The descriptor is only ever used with explicit offsets (sendfile, splice, pread),
+ *        so concurrent responses never disturb each other. Reference counted like
+ *        cache_entry: the descriptor is closed once the entry is invalidated or evicted and
+ *        the last response using it has finished.
+ */
+typedef struct open_file {
+    struct open_file *hash_next;           // Shard hash chain
+    struct open_file *lru_prev, *lru_next; // Shard eviction list, newest first
+    char *path;
+    unsigned long hash;
+
+    int fd;
+    struct stat st;
+    file_validators validators;
+
+    // Precompressed siblings opened along with the file (see open_file_get), indexed by
+    // content_coding; fd -1 where there is none. Served as the file's encoded variants.
+    int sidecar_fd[CODING_COUNT];
+    off_t sidecar_size[CODING_COUNT];
+
+    int referenced; // Second-chance bit, set on every hit (atomic)
+    int refcount;   // Owners: the cache itself (while published) plus each user (atomic)
+} open_file;
+
+// --- Function Declarations ---
+
+/**
+ * @brief Returns the open file for a normalized full path. While the web root is watched
+ *        for changes (see http_watch.h) hits take a shard read lock and make no syscalls;
+ *        otherwise every call opens the file afresh and nothing is kept. If serve_precompressed
+ *        is set and the file's type is compressed, its "<path>.gz", ".br" and ".zst" sidecars
+ *        are opened too, each only if it is smaller than the file and no older than it.
+ * @return A referenced entry that must be returned with open_file_release, or NULL with
+ *         errno set: ENOENT/ENOTDIR if there is no such file, EISDIR if it is not a regular
+ *         file, anything else if it could not be opened.
+ */
+open_file *open_file_get(const char *full_path);
+
+/**
+ * @brief Drops one reference. Takes void * so it can be passed directly as a
+ *        conn_queue_file_ref release callback.
+ */
+void open_file_release(void *file);
+
+/**
+ * @brief Forgets the entry for one path, if any; responses already using it finish with it.
+ */
+void open_file_invalidate(const char *full_path);
+
+/**
+ * @brief Forgets every entry.
+ */
+void open_file_flush(void);
+
+#endif // HTTP_FDCACHE_H
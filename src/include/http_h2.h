@@ -0,0 +1,96 @@
+#ifndef HTTP_H2_H
+#define HTTP_H2_H
+
+#include <stddef.h>      // For size_t
+#include "http_conn.h"   // For http_conn
+#include "http_parser.h" // For http_request
+
+// --- Configuration Constants ---
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" // Client connection preface (RFC 9113 3.4)
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HEADER_SIZE 9
+#define H2_MAX_FRAME_SIZE 16384    // SETTINGS_MAX_FRAME_SIZE we accept: the protocol minimum
+#define H2_DEFAULT_WINDOW 65535    // Flow-control window every stream and connection starts with
+#define H2_RECV_WINDOW (1 << 20)   // What we grant the client per stream and per connection
+#define H2_SEND_ROUND (256 * 1024) // DATA queued per pass over the streams (see h2_session_pump)
+#define H2_MAX_STREAMS_DEFAULT 100 // Default of the http2_max_streams setting
+
+// --- Data Structures ---
+
+/**
+ * @brief An HTTP/2 connection's state (frame reader, HPACK tables, flow-control windows,
+ *        open streams), hung off its http_conn once the connection has switched protocols.
+ */
+typedef struct h2_session h2_session;
+
+/**
+ * @brief One request/response exchange. Each stream has an http_conn of its own that the
+ *        request handler answers on exactly as it would an HTTP/1.1 client: the header block
+ *        it queues is re-encoded as a HEADERS frame, and its body chunks (memory, cached,
+ *        file or streamed) are moved into DATA frames on the real connection as the flow-
+ *        control windows allow, file ranges still going out with sendfile/splice.
+ */
+typedef struct h2_stream h2_stream;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Looks for the client connection preface at the start of a new connection's input
+ *        (HTTP/2 with prior knowledge).
+ * @return 1 if it is there, 0 if the client speaks HTTP/1.x, -1 if too few bytes have arrived to tell.
+ */
+int h2_detect_preface(const http_conn *conn);
+
+/**
+ * @brief Switches a connection to HTTP/2 and queues the server's SETTINGS. The client's
+ *        preface is expected next in the input.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int h2_session_start(http_conn *conn);
+
+/**
+ * @brief Whether a complete HTTP/1.1 request asks to continue in cleartext HTTP/2
+ *        ("Upgrade: h2c" with HTTP2-Settings) and HTTP/2 is enabled.
+ */
+int h2_upgrade_requested(const http_conn *conn);
+
+/**
+ * @brief Answers 101 Switching Protocols, starts a session with the request's HTTP2-Settings
+ *        and answers the request itself as stream 1.
+ * @return 0 on success, -1 if the request must be answered as HTTP/1.1 after all.
+ */
+int h2_upgrade(http_conn *conn);
+
+/**
+ * @brief Consumes the frames buffered in in_buf. Payloads are handled as they arrive, so a
+ *        frame larger than the input buffer never has to be held whole.
+ */
+void h2_process_input(http_conn *conn);
+
+/**
+ * @brief Moves up to H2_SEND_ROUND of the streams' queued output into DATA frames, one frame
+ *        per stream in turn, within the flow-control windows. Called once the connection's
+ *        output queue has drained, so streams share the socket fairly and the queue never
+ *        holds more than a round of data.
+ */
+void h2_session_pump(http_conn *conn);
+
+/**
+ * @brief Whether any stream is still open, receiving a request or sending a response.
+ */
+int h2_session_active(const http_conn *conn);
+
+/**
+ * @brief Releases the session and every stream still open (the connection is going away).
+ */
+void h2_session_destroy(http_conn *conn);
+
+/**
+ * @brief Takes the HTTP/1.1 header block the handler queued on a stream's conn (see
+ *        response_queue); it is sent as HEADERS once the handler has returned.
+ * @return 0 on success, -1 if the stream already has a response.
+ */
+int h2_stream_set_head(http_conn *stream_conn, const char *head, size_t len);
+
+#endif // HTTP_H2_H
@@ -1,39 +1,75 @@
 #ifndef HTTP_HANDLER_H
 #define HTTP_HANDLER_H
 
-#include "http_utils.h" // For http_header struct
+#include "http_utils.h"  // For get_mime_type, gzip helpers
+#include "http_parser.h" // For http_request
+#include "http_conn.h"   // For http_conn
 
 // --- Configuration Constants ---
 #define BUFFER_SIZE 4096
+
+// Defaults of the web_root and max_header_size settings (http_config.h).
 #define WEB_ROOT "./webroot"
+#define MAX_HEADER_SIZE_DEFAULT 8192 // Request line plus header fields; larger gets 431
+
+// Streaming compression: file bytes read per step, and the HTTP chunk buffer each step compresses into.
+#define COMPRESS_STREAM_WINDOW 16384
+#define COMPRESS_STREAM_FRAMING_TAIL 7 // Payload CRLF + "0\r\n\r\n" terminator
+#define COMPRESS_STREAM_CHUNK_SIZE (COMPRESS_STREAM_WINDOW + 10 + COMPRESS_STREAM_FRAMING_TAIL)
+
+// Request bodies: POST bodies of up to BODY_ECHO_MAX bytes are echoed back, larger ones are
+// read and discarded; PUT bodies are written to the target file. Beyond the limits: 413.
+#define BODY_ECHO_MAX (BUFFER_SIZE * 2)
+#define MAX_BODY_SIZE_DEFAULT (1024 * 1024)
+#define MAX_UPLOAD_SIZE_DEFAULT (1024ULL * 1024 * 1024)
+
+// Returned by process_single_request while the buffered bytes do not yet hold a full request.
+#define REQUEST_INCOMPLETE -1
 
 // --- Function Declarations ---
 
 /**
- * @brief Thread entry point. Implements the persistent connection loop.
+ * @brief Handles a single request from the connection's input buffer: parses the request
+ *        line and headers in place, and queues the response.
+ * @param consumed Set to the request's size (headers plus body) once it has been handled,
+ *        so a pipelined request behind it can be processed next.
+ * @return 1 if the connection should be kept open (keep-alive), 0 otherwise, or
+ *         REQUEST_INCOMPLETE if more bytes must be read first.
+ */
+int process_single_request(http_conn *conn, size_t *consumed);
+
+/**
+ * @brief Works out how the body of a freshly parsed request is framed and where it goes: kept
+ *        in the input buffer to be echoed (small POST bodies), written to the target file
+ *        (PUT), or read and discarded (everything else, so keep-alive stays in sync).
+ * @return 0 on success, -1 if an error response has been queued instead.
  */
-void *client_handler(void *socket_desc);
+int begin_request_body(http_conn *conn);
 
 /**
- * @brief Handles reading a single request, extracting the URL path, parsing headers, and responding.
- * @return 1 if the connection should be kept open (keep-alive), 0 otherwise.
+ * @brief Routes a complete request, body received, to its response. Shared by HTTP/1.x and
+ *        HTTP/2 streams (see http_h2.h).
+ * @param body The POST body to echo, or NULL if it was too long to keep.
  */
-int process_single_request(int client_sock);
+void dispatch_request(http_conn *conn, const char *body, size_t body_len, const char *connection_header);
 
 /**
  * @brief Sends an HTTP error response (e.g., 404 Not Found).
  */
-void send_error_response(int client_sock, int status_code, const char *status_text, const char *connection_header);
+void send_error_response(http_conn *conn, int status_code, const char *status_text, const char *connection_header);
 
 /**
  * @brief Sends a generic 200 OK response, optionally echoing a body.
+ * @param body Bytes to echo (need not be NUL-terminated), or NULL for the default page.
  */
-void send_generic_response(int client_sock, const char* body, const char *connection_header);
+void send_generic_response(http_conn *conn, const char* body, size_t body_len, const char *connection_header);
 
 /**
- * @brief Attempts to find and send a file located in the WEB_ROOT directory.
+ * @brief Attempts to find and send the file named by the request target in the web root directory.
+ * @param allow_chunked Non-zero if the body may be streamed without a length up front (chunked
+ *        in HTTP/1.1, plain DATA frames in HTTP/2), as large compressible files are.
  */
-void send_file_response(int client_sock, const char* path, const http_header headers[], int num_headers, const char *connection_header);
+void send_file_response(http_conn *conn, const http_request *req, int allow_chunked, const char *connection_header);
 
 
 #endif // HTTP_HANDLER_H
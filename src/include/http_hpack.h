@@ -0,0 +1,91 @@
+#ifndef HTTP_HPACK_H
+#define HTTP_HPACK_H
+
+#include <stddef.h> // For size_t
+
+// --- Configuration Constants ---
+#define HPACK_TABLE_SIZE_DEFAULT 4096 // SETTINGS_HEADER_TABLE_SIZE until the peer announces its own
+#define HPACK_ENTRY_OVERHEAD 32       // Counted on top of name and value for every dynamic entry
+#define HPACK_STATIC_ENTRIES 61
+
+// Returned by hpack_decode when the fields do not fit the caller's buffers. The table has
+// still been brought up to date, so the connection can carry on (the request cannot).
+#define HPACK_TOO_LARGE -2
+
+// --- Data Structures ---
+
+/**
+ * @brief One header field. Both strings are NUL-terminated; names are lowercase on the wire.
+ */
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} hpack_field;
+
+/**
+ * @brief One direction's dynamic table (RFC 7541 2.3.2): a ring of entries, newest first,
+ *        each holding its name and value in a single allocation. A connection keeps one for
+ *        decoding what the peer sends and one for encoding what it sends back.
+ */
+typedef struct {
+    hpack_field *entries; // entries[(head + i) % cap] has index HPACK_STATIC_ENTRIES + 1 + i
+    size_t cap;
+    size_t count;
+    size_t head;
+    size_t size;        // Sum of the entries' sizes (name + value + HPACK_ENTRY_OVERHEAD)
+    size_t max_size;    // Current limit, moved by dynamic table size updates
+    size_t limit;       // Largest max_size allowed: the decoder's own setting, or the peer's for the encoder
+    int update_pending; // Encoder: max_size changed, so the next block must open with an update
+} hpack_table;
+
+/**
+ * @brief How an encoded field may be remembered (RFC 7541 6.2).
+ */
+typedef enum {
+    HPACK_INDEX,      // Added to the dynamic table; for values that repeat across responses
+    HPACK_NO_INDEX,   // Sent as a literal; for values that change with every response
+    HPACK_NEVER_INDEX // Sent as a literal that intermediaries must not index either
+} hpack_indexing;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Starts an empty table that may grow to limit bytes.
+ */
+void hpack_table_init(hpack_table *table, size_t limit);
+
+/**
+ * @brief Releases every entry.
+ */
+void hpack_table_free(hpack_table *table);
+
+/**
+ * @brief Applies the peer's SETTINGS_HEADER_TABLE_SIZE to an encoding table. It never grows
+ *        past HPACK_TABLE_SIZE_DEFAULT; a change is announced at the start of the next block.
+ */
+void hpack_encoder_set_limit(hpack_table *table, size_t limit);
+
+/**
+ * @brief Decodes one complete header block, updating the table as it goes.
+ * @param fields Receives the fields in order; names and values are copied into out.
+ * @return Number of fields, -1 on a compression error (the connection cannot continue), or
+ *         HPACK_TOO_LARGE if more than max_fields or out_cap bytes would be needed.
+ */
+int hpack_decode(hpack_table *table, const unsigned char *block, size_t len, hpack_field *fields, int max_fields,
+                 char *out, size_t out_cap);
+
+/**
+ * @brief Appends the representation of one field to out: an index when the static or dynamic
+ *        table already holds it, otherwise a literal (Huffman-coded when that is shorter),
+ *        with the name indexed where possible. Opens with a pending table size update.
+ * @param name Must be lowercase.
+ * @return Bytes written, or -1 if out_cap is too small (the table is left unchanged) or the
+ *         table could not grow (the block must then not be sent: the peer's table would differ).
+ */
+int hpack_encode_field(hpack_table *table, unsigned char *out, size_t out_cap, const char *name, size_t name_len,
+                       const char *value, size_t value_len, hpack_indexing indexing);
+
+#endif // HTTP_HPACK_H
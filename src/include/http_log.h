@@ -0,0 +1,63 @@
+#ifndef HTTP_LOG_H
+#define HTTP_LOG_H
+
+#include <stddef.h> // For size_t
+
+// --- Configuration Constants ---
+#define LOG_RING_SLOTS 512           // Records buffered per thread; must be a power of two
+#define LOG_RECORD_SIZE 256          // Longer messages (e.g. raw request dumps) are truncated
+#define LOG_FLUSH_INTERVAL_MS 5      // Writer thread's sleep when every ring is empty
+#define LOG_LEVEL_DEFAULT LOG_INFO
+
+// --- Data Structures ---
+
+typedef enum {
+    LOG_DEBUG, // Raw request dumps and per-connection chatter
+    LOG_INFO,  // One access-log line per response, startup messages
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_OFF
+} log_level;
+
+// Minimum level that is recorded. Checked before formatting, so disabled calls cost one compare.
+extern log_level log_threshold;
+
+#define log_debug(...) do { if (log_threshold <= LOG_DEBUG) log_write(LOG_DEBUG, __VA_ARGS__); } while (0)
+#define log_info(...)  do { if (log_threshold <= LOG_INFO)  log_write(LOG_INFO,  __VA_ARGS__); } while (0)
+#define log_warn(...)  do { if (log_threshold <= LOG_WARN)  log_write(LOG_WARN,  __VA_ARGS__); } while (0)
+#define log_error(...) do { if (log_threshold <= LOG_ERROR) log_write(LOG_ERROR, __VA_ARGS__); } while (0)
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Sets the threshold and starts the background writer thread. Until this is called,
+ *        records are written synchronously (useful for tools and tests).
+ * @return 0 on success, -1 if the writer thread could not be started.
+ */
+int log_init(log_level threshold);
+
+/**
+ * @brief Changes the threshold at runtime (e.g. on a configuration reload).
+ */
+void log_set_threshold(log_level threshold);
+
+/**
+ * @brief Parses "debug", "info", "warn", "error" or "off".
+ * @return 0 on success, -1 for an unknown name.
+ */
+int log_level_parse(const char *name, log_level *level);
+
+/**
+ * @brief Formats a record into the calling thread's ring without blocking or locking.
+ *        If the ring is full the record is dropped and counted.
+ *        WARN and ERROR records go to stderr, the rest to stdout.
+ */
+void log_write(log_level level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Total records dropped so far because a thread's ring was full.
+ */
+unsigned long log_dropped(void);
+
+#endif // HTTP_LOG_H
@@ -0,0 +1,99 @@
+#ifndef HTTP_METRICS_H
+#define HTTP_METRICS_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint64_t
+
+// --- Configuration Constants ---
+#define METRICS_PATH "/metrics" // Reserved request path served in Prometheus text format
+
+// Histograms are log-linear: 2^METRICS_SUB_BITS buckets per power of two (~12% precision),
+// covering 1 ns to ~18 minutes; slower samples land in the last bucket.
+#define METRICS_SUB_BITS 3
+#define METRICS_HIST_BUCKETS 320
+
+// --- Data Structures ---
+
+/**
+ * @brief Phases of a request's lifecycle with their own latency histogram.
+ */
+typedef enum {
+    STAGE_FIRST_BYTE, // Accept until the first response byte is handed to the kernel
+    STAGE_PARSE,      // The parser call that completes a request's header block
+    STAGE_FILE_IO,    // stat/open/read of files being served
+    STAGE_COMPRESS,   // Compression work, cached variants and streamed bodies alike
+    STAGE_WRITE,      // Each send/sendfile (epoll) or send completion wait (io_uring)
+    STAGE_COUNT
+} metrics_stage;
+
+/**
+ * @brief Request routes, each with a whole-request latency histogram (first parsed byte
+ *        until the response is queued).
+ */
+typedef enum {
+    ROUTE_STATIC,  // GET of a file
+    ROUTE_ECHO,    // POST
+    ROUTE_UPLOAD,  // PUT
+    ROUTE_HEAD,
+    ROUTE_METRICS, // METRICS_PATH itself
+    ROUTE_OTHER,   // Errors and unsupported methods
+    ROUTE_COUNT
+} metrics_route;
+
+typedef enum {
+    METRIC_CONN_ACCEPTED,
+    METRIC_CONN_CLOSED,
+    METRIC_REQUESTS,
+    METRIC_REQUESTS_REUSED, // Requests that were not the first on their connection
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_COMPRESS_IN,     // Bytes before compression, for responses sent with a content coding
+    METRIC_COMPRESS_OUT,    // The same responses after compression
+    METRIC_TIMEOUT_HEADER,  // Connections closed by each timeout
+    METRIC_TIMEOUT_BODY,
+    METRIC_TIMEOUT_IDLE,
+    METRIC_TIMEOUT_WRITE,
+    METRIC_SHED_CONNECTION_LIMIT, // Connections and requests turned away with 503, by reason
+    METRIC_SHED_CLIENT_LIMIT,
+    METRIC_SHED_RATE_LIMIT,
+    METRIC_SHED_OVERLOAD,
+    METRIC_H2_CONNECTIONS,  // Connections that switched to HTTP/2, and the streams they opened
+    METRIC_H2_STREAMS,
+    METRIC_COUNT
+} metrics_counter;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Monotonic clock in nanoseconds, for the start/end of timed sections.
+ */
+uint64_t metrics_now(void);
+
+/**
+ * @brief Adds n to one of the calling thread's counters. Single-writer, so no atomic RMW.
+ */
+void metrics_add(metrics_counter counter, uint64_t n);
+
+/**
+ * @brief Counts one response with the given HTTP status code.
+ */
+void metrics_count_status(int status_code);
+
+/**
+ * @brief Records one sample (in nanoseconds) in a lifecycle stage histogram.
+ */
+void metrics_observe_stage(metrics_stage stage, uint64_t ns);
+
+/**
+ * @brief Records one whole-request latency sample (in nanoseconds) for a route.
+ */
+void metrics_observe_route(metrics_route route, uint64_t ns);
+
+/**
+ * @brief Sums every thread's counters and histograms into Prometheus text exposition format.
+ * @return malloc'd text (caller frees), or NULL on allocation failure.
+ */
+char *metrics_render(size_t *len);
+
+#endif // HTTP_METRICS_H
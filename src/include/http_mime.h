@@ -0,0 +1,42 @@
+#ifndef HTTP_MIME_H
+#define HTTP_MIME_H
+
+// --- Data Structures ---
+
+/**
+ * @brief What the server needs to know about a file extension, decided once per extension:
+ *        its Content-Type and whether responses of that type are worth compressing.
+ */
+typedef struct {
+    const char *extension; // Without the dot, e.g. "html"
+    const char *type;
+    int compressible;
+} mime_type;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Resolves the extension of a request path with one perfect-hash probe.
+ * @return The table entry; unknown or missing extensions get application/octet-stream.
+ *         Entries stay valid for the life of the process, across mime_load_types calls.
+ */
+const mime_type *mime_lookup(const char *path);
+
+/**
+ * @brief Extends the built-in table from a mime.types file ("type ext ext..." per line,
+ *        '#' comments). Its entries take precedence over built-in ones for the same
+ *        extension. The new table is published atomically, so lookups may run concurrently.
+ * @return Number of extensions loaded from the file, or -1 if it cannot be read or the
+ *         table cannot be rebuilt (the previous table stays in use).
+ */
+int mime_load_types(const char *path);
+
+/**
+ * @brief The compressibility rule applied to every type: any text/ type, JavaScript, JSON, XML
+ *        and SVG, including +json and +xml suffixes.
+ * @return 1 if compressible, 0 otherwise.
+ */
+int mime_type_is_compressible(const char *type);
+
+#endif // HTTP_MIME_H
@@ -0,0 +1,112 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h> // For size_t
+#include "http_utils.h" // For MAX_HEADERS
+
+// --- Data Structures ---
+
+/**
+ * @brief A view into the connection's read buffer. Once a request is complete the byte
+ *        after each slice is overwritten with '\0', so ptr can also be used as a C string.
+ */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} http_slice;
+
+typedef struct {
+    http_slice name;
+    http_slice value;
+} http_header_slice;
+
+/**
+ * @brief Header fields the server itself acts on. The parser resolves each header name to
+ *        one of these with a perfect hash as it is scanned, so looking them up afterwards is
+ *        a single array index instead of a scan over every header.
+ */
+typedef enum {
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_TRANSFER_ENCODING,
+    HDR_EXPECT,
+    HDR_ACCEPT_ENCODING,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_UPGRADE,
+    HDR_HTTP2_SETTINGS,
+    HDR_COUNT
+} http_header_id;
+
+typedef enum {
+    PARSE_INCOMPLETE, // Need more bytes; call again with the same (possibly grown) buffer
+    PARSE_COMPLETE,   // Request line and headers parsed; header_len bytes consumed
+    PARSE_ERROR       // Malformed request; error_status holds the HTTP status to answer with
+} parse_result;
+
+/**
+ * @brief Resumable request-line and header parser state. Nothing is copied: every field
+ *        points into the buffer passed to http_parse_request.
+ */
+typedef struct {
+    int state;
+    size_t pos;         // Bytes of the buffer already scanned
+    size_t mark;        // Start of the token being scanned
+    const char *base;   // Buffer seen by the previous call, to rebase slices if it moved
+
+    http_slice method;
+    http_slice target;
+    http_slice version;
+    http_header_slice headers[MAX_HEADERS];
+    int num_headers;
+    unsigned char known[HDR_COUNT]; // 1 + index in headers[] of each known field's first occurrence; 0 if absent
+    int header_id;      // http_header_id of the field being scanned, -1 if the server does not track it
+
+    size_t header_len;  // Size of request line + headers + blank line, once complete
+    int error_status;   // 400 or 431, on PARSE_ERROR
+} http_request;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Prepares the parser for a new request.
+ */
+void http_request_reset(http_request *req);
+
+/**
+ * @brief Parses as much of buf as is available, resuming where the previous call stopped.
+ *        On completion, the delimiter after each slice is replaced with '\0' in place.
+ * @param buf Start of the request; must begin at the same request on every call.
+ * @param len Number of valid bytes in buf.
+ */
+parse_result http_parse_request(http_request *req, char *buf, size_t len);
+
+/**
+ * @brief Case-insensitive header lookup on a completed request.
+ * @return The NUL-terminated value, or NULL if the header is absent.
+ */
+const char *http_request_header(const http_request *req, const char *name);
+
+/**
+ * @brief Looks up a known header on a completed request in constant time.
+ * @return The NUL-terminated value, or NULL if the header is absent.
+ */
+const char *http_request_header_id(const http_request *req, http_header_id id);
+
+/**
+ * @brief Maps a header name to its http_header_id (case-insensitively).
+ * @return The id, or -1 if the server does not track this header.
+ */
+int http_header_lookup(const char *name, size_t len);
+
+/**
+ * @brief Compares a slice to a C string, case-sensitively.
+ * @return 1 if equal, 0 otherwise.
+ */
+int http_slice_equals(http_slice slice, const char *str);
+
+#endif // HTTP_PARSER_H
@@ -0,0 +1,44 @@
+#ifndef HTTP_PHASH_H
+#define HTTP_PHASH_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint32_t
+
+// --- Data Structures ---
+
+/**
+ * @brief Perfect hash over a fixed set of ASCII keys, compared case-insensitively
+ *        (hash and displace: each key's bucket picks the seed that sends all of the bucket's
+ *        keys to distinct free slots). A lookup is a fixed-cost hash, one slot read and one compare.
+ *        Built once, then read-only and safe to share between threads.
+ */
+typedef struct {
+    const char *const *keys; // Borrowed; must outlive the table
+    uint32_t *seeds;         // Per bucket
+    int *slots;              // Key index per slot, -1 if empty
+    uint32_t bucket_count;
+    uint32_t slot_mask;      // Slot count - 1 (a power of two)
+} perfect_hash;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Builds a table over count distinct keys (distinct ignoring ASCII case).
+ * @return 0 on success, -1 on allocation failure, duplicate keys, or two keys the hash
+ *         cannot separate (only possible beyond 24 bytes; see phash_hash).
+ */
+int phash_build(perfect_hash *ph, const char *const *keys, int count);
+
+/**
+ * @brief Looks up key[0..len), which need not be NUL-terminated.
+ * @return Index of the matching key in the array given to phash_build, or -1.
+ */
+int phash_find(const perfect_hash *ph, const char *key, size_t len);
+
+/**
+ * @brief Releases the table (not the keys).
+ */
+void phash_free(perfect_hash *ph);
+
+#endif // HTTP_PHASH_H
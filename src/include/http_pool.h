@@ -0,0 +1,73 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <stddef.h> // For size_t
+
+// --- Configuration Constants ---
+#define POOL_ALIGNMENT 16 // Objects and arena allocations; leaves low pointer bits free for tags
+
+// --- Data Structures ---
+
+/**
+ * @brief Slab allocator for one fixed object size (connection state and its buffers).
+ *        Objects are carved from slabs of objects_per_slab and recycled through a free list,
+ *        so steady-state accept/close traffic never reaches malloc. A pool is meant to be
+ *        thread-local and is not synchronized; slabs are kept for the life of the process.
+ */
+typedef struct {
+    size_t object_size;
+    size_t objects_per_slab;
+    void *free_list;   // Recycled objects, linked through their first word
+    char *slab_next;   // Untouched space in the newest slab
+    size_t slab_left;  // Objects still available at slab_next
+} object_pool;
+
+#define OBJECT_POOL_INIT(size, per_slab) \
+    { ((size) + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT, (per_slab), NULL, NULL, 0 }
+
+/**
+ * @brief Bump allocator over a caller-provided buffer for request-scoped memory. Allocations
+ *        are never freed individually; the whole arena is reset once they are all dead.
+ */
+typedef struct {
+    char *base;
+    size_t cap;
+    size_t used;
+} arena;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Takes an object from the pool, adding a slab if the free list is empty.
+ * @return Uninitialized, POOL_ALIGNMENT-aligned memory, or NULL on allocation failure.
+ */
+void *pool_alloc(object_pool *pool);
+
+/**
+ * @brief Returns an object to the pool's free list.
+ */
+void pool_free(object_pool *pool, void *object);
+
+/**
+ * @brief Points the arena at buf (cap bytes), which must outlive it.
+ */
+void arena_init(arena *a, void *buf, size_t cap);
+
+/**
+ * @brief Carves size bytes from the arena.
+ * @return POOL_ALIGNMENT-aligned memory, or NULL if the arena is full (fall back to malloc).
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * @brief Returns non-zero if ptr was handed out by this arena (and must not be freed).
+ */
+int arena_owns(const arena *a, const void *ptr);
+
+/**
+ * @brief Releases every allocation at once.
+ */
+void arena_reset(arena *a);
+
+#endif // HTTP_POOL_H
@@ -0,0 +1,38 @@
+#ifndef HTTP_PRECOMPRESS_H
+#define HTTP_PRECOMPRESS_H
+
+// --- Configuration Constants ---
+// A sidecar is compressed once and sent many times, so it gets each encoder's best level.
+#define PRECOMPRESS_GZIP_LEVEL 9
+#define PRECOMPRESS_BROTLI_LEVEL 11
+#define PRECOMPRESS_ZSTD_LEVEL 19      // Past 19 zstd's windows grow too large for some decoders
+#define PRECOMPRESS_MAX_DEPTH 32       // Deepest directory below the web root that is walked
+#define PRECOMPRESS_BUFFER_SIZE (256 * 1024)
+
+// --- Data Structures ---
+
+/**
+ * @brief When the precompress setting writes sidecars.
+ */
+typedef enum {
+    PRECOMPRESS_OFF,
+    PRECOMPRESS_STARTUP, // Before the server starts listening
+    PRECOMPRESS_ONLY     // Instead of serving: write them and exit (e.g. from a deploy script)
+} precompress_mode;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Writes a precompressed sidecar ("<file>.gz", ".br", ".zst", one per coding this
+ *        build supports) next to every file under root that would be compressed when served
+ *        (compress_types and compress_min_size), for http_fdcache.h to pick up. The files
+ *        are shared out between threads. A sidecar no older than its file is up to date and
+ *        left alone; a new one is written to a temporary file, given its file's mtime and
+ *        renamed into place, and is not kept unless it is smaller than the file.
+ * @param threads Compressing threads; 0 for one per online CPU.
+ * @return 0 on success, -1 if the tree could not be walked or any sidecar not written.
+ */
+int precompress_tree(const char *root, unsigned threads);
+
+#endif // HTTP_PRECOMPRESS_H
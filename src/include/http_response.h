@@ -0,0 +1,61 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <stddef.h>     // For size_t
+#include "http_conn.h"  // For http_conn
+
+// --- Configuration Constants ---
+#define RESPONSE_HEAD_SIZE 1024 // Status line plus all header fields of one response
+
+// --- Data Structures ---
+
+/**
+ * @brief A response header block assembled on the stack. Status lines, the Date line and
+ *        the Connection line come from prebuilt fragments, so building one is a handful of
+ *        memcpy calls. Once queued it is coalesced with the body (and any other pipelined
+ *        responses) into a single writev/sendmsg by the connection's flush.
+ */
+typedef struct {
+    char head[RESPONSE_HEAD_SIZE];
+    size_t len;
+    int overflow; // Set if a field did not fit; response_queue then refuses the block
+} http_response;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Starts a response with its status line and the cached Date header.
+ */
+void response_begin(http_response *res, int status_code, const char *status_text);
+
+/**
+ * @brief Appends one "Name: value" header field.
+ */
+void response_add_header(http_response *res, const char *name, const char *value);
+
+/**
+ * @brief Appends prebuilt header lines (each ending in CRLF) verbatim.
+ */
+void response_add_raw(http_response *res, const char *lines, size_t len);
+
+/**
+ * @brief Appends "Content-Length: <len>" without going through printf.
+ */
+void response_add_content_length(http_response *res, size_t len);
+
+/**
+ * @brief Appends the Connection field and the blank line that ends the header block.
+ * @param connection_header "keep-alive" or "close".
+ */
+void response_end(http_response *res, const char *connection_header);
+
+/**
+ * @brief Copies the finished header block onto the connection's output queue. The body
+ *        is queued right behind it with conn_queue, conn_queue_ref, conn_queue_file or
+ *        conn_queue_stream.
+ * @return 0 on success, -1 if the block overflowed or could not be queued.
+ */
+int response_queue(http_conn *conn, const http_response *res);
+
+#endif // HTTP_RESPONSE_H
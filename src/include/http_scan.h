@@ -0,0 +1,50 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h> // For size_t
+
+// --- Data Structures ---
+
+/**
+ * @brief Instruction-set levels of the scanning kernels, lowest first.
+ */
+typedef enum {
+    SCAN_SCALAR, // Byte at a time; always available
+    SCAN_SSE42,  // 16 bytes at a time: PCMPESTRI for delimiters, PSHUFB nibble tables for tokens
+    SCAN_AVX2,   // 32 bytes at a time: byte compares and VPSHUFB nibble tables
+    SCAN_LEVEL_COUNT
+} scan_level;
+
+/**
+ * @brief The byte-class searches the request parser spends its time in. Each returns the
+ *        offset of the first byte that ends the run, or len if every byte belongs to it.
+ *        Kernels never read past p + len.
+ */
+typedef struct {
+    const char *name;
+    size_t (*line_end)(const char *p, size_t len);   // First '\r', '\n' or '\0'
+    size_t (*target_end)(const char *p, size_t len); // First control byte, space or DEL
+    size_t (*token_end)(const char *p, size_t len);  // First byte that is not an RFC 9110 tchar
+} scan_kernels;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief The kernels the parser uses: the best level this CPU supports, detected on first use.
+ */
+const scan_kernels *scan_active(void);
+
+/**
+ * @brief A specific level's kernels, for tests and benchmarks.
+ * @return NULL if the CPU (or the build target) does not support that level.
+ */
+const scan_kernels *scan_kernels_for(scan_level level);
+
+/**
+ * @brief Caps the level scan_active picks (e.g. to compare levels end to end). Takes effect
+ *        for requests parsed afterwards.
+ */
+void scan_limit(scan_level max_level);
+
+#endif // HTTP_SCAN_H
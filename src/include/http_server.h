@@ -1,16 +1,31 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SERVER_H
 
+#include <sys/socket.h> // For SOMAXCONN
+
 // --- Configuration Constants ---
-#define MAX_CONNECTIONS 10
 #define PORT_DEFAULT 8080
+#define WORKER_THREADS 0          // Default event-loop threads; 0 means one per online CPU
+#define LISTEN_BACKLOG SOMAXCONN  // Default pending-connection queue of each worker's listener
+#define MAX_EVENTS 256     // Readiness events handled per epoll_wait call
+
+// --- Data Structures ---
+
+/**
+ * @brief Event engine the workers drive their sockets with.
+ */
+typedef enum {
+    IO_BACKEND_EPOLL, // Non-blocking sockets, edge-triggered epoll (default)
+    IO_BACKEND_URING  // Batched accept/recv/send through io_uring; falls back to epoll if unavailable
+} io_backend;
 
 // --- Function Declarations ---
 
 /**
  * @brief Initializes and runs the HTTP server loop.
  * @param port The port number to listen on.
+ * @param backend The I/O engine to run the workers on.
  */
-int run_server(int port);
+int run_server(int port, io_backend backend);
 
 #endif // HTTP_SERVER_H
@@ -0,0 +1,75 @@
+#ifndef HTTP_TIMER_H
+#define HTTP_TIMER_H
+
+#include <stdint.h> // For uint64_t
+
+// --- Configuration Constants ---
+#define TIMER_TICK_MS 100   // Resolution of the wheel; timers fire up to one tick late
+#define TIMER_LEVEL_BITS 6  // 64 slots per level
+#define TIMER_LEVELS 4      // 2^24 ticks (~19 days at 100 ms) before timers are clamped
+
+#define TIMER_SLOTS (1 << TIMER_LEVEL_BITS)
+
+// --- Data Structures ---
+
+/**
+ * @brief A timer embedded in the object it times out. Unlinking needs no search, so arming
+ *        and cancelling are O(1) whatever the number of timers.
+ */
+typedef struct timer_node {
+    struct timer_node *next;
+    struct timer_node **pprev; // NULL while not armed
+    uint64_t expires;          // In ticks
+} timer_node;
+
+/**
+ * @brief Hierarchical timer wheel: level 0 holds the next TIMER_SLOTS ticks one slot per
+ *        tick, each higher level covers TIMER_SLOTS times the span of the one below with
+ *        coarser slots, which are cascaded down as the wheel turns. Single-threaded: each
+ *        worker owns one.
+ */
+typedef struct {
+    uint64_t now;  // Ticks processed so far
+    unsigned armed;
+    timer_node *slots[TIMER_LEVELS][TIMER_SLOTS];
+} timer_wheel;
+
+
+// --- Function Declarations ---
+
+/**
+ * @brief Starts an empty wheel at the given monotonic time.
+ */
+void timer_wheel_init(timer_wheel *wheel, uint64_t now_ms);
+
+/**
+ * @brief (Re)arms a timer to fire at a monotonic time. Deadlines are taken as absolute so a
+ *        wheel that has not been turned for a while does not fire fresh timers early.
+ */
+void timer_arm(timer_wheel *wheel, timer_node *node, uint64_t deadline_ms);
+
+/**
+ * @brief Disarms a timer; harmless if it is not armed.
+ */
+void timer_cancel(timer_wheel *wheel, timer_node *node);
+
+/**
+ * @brief Returns non-zero while the timer is armed.
+ */
+static inline int timer_pending(const timer_node *node) {
+    return node->pprev != 0;
+}
+
+/**
+ * @brief Turns the wheel up to now_ms, calling expire for every timer that has come due.
+ *        Each timer is disarmed before its callback runs, which may re-arm it or free it.
+ */
+void timer_advance(timer_wheel *wheel, uint64_t now_ms, void (*expire)(timer_node *node));
+
+/**
+ * @brief How long an event loop may sleep before the wheel needs turning.
+ * @return Milliseconds, or -1 if no timer is armed.
+ */
+int timer_wait_ms(const timer_wheel *wheel);
+
+#endif // HTTP_TIMER_H
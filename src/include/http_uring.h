@@ -0,0 +1,24 @@
+#ifndef HTTP_URING_H
+#define HTTP_URING_H
+
+// --- Configuration Constants ---
+#define URING_ENTRIES 256        // Submission queue depth per worker
+#define URING_RECV_BUFFERS 256   // Provided BUFFER_SIZE buffers for multishot recv, per worker
+
+// --- Function Declarations ---
+
+/**
+ * @brief Checks whether the running kernel supports the io_uring operations the backend needs.
+ * @return 1 if the io_uring backend can be used, 0 otherwise.
+ */
+int uring_supported(void);
+
+/**
+ * @brief Runs a worker's event loop on io_uring: accept, recv, send and file splices are
+ *        submitted in batches and reaped with a single io_uring_enter per iteration.
+ * @return -1 if the ring could not be set up (the caller should fall back to epoll),
+ *         0 if the loop stopped on a fatal error.
+ */
+int uring_run_worker(int listen_fd, int worker_id);
+
+#endif // HTTP_URING_H
@@ -1,17 +1,42 @@
 #ifndef HTTP_UTILS_H
 #define HTTP_UTILS_H
 
-#include <stddef.h> // For size_t
+#include <stddef.h>    // For size_t
+#include <time.h>      // For time_t
+#include <sys/types.h> // For off_t
+#include <sys/stat.h>  // For struct stat
+#include "http_encoding.h" // For CODING_COUNT
 
 // --- Data Structures ---
 #define MAX_HEADERS 32
 #define MAX_HEADER_LEN 256
+#define ETAG_SIZE 64      // Quoted entity tag, e.g. "1a2b-3c4d-5e6f7a8b-gz"
+#define HTTP_DATE_SIZE 32 // IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+#define MAX_RANGES 16     // Range requests with more parts are answered with the whole file
 
 typedef struct {
     char key[MAX_HEADER_LEN];
     char value[MAX_HEADER_LEN];
 } http_header;
 
+/**
+ * @brief Cache validators of one file version, computed once from its stat data.
+ *        Each content coding gets its own strong tag, since its bytes differ.
+ */
+typedef struct {
+    char etag[CODING_COUNT][ETAG_SIZE]; // Indexed by content_coding; [CODING_IDENTITY] is the file as is
+    char last_modified[HTTP_DATE_SIZE];
+    time_t mtime;
+} file_validators;
+
+/**
+ * @brief One satisfiable byte range of a file, both ends inclusive.
+ */
+typedef struct {
+    off_t first;
+    off_t last;
+} byte_range;
+
 
 // --- Function Declarations ---
 
@@ -34,15 +59,95 @@ int parse_headers(char* request_buffer, http_header headers[], int max_headers);
 const char* get_header_value(const http_header headers[], int num_headers, const char* key);
 
 /**
- * @brief Simple utility to determine the MIME type based on file extension.
+ * @brief Determines the MIME type based on file extension (a perfect-hash table hit; see
+ *        http_mime.h, which also gives the compressibility decision in the same lookup).
  * @return MIME type string.
  */
 const char *get_mime_type(const char *path);
 
 /**
- * @brief Uses zlib's compress2 to compress the given data into Gzip format.
+ * @brief Decides whether responses of the given MIME type are worth compressing (text assets).
+ * @return 1 if compressible, 0 otherwise.
+ */
+int is_compressible_mime(const char *mime_type);
+
+/**
+ * @brief Derives strong ETags (inode, size, mtime in nanoseconds) and Last-Modified from st.
+ */
+void file_validators_init(file_validators *validators, const struct stat *st);
+
+/**
+ * @brief Formats t as an IMF-fixdate (the HTTP date format) into out[HTTP_DATE_SIZE].
+ */
+void format_http_date(time_t t, char *out);
+
+/**
+ * @brief Parses an IMF-fixdate such as an If-Modified-Since value.
+ * @return 0 on success, -1 if the value is not a valid date.
+ */
+int parse_http_date(const char *value, time_t *t);
+
+/**
+ * @brief Checks an If-None-Match value ("*" or a comma-separated list of entity tags)
+ *        against etag using the weak comparison that RFC 9110 requires for this header.
+ * @return 1 if any listed tag matches, 0 otherwise.
+ */
+int etag_list_matches(const char *list, const char *etag);
+
+/**
+ * @brief Parses a "Range: bytes=..." value against a file of the given size. Ranges that
+ *        start past the end are dropped, suffix ranges ("-500") and open ranges ("9500-")
+ *        are resolved, and last positions are clamped to the file.
+ * @return Number of satisfiable ranges stored in ranges[]; 0 if none is satisfiable (416);
+ *         -1 if the value is malformed, not in bytes, or has more than max parts, in which
+ *         case the header is ignored and the whole file is sent.
+ */
+int parse_byte_ranges(const char *value, off_t size, byte_range ranges[], int max);
+
+/**
+ * @brief Collapses repeated slashes and "." segments in place, so every spelling of a file's
+ *        path (e.g. "/a//b/./c") names the same cache entry. ".." is left alone.
+ */
+void path_normalize(char *path);
+
+/**
+ * @brief Reads exactly len bytes from fd at offset with pread, retrying on short reads; the
+ *        file position is untouched, so a descriptor shared between responses can be read.
+ * @return 0 on success, -1 on error or premature end of file.
+ */
+int read_fully(int fd, unsigned char *buf, size_t len, off_t offset);
+
+/**
+ * @brief Compresses the given data into a single gzip member (RFC 1952) with deflate.
+ * @param level zlib compression level (1-9, or Z_DEFAULT_COMPRESSION).
  * @return Dynamically allocated buffer containing compressed data, or NULL on error.
  */
-unsigned char* compress_data_gzip(const unsigned char *data, size_t data_len, size_t *compressed_len);
+unsigned char* compress_data_gzip(const unsigned char *data, size_t data_len, int level, size_t *compressed_len);
+
+/**
+ * @brief Incremental gzip compressor for bodies too large to compress in one piece.
+ */
+typedef struct gzip_stream gzip_stream;
+
+/**
+ * @brief Starts an incremental gzip compressor at the given zlib level.
+ * @return New stream, or NULL on error.
+ */
+gzip_stream *gzip_stream_create(int level);
+
+/**
+ * @brief Feeds input to the compressor and collects whatever output is ready.
+ * @param finish Non-zero once in holds the final bytes of the body.
+ * @param in_used Set to the number of input bytes consumed.
+ * @param out_len Set to the number of bytes written to out.
+ * @return 1 once the gzip trailer has been written, 0 if more calls are needed, -1 on error.
+ */
+int gzip_stream_compress(gzip_stream *gz, const unsigned char *in, size_t in_len, int finish,
+                         unsigned char *out, size_t out_cap, size_t *in_used, size_t *out_len);
+
+/**
+ * @brief Releases the compressor.
+ */
+void gzip_stream_destroy(gzip_stream *gz);
 
 #endif // HTTP_UTILS_H
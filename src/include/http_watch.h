@@ -0,0 +1,35 @@
+#ifndef HTTP_WATCH_H
+#define HTTP_WATCH_H
+
+// --- Configuration Constants ---
+#define WATCH_MAX_DEPTH 32     // Deepest directory below the web root that is watched; deeper trees are not trusted
+#define WATCH_RETRY_MS 5000    // How often a web root that could not be watched is tried again
+#define WATCH_EVENT_BUFFER 16384
+
+// --- Function Declarations ---
+
+/**
+ * @brief Watches every directory under the configured web root with inotify and starts the
+ *        thread that turns change events into cache invalidations (content cache and open
+ *        file cache), so both can trust their entries without revalidating. Directory
+ *        renames, deletions and event queue overflows flush both caches and rebuild the
+ *        watches. Call before the workers start.
+ * @return 0 if the watch thread is running (even if the root could not be watched yet).
+ */
+int watch_start(void);
+
+/**
+ * @brief Whether every change under the current web root is being reported. While it is 0
+ *        (no inotify, too many directories, symlinks in the tree, directories deeper than
+ *        WATCH_MAX_DEPTH, or a rebuild in progress) the caches fall back to checking files
+ *        themselves.
+ */
+int watch_active(void);
+
+/**
+ * @brief Asks the watch thread to follow a reloaded config: a different web_root is
+ *        watched from scratch and both caches are flushed.
+ */
+void watch_refresh(void);
+
+#endif // HTTP_WATCH_H
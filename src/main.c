@@ -1,21 +1,47 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
 #include "include/http_server.h"
+#include "include/http_log.h"
+#include "include/http_mime.h"
+#include "include/http_config.h"
+#include "include/http_precompress.h"
 
 /**
  * @brief Main entry point for the HTTP server.
+ * Usage: httpserver [port] [--config FILE] [--io-uring] [--SETTING VALUE ...]
+ *        Every setting in server_config (http_config.h) can be given in the config file as
+ *        "name = value" or on the command line as --name-with-dashes VALUE, e.g.
+ *        --log-level warn, --max-body-size 4m, --idle-timeout-ms 5000. Send SIGHUP to reload.
+ *        --precompress only writes the web root's precompressed sidecars and exits.
  */
 int main(int argc, char *argv[]) {
-    // Determine the port to use
-    int port = PORT_DEFAULT;
-    if (argc > 1) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            fprintf(stderr, "Invalid port number. Using default %d.\n", PORT_DEFAULT);
-            port = PORT_DEFAULT;
-        }
+    // Only the reload thread started by run_server waits for SIGHUP; every other thread
+    // inherits this mask, so a reload signal never interrupts (or kills) one of them.
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &reload_signals, NULL);
+
+    if (config_init(argc, argv) != 0) {
+        return EXIT_FAILURE;
+    }
+    const server_config *config = config_current();
+
+    // Before log_init, so a failure is reported synchronously rather than lost on exit.
+    if (config->mime_types[0] && mime_load_types(config->mime_types) < 0) {
+        return EXIT_FAILURE;
+    }
+    // Also before log_init: the pass runs alone, and its summary must not wait for a writer thread.
+    if (config->precompress != PRECOMPRESS_OFF) {
+        int rc = precompress_tree(config->web_root, config->workers);
+        if (config->precompress == PRECOMPRESS_ONLY) return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (log_init(config->log_level) != 0) {
+        return EXIT_FAILURE;
     }
 
     // Call the server's main loop function, defined in http_server.c
-    return run_server(port);
+    return run_server((int)config->port, config->backend);
 }
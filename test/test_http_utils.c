@@ -1,9 +1,31 @@
+#define _GNU_SOURCE // For struct stat's st_mtim
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <zlib.h>
+#include <unistd.h> // For write, close, unlink
 // Include the header for the utilities we are testing
 #include "../src/include/http_utils.h"
+#include "../src/include/http_parser.h"
+#include "../src/include/http_phash.h"
+#include "../src/include/http_mime.h"
+#include "../src/include/http_scan.h"
+#include "../src/include/http_body.h"
+#include "../src/include/http_timer.h"
+#include "../src/include/http_admission.h"
+#include "../src/include/http_config.h"
+#include "../src/include/http_fdcache.h"
+#include "../src/include/http_watch.h"
+#include "../src/include/http_encoding.h"
+#include "../src/include/http_precompress.h"
+#include "../src/include/http_hpack.h"
+#include <errno.h>
+#include <fcntl.h>     // For AT_FDCWD
+#include <time.h>      // For nanosleep
+#include <sys/stat.h>  // For mkdir
+#include <sys/socket.h> // For socketpair
+#include <netinet/in.h>
 
 // --- Mock Test Framework ---
 #define TEST(name) \
@@ -83,14 +105,740 @@ void test_mime_type() {
         assert(strcmp(get_mime_type("/path/to/app.js"), "application/javascript") == 0);
         assert(strcmp(get_mime_type("/favicon.ico"), "image/x-icon") == 0);
         assert(strcmp(get_mime_type("/data/unknown"), "application/octet-stream") == 0);
+
+        // Only text assets are worth compressing
+        assert(is_compressible_mime("text/html") == 1);
+        assert(is_compressible_mime("application/javascript") == 1);
+        assert(is_compressible_mime("image/png") == 0);
+    END_TEST
+}
+
+// Inflates a gzip member (windowBits 15 + 16 rejects zlib-wrapped data).
+static size_t gunzip(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_cap) {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    assert(inflateInit2(&strm, 15 + 16) == Z_OK);
+    strm.next_in = (unsigned char *)in;
+    strm.avail_in = in_len;
+    strm.next_out = out;
+    strm.avail_out = out_cap;
+    assert(inflate(&strm, Z_FINISH) == Z_STREAM_END);
+    size_t out_len = strm.total_out;
+    inflateEnd(&strm);
+    return out_len;
+}
+
+void test_compress_gzip() {
+    TEST("Test Gzip Compression")
+        unsigned char input[20000];
+        for (size_t i = 0; i < sizeof(input); i++) input[i] = "<p>hello gzip</p>\n"[i % 18];
+        unsigned char output[sizeof(input)];
+
+        // One-shot: real gzip framing (magic bytes 1f 8b) that round-trips
+        size_t compressed_len = 0;
+        unsigned char *compressed = compress_data_gzip(input, sizeof(input), Z_DEFAULT_COMPRESSION, &compressed_len);
+        assert(compressed != NULL);
+        assert(compressed_len < sizeof(input));
+        assert(compressed[0] == 0x1f && compressed[1] == 0x8b);
+        assert(gunzip(compressed, compressed_len, output, sizeof(output)) == sizeof(input));
+        assert(memcmp(input, output, sizeof(input)) == 0);
+        free(compressed);
+
+        // Streaming: feed small windows into a small output buffer
+        gzip_stream *gz = gzip_stream_create(Z_DEFAULT_COMPRESSION);
+        assert(gz != NULL);
+        unsigned char stream_out[sizeof(input)];
+        size_t stream_len = 0, in_off = 0;
+        int rc = 0;
+        while (rc == 0) {
+            size_t window = sizeof(input) - in_off < 4096 ? sizeof(input) - in_off : 4096;
+            int finish = (in_off + window == sizeof(input));
+            size_t used = 0, out = 0;
+            size_t room = sizeof(stream_out) - stream_len < 64 ? sizeof(stream_out) - stream_len : 64;
+            rc = gzip_stream_compress(gz, input + in_off, window, finish, stream_out + stream_len, room, &used, &out);
+            assert(rc >= 0);
+            in_off += used;
+            stream_len += out;
+        }
+        gzip_stream_destroy(gz);
+        assert(in_off == sizeof(input));
+        assert(gunzip(stream_out, stream_len, output, sizeof(output)) == sizeof(input));
+        assert(memcmp(input, output, sizeof(input)) == 0);
+    END_TEST
+}
+
+void test_parse_request() {
+    TEST("Test Incremental Request Parsing")
+        char buffer[256];
+        const char *raw = "GET /a/b?x=1 HTTP/1.1\r\nHost: example\r\nAccept-Encoding:  gzip, br  \r\n\r\nBODY";
+        size_t raw_len = strlen(raw);
+        http_request req;
+
+        // Feed one byte at a time; only the final CRLF completes the request.
+        http_request_reset(&req);
+        size_t header_len = raw_len - 4;
+        for (size_t len = 1; len < header_len; len++) {
+            memcpy(buffer, raw, len);
+            assert(http_parse_request(&req, buffer, len) == PARSE_INCOMPLETE);
+        }
+        memcpy(buffer, raw, raw_len);
+        assert(http_parse_request(&req, buffer, raw_len) == PARSE_COMPLETE);
+        assert(req.header_len == header_len);
+        assert(strcmp(req.method.ptr, "GET") == 0 && http_slice_equals(req.method, "GET"));
+        assert(strcmp(req.target.ptr, "/a/b?x=1") == 0);
+        assert(strcmp(req.version.ptr, "HTTP/1.1") == 0);
+        assert(req.num_headers == 2);
+        assert(strcmp(http_request_header(&req, "host"), "example") == 0);
+        assert(strcmp(http_request_header(&req, "Accept-Encoding"), "gzip, br") == 0);
+        assert(http_request_header(&req, "Connection") == NULL);
+        assert(strcmp(http_request_header_id(&req, HDR_HOST), "example") == 0);
+        assert(strcmp(http_request_header_id(&req, HDR_ACCEPT_ENCODING), "gzip, br") == 0);
+        assert(http_request_header_id(&req, HDR_RANGE) == NULL);
+        assert(http_header_lookup("content-LENGTH", 14) == HDR_CONTENT_LENGTH);
+        assert(http_header_lookup("Content-Lengthy", 15) == -1);
+
+        // Slices follow the buffer if it moves between calls.
+        char moved[256];
+        http_request_reset(&req);
+        memcpy(buffer, raw, 20);
+        assert(http_parse_request(&req, buffer, 20) == PARSE_INCOMPLETE);
+        memcpy(moved, raw, raw_len);
+        assert(http_parse_request(&req, moved, raw_len) == PARSE_COMPLETE);
+        assert(req.method.ptr == moved && strcmp(req.target.ptr, "/a/b?x=1") == 0);
+
+        // Repeated framing headers: agreeing Content-Length copies pass, anything else is refused.
+        strcpy(buffer, "POST / HTTP/1.1\r\nContent-Length: 5\r\nHost: a\r\nContent-Length: 5\r\n\r\n");
+        http_request_reset(&req);
+        assert(http_parse_request(&req, buffer, strlen(buffer)) == PARSE_COMPLETE);
+        assert(strcmp(http_request_header_id(&req, HDR_CONTENT_LENGTH), "5") == 0);
+        strcpy(buffer, "POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 40\r\n\r\n");
+        http_request_reset(&req);
+        assert(http_parse_request(&req, buffer, strlen(buffer)) == PARSE_ERROR && req.error_status == 400);
+        strcpy(buffer, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\ntransfer-encoding: identity\r\n\r\n");
+        http_request_reset(&req);
+        assert(http_parse_request(&req, buffer, strlen(buffer)) == PARSE_ERROR && req.error_status == 400);
+
+        // Malformed input is reported with the status to answer with.
+        strcpy(buffer, "GET / HTTP/1.1\r\nNo colon here\r\n\r\n");
+        http_request_reset(&req);
+        assert(http_parse_request(&req, buffer, strlen(buffer)) == PARSE_ERROR);
+        assert(req.error_status == 400);
+
+        strcpy(buffer, "GET / FTP/1.0\r\n\r\n");
+        http_request_reset(&req);
+        assert(http_parse_request(&req, buffer, strlen(buffer)) == PARSE_ERROR);
+    END_TEST
+}
+
+void test_validators() {
+    TEST("Test ETag and HTTP Date Validators")
+        char date[HTTP_DATE_SIZE];
+        time_t parsed;
+        format_http_date(784111777, date);
+        assert(strcmp(date, "Sun, 06 Nov 1994 08:49:37 GMT") == 0);
+        assert(parse_http_date(date, &parsed) == 0 && parsed == 784111777);
+        assert(parse_http_date("yesterday", &parsed) == -1);
+
+        struct stat st;
+        memset(&st, 0, sizeof(st));
+        st.st_ino = 0x1234;
+        st.st_size = 100;
+        st.st_mtim.tv_sec = 784111777;
+        file_validators validators;
+        file_validators_init(&validators, &st);
+        const char *identity = validators.etag[CODING_IDENTITY];
+        assert(identity[0] == '"' && strcmp(validators.last_modified, date) == 0);
+        assert(strcmp(identity, validators.etag[CODING_GZIP]) != 0);
+        assert(strcmp(validators.etag[CODING_BROTLI], validators.etag[CODING_ZSTD]) != 0);
+
+        assert(etag_list_matches(identity, identity) == 1);
+        assert(etag_list_matches(identity, validators.etag[CODING_GZIP]) == 0);
+        assert(etag_list_matches("*", identity) == 1);
+        assert(etag_list_matches("\"abc\", W/\"def\"", "\"def\"") == 1);
+        assert(etag_list_matches("\"abc\", \"de\"", "\"def\"") == 0);
+    END_TEST
+}
+
+void test_byte_ranges() {
+    TEST("Test Byte Range Parsing")
+        byte_range ranges[MAX_RANGES];
+        assert(parse_byte_ranges("bytes=0-99", 1000, ranges, MAX_RANGES) == 1);
+        assert(ranges[0].first == 0 && ranges[0].last == 99);
+        assert(parse_byte_ranges("bytes=-100, 900-", 1000, ranges, MAX_RANGES) == 2);
+        assert(ranges[0].first == 900 && ranges[0].last == 999);
+        assert(ranges[1].first == 900 && ranges[1].last == 999);
+        assert(parse_byte_ranges("bytes=500-5000", 1000, ranges, MAX_RANGES) == 1 && ranges[0].last == 999);
+
+        // Unsatisfiable (416) versus ignored (whole file).
+        assert(parse_byte_ranges("bytes=1000-", 1000, ranges, MAX_RANGES) == 0);
+        assert(parse_byte_ranges("bytes=-0", 1000, ranges, MAX_RANGES) == 0);
+        assert(parse_byte_ranges("bytes=9-1", 1000, ranges, MAX_RANGES) == -1);
+        assert(parse_byte_ranges("items=0-1", 1000, ranges, MAX_RANGES) == -1);
+        assert(parse_byte_ranges("bytes=0-1,2-3,4-5", 1000, ranges, 2) == -1);
+    END_TEST
+}
+
+void test_lookup_tables() {
+    TEST("Test Perfect Hash and MIME Tables")
+        static const char *const keys[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta" };
+        perfect_hash ph;
+        assert(phash_build(&ph, keys, 8) == 0);
+        for (int i = 0; i < 8; i++) assert(phash_find(&ph, keys[i], strlen(keys[i])) == i);
+        assert(phash_find(&ph, "GAMMA", 5) == 2);
+        assert(phash_find(&ph, "gamm", 4) == -1);
+        assert(phash_find(&ph, "iota", 4) == -1);
+        phash_free(&ph);
+
+        static const char *const duplicates[] = { "same", "SAME" };
+        assert(phash_build(&ph, duplicates, 2) == -1);
+
+        const mime_type *css = mime_lookup("/assets/site.CSS");
+        assert(strcmp(css->type, "text/css") == 0 && css->compressible == 1);
+        assert(mime_lookup("/photo.png")->compressible == 0);
+        assert(strcmp(mime_lookup("/dir.d/README")->type, "application/octet-stream") == 0);
+
+        // A mime.types file adds extensions and overrides built-in ones.
+        char path[] = "/tmp/test_mime_XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        const char *types = "# comment\napplication/x-custom  cst cst2\ntext/x-css css\nbroken-line\n";
+        assert(write(fd, types, strlen(types)) == (ssize_t)strlen(types));
+        close(fd);
+        assert(mime_load_types(path) == 3);
+        unlink(path);
+        assert(strcmp(mime_lookup("/a.cst2")->type, "application/x-custom") == 0);
+        assert(strcmp(mime_lookup("/a.css")->type, "text/x-css") == 0);
+        assert(strcmp(mime_lookup("/a.png")->type, "image/png") == 0);
+    END_TEST
+}
+
+void test_scan_kernels() {
+    TEST("Test Scanning Kernels Against Scalar")
+        const scan_kernels *scalar = scan_kernels_for(SCAN_SCALAR);
+        char buf[96];
+        for (int level = SCAN_SCALAR + 1; level < SCAN_LEVEL_COUNT; level++) {
+            const scan_kernels *k = scan_kernels_for((scan_level)level);
+            if (!k) continue; // Not supported by this CPU
+
+            // Every byte value at every position of a run, for every run length up to 2 blocks + tail.
+            for (int c = 0; c < 256; c++) {
+                for (size_t at = 0; at < 70; at++) {
+                    memset(buf, 'a', sizeof(buf));
+                    buf[at] = (char)c;
+                    for (size_t len = 0; len <= 70; len += 7) {
+                        assert(k->line_end(buf, len) == scalar->line_end(buf, len));
+                        assert(k->target_end(buf, len) == scalar->target_end(buf, len));
+                        assert(k->token_end(buf, len) == scalar->token_end(buf, len));
+                    }
+                }
+            }
+        }
+        assert(scan_active() != NULL);
+    END_TEST
+}
+
+void test_body_decoder() {
+    TEST("Test Request Body Decoding")
+        // Chunked, fed one byte at a time: the decoded bytes come out in order, framing removed.
+        const char *wire = "5;name=v\r\nhello\r\n6\r\n world\r\n0\r\nTrailer: x\r\n\r\nGET";
+        body_reader reader;
+        body_reader_init(&reader, 1, 0, 1024);
+        char decoded[32] = {0}, piece[1];
+        size_t total = 0, pos = 0;
+        body_status status = BODY_IN_PROGRESS;
+        while (status == BODY_IN_PROGRESS) {
+            piece[0] = wire[pos];
+            size_t len = 1, out = 0;
+            status = body_decode(&reader, piece, &len, &out);
+            assert(len == 1);
+            memcpy(decoded + total, piece, out);
+            total += out;
+            pos++;
+        }
+        assert(status == BODY_COMPLETE);
+        assert(total == 11 && memcmp(decoded, "hello world", 11) == 0);
+        assert(strcmp(wire + pos, "GET") == 0); // The next request is left alone
+
+        // Whole buffer at once, decoded in place.
+        char buf[80];
+        strcpy(buf, wire);
+        size_t len = strlen(buf), out = 0;
+        body_reader_init(&reader, 1, 0, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_COMPLETE);
+        assert(out == 11 && memcmp(buf, "hello world", 11) == 0 && len == strlen(wire) - 3);
+
+        // Content-Length: bytes pass through; only the count is tracked.
+        strcpy(buf, "abcdefGET");
+        len = 9;
+        body_reader_init(&reader, 0, 6, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_COMPLETE && len == 6 && out == 6);
+
+        // Errors and limits.
+        strcpy(buf, "zz\r\n");
+        len = 4;
+        body_reader_init(&reader, 1, 0, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_ERROR);
+        strcpy(buf, "5\r\nhelloXX");
+        len = strlen(buf);
+        body_reader_init(&reader, 1, 0, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_ERROR);
+        strcpy(buf, "401\r\n");
+        len = strlen(buf);
+        body_reader_init(&reader, 1, 0, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_TOO_LARGE);
+        len = 0;
+        body_reader_init(&reader, 0, 1025, 1024);
+        assert(body_decode(&reader, buf, &len, &out) == BODY_TOO_LARGE);
+
+        uint64_t length = 0;
+        assert(body_parse_content_length("12345", &length) == 0 && length == 12345);
+        assert(body_parse_content_length("", &length) == -1);
+        assert(body_parse_content_length("-1", &length) == -1);
+        assert(body_parse_content_length("12 ", &length) == -1);
+        assert(body_parse_content_length("99999999999999999999", &length) == -1);
+    END_TEST
+}
+
+#define WHEEL_TEST_TIMERS 512
+static timer_node wheel_nodes[WHEEL_TEST_TIMERS];
+static uint64_t wheel_deadline[WHEEL_TEST_TIMERS];
+static uint64_t wheel_fired_at[WHEEL_TEST_TIMERS];
+static uint64_t wheel_now_ms;
+
+static void record_expiry(timer_node *node) {
+    wheel_fired_at[node - wheel_nodes] = wheel_now_ms;
+}
+
+void test_timer_wheel() {
+    TEST("Test Hierarchical Timer Wheel")
+        timer_wheel wheel;
+        wheel_now_ms = 1000;
+        timer_wheel_init(&wheel, wheel_now_ms);
+
+        // Deadlines spread over every level, including past one level-3 turn.
+        for (int i = 0; i < WHEEL_TEST_TIMERS; i++) {
+            memset(&wheel_nodes[i], 0, sizeof(timer_node));
+            wheel_deadline[i] = wheel_now_ms + (uint64_t)i * i * 97 % 30000000 + 1;
+            wheel_fired_at[i] = 0;
+            timer_arm(&wheel, &wheel_nodes[i], wheel_deadline[i]);
+        }
+        assert(timer_wait_ms(&wheel) == TIMER_TICK_MS);
+
+        // Cancelled and re-armed timers.
+        timer_cancel(&wheel, &wheel_nodes[7]);
+        timer_cancel(&wheel, &wheel_nodes[7]);
+        assert(!timer_pending(&wheel_nodes[7]));
+        wheel_deadline[8] = wheel_now_ms + 5000;
+        timer_arm(&wheel, &wheel_nodes[8], wheel_deadline[8]);
+
+        // Turn in uneven steps; every timer fires within one tick after its deadline.
+        while (wheel_now_ms < 1000 + 30000000 + 2 * TIMER_TICK_MS) {
+            wheel_now_ms += 3777;
+            timer_advance(&wheel, wheel_now_ms, record_expiry);
+        }
+        for (int i = 0; i < WHEEL_TEST_TIMERS; i++) {
+            if (i == 7) {
+                assert(wheel_fired_at[i] == 0);
+                continue;
+            }
+            assert(wheel_fired_at[i] >= wheel_deadline[i]);
+            assert(wheel_fired_at[i] < wheel_deadline[i] + TIMER_TICK_MS + 3777);
+            assert(!timer_pending(&wheel_nodes[i]));
+        }
+        assert(timer_wait_ms(&wheel) == -1);
     END_TEST
 }
 
 
+/**
+ * @brief Accepts one end of a fresh socket pair as a connection from 10.0.0.<host>.
+ * @return admission_accept's result; *client_fd is the other end.
+ */
+static int admit_from(int host, admission_ticket *ticket, int *client_fd) {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    struct sockaddr_storage peer;
+    memset(&peer, 0, sizeof(peer));
+    struct sockaddr_in *in = (struct sockaddr_in *)&peer;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(0x0A000000u | (unsigned)host);
+    *client_fd = fds[0];
+    int result = admission_accept(fds[1], &peer, ticket);
+    if (result == 0) close(fds[1]); // Admitted: the test plays the connection itself
+    return result;
+}
+
+void test_admission() {
+    TEST("Test Admission Control")
+        admission_ticket a1, a2, a3, b1, c1;
+        int fd_a1, fd_a2, fd_a3, fd_b1, fd_c1;
+        char reply[256];
+        server_config config;
+        config_defaults(&config);
+        config.max_connections = 3;
+        config.max_connections_per_ip = 2;
+        config.rate_limit_per_ip = 1; // Burst of 2
+        config_publish(&config);
+
+        // Per-client cap: the third connection from the same address is refused with the 503.
+        assert(admit_from(1, &a1, &fd_a1) == 0 && a1.client != NULL);
+        assert(admit_from(1, &a2, &fd_a2) == 0 && a2.client == a1.client);
+        assert(admit_from(1, &a3, &fd_a3) == -1 && !a3.admitted);
+        ssize_t n = read(fd_a3, reply, sizeof(reply) - 1);
+        assert(n > 0);
+        reply[n] = '\0';
+        assert(strncmp(reply, "HTTP/1.1 503 ", 13) == 0);
+        assert(strstr(reply, "\r\nRetry-After: " SHED_RETRY_AFTER "\r\n") != NULL);
+        assert(read(fd_a3, reply, sizeof(reply)) == 0); // ...and closed
+
+        // Global cap, whichever client asks.
+        assert(admit_from(2, &b1, &fd_b1) == 0 && b1.client != a1.client);
+        assert(admit_from(3, &c1, &fd_c1) == -1);
+
+        // Token bucket: the burst is served, the next request is shed until tokens accrue.
+        shed_reason reason;
+        assert(admission_request(&a1, &reason) == 0);
+        assert(admission_request(&a2, &reason) == 0); // Same client, same bucket
+        assert(admission_request(&a1, &reason) == -1 && reason == SHED_RATE_LIMIT);
+        assert(admission_request(&b1, &reason) == 0);
+
+        // Released slots are available again.
+        admission_release(&a1);
+        assert(!a1.admitted && a1.client == NULL);
+        admission_release(&a1); // Harmless twice
+        admission_ticket c2;
+        int fd_c2;
+        assert(admit_from(3, &c2, &fd_c2) == 0);
+
+        admission_release(&a2);
+        admission_release(&b1);
+        admission_release(&c2);
+        int fds[] = {fd_a1, fd_a2, fd_a3, fd_b1, fd_c1, fd_c2};
+        for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) close(fds[i]);
+        config_defaults(&config);
+        config_publish(&config);
+    END_TEST
+}
+
+void test_config_load() {
+    TEST("Test Configuration Loading")
+        char path[] = "/tmp/httpserver_config_XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        const char *text = "# tuning\n"
+                           "workers = 2\n"
+                           "  max_body_size=4k  \n"
+                           "\n"
+                           "web_root = /tmp\n"
+                           "gzip_level = 9\n"
+                           "idle_timeout_ms = 5000\n";
+        assert(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+        close(fd);
+
+        server_config config, defaults;
+        char err[256];
+        config_defaults(&defaults);
+
+        // Defaults, then the file, then flags (which win wherever --config appears).
+        char *args[] = {"httpserver", "9090", "--gzip-level", "1", "--config", path, "--io-uring", NULL};
+        assert(config_load(&config, 7, args, err, sizeof(err)) == 0);
+        assert(config.port == 9090 && config.backend == IO_BACKEND_URING);
+        assert(config.workers == 2 && config.max_body_size == 4096);
+        assert(strcmp(config.web_root, "/tmp") == 0);
+        assert(config.gzip_level == 1 && config.idle_timeout_ms == 5000);
+        assert(config.max_upload_size == defaults.max_upload_size);
+
+        // Rejected: unknown names, malformed and out-of-range values, inconsistent combinations.
+        char *unknown[] = {"httpserver", "--no-such-setting", "1", NULL};
+        assert(config_load(&config, 3, unknown, err, sizeof(err)) == -1);
+        assert(strstr(err, "no-such-setting") != NULL);
+        char *range[] = {"httpserver", "--gzip-level", "10", NULL};
+        assert(config_load(&config, 3, range, err, sizeof(err)) == -1);
+        char *garbage[] = {"httpserver", "--max-body-size", "12q", NULL};
+        assert(config_load(&config, 3, garbage, err, sizeof(err)) == -1);
+        char *missing[] = {"httpserver", "--workers", NULL};
+        assert(config_load(&config, 2, missing, err, sizeof(err)) == -1);
+        char *headers[] = {"httpserver", "--input-buffer-size", "4k", "--max-header-size", "8k", NULL};
+        assert(config_load(&config, 5, headers, err, sizeof(err)) == -1);
+        char *root[] = {"httpserver", "--web-root", "/nonexistent/webroot", NULL};
+        assert(config_load(&config, 3, root, err, sizeof(err)) == -1);
+
+        FILE *file = fopen(path, "w");
+        fputs("workers = 2\nbogus line\n", file);
+        fclose(file);
+        char *bad_file[] = {"httpserver", "--config", path, NULL};
+        assert(config_load(&config, 3, bad_file, err, sizeof(err)) == -1);
+        assert(strstr(err, ":2:") != NULL);
+        unlink(path);
+    END_TEST
+}
+
+void test_open_file_cache() {
+    TEST("Test Open File Cache")
+        // Every spelling of a path normalizes to the same cache key.
+        char path[256];
+        strcpy(path, "./webroot//a/./b/.");
+        path_normalize(path);
+        assert(strcmp(path, "./webroot/a/b") == 0);
+        strcpy(path, "/srv/www///index.html");
+        path_normalize(path);
+        assert(strcmp(path, "/srv/www/index.html") == 0);
+
+        char root[] = "/tmp/httpserver_root_XXXXXX";
+        assert(mkdtemp(root) != NULL);
+        char file_path[sizeof(root) + 16];
+        snprintf(file_path, sizeof(file_path), "%s/a.txt", root);
+        FILE *file = fopen(file_path, "w");
+        fputs("one", file);
+        fclose(file);
+
+        // Unwatched: every call opens the file afresh.
+        open_file *first = open_file_get(file_path);
+        assert(first && first->st.st_size == 3 && first->refcount == 1);
+        open_file_release(first);
+        assert(open_file_get(root) == NULL && errno == EISDIR);
+        char missing[sizeof(root) + 16];
+        snprintf(missing, sizeof(missing), "%s/none", root);
+        assert(open_file_get(missing) == NULL && errno == ENOENT);
+
+        // Watched: hits share one descriptor until the file changes.
+        server_config config;
+        config_defaults(&config);
+        strcpy(config.web_root, root);
+        config_publish(&config);
+        assert(watch_start() == 0 && watch_active());
+        first = open_file_get(file_path);
+        open_file *again = open_file_get(file_path);
+        assert(first == again && first->refcount == 3);
+        open_file_release(again);
+
+        file = fopen(file_path, "w");
+        fputs("three", file);
+        fclose(file);
+        open_file *changed = NULL;
+        for (int i = 0; i < 100 && (!changed || changed == first); i++) {
+            if (changed) open_file_release(changed);
+            struct timespec pause = {0, 10 * 1000000};
+            nanosleep(&pause, NULL);
+            changed = open_file_get(file_path);
+        }
+        assert(changed != first && changed->st.st_size == 5);
+        assert(first->refcount == 1 && first->st.st_size == 3); // Still usable by its holder
+        open_file_release(first);
+        open_file_release(changed);
+
+        config_defaults(&config);
+        config_publish(&config);
+        watch_refresh();
+        unlink(file_path);
+        rmdir(root);
+    END_TEST
+}
+
+void test_content_negotiation() {
+    TEST("Test Content Negotiation")
+        accepted_codings accepted;
+        encoding_parse_accept("gzip, deflate, br;q=0.8, zstd;q=0.800", &accepted);
+        assert(accepted.q[CODING_GZIP] == 1000 && accepted.q[CODING_BROTLI] == 800 && accepted.q[CODING_ZSTD] == 800);
+        assert(accepted.q[CODING_IDENTITY] == 1); // Unlisted: acceptable, but only as a last resort
+        encoding_parse_accept("*;q=0.5, GZIP;Q=0, identity;q=0", &accepted);
+        assert(accepted.q[CODING_GZIP] == 0 && accepted.q[CODING_BROTLI] == 500 && accepted.q[CODING_IDENTITY] == 0);
+        encoding_parse_accept("*;q=0", &accepted);
+        assert(accepted.q[CODING_IDENTITY] == 0 && accepted.q[CODING_ZSTD] == 0);
+        encoding_parse_accept("x-gzip;q=0.3, br;q=1.5, zstd;q=abc", &accepted);
+        assert(accepted.q[CODING_GZIP] == 300 && accepted.q[CODING_BROTLI] == 0 && accepted.q[CODING_ZSTD] == 0);
+        encoding_parse_accept(NULL, &accepted);
+        assert(accepted.q[CODING_IDENTITY] == 1 && accepted.q[CODING_GZIP] == 0);
+
+        // Ready-made variants: the smallest among the highest weighted; q-values outrank size.
+        size_t lengths[CODING_COUNT] = { 1000, 300, 200, 250 };
+        encoding_parse_accept("gzip, br, zstd", &accepted);
+        assert(encoding_choose_smallest(&accepted, lengths) == CODING_BROTLI);
+        encoding_parse_accept("gzip, br;q=0.9, zstd;q=0.9", &accepted);
+        assert(encoding_choose_smallest(&accepted, lengths) == CODING_GZIP);
+        lengths[CODING_GZIP] = 0; // Compression did not pay off
+        encoding_parse_accept("gzip", &accepted);
+        assert(encoding_choose_smallest(&accepted, lengths) == CODING_IDENTITY);
+
+        // Compressed on the fly: the fastest encoder the client accepts.
+        encoding_parse_accept("br, gzip", &accepted);
+        assert(encoding_choose_fastest(&accepted) == CODING_GZIP);
+        encoding_parse_accept("identity", &accepted);
+        assert(encoding_choose_fastest(&accepted) == CODING_IDENTITY);
+
+        // Every supported coding works through both the one-shot and the streaming encoder.
+        unsigned char input[4096];
+        for (size_t i = 0; i < sizeof(input); i++) input[i] = (unsigned char)("abcabcabd"[i % 9]);
+        for (int c = CODING_GZIP; c < CODING_COUNT; c++) {
+            if (!encoding_supported((content_coding)c)) continue;
+            size_t len;
+            unsigned char *out = encoding_compress((content_coding)c, 5, input, sizeof(input), &len);
+            assert(out && len > 0 && len < sizeof(input));
+            free(out);
+
+            encoder_stream *stream = encoder_stream_create((content_coding)c, 5);
+            unsigned char chunk[64];
+            size_t in_off = 0, total = 0;
+            int rc = 0;
+            while (rc == 0) {
+                size_t used, produced;
+                rc = encoder_stream_compress(stream, input + in_off, sizeof(input) - in_off, 1, chunk, sizeof(chunk),
+                                             &used, &produced);
+                in_off += used;
+                total += produced;
+            }
+            assert(rc == 1 && in_off == sizeof(input) && total > 0);
+            encoder_stream_destroy(stream);
+        }
+    END_TEST
+}
+
+void test_precompressed_sidecars() {
+    TEST("Test Precompressed Sidecars")
+        assert(encoding_from_file_name("app.css.br", NULL) == CODING_BROTLI);
+        size_t base_len;
+        assert(encoding_from_file_name("/a/b.js.gz", &base_len) == CODING_GZIP && base_len == 7);
+        assert(encoding_from_file_name("notes.zstd", &base_len) == CODING_IDENTITY && base_len == 10);
+
+        char root[] = "/tmp/httpserver_pre_XXXXXX";
+        assert(mkdtemp(root) != NULL);
+        char css[sizeof(root) + 16], gz[sizeof(root) + 16], small[sizeof(root) + 16];
+        snprintf(css, sizeof(css), "%s/a.css", root);
+        snprintf(gz, sizeof(gz), "%s/a.css.gz", root);
+        snprintf(small, sizeof(small), "%s/b.css", root);
+        FILE *file = fopen(css, "w");
+        for (int i = 0; i < 200; i++) fprintf(file, ".rule-%d { color: red; }\n", i % 7);
+        fclose(file);
+        file = fopen(small, "w");
+        fputs("p{}", file); // Below compress_min_size
+        fclose(file);
+
+        // Opened afresh every time, so each check sees the files as they are now.
+        server_config config;
+        config_defaults(&config);
+        config.open_file_cache_entries = 0;
+        config_publish(&config);
+
+        assert(precompress_tree(root, 2) == 0);
+        struct stat css_st, gz_st, again_st;
+        assert(stat(css, &css_st) == 0 && stat(gz, &gz_st) == 0);
+        assert(gz_st.st_size < css_st.st_size && gz_st.st_mtim.tv_sec == css_st.st_mtim.tv_sec &&
+               gz_st.st_mtim.tv_nsec == css_st.st_mtim.tv_nsec);
+        snprintf(small, sizeof(small), "%s/b.css.gz", root);
+        assert(access(small, F_OK) != 0);
+
+        // Up to date: a second pass leaves the sidecar alone.
+        assert(precompress_tree(root, 2) == 0);
+        assert(stat(gz, &again_st) == 0 && again_st.st_ino == gz_st.st_ino);
+
+        open_file *opened = open_file_get(css);
+        assert(opened && opened->sidecar_fd[CODING_GZIP] >= 0 && opened->sidecar_size[CODING_GZIP] == gz_st.st_size);
+        assert(opened->sidecar_fd[CODING_IDENTITY] == -1);
+        open_file_release(opened);
+
+        // A file newer than its sidecar is no longer served from it.
+        struct timespec later[2] = { css_st.st_atim, { css_st.st_mtim.tv_sec + 10, 0 } };
+        assert(utimensat(AT_FDCWD, css, later, 0) == 0);
+        opened = open_file_get(css);
+        assert(opened && opened->sidecar_fd[CODING_GZIP] == -1);
+        open_file_release(opened);
+
+        config_defaults(&config);
+        config_publish(&config);
+        for (int c = CODING_GZIP; c < CODING_COUNT; c++) {
+            char sidecar[sizeof(root) + 16];
+            snprintf(sidecar, sizeof(sidecar), "%s%s", css, encoding_file_suffix((content_coding)c));
+            unlink(sidecar);
+        }
+        unlink(css);
+        snprintf(small, sizeof(small), "%s/b.css", root);
+        unlink(small);
+        rmdir(root);
+    END_TEST
+}
+
+void test_hpack() {
+    TEST("Test HPACK Header Compression")
+        // RFC 7541 C.4: three requests on one connection, Huffman-coded, sharing the dynamic table.
+        static const unsigned char first[] = { 0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a,
+                                               0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff };
+        static const unsigned char second[] = { 0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf };
+        static const unsigned char third[] = { 0x82, 0x87, 0x85, 0xbf, 0x40, 0x88, 0x25, 0xa8, 0x49, 0xe9, 0x5b,
+                                               0xa9, 0x7d, 0x7f, 0x89, 0x25, 0xa8, 0x49, 0xe9, 0x5b, 0xb8, 0xe8,
+                                               0xb4, 0xbf };
+        hpack_table decoder;
+        hpack_table_init(&decoder, HPACK_TABLE_SIZE_DEFAULT);
+        hpack_field fields[8];
+        char out[512];
+
+        assert(hpack_decode(&decoder, first, sizeof(first), fields, 8, out, sizeof(out)) == 4);
+        assert(strcmp(fields[0].name, ":method") == 0 && strcmp(fields[0].value, "GET") == 0);
+        assert(strcmp(fields[3].name, ":authority") == 0 && strcmp(fields[3].value, "www.example.com") == 0);
+        assert(decoder.count == 1 && decoder.size == 57);
+
+        assert(hpack_decode(&decoder, second, sizeof(second), fields, 8, out, sizeof(out)) == 5);
+        assert(strcmp(fields[3].value, "www.example.com") == 0); // From the dynamic table
+        assert(strcmp(fields[4].name, "cache-control") == 0 && strcmp(fields[4].value, "no-cache") == 0);
+        assert(decoder.count == 2 && decoder.size == 110);
+
+        assert(hpack_decode(&decoder, third, sizeof(third), fields, 8, out, sizeof(out)) == 5);
+        assert(strcmp(fields[1].value, "https") == 0 && strcmp(fields[2].value, "/index.html") == 0);
+        assert(strcmp(fields[4].name, "custom-key") == 0 && strcmp(fields[4].value, "custom-value") == 0);
+        assert(decoder.count == 3 && decoder.size == 164);
+
+        // Too many fields for the caller leaves the table usable; a bad index breaks the connection.
+        assert(hpack_decode(&decoder, first, sizeof(first), fields, 2, out, sizeof(out)) == HPACK_TOO_LARGE);
+        static const unsigned char bad_index[] = { 0xff, 0x7f };
+        assert(hpack_decode(&decoder, bad_index, sizeof(bad_index), fields, 8, out, sizeof(out)) == -1);
+        hpack_table_free(&decoder);
+
+        // Round trip: an indexed field costs one byte the second time, a non-indexed one never shrinks.
+        hpack_table encoder;
+        hpack_table_init(&encoder, HPACK_TABLE_SIZE_DEFAULT);
+        hpack_table_init(&decoder, HPACK_TABLE_SIZE_DEFAULT);
+        unsigned char block[256];
+        for (int round = 0; round < 2; round++) {
+            int len = 0, n;
+            n = hpack_encode_field(&encoder, block + len, sizeof(block) - len, ":status", 7, "200", 3, HPACK_INDEX);
+            assert(n == 1);
+            len += n;
+            n = hpack_encode_field(&encoder, block + len, sizeof(block) - len, "server", 6, "httpserver", 10,
+                                   HPACK_INDEX);
+            assert(n > 0 && (round == 0 || n == 1));
+            len += n;
+            n = hpack_encode_field(&encoder, block + len, sizeof(block) - len, "content-length", 14, "1234", 4,
+                                   HPACK_NO_INDEX);
+            assert(n > 1);
+            len += n;
+            assert(hpack_decode(&decoder, block, (size_t)len, fields, 8, out, sizeof(out)) == 3);
+            assert(strcmp(fields[1].name, "server") == 0 && strcmp(fields[1].value, "httpserver") == 0);
+            assert(strcmp(fields[2].value, "1234") == 0);
+            assert(decoder.count == 1 && encoder.size == decoder.size);
+        }
+        assert(hpack_encode_field(&encoder, block, 2, "x-long", 6, "value", 5, HPACK_INDEX) == -1);
+        hpack_table_free(&encoder);
+        hpack_table_free(&decoder);
+    END_TEST
+}
+
 void run_all_tests() {
     test_extract_path();
     test_parse_headers();
     test_mime_type();
+    test_compress_gzip();
+    test_parse_request();
+    test_validators();
+    test_byte_ranges();
+    test_lookup_tables();
+    test_scan_kernels();
+    test_body_decoder();
+    test_timer_wheel();
+    test_admission();
+    test_config_load();
+    test_open_file_cache();
+    test_content_negotiation();
+    test_precompressed_sidecars();
+    test_hpack();
 }
 
 int main() {